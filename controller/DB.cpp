@@ -96,6 +96,183 @@ void DB::cleanMember(nlohmann::json &member)
 	member.erase("lastRequestMetaData");
 }
 
+void DB::Member::fromJson(const nlohmann::json &member)
+{
+	nlohmann::json o;
+	for(auto i=member.begin();i!=member.end();++i) {
+		const std::string &k = i.key();
+		const nlohmann::json &v = i.value();
+		if (k == "id") {
+			id = OSUtils::jsonIntHex(v,0ULL);
+		} else if (k == "nwid") {
+			networkId = OSUtils::jsonIntHex(v,0ULL);
+		} else if ((k == "address")||(k == "objtype")) {
+			// always the same as id and "member"
+		} else if (k == "revision") {
+			revision = OSUtils::jsonInt(v,0ULL);
+		} else if (k == "creationTime") {
+			creationTime = (int64_t)OSUtils::jsonInt(v,0ULL);
+		} else if (k == "lastAuthorizedTime") {
+			lastAuthorizedTime = (int64_t)OSUtils::jsonInt(v,0ULL);
+		} else if (k == "lastDeauthorizedTime") {
+			lastDeauthorizedTime = (int64_t)OSUtils::jsonInt(v,0ULL);
+		} else if (k == "identity") {
+			const std::string ids(OSUtils::jsonString(v,""));
+			if (ids.length() > 0) {
+				Identity tmp;
+				if (tmp.fromString(ids.c_str()))
+					identity = tmp;
+				else o[k] = v; // kept as-is so an unreadable identity still locks out the member
+			}
+		} else if (k == "remoteTraceTarget") {
+			const std::string rtt(OSUtils::jsonString(v,""));
+			if (rtt.length() > 0) {
+				const Address a((rtt.length() == 10) ? Utils::hexStrToU64(rtt.c_str()) : 0ULL);
+				if (a)
+					remoteTraceTarget = a;
+				else o[k] = v; // kept as-is rather than silently cleared
+			}
+		} else if (k == "remoteTraceLevel") {
+			remoteTraceLevel = (int)OSUtils::jsonInt(v,0ULL);
+		} else if (k == "vMajor") {
+			vMajor = (int)OSUtils::jsonInt(v,0ULL);
+		} else if (k == "vMinor") {
+			vMinor = (int)OSUtils::jsonInt(v,0ULL);
+		} else if (k == "vRev") {
+			vRev = (int)OSUtils::jsonInt(v,0ULL);
+		} else if (k == "vProto") {
+			vProto = (int)OSUtils::jsonInt(v,0ULL);
+		} else if (k == "authorized") {
+			authorized = OSUtils::jsonBool(v,false);
+		} else if (k == "activeBridge") {
+			activeBridge = OSUtils::jsonBool(v,false);
+		} else if (k == "noAutoAssignIps") {
+			noAutoAssignIps = OSUtils::jsonBool(v,false);
+		} else if (k == "lastAuthorizedCredentialType") {
+			lastAuthorizedCredentialType = OSUtils::jsonString(v,"");
+		} else if (k == "lastAuthorizedCredential") {
+			lastAuthorizedCredential = OSUtils::jsonString(v,"");
+		} else if (k == "ipAssignments") {
+			ipAssignments.clear();
+			nlohmann::json bad = nlohmann::json::array();
+			if (v.is_array()) {
+				for(auto ip=v.begin();ip!=v.end();++ip) {
+					if (ip->is_string()) {
+						const InetAddress ipa(ip->get<std::string>().c_str());
+						if ((ipa.ss_family == AF_INET)||(ipa.ss_family == AF_INET6)) {
+							ipAssignments.push_back(ipa);
+							continue;
+						}
+					}
+					bad.push_back(*ip);
+				}
+			} else if (!v.is_null()) {
+				bad.push_back(v);
+			}
+			if (!bad.empty())
+				o[k] = bad; // unparsable entries are kept and written back after the parsed ones
+		} else if (k == "capabilities") {
+			capabilities.clear();
+			if (v.is_array()) {
+				for(auto c=v.begin();c!=v.end();++c)
+					capabilities.push_back(OSUtils::jsonInt(*c,0ULL));
+			}
+		} else if (k == "tags") {
+			tags.clear();
+			if (v.is_array()) {
+				for(auto t=v.begin();t!=v.end();++t) {
+					if ((t->is_array())&&(t->size() == 2))
+						tags.push_back(std::pair<uint64_t,uint64_t>(OSUtils::jsonInt((*t)[0],0ULL),OSUtils::jsonInt((*t)[1],0ULL)));
+				}
+			}
+		} else {
+			o[k] = v;
+		}
+	}
+	if (o.is_object())
+		other.reset(new nlohmann::json(o));
+}
+
+nlohmann::json DB::Member::toJson() const
+{
+	char tmp[ZT_IDENTITY_STRING_BUFFER_LENGTH];
+	nlohmann::json m((other) ? *other : nlohmann::json::object());
+	OSUtils::ztsnprintf(tmp,sizeof(tmp),"%.10llx",(unsigned long long)id);
+	m["id"] = tmp;
+	m["address"] = tmp;
+	OSUtils::ztsnprintf(tmp,sizeof(tmp),"%.16llx",(unsigned long long)networkId);
+	m["nwid"] = tmp;
+	m["objtype"] = "member";
+	m["revision"] = revision;
+	m["creationTime"] = creationTime;
+	m["lastAuthorizedTime"] = lastAuthorizedTime;
+	m["lastDeauthorizedTime"] = lastDeauthorizedTime;
+	if (identity)
+		m["identity"] = identity.toString(false,tmp);
+	if (remoteTraceTarget)
+		m["remoteTraceTarget"] = remoteTraceTarget.toString(tmp);
+	else if (!m.count("remoteTraceTarget"))
+		m["remoteTraceTarget"] = nlohmann::json();
+	m["remoteTraceLevel"] = remoteTraceLevel;
+	m["vMajor"] = vMajor;
+	m["vMinor"] = vMinor;
+	m["vRev"] = vRev;
+	m["vProto"] = vProto;
+	m["authorized"] = authorized;
+	m["activeBridge"] = activeBridge;
+	m["noAutoAssignIps"] = noAutoAssignIps;
+	m["lastAuthorizedCredentialType"] = (lastAuthorizedCredentialType.length() > 0) ? nlohmann::json(lastAuthorizedCredentialType) : nlohmann::json();
+	m["lastAuthorizedCredential"] = (lastAuthorizedCredential.length() > 0) ? nlohmann::json(lastAuthorizedCredential) : nlohmann::json();
+	nlohmann::json bad;
+	if (m.count("ipAssignments"))
+		bad.swap(m["ipAssignments"]);
+	nlohmann::json &ips = m["ipAssignments"] = nlohmann::json::array();
+	for(auto ip=ipAssignments.begin();ip!=ipAssignments.end();++ip)
+		ips.push_back(ip->toIpString(tmp));
+	if (bad.is_array()) {
+		for(auto ip=bad.begin();ip!=bad.end();++ip)
+			ips.push_back(*ip);
+	}
+	nlohmann::json &caps = m["capabilities"] = nlohmann::json::array();
+	for(auto c=capabilities.begin();c!=capabilities.end();++c)
+		caps.push_back(*c);
+	nlohmann::json &mtags = m["tags"] = nlohmann::json::array();
+	for(auto t=tags.begin();t!=tags.end();++t) {
+		nlohmann::json ta = nlohmann::json::array();
+		ta.push_back(t->first);
+		ta.push_back(t->second);
+		mtags.push_back(ta);
+	}
+	return m;
+}
+
+bool DB::Member::operator==(const Member &m) const
+{
+	return (
+		(id == m.id)&&
+		(networkId == m.networkId)&&
+		(revision == m.revision)&&
+		(creationTime == m.creationTime)&&
+		(lastAuthorizedTime == m.lastAuthorizedTime)&&
+		(lastDeauthorizedTime == m.lastDeauthorizedTime)&&
+		(identity == m.identity)&&
+		(remoteTraceTarget == m.remoteTraceTarget)&&
+		(remoteTraceLevel == m.remoteTraceLevel)&&
+		(vMajor == m.vMajor)&&
+		(vMinor == m.vMinor)&&
+		(vRev == m.vRev)&&
+		(vProto == m.vProto)&&
+		(authorized == m.authorized)&&
+		(activeBridge == m.activeBridge)&&
+		(noAutoAssignIps == m.noAutoAssignIps)&&
+		(lastAuthorizedCredentialType == m.lastAuthorizedCredentialType)&&
+		(lastAuthorizedCredential == m.lastAuthorizedCredential)&&
+		(ipAssignments == m.ipAssignments)&&
+		(capabilities == m.capabilities)&&
+		(tags == m.tags)&&
+		((other == m.other)||((other)&&(m.other)&&(*other == *m.other))));
+}
+
 DB::DB(EmbeddedNetworkController *const nc,const Identity &myId,const char *path) :
 	_controller(nc),
 	_myId(myId),
@@ -113,7 +290,7 @@ DB::~DB()
 
 bool DB::get(const uint64_t networkId,nlohmann::json &network)
 {
-	waitForReady();
+	_waitForNetwork(networkId);
 	std::shared_ptr<_Network> nw;
 	{
 		std::lock_guard<std::mutex> l(_networks_l);
@@ -122,16 +299,18 @@ bool DB::get(const uint64_t networkId,nlohmann::json &network)
 			return false;
 		nw = nwi->second;
 	}
+	std::shared_ptr<const nlohmann::json> config;
 	{
 		std::lock_guard<std::mutex> l2(nw->lock);
-		network = nw->config;
+		config = nw->config;
 	}
+	network = (config) ? *config : nlohmann::json();
 	return true;
 }
 
 bool DB::get(const uint64_t networkId,nlohmann::json &network,const uint64_t memberId,nlohmann::json &member)
 {
-	waitForReady();
+	_waitForNetwork(networkId);
 	std::shared_ptr<_Network> nw;
 	{
 		std::lock_guard<std::mutex> l(_networks_l);
@@ -140,20 +319,67 @@ bool DB::get(const uint64_t networkId,nlohmann::json &network,const uint64_t mem
 			return false;
 		nw = nwi->second;
 	}
+	std::shared_ptr<const nlohmann::json> config;
+	std::shared_ptr<const Member> m;
 	{
 		std::lock_guard<std::mutex> l2(nw->lock);
-		network = nw->config;
-		auto m = nw->members.find(memberId);
-		if (m == nw->members.end())
-			return false;
-		member = m->second;
+		config = nw->config;
+		auto mi = nw->members.find(memberId);
+		if (mi != nw->members.end())
+			m = mi->second;
 	}
+	network = (config) ? *config : nlohmann::json();
+	if (!m)
+		return false;
+	member = m->toJson();
 	return true;
 }
 
 bool DB::get(const uint64_t networkId,nlohmann::json &network,const uint64_t memberId,nlohmann::json &member,NetworkSummaryInfo &info)
 {
-	waitForReady();
+	std::shared_ptr<const nlohmann::json> config;
+	std::shared_ptr<const Member> m;
+	const bool found = get(networkId,config,memberId,m,info);
+	if (config)
+		network = *config;
+	if (!found)
+		return false;
+	member = m->toJson();
+	return true;
+}
+
+bool DB::get(const uint64_t networkId,nlohmann::json &network,std::vector<nlohmann::json> &members)
+{
+	_waitForNetwork(networkId);
+	std::shared_ptr<_Network> nw;
+	{
+		std::lock_guard<std::mutex> l(_networks_l);
+		auto nwi = _networks.find(networkId);
+		if (nwi == _networks.end())
+			return false;
+		nw = nwi->second;
+	}
+	std::shared_ptr<const nlohmann::json> config;
+	std::vector< std::shared_ptr<const Member> > ms;
+	{
+		std::lock_guard<std::mutex> l2(nw->lock);
+		config = nw->config;
+		ms.reserve(nw->members.size());
+		for(auto m=nw->members.begin();m!=nw->members.end();++m)
+			ms.push_back(m->second);
+	}
+	network = (config) ? *config : nlohmann::json();
+	members.reserve(members.size() + ms.size());
+	for(auto m=ms.begin();m!=ms.end();++m)
+		members.push_back((*m)->toJson());
+	return true;
+}
+
+bool DB::get(const uint64_t networkId,std::shared_ptr<const nlohmann::json> &network,const uint64_t memberId,std::shared_ptr<const Member> &member,NetworkSummaryInfo &info)
+{
+	network.reset();
+	member.reset();
+	_waitForNetwork(networkId);
 	std::shared_ptr<_Network> nw;
 	{
 		std::lock_guard<std::mutex> l(_networks_l);
@@ -174,9 +400,9 @@ bool DB::get(const uint64_t networkId,nlohmann::json &network,const uint64_t mem
 	return true;
 }
 
-bool DB::get(const uint64_t networkId,nlohmann::json &network,std::vector<nlohmann::json> &members)
+bool DB::summary(const uint64_t networkId,NetworkSummaryInfo &info)
 {
-	waitForReady();
+	_waitForNetwork(networkId);
 	std::shared_ptr<_Network> nw;
 	{
 		std::lock_guard<std::mutex> l(_networks_l);
@@ -187,16 +413,13 @@ bool DB::get(const uint64_t networkId,nlohmann::json &network,std::vector<nlohma
 	}
 	{
 		std::lock_guard<std::mutex> l2(nw->lock);
-		network = nw->config;
-		for(auto m=nw->members.begin();m!=nw->members.end();++m)
-			members.push_back(m->second);
+		_fillSummaryInfo(nw,info);
 	}
 	return true;
 }
 
-bool DB::summary(const uint64_t networkId,NetworkSummaryInfo &info)
+bool DB::ipAssigned(const uint64_t networkId,const InetAddress &ip)
 {
-	waitForReady();
 	std::shared_ptr<_Network> nw;
 	{
 		std::lock_guard<std::mutex> l(_networks_l);
@@ -205,11 +428,22 @@ bool DB::summary(const uint64_t networkId,NetworkSummaryInfo &info)
 			return false;
 		nw = nwi->second;
 	}
+	std::lock_guard<std::mutex> l2(nw->lock);
+	return nw->assignedIps.contains(ip);
+}
+
+bool DB::nextFreeIpv4(const uint64_t networkId,const uint32_t start,const uint32_t end,uint32_t &ip)
+{
+	std::shared_ptr<_Network> nw;
 	{
-		std::lock_guard<std::mutex> l2(nw->lock);
-		_fillSummaryInfo(nw,info);
+		std::lock_guard<std::mutex> l(_networks_l);
+		auto nwi = _networks.find(networkId);
+		if (nwi == _networks.end())
+			return false;
+		nw = nwi->second;
 	}
-	return true;
+	std::lock_guard<std::mutex> l2(nw->lock);
+	return nw->assignedIps.nextFreeIpv4(start,end,ip);
 }
 
 void DB::networks(std::vector<uint64_t> &networks)
@@ -221,6 +455,20 @@ void DB::networks(std::vector<uint64_t> &networks)
 		networks.push_back(n->first);
 }
 
+void DB::saveMember(const Member *orig,const Member &member)
+{
+	if ((orig)&&(*orig == member))
+		return;
+	nlohmann::json record(member.toJson());
+	cleanMember(record);
+	if (orig) {
+		nlohmann::json o(orig->toJson());
+		save(&o,record);
+	} else {
+		save((nlohmann::json *)0,record);
+	}
+}
+
 void DB::_memberChanged(nlohmann::json &old,nlohmann::json &memberConfig,bool push)
 {
 	uint64_t memberId = 0;
@@ -250,12 +498,8 @@ void DB::_memberChanged(nlohmann::json &old,nlohmann::json &memberConfig,bool pu
 				if (ips.is_array()) {
 					for(unsigned long i=0;i<ips.size();++i) {
 						json &ipj = ips[i];
-						if (ipj.is_string()) {
-							const std::string ips = ipj;
-							InetAddress ipa(ips.c_str());
-							ipa.setPort(0);
-							nw->allocatedIps.erase(ipa);
-						}
+						if (ipj.is_string())
+							nw->assignedIps.remove(InetAddress(ipj.get<std::string>().c_str()));
 					}
 				}
 			}
@@ -263,9 +507,12 @@ void DB::_memberChanged(nlohmann::json &old,nlohmann::json &memberConfig,bool pu
 	}
 
 	if (memberConfig.is_object()) {
+		std::shared_ptr<Member> m(new Member());
+		m->fromJson(memberConfig);
+
 		if (!nw) {
-			memberId = OSUtils::jsonIntHex(memberConfig["id"],0ULL);
-			networkId = OSUtils::jsonIntHex(memberConfig["nwid"],0ULL);
+			memberId = m->id;
+			networkId = m->networkId;
 			if ((!memberId)||(!networkId))
 				return;
 			std::lock_guard<std::mutex> l(_networks_l);
@@ -278,31 +525,18 @@ void DB::_memberChanged(nlohmann::json &old,nlohmann::json &memberConfig,bool pu
 		{
 			std::lock_guard<std::mutex> l(nw->lock);
 
-			nw->members[memberId] = memberConfig;
+			nw->members[memberId] = m;
 
-			if (OSUtils::jsonBool(memberConfig["activeBridge"],false))
+			if (m->activeBridge)
 				nw->activeBridgeMembers.insert(memberId);
-			isAuth = OSUtils::jsonBool(memberConfig["authorized"],false);
+			isAuth = m->authorized;
 			if (isAuth)
 				nw->authorizedMembers.insert(memberId);
-			json &ips = memberConfig["ipAssignments"];
-			if (ips.is_array()) {
-				for(unsigned long i=0;i<ips.size();++i) {
-					json &ipj = ips[i];
-					if (ipj.is_string()) {
-						const std::string ips = ipj;
-						InetAddress ipa(ips.c_str());
-						ipa.setPort(0);
-						nw->allocatedIps.insert(ipa);
-					}
-				}
-			}
+			for(auto ip=m->ipAssignments.begin();ip!=m->ipAssignments.end();++ip)
+				nw->assignedIps.add(*ip);
 
-			if (!isAuth) {
-				const int64_t ldt = (int64_t)OSUtils::jsonInt(memberConfig["lastDeauthorizedTime"],0ULL);
-				if (ldt > nw->mostRecentDeauthTime)
-					nw->mostRecentDeauthTime = ldt;
-			}
+			if ((!isAuth)&&(m->lastDeauthorizedTime > nw->mostRecentDeauthTime))
+				nw->mostRecentDeauthTime = m->lastDeauthorizedTime;
 		}
 
 		if (push)
@@ -334,6 +568,7 @@ void DB::_networkChanged(nlohmann::json &old,nlohmann::json &networkConfig,bool
 		const std::string ids = networkConfig["id"];
 		const uint64_t id = Utils::hexStrToU64(ids.c_str());
 		if (id) {
+			std::shared_ptr<const nlohmann::json> config(new nlohmann::json(networkConfig));
 			std::shared_ptr<_Network> nw;
 			{
 				std::lock_guard<std::mutex> l(_networks_l);
@@ -344,7 +579,7 @@ void DB::_networkChanged(nlohmann::json &old,nlohmann::json &networkConfig,bool
 			}
 			{
 				std::lock_guard<std::mutex> l2(nw->lock);
-				nw->config = networkConfig;
+				nw->config = config;
 			}
 			if (push)
 				_controller->onNetworkUpdate(id);
@@ -364,9 +599,6 @@ void DB::_fillSummaryInfo(const std::shared_ptr<_Network> &nw,NetworkSummaryInfo
 	for(auto ab=nw->activeBridgeMembers.begin();ab!=nw->activeBridgeMembers.end();++ab)
 		info.activeBridges.push_back(Address(*ab));
 	std::sort(info.activeBridges.begin(),info.activeBridges.end());
-	for(auto ip=nw->allocatedIps.begin();ip!=nw->allocatedIps.end();++ip)
-		info.allocatedIps.push_back(*ip);
-	std::sort(info.allocatedIps.begin(),info.allocatedIps.end());
 	info.authorizedMemberCount = (unsigned long)nw->authorizedMembers.size();
 	info.totalMemberCount = (unsigned long)nw->members.size();
 	info.mostRecentDeauthTime = nw->mostRecentDeauthTime;
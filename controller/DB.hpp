@@ -25,6 +25,8 @@
 #include "../osdep/OSUtils.hpp"
 #include "../osdep/BlockingQueue.hpp"
 
+#include "IpIndex.hpp"
+
 #include <memory>
 #include <string>
 #include <thread>
@@ -52,12 +54,67 @@ public:
 	{
 		NetworkSummaryInfo() : authorizedMemberCount(0),totalMemberCount(0),mostRecentDeauthTime(0) {}
 		std::vector<Address> activeBridges;
-		std::vector<InetAddress> allocatedIps;
 		unsigned long authorizedMemberCount;
 		unsigned long totalMemberCount;
 		int64_t mostRecentDeauthTime;
 	};
 
+	/**
+	 * A network member as held in memory
+	 *
+	 * Records are stored and sent over the API as JSON, and are converted
+	 * with fromJson() and toJson(). Fields not modeled here are kept in
+	 * other so they survive the round trip.
+	 */
+	struct Member
+	{
+		Member() :
+			id(0),
+			networkId(0),
+			revision(0),
+			creationTime(0),
+			lastAuthorizedTime(0),
+			lastDeauthorizedTime(0),
+			remoteTraceLevel(0),
+			vMajor(-1),
+			vMinor(-1),
+			vRev(-1),
+			vProto(-1),
+			authorized(false),
+			activeBridge(false),
+			noAutoAssignIps(false) {}
+
+		/**
+		 * Set fields from a JSON member record (fields it lacks are left as they are)
+		 */
+		void fromJson(const nlohmann::json &member);
+
+		nlohmann::json toJson() const;
+
+		bool operator==(const Member &m) const;
+		inline bool operator!=(const Member &m) const { return !(*this == m); }
+
+		uint64_t id;
+		uint64_t networkId;
+		uint64_t revision;
+		int64_t creationTime;
+		int64_t lastAuthorizedTime;
+		int64_t lastDeauthorizedTime;
+		Identity identity; // nil until learned from the member's first request
+		Address remoteTraceTarget;
+		int remoteTraceLevel;
+		int vMajor,vMinor,vRev,vProto;
+		bool authorized;
+		bool activeBridge;
+		bool noAutoAssignIps;
+		std::string lastAuthorizedCredentialType; // empty for none
+		std::string lastAuthorizedCredential; // empty for none
+		std::vector<InetAddress> ipAssignments;
+		std::vector<uint64_t> capabilities;
+		std::vector< std::pair<uint64_t,uint64_t> > tags;
+		std::shared_ptr<const nlohmann::json> other;
+	};
+
 	/**
 	 * Ensure that all network fields are present
 	 */
@@ -84,8 +141,9 @@ public:
 	virtual bool waitForReady() = 0;
 	virtual bool isReady() = 0;
 
-	inline bool hasNetwork(const uint64_t networkId) const
+	inline bool hasNetwork(const uint64_t networkId)
 	{
+		_waitForNetwork(networkId);
 		std::lock_guard<std::mutex> l(_networks_l);
 		return (_networks.find(networkId) != _networks.end());
 	}
@@ -95,12 +153,50 @@ public:
 	bool get(const uint64_t networkId,nlohmann::json &network,const uint64_t memberId,nlohmann::json &member,NetworkSummaryInfo &info);
 	bool get(const uint64_t networkId,nlohmann::json &network,std::vector<nlohmann::json> &members);
 
+	/**
+	 * Get a network and member without copying them
+	 *
+	 * @param networkId Network ID
+	 * @param network Set to network config or NULL if not found
+	 * @param memberId Member ID
+	 * @param member Set to member or NULL if not found
+	 * @param info Summary info for network
+	 * @return True if network and member were both found
+	 */
+	bool get(const uint64_t networkId,std::shared_ptr<const nlohmann::json> &network,const uint64_t memberId,std::shared_ptr<const Member> &member,NetworkSummaryInfo &info);
+
 	bool summary(const uint64_t networkId,NetworkSummaryInfo &info);
 
+	/**
+	 * @param networkId Network ID
+	 * @param ip IP address (port is ignored)
+	 * @return True if this IP is assigned to any member of this network
+	 */
+	bool ipAssigned(const uint64_t networkId,const InetAddress &ip);
+
+	/**
+	 * Find the first IPv4 address in a range not assigned to any member of a network
+	 *
+	 * @param networkId Network ID
+	 * @param start First address (host byte order)
+	 * @param end Last address (host byte order)
+	 * @param ip Set to free address (host byte order) if found
+	 * @return True if a free address was found
+	 */
+	bool nextFreeIpv4(const uint64_t networkId,const uint32_t start,const uint32_t end,uint32_t &ip);
+
 	void networks(std::vector<uint64_t> &networks);
 
 	virtual void save(nlohmann::json *orig,nlohmann::json &record) = 0;
 
+	/**
+	 * Save a member if it differs from the original
+	 *
+	 * @param orig Member as it was before changes or NULL if new
+	 * @param member Member to save
+	 */
+	void saveMember(const Member *orig,const Member &member);
+
 	virtual void eraseNetwork(const uint64_t networkId) = 0;
 
 	virtual void eraseMember(const uint64_t networkId,const uint64_t memberId) = 0;
@@ -108,14 +204,22 @@ public:
 	virtual void nodeIsOnline(const uint64_t networkId,const uint64_t memberId,const InetAddress &physicalAddress) = 0;
 
 protected:
+	/**
+	 * Wait until a network and all its members are loaded
+	 *
+	 * The default waits for the whole DB. Implementations that load in the
+	 * background can let requests for loaded networks through sooner.
+	 */
+	virtual void _waitForNetwork(const uint64_t networkId) { waitForReady(); }
+
 	struct _Network
 	{
 		_Network() : mostRecentDeauthTime(0) {}
-		nlohmann::json config;
-		std::unordered_map<uint64_t,nlohmann::json> members;
+		std::shared_ptr<const nlohmann::json> config;
+		std::unordered_map< uint64_t,std::shared_ptr<const Member> > members;
 		std::unordered_set<uint64_t> activeBridgeMembers;
 		std::unordered_set<uint64_t> authorizedMembers;
-		std::unordered_set<InetAddress,InetAddress::Hasher> allocatedIps;
+		IpIndex assignedIps;
 		int64_t mostRecentDeauthTime;
 		std::mutex lock;
 	};
@@ -248,6 +248,15 @@ static json _renderRule(ZT_VirtualNetworkRule &rule)
 	return r;
 }
 
+static inline bool _hasIp(const std::vector<InetAddress> &ips,const InetAddress &ip)
+{
+	for(std::vector<InetAddress>::const_iterator i(ips.begin());i!=ips.end();++i) {
+		if (i->ipsEqual(ip))
+			return true;
+	}
+	return false;
+}
+
 static bool _parseRule(json &r,ZT_VirtualNetworkRule &rule)
 {
 	if (!r.is_object())
@@ -460,6 +469,8 @@ EmbeddedNetworkController::EmbeddedNetworkController(Node *node,const char *dbPa
 	_startTime(OSUtils::now()),
 	_node(node),
 	_path(dbPath),
+	_dbWriteDelay(ZT_CONTROLLER_FILEDB_DEFAULT_WRITE_DELAY),
+	_dbSync(false),
 	_sender((NetworkController::Sender *)0)
 {
 }
@@ -470,21 +481,24 @@ EmbeddedNetworkController::~EmbeddedNetworkController()
 	_queue.stop();
 	for(auto t=_threads.begin();t!=_threads.end();++t)
 		t->join();
+	Utils::burn(&_signingKey,sizeof(_signingKey));
 }
 
 void EmbeddedNetworkController::init(const Identity &signingId,Sender *sender)
 {
 	char tmp[64];
 	_signingId = signingId;
+	_signingId.expandSigningKey(_signingKey);
 	_sender = sender;
 	_signingIdAddressString = signingId.address().toString(tmp);
 #ifdef ZT_CONTROLLER_USE_RETHINKDB
 	if ((_path.length() > 10)&&(_path.substr(0,10) == "rethinkdb:"))
 		_db.reset(new RethinkDB(this,_signingId,_path.c_str()));
-	else // else use FileDB after endif
+	else // else use LogDB or FileDB after endif
 #endif
-		_db.reset(new FileDB(this,_signingId,_path.c_str()));
-	_db->waitForReady();
+	if ((_path.length() > 6)&&(_path.substr(0,6) == "logdb:"))
+		_db.reset(new LogDB(this,_signingId,_path.c_str() + 6,_dbSync));
+	else _db.reset(new FileDB(this,_signingId,_path.c_str(),_dbWriteDelay,_dbSync));
 }
 
 void EmbeddedNetworkController::request(
@@ -504,7 +518,12 @@ void EmbeddedNetworkController::request(
 	qe->identity = identity;
 	qe->metaData = metaData;
 	qe->type = _RQEntry::RQENTRY_TYPE_REQUEST;
-	_queue.post(qe);
+
+	// A member's newer request replaces one still waiting. Pushes (no packet ID) are
+	// kept apart from genuine requests since only the latter update version info.
+	_RQEntry *replaced = (_RQEntry *)0;
+	if (_queue.post(nwid,identity.address().toInt() | ((requestPacketId) ? 0ULL : 0x8000000000000000ULL),qe,replaced))
+		delete replaced;
 }
 
 unsigned int EmbeddedNetworkController::handleControlPlaneHttpGET(
@@ -597,7 +616,19 @@ unsigned int EmbeddedNetworkController::handleControlPlaneHttpGET(
 
 		char tmp[4096];
 		const bool dbOk = _db->isReady();
-		OSUtils::ztsnprintf(tmp,sizeof(tmp),"{\n\t\"controller\": true,\n\t\"apiVersion\": %d,\n\t\"clock\": %llu,\n\t\"databaseReady\": %s\n}\n",ZT_NETCONF_CONTROLLER_API_VERSION,(unsigned long long)OSUtils::now(),dbOk ? "true" : "false");
+		const FairQueue< uint64_t,uint64_t,_RQEntry * >::Stats qs(_queue.stats());
+		OSUtils::ztsnprintf(tmp,sizeof(tmp),"{\n\t\"controller\": true,\n\t\"apiVersion\": %d,\n\t\"clock\": %llu,\n\t\"databaseReady\": %s,\n\t\"requestQueue\": {\n\t\t\"depth\": %lu,\n\t\t\"networks\": %lu,\n\t\t\"posted\": %llu,\n\t\t\"coalesced\": %llu,\n\t\t\"served\": %llu,\n\t\t\"averageWait\": %llu,\n\t\t\"maxWait\": %llu,\n\t\t\"oldestWait\": %llu\n\t}\n}\n",
+			ZT_NETCONF_CONTROLLER_API_VERSION,
+			(unsigned long long)OSUtils::now(),
+			dbOk ? "true" : "false",
+			qs.depth,
+			qs.flows,
+			(unsigned long long)qs.posted,
+			(unsigned long long)qs.coalesced,
+			(unsigned long long)qs.served,
+			(unsigned long long)((qs.served) ? (qs.totalWait / qs.served) : 0ULL),
+			(unsigned long long)qs.maxWait,
+			(unsigned long long)qs.oldestWait);
 		responseBody = tmp;
 		responseContentType = "application/json";
 		return dbOk ? 200 : 503;
@@ -1137,6 +1168,11 @@ void EmbeddedNetworkController::handleRemoteTrace(const ZT_RemoteTrace &rt)
 
 void EmbeddedNetworkController::onNetworkUpdate(const uint64_t networkId)
 {
+	{
+		std::lock_guard<std::mutex> l(_configTemplates_l);
+		_configTemplates.erase(networkId);
+	}
+
 	// Send an update to all members of the network that are online
 	const int64_t now = OSUtils::now();
 	std::lock_guard<std::mutex> l(_memberStatus_l);
@@ -1178,9 +1214,9 @@ void EmbeddedNetworkController::_request(
 	const Identity &identity,
 	const Dictionary<ZT_NETWORKCONFIG_METADATA_DICT_CAPACITY> &metaData)
 {
-	char nwids[24];
 	DB::NetworkSummaryInfo ns;
-	json network,member,origMember;
+	std::shared_ptr<const json> network;
+	std::shared_ptr<const DB::Member> origMember;
 
 	if (!_db)
 		return;
@@ -1200,54 +1236,47 @@ void EmbeddedNetworkController::_request(
 
 	_db->nodeIsOnline(nwid,identity.address().toInt(),fromAddr);
 
-	Utils::hex(nwid,nwids);
-	_db->get(nwid,network,identity.address().toInt(),member,ns);
-	if ((!network.is_object())||(network.size() == 0)) {
+	_db->get(nwid,network,identity.address().toInt(),origMember,ns);
+	if ((!network)||(!network->is_object())||(network->size() == 0)) {
 		_sender->ncSendError(nwid,requestPacketId,identity.address(),NetworkController::NC_ERROR_OBJECT_NOT_FOUND);
 		return;
 	}
-	origMember = member;
-	const bool newMember = ((!member.is_object())||(member.size() == 0));
-	DB::initMember(member);
-
-	{
-		const std::string haveIdStr(OSUtils::jsonString(member["identity"],""));
-		if (haveIdStr.length() > 0) {
-			// If we already know this member's identity perform a full compare. This prevents
-			// a "collision" from being able to auth onto our network in place of an already
-			// known member.
-			try {
-				if (Identity(haveIdStr.c_str()) != identity) {
-					_sender->ncSendError(nwid,requestPacketId,identity.address(),NetworkController::NC_ERROR_ACCESS_DENIED);
-					return;
-				}
-			} catch ( ... ) {
-				_sender->ncSendError(nwid,requestPacketId,identity.address(),NetworkController::NC_ERROR_ACCESS_DENIED);
-				return;
-			}
-		} else {
-			// If we do not yet know this member's identity, learn it.
-			char idtmp[1024];
-			member["identity"] = identity.toString(false,idtmp);
+	const bool newMember = (!origMember);
+	DB::Member member;
+	if (origMember)
+		member = *origMember;
+	else member.creationTime = now;
+
+	const std::shared_ptr<const _NetworkConfigTemplate> nct(_configTemplate(nwid,*network));
+
+	if (member.identity) {
+		// If we already know this member's identity perform a full compare. This prevents
+		// a "collision" from being able to auth onto our network in place of an already
+		// known member.
+		if (member.identity != identity) {
+			_sender->ncSendError(nwid,requestPacketId,identity.address(),NetworkController::NC_ERROR_ACCESS_DENIED);
+			return;
 		}
+	} else if ((member.other)&&(member.other->find("identity") != member.other->end())) {
+		// A stored identity that cannot be read never matches
+		_sender->ncSendError(nwid,requestPacketId,identity.address(),NetworkController::NC_ERROR_ACCESS_DENIED);
+		return;
+	} else {
+		// If we do not yet know this member's identity, learn it.
+		member.identity = identity;
 	}
 
 	// These are always the same, but make sure they are set
-	{
-		char tmpid[128];
-		const std::string addrs(identity.address().toString(tmpid));
-		member["id"] = addrs;
-		member["address"] = addrs;
-		member["nwid"] = nwids;
-	}
+	member.id = identity.address().toInt();
+	member.networkId = nwid;
 
 	// Determine whether and how member is authorized
 	bool authorized = false;
 	bool autoAuthorized = false;
-	json autoAuthCredentialType,autoAuthCredential;
-	if (OSUtils::jsonBool(member["authorized"],false)) {
+	std::string autoAuthCredentialType,autoAuthCredential;
+	if (member.authorized) {
 		authorized = true;
-	} else if (!OSUtils::jsonBool(network["private"],true)) {
+	} else if (!nct->isPrivate) {
 		authorized = true;
 		autoAuthorized = true;
 		autoAuthCredentialType = "public";
@@ -1257,14 +1286,16 @@ void EmbeddedNetworkController::_request(
 			presentedAuth[511] = (char)0; // sanity check
 			if ((strlen(presentedAuth) > 6)&&(!strncmp(presentedAuth,"token:",6))) {
 				const char *const presentedToken = presentedAuth + 6;
-				json authTokens(network["authTokens"]);
-				json &tokenExpires = authTokens[presentedToken];
-				if (tokenExpires.is_number()) {
-					if ((tokenExpires == 0)||(tokenExpires > now)) {
-						authorized = true;
-						autoAuthorized = true;
-						autoAuthCredentialType = "token";
-						autoAuthCredential = presentedToken;
+				json::const_iterator authTokens(network->find("authTokens"));
+				if ((authTokens != network->end())&&(authTokens->is_object())) {
+					json::const_iterator tokenExpires(authTokens->find(presentedToken));
+					if ((tokenExpires != authTokens->end())&&(tokenExpires->is_number())) {
+						if ((*tokenExpires == 0)||(*tokenExpires > now)) {
+							authorized = true;
+							autoAuthorized = true;
+							autoAuthCredentialType = "token";
+							autoAuthCredential = presentedToken;
+						}
 					}
 				}
 			}
@@ -1273,10 +1304,10 @@ void EmbeddedNetworkController::_request(
 
 	// If we auto-authorized, update member record
 	if ((autoAuthorized)&&(authorized)) {
-		member["authorized"] = true;
-		member["lastAuthorizedTime"] = now;
-		member["lastAuthorizedCredentialType"] = autoAuthCredentialType;
-		member["lastAuthorizedCredential"] = autoAuthCredential;
+		member.authorized = true;
+		member.lastAuthorizedTime = now;
+		member.lastAuthorizedCredentialType = autoAuthCredentialType;
+		member.lastAuthorizedCredential = autoAuthCredential;
 	}
 
 	if (authorized) {
@@ -1287,10 +1318,10 @@ void EmbeddedNetworkController::_request(
 			const uint64_t vRev = metaData.getUI(ZT_NETWORKCONFIG_REQUEST_METADATA_KEY_NODE_REVISION,0);
 			const uint64_t vProto = metaData.getUI(ZT_NETWORKCONFIG_REQUEST_METADATA_KEY_PROTOCOL_VERSION,0);
 
-			member["vMajor"] = vMajor;
-			member["vMinor"] = vMinor;
-			member["vRev"] = vRev;
-			member["vProto"] = vProto;
+			member.vMajor = (int)vMajor;
+			member.vMinor = (int)vMinor;
+			member.vRev = (int)vRev;
+			member.vProto = (int)vProto;
 
 			{
 				std::lock_guard<std::mutex> l(_memberStatus_l);
@@ -1306,8 +1337,7 @@ void EmbeddedNetworkController::_request(
 		}
 	} else {
 		// If they are not authorized, STOP!
-		DB::cleanMember(member);
-		_db->save(&origMember,member);
+		_db->saveMember(origMember.get(),member);
 		_sender->ncSendError(nwid,requestPacketId,identity.address(),NetworkController::NC_ERROR_ACCESS_DENIED);
 		return;
 	}
@@ -1330,45 +1360,30 @@ void EmbeddedNetworkController::_request(
 	}
 
 	std::unique_ptr<NetworkConfig> nc(new NetworkConfig());
+	Credential::SigningBatch signatures(_signingId.address(),_signingKey); // signed all at once below
 
 	nc->networkId = nwid;
-	nc->type = OSUtils::jsonBool(network["private"],true) ? ZT_NETWORK_TYPE_PRIVATE : ZT_NETWORK_TYPE_PUBLIC;
+	nc->type = (nct->isPrivate) ? ZT_NETWORK_TYPE_PRIVATE : ZT_NETWORK_TYPE_PUBLIC;
 	nc->timestamp = now;
 	nc->credentialTimeMaxDelta = credentialtmd;
-	nc->revision = OSUtils::jsonInt(network["revision"],0ULL);
+	nc->revision = nct->revision;
 	nc->issuedTo = identity.address();
-	if (OSUtils::jsonBool(network["enableBroadcast"],true)) nc->flags |= ZT_NETWORKCONFIG_FLAG_ENABLE_BROADCAST;
-	Utils::scopy(nc->name,sizeof(nc->name),OSUtils::jsonString(network["name"],"").c_str());
-	nc->mtu = std::max(std::min((unsigned int)OSUtils::jsonInt(network["mtu"],ZT_DEFAULT_MTU),(unsigned int)ZT_MAX_MTU),(unsigned int)ZT_MIN_MTU);
-	nc->multicastLimit = (unsigned int)OSUtils::jsonInt(network["multicastLimit"],32ULL);
-
-	std::string rtt(OSUtils::jsonString(member["remoteTraceTarget"],""));
-	if (rtt.length() == 10) {
-		nc->remoteTraceTarget = Address(Utils::hexStrToU64(rtt.c_str()));
-		nc->remoteTraceLevel = (Trace::Level)OSUtils::jsonInt(member["remoteTraceLevel"],0ULL);
+	if (nct->enableBroadcast) nc->flags |= ZT_NETWORKCONFIG_FLAG_ENABLE_BROADCAST;
+	Utils::scopy(nc->name,sizeof(nc->name),nct->name.c_str());
+	nc->mtu = nct->mtu;
+	nc->multicastLimit = nct->multicastLimit;
+
+	if (member.remoteTraceTarget) {
+		nc->remoteTraceTarget = member.remoteTraceTarget;
+		nc->remoteTraceLevel = (Trace::Level)member.remoteTraceLevel;
 	} else {
-		rtt = OSUtils::jsonString(network["remoteTraceTarget"],"");
-		if (rtt.length() == 10) {
-			nc->remoteTraceTarget = Address(Utils::hexStrToU64(rtt.c_str()));
-		} else {
-			nc->remoteTraceTarget.zero();
-		}
-		nc->remoteTraceLevel = (Trace::Level)OSUtils::jsonInt(network["remoteTraceLevel"],0ULL);
+		nc->remoteTraceTarget = nct->remoteTraceTarget;
+		nc->remoteTraceLevel = (Trace::Level)nct->remoteTraceLevel;
 	}
 
 	for(std::vector<Address>::const_iterator ab(ns.activeBridges.begin());ab!=ns.activeBridges.end();++ab)
 		nc->addSpecialist(*ab,ZT_NETWORKCONFIG_SPECIALIST_TYPE_ACTIVE_BRIDGE);
 
-	json &v4AssignMode = network["v4AssignMode"];
-	json &v6AssignMode = network["v6AssignMode"];
-	json &ipAssignmentPools = network["ipAssignmentPools"];
-	json &routes = network["routes"];
-	json &rules = network["rules"];
-	json &capabilities = network["capabilities"];
-	json &tags = network["tags"];
-	json &memberCapabilities = member["capabilities"];
-	json &memberTags = member["tags"];
-
 	if (metaData.getUI(ZT_NETWORKCONFIG_REQUEST_METADATA_KEY_RULES_ENGINE_REV,0) <= 0) {
 		// Old versions with no rules engine support get an allow everything rule.
 		// Since rules are enforced bidirectionally, newer versions *will* still
@@ -1376,127 +1391,65 @@ void EmbeddedNetworkController::_request(
 		nc->ruleCount = 1;
 		nc->rules[0].t = ZT_NETWORK_RULE_ACTION_ACCEPT;
 	} else {
-		if (rules.is_array()) {
-			for(unsigned long i=0;i<rules.size();++i) {
-				if (nc->ruleCount >= ZT_MAX_NETWORK_RULES)
-					break;
-				if (_parseRule(rules[i],nc->rules[nc->ruleCount]))
-					++nc->ruleCount;
-			}
-		}
-
-		std::map< uint64_t,json * > capsById;
-		if (!memberCapabilities.is_array())
-			memberCapabilities = json::array();
-		if (capabilities.is_array()) {
-			for(unsigned long i=0;i<capabilities.size();++i) {
-				json &cap = capabilities[i];
-				if (cap.is_object()) {
-					const uint64_t id = OSUtils::jsonInt(cap["id"],0ULL) & 0xffffffffULL;
-					capsById[id] = &cap;
-					if ((newMember)&&(OSUtils::jsonBool(cap["default"],false))) {
-						bool have = false;
-						for(unsigned long i=0;i<memberCapabilities.size();++i) {
-							if (id == (OSUtils::jsonInt(memberCapabilities[i],0ULL) & 0xffffffffULL)) {
-								have = true;
-								break;
-							}
-						}
-						if (!have)
-							memberCapabilities.push_back(id);
+		nc->ruleCount = (unsigned int)nct->rules.size();
+		if (nc->ruleCount)
+			ZT_FAST_MEMCPY(nc->rules,&(nct->rules[0]),sizeof(ZT_VirtualNetworkRule) * nc->ruleCount);
+
+		if (newMember) {
+			for(std::vector<uint64_t>::const_iterator id(nct->defaultCapabilities.begin());id!=nct->defaultCapabilities.end();++id) {
+				bool have = false;
+				for(std::vector<uint64_t>::const_iterator c(member.capabilities.begin());c!=member.capabilities.end();++c) {
+					if (*id == (*c & 0xffffffffULL)) {
+						have = true;
+						break;
 					}
 				}
+				if (!have)
+					member.capabilities.push_back(*id);
 			}
 		}
-		for(unsigned long i=0;i<memberCapabilities.size();++i) {
-			const uint64_t capId = OSUtils::jsonInt(memberCapabilities[i],0ULL) & 0xffffffffULL;
-			std::map< uint64_t,json * >::const_iterator ctmp = capsById.find(capId);
-			if (ctmp != capsById.end()) {
-				json *cap = ctmp->second;
-				if ((cap)&&(cap->is_object())&&(cap->size() > 0)) {
-					ZT_VirtualNetworkRule capr[ZT_MAX_CAPABILITY_RULES];
-					unsigned int caprc = 0;
-					json &caprj = (*cap)["rules"];
-					if ((caprj.is_array())&&(caprj.size() > 0)) {
-						for(unsigned long j=0;j<caprj.size();++j) {
-							if (caprc >= ZT_MAX_CAPABILITY_RULES)
-								break;
-							if (_parseRule(caprj[j],capr[caprc]))
-								++caprc;
-						}
-					}
-					nc->capabilities[nc->capabilityCount] = Capability((uint32_t)capId,nwid,now,1,capr,caprc);
-					if (nc->capabilities[nc->capabilityCount].sign(_signingId,identity.address()))
-						++nc->capabilityCount;
-					if (nc->capabilityCount >= ZT_MAX_NETWORK_CAPABILITIES)
-						break;
-				}
+		for(std::vector<uint64_t>::const_iterator c(member.capabilities.begin());c!=member.capabilities.end();++c) {
+			const uint64_t capId = *c & 0xffffffffULL;
+			std::map< uint64_t,std::vector<ZT_VirtualNetworkRule> >::const_iterator cap(nct->capabilities.find(capId));
+			if (cap != nct->capabilities.end()) {
+				nc->capabilities[nc->capabilityCount] = Capability((uint32_t)capId,nwid,now,1,(cap->second.empty()) ? (const ZT_VirtualNetworkRule *)0 : &(cap->second[0]),(unsigned int)cap->second.size());
+				if (nc->capabilities[nc->capabilityCount].sign(signatures,identity.address()))
+					++nc->capabilityCount;
+				if (nc->capabilityCount >= ZT_MAX_NETWORK_CAPABILITIES)
+					break;
 			}
 		}
 
 		std::map< uint32_t,uint32_t > memberTagsById;
-		if (memberTags.is_array()) {
-			for(unsigned long i=0;i<memberTags.size();++i) {
-				json &t = memberTags[i];
-				if ((t.is_array())&&(t.size() == 2))
-					memberTagsById[(uint32_t)(OSUtils::jsonInt(t[0],0ULL) & 0xffffffffULL)] = (uint32_t)(OSUtils::jsonInt(t[1],0ULL) & 0xffffffffULL);
-			}
-		}
-		if (tags.is_array()) { // check network tags array for defaults that are not present in member tags
-			for(unsigned long i=0;i<tags.size();++i) {
-				json &t = tags[i];
-				if (t.is_object()) {
-					const uint32_t id = (uint32_t)(OSUtils::jsonInt(t["id"],0) & 0xffffffffULL);
-					json &dfl = t["default"];
-					if ((dfl.is_number())&&(memberTagsById.find(id) == memberTagsById.end())) {
-						memberTagsById[id] = (uint32_t)(OSUtils::jsonInt(dfl,0) & 0xffffffffULL);
-						json mt = json::array();
-						mt.push_back(id);
-						mt.push_back(dfl);
-						memberTags.push_back(mt); // add default to member tags if not present
-					}
-				}
+		for(std::vector< std::pair<uint64_t,uint64_t> >::const_iterator t(member.tags.begin());t!=member.tags.end();++t)
+			memberTagsById[(uint32_t)(t->first & 0xffffffffULL)] = (uint32_t)(t->second & 0xffffffffULL);
+		for(std::vector< std::pair< uint32_t,json > >::const_iterator dt(nct->defaultTags.begin());dt!=nct->defaultTags.end();++dt) {
+			if (memberTagsById.find(dt->first) == memberTagsById.end()) {
+				const uint64_t dflt = OSUtils::jsonInt(dt->second,0);
+				memberTagsById[dt->first] = (uint32_t)(dflt & 0xffffffffULL);
+				member.tags.push_back(std::pair<uint64_t,uint64_t>(dt->first,dflt)); // add default to member tags if not present
 			}
 		}
 		for(std::map< uint32_t,uint32_t >::const_iterator t(memberTagsById.begin());t!=memberTagsById.end();++t) {
 			if (nc->tagCount >= ZT_MAX_NETWORK_TAGS)
 				break;
 			nc->tags[nc->tagCount] = Tag(nwid,now,identity.address(),t->first,t->second);
-			if (nc->tags[nc->tagCount].sign(_signingId))
-				++nc->tagCount;
+			nc->tags[nc->tagCount].sign(signatures);
+			++nc->tagCount;
 		}
 	}
 
-	if (routes.is_array()) {
-		for(unsigned long i=0;i<routes.size();++i) {
-			if (nc->routeCount >= ZT_MAX_NETWORK_ROUTES)
-				break;
-			json &route = routes[i];
-			json &target = route["target"];
-			json &via = route["via"];
-			if (target.is_string()) {
-				const InetAddress t(target.get<std::string>().c_str());
-				InetAddress v;
-				if (via.is_string()) v.fromString(via.get<std::string>().c_str());
-				if ((t.ss_family == AF_INET)||(t.ss_family == AF_INET6)) {
-					ZT_VirtualNetworkRoute *r = &(nc->routes[nc->routeCount]);
-					*(reinterpret_cast<InetAddress *>(&(r->target))) = t;
-					if (v.ss_family == t.ss_family)
-						*(reinterpret_cast<InetAddress *>(&(r->via))) = v;
-					++nc->routeCount;
-				}
-			}
-		}
-	}
+	for(std::vector<ZT_VirtualNetworkRoute>::const_iterator r(nct->routes.begin());r!=nct->routes.end();++r)
+		nc->routes[nc->routeCount++] = *r;
 
-	const bool noAutoAssignIps = OSUtils::jsonBool(member["noAutoAssignIps"],false);
+	const bool noAutoAssignIps = member.noAutoAssignIps;
 
-	if ((v6AssignMode.is_object())&&(!noAutoAssignIps)) {
-		if ((OSUtils::jsonBool(v6AssignMode["rfc4193"],false))&&(nc->staticIpCount < ZT_MAX_ZT_ASSIGNED_ADDRESSES)) {
+	if (!noAutoAssignIps) {
+		if ((nct->v6AssignRfc4193)&&(nc->staticIpCount < ZT_MAX_ZT_ASSIGNED_ADDRESSES)) {
 			nc->staticIps[nc->staticIpCount++] = InetAddress::makeIpv6rfc4193(nwid,identity.address().toInt());
 			nc->flags |= ZT_NETWORKCONFIG_FLAG_ENABLE_IPV6_NDP_EMULATION;
 		}
-		if ((OSUtils::jsonBool(v6AssignMode["6plane"],false))&&(nc->staticIpCount < ZT_MAX_ZT_ASSIGNED_ADDRESSES)) {
+		if ((nct->v6Assign6plane)&&(nc->staticIpCount < ZT_MAX_ZT_ASSIGNED_ADDRESSES)) {
 			nc->staticIps[nc->staticIpCount++] = InetAddress::makeIpv66plane(nwid,identity.address().toInt());
 			nc->flags |= ZT_NETWORKCONFIG_FLAG_ENABLE_IPV6_NDP_EMULATION;
 		}
@@ -1504,95 +1457,81 @@ void EmbeddedNetworkController::_request(
 
 	bool haveManagedIpv4AutoAssignment = false;
 	bool haveManagedIpv6AutoAssignment = false; // "special" NDP-emulated address types do not count
-	json ipAssignments = member["ipAssignments"]; // we want to make a copy
-	if (ipAssignments.is_array()) {
-		for(unsigned long i=0;i<ipAssignments.size();++i) {
-			if (ipAssignments[i].is_string()) {
-				const std::string ips = ipAssignments[i];
-				InetAddress ip(ips.c_str());
-
-				// IP assignments are only pushed if there is a corresponding local route. We also now get the netmask bits from
-				// this route, ignoring the netmask bits field of the assigned IP itself. Using that was worthless and a source
-				// of user error / poor UX.
-				int routedNetmaskBits = -1;
-				for(unsigned int rk=0;rk<nc->routeCount;++rk) {
-					if ( (!nc->routes[rk].via.ss_family) && (reinterpret_cast<const InetAddress *>(&(nc->routes[rk].target))->containsAddress(ip)) )
-						routedNetmaskBits = reinterpret_cast<const InetAddress *>(&(nc->routes[rk].target))->netmaskBits();
-				}
+	for(std::vector<InetAddress>::const_iterator ipa(member.ipAssignments.begin());ipa!=member.ipAssignments.end();++ipa) {
+		InetAddress ip(*ipa);
+
+		// IP assignments are only pushed if there is a corresponding local route. We also now get the netmask bits from
+		// this route, ignoring the netmask bits field of the assigned IP itself. Using that was worthless and a source
+		// of user error / poor UX.
+		int routedNetmaskBits = -1;
+		for(unsigned int rk=0;rk<nc->routeCount;++rk) {
+			if ( (!nc->routes[rk].via.ss_family) && (reinterpret_cast<const InetAddress *>(&(nc->routes[rk].target))->containsAddress(ip)) )
+				routedNetmaskBits = reinterpret_cast<const InetAddress *>(&(nc->routes[rk].target))->netmaskBits();
+		}
 
-				if (routedNetmaskBits >= 0) {
-					if (nc->staticIpCount < ZT_MAX_ZT_ASSIGNED_ADDRESSES) {
-						ip.setPort(routedNetmaskBits);
-						nc->staticIps[nc->staticIpCount++] = ip;
-					}
-					if (ip.ss_family == AF_INET)
-						haveManagedIpv4AutoAssignment = true;
-					else if (ip.ss_family == AF_INET6)
-						haveManagedIpv6AutoAssignment = true;
-				}
+		if (routedNetmaskBits >= 0) {
+			if (nc->staticIpCount < ZT_MAX_ZT_ASSIGNED_ADDRESSES) {
+				ip.setPort(routedNetmaskBits);
+				nc->staticIps[nc->staticIpCount++] = ip;
 			}
+			if (ip.ss_family == AF_INET)
+				haveManagedIpv4AutoAssignment = true;
+			else if (ip.ss_family == AF_INET6)
+				haveManagedIpv6AutoAssignment = true;
 		}
-	} else {
-		ipAssignments = json::array();
 	}
 
-	if ( (ipAssignmentPools.is_array()) && ((v6AssignMode.is_object())&&(OSUtils::jsonBool(v6AssignMode["zt"],false))) && (!haveManagedIpv6AutoAssignment) && (!noAutoAssignIps) ) {
-		for(unsigned long p=0;((p<ipAssignmentPools.size())&&(!haveManagedIpv6AutoAssignment));++p) {
-			json &pool = ipAssignmentPools[p];
-			if (pool.is_object()) {
-				InetAddress ipRangeStart(OSUtils::jsonString(pool["ipRangeStart"],"").c_str());
-				InetAddress ipRangeEnd(OSUtils::jsonString(pool["ipRangeEnd"],"").c_str());
-				if ( (ipRangeStart.ss_family == AF_INET6) && (ipRangeEnd.ss_family == AF_INET6) ) {
-					uint64_t s[2],e[2],x[2],xx[2];
-					ZT_FAST_MEMCPY(s,ipRangeStart.rawIpData(),16);
-					ZT_FAST_MEMCPY(e,ipRangeEnd.rawIpData(),16);
-					s[0] = Utils::ntoh(s[0]);
-					s[1] = Utils::ntoh(s[1]);
-					e[0] = Utils::ntoh(e[0]);
-					e[1] = Utils::ntoh(e[1]);
-					x[0] = s[0];
-					x[1] = s[1];
-
-					for(unsigned int trialCount=0;trialCount<1000;++trialCount) {
-						if ((trialCount == 0)&&(e[1] > s[1])&&((e[1] - s[1]) >= 0xffffffffffULL)) {
-							// First see if we can just cram a ZeroTier ID into the higher 64 bits. If so do that.
-							xx[0] = Utils::hton(x[0]);
-							xx[1] = Utils::hton(x[1] + identity.address().toInt());
-						} else {
-							// Otherwise pick random addresses -- this technically doesn't explore the whole range if the lower 64 bit range is >= 1 but that won't matter since that would be huge anyway
-							Utils::getSecureRandom((void *)xx,16);
-							if ((e[0] > s[0]))
-								xx[0] %= (e[0] - s[0]);
-							else xx[0] = 0;
-							if ((e[1] > s[1]))
-								xx[1] %= (e[1] - s[1]);
-							else xx[1] = 0;
-							xx[0] = Utils::hton(x[0] + xx[0]);
-							xx[1] = Utils::hton(x[1] + xx[1]);
-						}
+	if ( (nct->v6AssignZt) && (!haveManagedIpv6AutoAssignment) && (!noAutoAssignIps) ) {
+		for(unsigned long p=0;((p<nct->ipAssignmentPools.size())&&(!haveManagedIpv6AutoAssignment));++p) {
+			const InetAddress &ipRangeStart = nct->ipAssignmentPools[p].first;
+			const InetAddress &ipRangeEnd = nct->ipAssignmentPools[p].second;
+			if ( (ipRangeStart.ss_family == AF_INET6) && (ipRangeEnd.ss_family == AF_INET6) ) {
+				uint64_t s[2],e[2],x[2],xx[2];
+				ZT_FAST_MEMCPY(s,ipRangeStart.rawIpData(),16);
+				ZT_FAST_MEMCPY(e,ipRangeEnd.rawIpData(),16);
+				s[0] = Utils::ntoh(s[0]);
+				s[1] = Utils::ntoh(s[1]);
+				e[0] = Utils::ntoh(e[0]);
+				e[1] = Utils::ntoh(e[1]);
+				x[0] = s[0];
+				x[1] = s[1];
+
+				for(unsigned int trialCount=0;trialCount<1000;++trialCount) {
+					if ((trialCount == 0)&&(e[1] > s[1])&&((e[1] - s[1]) >= 0xffffffffffULL)) {
+						// First see if we can just cram a ZeroTier ID into the higher 64 bits. If so do that.
+						xx[0] = Utils::hton(x[0]);
+						xx[1] = Utils::hton(x[1] + identity.address().toInt());
+					} else {
+						// Otherwise pick random addresses -- this technically doesn't explore the whole range if the lower 64 bit range is >= 1 but that won't matter since that would be huge anyway
+						Utils::getSecureRandom((void *)xx,16);
+						if ((e[0] > s[0]))
+							xx[0] %= (e[0] - s[0]);
+						else xx[0] = 0;
+						if ((e[1] > s[1]))
+							xx[1] %= (e[1] - s[1]);
+						else xx[1] = 0;
+						xx[0] = Utils::hton(x[0] + xx[0]);
+						xx[1] = Utils::hton(x[1] + xx[1]);
+					}
 
-						InetAddress ip6((const void *)xx,16,0);
+					InetAddress ip6((const void *)xx,16,0);
 
-						// Check if this IP is within a local-to-Ethernet routed network
-						int routedNetmaskBits = 0;
-						for(unsigned int rk=0;rk<nc->routeCount;++rk) {
-							if ( (!nc->routes[rk].via.ss_family) && (nc->routes[rk].target.ss_family == AF_INET6) && (reinterpret_cast<const InetAddress *>(&(nc->routes[rk].target))->containsAddress(ip6)) )
-								routedNetmaskBits = reinterpret_cast<const InetAddress *>(&(nc->routes[rk].target))->netmaskBits();
-						}
+					// Check if this IP is within a local-to-Ethernet routed network
+					int routedNetmaskBits = 0;
+					for(unsigned int rk=0;rk<nc->routeCount;++rk) {
+						if ( (!nc->routes[rk].via.ss_family) && (nc->routes[rk].target.ss_family == AF_INET6) && (reinterpret_cast<const InetAddress *>(&(nc->routes[rk].target))->containsAddress(ip6)) )
+							routedNetmaskBits = reinterpret_cast<const InetAddress *>(&(nc->routes[rk].target))->netmaskBits();
+					}
 
-						// If it's routed, then try to claim and assign it and if successful end loop
-						if ( (routedNetmaskBits > 0) && (!std::binary_search(ns.allocatedIps.begin(),ns.allocatedIps.end(),ip6)) ) {
-							char tmpip[64];
-							const std::string ipStr(ip6.toIpString(tmpip));
-							if (std::find(ipAssignments.begin(),ipAssignments.end(),ipStr) == ipAssignments.end()) {
-								ipAssignments.push_back(ipStr);
-								member["ipAssignments"] = ipAssignments;
-								ip6.setPort((unsigned int)routedNetmaskBits);
-								if (nc->staticIpCount < ZT_MAX_ZT_ASSIGNED_ADDRESSES)
-									nc->staticIps[nc->staticIpCount++] = ip6;
-								haveManagedIpv6AutoAssignment = true;
-								break;
-							}
+					// If it's routed, then try to claim and assign it and if successful end loop
+					if ( (routedNetmaskBits > 0) && (!_db->ipAssigned(nwid,ip6)) ) {
+						if (!_hasIp(member.ipAssignments,ip6)) {
+							member.ipAssignments.push_back(ip6);
+							ip6.setPort((unsigned int)routedNetmaskBits);
+							if (nc->staticIpCount < ZT_MAX_ZT_ASSIGNED_ADDRESSES)
+								nc->staticIps[nc->staticIpCount++] = ip6;
+							haveManagedIpv6AutoAssignment = true;
+							break;
 						}
 					}
 				}
@@ -1600,60 +1539,60 @@ void EmbeddedNetworkController::_request(
 		}
 	}
 
-	if ( (ipAssignmentPools.is_array()) && ((v4AssignMode.is_object())&&(OSUtils::jsonBool(v4AssignMode["zt"],false))) && (!haveManagedIpv4AutoAssignment) && (!noAutoAssignIps) ) {
-		for(unsigned long p=0;((p<ipAssignmentPools.size())&&(!haveManagedIpv4AutoAssignment));++p) {
-			json &pool = ipAssignmentPools[p];
-			if (pool.is_object()) {
-				InetAddress ipRangeStartIA(OSUtils::jsonString(pool["ipRangeStart"],"").c_str());
-				InetAddress ipRangeEndIA(OSUtils::jsonString(pool["ipRangeEnd"],"").c_str());
-				if ( (ipRangeStartIA.ss_family == AF_INET) && (ipRangeEndIA.ss_family == AF_INET) ) {
-					uint32_t ipRangeStart = Utils::ntoh((uint32_t)(reinterpret_cast<struct sockaddr_in *>(&ipRangeStartIA)->sin_addr.s_addr));
-					uint32_t ipRangeEnd = Utils::ntoh((uint32_t)(reinterpret_cast<struct sockaddr_in *>(&ipRangeEndIA)->sin_addr.s_addr));
-					if ((ipRangeEnd < ipRangeStart)||(ipRangeStart == 0))
-						continue;
-					uint32_t ipRangeLen = ipRangeEnd - ipRangeStart;
-
-					// Start with the LSB of the member's address
-					uint32_t ipTrialCounter = (uint32_t)(identity.address().toInt() & 0xffffffff);
-
-					for(uint32_t k=ipRangeStart,trialCount=0;((k<=ipRangeEnd)&&(trialCount < 1000));++k,++trialCount) {
-						uint32_t ip = (ipRangeLen > 0) ? (ipRangeStart + (ipTrialCounter % ipRangeLen)) : ipRangeStart;
-						++ipTrialCounter;
-						if ((ip & 0x000000ff) == 0x000000ff)
-							continue; // don't allow addresses that end in .255
-
-						// Check if this IP is within a local-to-Ethernet routed network
-						int routedNetmaskBits = -1;
-						for(unsigned int rk=0;rk<nc->routeCount;++rk) {
-							if (nc->routes[rk].target.ss_family == AF_INET) {
-								uint32_t targetIp = Utils::ntoh((uint32_t)(reinterpret_cast<const struct sockaddr_in *>(&(nc->routes[rk].target))->sin_addr.s_addr));
-								int targetBits = Utils::ntoh((uint16_t)(reinterpret_cast<const struct sockaddr_in *>(&(nc->routes[rk].target))->sin_port));
-								if ((ip & (0xffffffff << (32 - targetBits))) == targetIp) {
-									routedNetmaskBits = targetBits;
-									break;
-								}
+	if ( (nct->v4AssignZt) && (!haveManagedIpv4AutoAssignment) && (!noAutoAssignIps) ) {
+		for(unsigned long p=0;((p<nct->ipAssignmentPools.size())&&(!haveManagedIpv4AutoAssignment));++p) {
+			const InetAddress &ipRangeStartIA = nct->ipAssignmentPools[p].first;
+			const InetAddress &ipRangeEndIA = nct->ipAssignmentPools[p].second;
+			if ( (ipRangeStartIA.ss_family == AF_INET) && (ipRangeEndIA.ss_family == AF_INET) ) {
+				uint32_t ipRangeStart = Utils::ntoh((uint32_t)(reinterpret_cast<const struct sockaddr_in *>(&ipRangeStartIA)->sin_addr.s_addr));
+				uint32_t ipRangeEnd = Utils::ntoh((uint32_t)(reinterpret_cast<const struct sockaddr_in *>(&ipRangeEndIA)->sin_addr.s_addr));
+				if ((ipRangeEnd < ipRangeStart)||(ipRangeStart == 0))
+					continue;
+				const uint32_t ipRangeLen = ipRangeEnd - ipRangeStart;
+				const uint32_t ipRangeLast = (ipRangeLen > 0) ? (ipRangeEnd - 1) : ipRangeStart; // last address tried, as before
+
+				// Start with the LSB of the member's address
+				uint32_t ip = (ipRangeLen > 0) ? (ipRangeStart + ((uint32_t)(identity.address().toInt() & 0xffffffff) % ipRangeLen)) : ipRangeStart;
+
+				for(uint32_t trialCount=0;((trialCount<=ipRangeLen)&&(trialCount < 1000));++trialCount) {
+					// Skip any run of assigned addresses in one lookup, wrapping around to the start of the pool
+					if ((!_db->nextFreeIpv4(nwid,ip,ipRangeLast,ip))&&(!_db->nextFreeIpv4(nwid,ipRangeStart,ipRangeLast,ip)))
+						break; // pool is full
+					const uint32_t nextIp = (ip >= ipRangeLast) ? ipRangeStart : (ip + 1);
+					if ((ip & 0x000000ff) == 0x000000ff) {
+						ip = nextIp;
+						continue; // don't allow addresses that end in .255
+					}
+
+					// Check if this IP is within a local-to-Ethernet routed network
+					int routedNetmaskBits = -1;
+					for(unsigned int rk=0;rk<nc->routeCount;++rk) {
+						if (nc->routes[rk].target.ss_family == AF_INET) {
+							uint32_t targetIp = Utils::ntoh((uint32_t)(reinterpret_cast<const struct sockaddr_in *>(&(nc->routes[rk].target))->sin_addr.s_addr));
+							int targetBits = Utils::ntoh((uint16_t)(reinterpret_cast<const struct sockaddr_in *>(&(nc->routes[rk].target))->sin_port));
+							if ((ip & (0xffffffff << (32 - targetBits))) == targetIp) {
+								routedNetmaskBits = targetBits;
+								break;
 							}
 						}
+					}
 
-						// If it's routed, then try to claim and assign it and if successful end loop
-						const InetAddress ip4(Utils::hton(ip),0);
-						if ( (routedNetmaskBits > 0) && (!std::binary_search(ns.allocatedIps.begin(),ns.allocatedIps.end(),ip4)) ) {
-							char tmpip[64];
-							const std::string ipStr(ip4.toIpString(tmpip));
-							if (std::find(ipAssignments.begin(),ipAssignments.end(),ipStr) == ipAssignments.end()) {
-								ipAssignments.push_back(ipStr);
-								member["ipAssignments"] = ipAssignments;
-								if (nc->staticIpCount < ZT_MAX_ZT_ASSIGNED_ADDRESSES) {
-									struct sockaddr_in *const v4ip = reinterpret_cast<struct sockaddr_in *>(&(nc->staticIps[nc->staticIpCount++]));
-									v4ip->sin_family = AF_INET;
-									v4ip->sin_port = Utils::hton((uint16_t)routedNetmaskBits);
-									v4ip->sin_addr.s_addr = Utils::hton(ip);
-								}
-								haveManagedIpv4AutoAssignment = true;
-								break;
+					// If it's routed, then try to claim and assign it and if successful end loop
+					const InetAddress ip4(Utils::hton(ip),0);
+					if (routedNetmaskBits > 0) {
+						if (!_hasIp(member.ipAssignments,ip4)) {
+							member.ipAssignments.push_back(ip4);
+							if (nc->staticIpCount < ZT_MAX_ZT_ASSIGNED_ADDRESSES) {
+								struct sockaddr_in *const v4ip = reinterpret_cast<struct sockaddr_in *>(&(nc->staticIps[nc->staticIpCount++]));
+								v4ip->sin_family = AF_INET;
+								v4ip->sin_port = Utils::hton((uint16_t)routedNetmaskBits);
+								v4ip->sin_addr.s_addr = Utils::hton(ip);
 							}
+							haveManagedIpv4AutoAssignment = true;
+							break;
 						}
 					}
+					ip = nextIp;
 				}
 			}
 		}
@@ -1664,23 +1603,143 @@ void EmbeddedNetworkController::_request(
 		nc->certificatesOfOwnership[0] = CertificateOfOwnership(nwid,now,identity.address(),1);
 		for(unsigned int i=0;i<nc->staticIpCount;++i)
 			nc->certificatesOfOwnership[0].addThing(nc->staticIps[i]);
-		nc->certificatesOfOwnership[0].sign(_signingId);
+		nc->certificatesOfOwnership[0].sign(signatures);
 		nc->certificateOfOwnershipCount = 1;
 	}
 
-	CertificateOfMembership com(now,credentialtmd,nwid,identity.address());
-	if (com.sign(_signingId)) {
-		nc->com = com;
-	} else {
-		_sender->ncSendError(nwid,requestPacketId,identity.address(),NetworkController::NC_ERROR_INTERNAL_SERVER_ERROR);
-		return;
-	}
+	nc->com = CertificateOfMembership(now,credentialtmd,nwid,identity.address());
+	nc->com.sign(signatures);
 
-	DB::cleanMember(member);
-	_db->save(&origMember,member);
+	signatures.sign();
+
+	_db->saveMember(origMember.get(),member);
 	_sender->ncSendConfig(nwid,requestPacketId,identity.address(),*(nc.get()),metaData.getUI(ZT_NETWORKCONFIG_REQUEST_METADATA_KEY_VERSION,0) < 6);
 }
 
+std::shared_ptr<const EmbeddedNetworkController::_NetworkConfigTemplate> EmbeddedNetworkController::_configTemplate(const uint64_t nwid,const json &networkConfig)
+{
+	json::const_iterator rev(networkConfig.find("revision"));
+	json::const_iterator ct(networkConfig.find("creationTime"));
+	const uint64_t revision = (rev != networkConfig.end()) ? OSUtils::jsonInt(*rev,0ULL) : 0ULL;
+	const uint64_t creationTime = (ct != networkConfig.end()) ? OSUtils::jsonInt(*ct,0ULL) : 0ULL;
+	{
+		std::lock_guard<std::mutex> l(_configTemplates_l);
+		auto t = _configTemplates.find(nwid);
+		if ((t != _configTemplates.end())&&(t->second->revision == revision)&&(t->second->creationTime == creationTime))
+			return t->second;
+	}
+
+	json network(networkConfig); // parsed below with operator[], which needs a mutable copy
+	std::shared_ptr<_NetworkConfigTemplate> nct(new _NetworkConfigTemplate());
+	nct->revision = revision;
+	nct->creationTime = creationTime;
+	nct->isPrivate = OSUtils::jsonBool(network["private"],true);
+	nct->enableBroadcast = OSUtils::jsonBool(network["enableBroadcast"],true);
+	nct->name = OSUtils::jsonString(network["name"],"");
+	nct->mtu = std::max(std::min((unsigned int)OSUtils::jsonInt(network["mtu"],ZT_DEFAULT_MTU),(unsigned int)ZT_MAX_MTU),(unsigned int)ZT_MIN_MTU);
+	nct->multicastLimit = (unsigned int)OSUtils::jsonInt(network["multicastLimit"],32ULL);
+
+	const std::string rtt(OSUtils::jsonString(network["remoteTraceTarget"],""));
+	if (rtt.length() == 10)
+		nct->remoteTraceTarget = Address(Utils::hexStrToU64(rtt.c_str()));
+	nct->remoteTraceLevel = (int)OSUtils::jsonInt(network["remoteTraceLevel"],0ULL);
+
+	json &rules = network["rules"];
+	if (rules.is_array()) {
+		for(unsigned long i=0;i<rules.size();++i) {
+			if (nct->rules.size() >= ZT_MAX_NETWORK_RULES)
+				break;
+			ZT_VirtualNetworkRule rule;
+			memset(&rule,0,sizeof(rule));
+			if (_parseRule(rules[i],rule))
+				nct->rules.push_back(rule);
+		}
+	}
+
+	json &capabilities = network["capabilities"];
+	if (capabilities.is_array()) {
+		for(unsigned long i=0;i<capabilities.size();++i) {
+			json &cap = capabilities[i];
+			if (cap.is_object()) {
+				const uint64_t id = OSUtils::jsonInt(cap["id"],0ULL) & 0xffffffffULL;
+				if (OSUtils::jsonBool(cap["default"],false))
+					nct->defaultCapabilities.push_back(id);
+				std::vector<ZT_VirtualNetworkRule> &capr = nct->capabilities[id];
+				capr.clear();
+				json &caprj = cap["rules"];
+				if (caprj.is_array()) {
+					for(unsigned long j=0;j<caprj.size();++j) {
+						if (capr.size() >= ZT_MAX_CAPABILITY_RULES)
+							break;
+						ZT_VirtualNetworkRule rule;
+						memset(&rule,0,sizeof(rule));
+						if (_parseRule(caprj[j],rule))
+							capr.push_back(rule);
+					}
+				}
+			}
+		}
+	}
+
+	json &tags = network["tags"];
+	if (tags.is_array()) {
+		for(unsigned long i=0;i<tags.size();++i) {
+			json &t = tags[i];
+			if (t.is_object()) {
+				json &dfl = t["default"];
+				if (dfl.is_number())
+					nct->defaultTags.push_back(std::pair< uint32_t,json >((uint32_t)(OSUtils::jsonInt(t["id"],0) & 0xffffffffULL),dfl));
+			}
+		}
+	}
+
+	json &routes = network["routes"];
+	if (routes.is_array()) {
+		for(unsigned long i=0;i<routes.size();++i) {
+			if (nct->routes.size() >= ZT_MAX_NETWORK_ROUTES)
+				break;
+			json &route = routes[i];
+			json &target = route["target"];
+			json &via = route["via"];
+			if (target.is_string()) {
+				const InetAddress t(target.get<std::string>().c_str());
+				InetAddress v;
+				if (via.is_string()) v.fromString(via.get<std::string>().c_str());
+				if ((t.ss_family == AF_INET)||(t.ss_family == AF_INET6)) {
+					ZT_VirtualNetworkRoute r;
+					memset(&r,0,sizeof(r));
+					*(reinterpret_cast<InetAddress *>(&(r.target))) = t;
+					if (v.ss_family == t.ss_family)
+						*(reinterpret_cast<InetAddress *>(&(r.via))) = v;
+					nct->routes.push_back(r);
+				}
+			}
+		}
+	}
+
+	json &ipAssignmentPools = network["ipAssignmentPools"];
+	if (ipAssignmentPools.is_array()) {
+		for(unsigned long p=0;p<ipAssignmentPools.size();++p) {
+			json &pool = ipAssignmentPools[p];
+			if (pool.is_object())
+				nct->ipAssignmentPools.push_back(std::pair<InetAddress,InetAddress>(InetAddress(OSUtils::jsonString(pool["ipRangeStart"],"").c_str()),InetAddress(OSUtils::jsonString(pool["ipRangeEnd"],"").c_str())));
+		}
+	}
+
+	json &v4AssignMode = network["v4AssignMode"];
+	json &v6AssignMode = network["v6AssignMode"];
+	nct->v4AssignZt = ((v4AssignMode.is_object())&&(OSUtils::jsonBool(v4AssignMode["zt"],false)));
+	nct->v6AssignZt = ((v6AssignMode.is_object())&&(OSUtils::jsonBool(v6AssignMode["zt"],false)));
+	nct->v6AssignRfc4193 = ((v6AssignMode.is_object())&&(OSUtils::jsonBool(v6AssignMode["rfc4193"],false)));
+	nct->v6Assign6plane = ((v6AssignMode.is_object())&&(OSUtils::jsonBool(v6AssignMode["6plane"],false)));
+
+	{
+		std::lock_guard<std::mutex> l(_configTemplates_l);
+		_configTemplates[nwid] = nct;
+	}
+	return nct;
+}
+
 void EmbeddedNetworkController::_startThreads()
 {
 	std::lock_guard<std::mutex> l(_threads_l);
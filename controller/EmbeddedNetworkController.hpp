@@ -29,21 +29,25 @@
 #include <thread>
 #include <unordered_map>
 #include <atomic>
+#include <memory>
+#include <mutex>
 
 #include "../node/Constants.hpp"
 #include "../node/NetworkController.hpp"
 #include "../node/Utils.hpp"
 #include "../node/Address.hpp"
 #include "../node/InetAddress.hpp"
+#include "../node/C25519.hpp"
 
 #include "../osdep/OSUtils.hpp"
 #include "../osdep/Thread.hpp"
-#include "../osdep/BlockingQueue.hpp"
+#include "../osdep/FairQueue.hpp"
 
 #include "../ext/json/json.hpp"
 
 #include "DB.hpp"
 #include "FileDB.hpp"
+#include "LogDB.hpp"
 #ifdef ZT_CONTROLLER_USE_RETHINKDB
 #include "RethinkDB.hpp"
 #endif
@@ -62,6 +66,18 @@ public:
 	EmbeddedNetworkController(Node *node,const char *dbPath);
 	virtual ~EmbeddedNetworkController();
 
+	/**
+	 * Set how the file-based DB writes member changes (call before init())
+	 *
+	 * @param writeDelay Maximum ms a changed member waits before it is written, 0 to write it during the request
+	 * @param sync If true, flush files to disk (fsync) as they are written, or each record as it is appended with LogDB
+	 */
+	inline void setFileDbWriteOptions(const unsigned int writeDelay,const bool sync)
+	{
+		_dbWriteDelay = writeDelay;
+		_dbSync = sync;
+	}
+
 	virtual void init(const Identity &signingId,Sender *sender);
 
 	virtual void request(
@@ -101,7 +117,32 @@ public:
 	void onNetworkMemberDeauthorize(const uint64_t networkId,const uint64_t memberId);
 
 private:
+	// Network-wide part of network configs, parsed from a network's JSON once per revision
+	struct _NetworkConfigTemplate
+	{
+		uint64_t revision;
+		uint64_t creationTime; // with revision, tells a recreated network from the old one
+		bool isPrivate;
+		bool enableBroadcast;
+		std::string name;
+		unsigned int mtu;
+		unsigned int multicastLimit;
+		Address remoteTraceTarget;
+		int remoteTraceLevel;
+		std::vector<ZT_VirtualNetworkRule> rules;
+		std::map< uint64_t,std::vector<ZT_VirtualNetworkRule> > capabilities; // by ID
+		std::vector<uint64_t> defaultCapabilities; // IDs given to new members
+		std::vector< std::pair< uint32_t,nlohmann::json > > defaultTags; // ID and default value
+		std::vector<ZT_VirtualNetworkRoute> routes;
+		std::vector< std::pair<InetAddress,InetAddress> > ipAssignmentPools; // start and end of each pool
+		bool v4AssignZt;
+		bool v6AssignZt;
+		bool v6AssignRfc4193;
+		bool v6Assign6plane;
+	};
+
 	void _request(uint64_t nwid,const InetAddress &fromAddr,uint64_t requestPacketId,const Identity &identity,const Dictionary<ZT_NETWORKCONFIG_METADATA_DICT_CAPACITY> &metaData);
+	std::shared_ptr<const _NetworkConfigTemplate> _configTemplate(const uint64_t nwid,const nlohmann::json &networkConfig);
 	void _startThreads();
 
 	struct _RQEntry
@@ -143,15 +184,20 @@ private:
 	const int64_t _startTime;
 	Node *const _node;
 	std::string _path;
+	unsigned int _dbWriteDelay;
+	bool _dbSync;
 	Identity _signingId;
+	C25519::SigningKey _signingKey;
 	std::string _signingIdAddressString;
 	NetworkController::Sender *_sender;
 	std::unique_ptr<DB> _db;
-	BlockingQueue< _RQEntry * > _queue;
+	FairQueue< uint64_t,uint64_t,_RQEntry * > _queue; // per network, deduplicated by member
 	std::vector<std::thread> _threads;
 	std::mutex _threads_l;
 	std::unordered_map< _MemberStatusKey,_MemberStatus,_MemberStatusHash > _memberStatus;
 	std::mutex _memberStatus_l;
+	std::unordered_map< uint64_t,std::shared_ptr<const _NetworkConfigTemplate> > _configTemplates;
+	std::mutex _configTemplates_l;
 };
 
 } // namespace ZeroTier
@@ -18,13 +18,63 @@
 
 #include "FileDB.hpp"
 
+#include <algorithm>
+#include <chrono>
+
+#ifdef __WINDOWS__
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 namespace ZeroTier
 {
 
-FileDB::FileDB(EmbeddedNetworkController *const nc,const Identity &myId,const char *path) :
+namespace {
+
+// Write a file, flushing it to disk before returning if sync is set
+static bool writeFile(const char *path,const std::string &data,const bool sync)
+{
+	if (!sync)
+		return OSUtils::writeFile(path,data);
+	FILE *f = fopen(path,"wb");
+	if (!f)
+		return false;
+	bool ok = ((fwrite(data.data(),1,data.length(),f) == data.length())&&(fflush(f) == 0));
+#ifdef __WINDOWS__
+	ok &= (_commit(_fileno(f)) == 0);
+#else
+	ok &= (fsync(fileno(f)) == 0);
+#endif
+	fclose(f);
+	return ok;
+}
+
+// Make renames within a directory durable (no-op where not needed or supported)
+static void syncDirectory(const char *path)
+{
+#ifndef __WINDOWS__
+	const int fd = ::open(path,O_RDONLY);
+	if (fd >= 0) {
+		fsync(fd);
+		::close(fd);
+	}
+#endif
+}
+
+} // anonymous namespace
+
+FileDB::FileDB(EmbeddedNetworkController *const nc,const Identity &myId,const char *path,const unsigned int writeDelay,const bool sync) :
 	DB(nc,myId,path),
 	_networksPath(_path + ZT_PATH_SEPARATOR_S + "network"),
-	_tracePath(_path + ZT_PATH_SEPARATOR_S + "trace")
+	_tracePath(_path + ZT_PATH_SEPARATOR_S + "trace"),
+	_loadNext(0),
+	_ready(false),
+	_run(true),
+	_writeDelay(writeDelay),
+	_sync(sync),
+	_oldestPendingWrite(0)
 {
 	OSUtils::mkdir(_path.c_str());
 	OSUtils::lockDownFile(_path.c_str(),true);
@@ -32,45 +82,63 @@ FileDB::FileDB(EmbeddedNetworkController *const nc,const Identity &myId,const ch
 	OSUtils::mkdir(_tracePath.c_str());
 
 	std::vector<std::string> networks(OSUtils::listDirectory(_networksPath.c_str(),false));
-	std::string buf;
 	for(auto n=networks.begin();n!=networks.end();++n) {
-		buf.clear();
-		if ((n->length() == 21)&&(OSUtils::readFile((_networksPath + ZT_PATH_SEPARATOR_S + *n).c_str(),buf))) {
-			try {
-				nlohmann::json network(OSUtils::jsonParse(buf));
-				const std::string nwids = network["id"];
-				if (nwids.length() == 16) {
-					nlohmann::json nullJson;
-					_networkChanged(nullJson,network,false);
-					std::string membersPath(_networksPath + ZT_PATH_SEPARATOR_S + nwids + ZT_PATH_SEPARATOR_S "member");
-					std::vector<std::string> members(OSUtils::listDirectory(membersPath.c_str(),false));
-					for(auto m=members.begin();m!=members.end();++m) {
-						buf.clear();
-						if ((m->length() == 15)&&(OSUtils::readFile((membersPath + ZT_PATH_SEPARATOR_S + *m).c_str(),buf))) {
-							try {
-								nlohmann::json member(OSUtils::jsonParse(buf));
-								const std::string addrs = member["id"];
-								if (addrs.length() == 10) {
-									nlohmann::json nullJson2;
-									_memberChanged(nullJson2,member,false);
-								}
-							} catch ( ... ) {}
-						}
-					}
-				}
-			} catch ( ... ) {}
+		if ((n->length() == 21)&&(n->substr(16) == ".json")) {
+			const uint64_t nwid = Utils::hexStrToU64(n->substr(0,16).c_str());
+			if ((nwid)&&(_loading.find(nwid) == _loading.end())) {
+				_loading[nwid];
+				_loadOrder.push_back(nwid);
+			}
+		}
+	}
+
+	if (_loadOrder.empty()) {
+		_ready = true;
+	} else {
+		const unsigned int threads = std::max(1U,std::min(std::thread::hardware_concurrency(),(unsigned int)ZT_CONTROLLER_FILEDB_LOAD_THREADS_MAX));
+		for(unsigned int t=0;t<threads;++t) {
+			_loaders.push_back(std::thread([this]() {
+				std::unique_lock<std::mutex> l(_loading_l);
+				while ((_run)&&(_loadSome(l,0))) {}
+			}));
 		}
 	}
+
+	if (_writeDelay)
+		_writer = std::thread([this]() { _writerMain(); });
 }
 
-FileDB::~FileDB() {}
+FileDB::~FileDB()
+{
+	{
+		std::lock_guard<std::mutex> l(_writes_l);
+		_run = false;
+	}
+	_writesWake.notify_all();
+	for(auto t=_loaders.begin();t!=_loaders.end();++t)
+		t->join();
+	if (_writer.joinable())
+		_writer.join();
+	_writeMembers(_pendingWrites);
+}
 
-bool FileDB::waitForReady() { return true; }
-bool FileDB::isReady() { return true; }
+bool FileDB::waitForReady()
+{
+	if (_ready)
+		return true;
+	std::unique_lock<std::mutex> l(_loading_l);
+	while (!_loading.empty()) {
+		if (!_loadSome(l,0))
+			_loadDone.wait(l);
+	}
+	return true;
+}
+
+bool FileDB::isReady() { return _ready; }
 
 void FileDB::save(nlohmann::json *orig,nlohmann::json &record)
 {
-	char p1[4096],p2[4096],pb[4096];
+	char p1[4096],p2[4096];
 	try {
 		if (orig) {
 			if (*orig != record) {
@@ -90,9 +158,11 @@ void FileDB::save(nlohmann::json *orig,nlohmann::json &record)
 				if ((!old.is_object())||(old != record)) {
 					OSUtils::ztsnprintf(p1,sizeof(p1),"%s" ZT_PATH_SEPARATOR_S "%.16llx.json.new",_networksPath.c_str(),nwid);
 					OSUtils::ztsnprintf(p2,sizeof(p2),"%s" ZT_PATH_SEPARATOR_S "%.16llx.json",_networksPath.c_str(),nwid);
-					if (!OSUtils::writeFile(p1,OSUtils::jsonDump(record,-1)))
+					if (!writeFile(p1,OSUtils::jsonDump(record,-1),_sync))
 						fprintf(stderr,"WARNING: controller unable to write to path: %s" ZT_EOL_S,p1);
 					OSUtils::rename(p1,p2);
+					if (_sync)
+						syncDirectory(_networksPath.c_str());
 
 					_networkChanged(old,record,true);
 				}
@@ -105,19 +175,23 @@ void FileDB::save(nlohmann::json *orig,nlohmann::json &record)
 				get(nwid,network,id,old);
 
 				if ((!old.is_object())||(old != record)) {
-					OSUtils::ztsnprintf(pb,sizeof(pb),"%s" ZT_PATH_SEPARATOR_S "%.16llx" ZT_PATH_SEPARATOR_S "member",_networksPath.c_str(),(unsigned long long)nwid);
-					OSUtils::ztsnprintf(p1,sizeof(p1),"%s" ZT_PATH_SEPARATOR_S "%.10llx.json.new",pb,(unsigned long long)id);
-					if (!OSUtils::writeFile(p1,OSUtils::jsonDump(record,-1))) {
-						OSUtils::ztsnprintf(p2,sizeof(p2),"%s" ZT_PATH_SEPARATOR_S "%.16llx",_networksPath.c_str(),(unsigned long long)nwid);
-						OSUtils::mkdir(p2);
-						OSUtils::mkdir(pb);
-						if (!OSUtils::writeFile(p1,OSUtils::jsonDump(record,-1)))
-							fprintf(stderr,"WARNING: controller unable to write to path: %s" ZT_EOL_S,p1);
-					}
-					OSUtils::ztsnprintf(p2,sizeof(p2),"%s" ZT_PATH_SEPARATOR_S "%.10llx.json",pb,(unsigned long long)id);
-					OSUtils::rename(p1,p2);
-
+					// The file is written from memory later, so the latest of any number of saves gets written once
 					_memberChanged(old,record,true);
+					std::set< std::pair<uint64_t,uint64_t> > one;
+					{
+						std::lock_guard<std::mutex> l(_writes_l);
+						if (_writeDelay) {
+							if (_pendingWrites.empty())
+								_oldestPendingWrite = OSUtils::now();
+							_pendingWrites.insert(std::pair<uint64_t,uint64_t>(nwid,id));
+							if (_pendingWrites.size() >= ZT_CONTROLLER_FILEDB_WRITE_BATCH_MAX)
+								_writesWake.notify_one();
+						} else {
+							one.insert(std::pair<uint64_t,uint64_t>(nwid,id));
+						}
+					}
+					if (!one.empty())
+						_writeMembers(one);
 				}
 			}
 		} else if (objtype == "trace") {
@@ -149,4 +223,184 @@ void FileDB::nodeIsOnline(const uint64_t networkId,const uint64_t memberId,const
 	// Nothing to do here right now in the filesystem store mode since we can just get this from the peer list
 }
 
+void FileDB::_waitForNetwork(const uint64_t networkId)
+{
+	if (_ready)
+		return;
+	std::unique_lock<std::mutex> l(_loading_l);
+	while (_loading.find(networkId) != _loading.end()) {
+		if (!_loadSome(l,networkId))
+			_loadDone.wait(l);
+	}
+}
+
+// Do one unit of loading work: read a network and list its members, or load
+// a batch of members. Only networkId is worked on if it is nonzero. Networks
+// already started are finished before new ones are started. Returns false if
+// there was nothing to do. The lock is released while files are read.
+bool FileDB::_loadSome(std::unique_lock<std::mutex> &l,const uint64_t networkId)
+{
+	uint64_t nwid = 0;
+	_LoadingNetwork *ln = (_LoadingNetwork *)0;
+	if (networkId) {
+		auto i = _loading.find(networkId);
+		if ((i == _loading.end())||((i->second.started)&&(i->second.nextMember >= i->second.members.size())))
+			return false;
+		nwid = networkId;
+		ln = &(i->second);
+	} else {
+		while (!_loadActive.empty()) {
+			auto i = _loading.find(_loadActive.front());
+			if ((i != _loading.end())&&(i->second.nextMember < i->second.members.size())) {
+				nwid = i->first;
+				ln = &(i->second);
+				break;
+			}
+			_loadActive.pop_front();
+		}
+		while ((!ln)&&(_loadNext < _loadOrder.size())) {
+			auto i = _loading.find(_loadOrder[_loadNext++]);
+			if ((i != _loading.end())&&(!i->second.started)) {
+				nwid = i->first;
+				ln = &(i->second);
+			}
+		}
+		if (!ln)
+			return false;
+	}
+
+	// Entries are not erased while busy, so ln stays valid while unlocked
+	++ln->busy;
+	if (!ln->started) {
+		ln->started = true;
+		std::string membersPath;
+		std::vector<std::string> members;
+		l.unlock();
+		_loadNetwork(nwid,membersPath,members);
+		l.lock();
+		ln->membersPath.swap(membersPath);
+		ln->members.swap(members);
+		if (!ln->members.empty()) {
+			_loadActive.push_back(nwid);
+			// Callers of _waitForNetwork() waiting on the listing can now load members themselves
+			_loadDone.notify_all();
+		}
+	} else {
+		const std::size_t start = ln->nextMember;
+		const std::size_t count = std::min((std::size_t)ZT_CONTROLLER_FILEDB_LOAD_BATCH,ln->members.size() - start);
+		ln->nextMember += count;
+		l.unlock();
+		_loadMembers(ln->membersPath,ln->members.data() + start,count);
+		l.lock();
+	}
+
+	if ((--ln->busy == 0)&&(ln->nextMember >= ln->members.size())) {
+		_loading.erase(nwid);
+		if (_loading.empty())
+			_ready = true;
+		_loadDone.notify_all();
+	}
+	return true;
+}
+
+void FileDB::_loadNetwork(const uint64_t networkId,std::string &membersPath,std::vector<std::string> &members)
+{
+	char p[4096];
+	std::string buf;
+	OSUtils::ztsnprintf(p,sizeof(p),"%s" ZT_PATH_SEPARATOR_S "%.16llx.json",_networksPath.c_str(),(unsigned long long)networkId);
+	if (OSUtils::readFile(p,buf)) {
+		try {
+			nlohmann::json network(OSUtils::jsonParse(buf));
+			const std::string nwids = network["id"];
+			if (nwids.length() == 16) {
+				nlohmann::json nullJson;
+				_networkChanged(nullJson,network,false);
+				membersPath = _networksPath + ZT_PATH_SEPARATOR_S + nwids + ZT_PATH_SEPARATOR_S "member";
+				std::vector<std::string> ls(OSUtils::listDirectory(membersPath.c_str(),false));
+				members.reserve(ls.size());
+				for(auto m=ls.begin();m!=ls.end();++m) {
+					if (m->length() == 15)
+						members.push_back(*m);
+				}
+			}
+		} catch ( ... ) {}
+	}
+}
+
+void FileDB::_loadMembers(const std::string &membersPath,const std::string *members,const std::size_t count)
+{
+	std::string buf;
+	for(std::size_t i=0;i<count;++i) {
+		buf.clear();
+		if (OSUtils::readFile((membersPath + ZT_PATH_SEPARATOR_S + members[i]).c_str(),buf)) {
+			try {
+				nlohmann::json member(OSUtils::jsonParse(buf));
+				const std::string addrs = member["id"];
+				if (addrs.length() == 10) {
+					nlohmann::json nullJson;
+					_memberChanged(nullJson,member,false);
+				}
+			} catch ( ... ) {}
+		}
+	}
+}
+
+// Write the current in-memory state of members to their files. New files are
+// all written (and synced if enabled) before any of them replaces an old one.
+void FileDB::_writeMembers(const std::set< std::pair<uint64_t,uint64_t> > &members)
+{
+	char pb[4096],p1[4096],p2[4096];
+	std::vector< std::pair<std::string,std::string> > renames;
+	std::vector<std::string> dirs;
+	renames.reserve(members.size());
+	for(auto m=members.begin();m!=members.end();++m) {
+		nlohmann::json network,member;
+		if (!get(m->first,network,m->second,member))
+			continue; // erased since it was saved
+		const std::string data(OSUtils::jsonDump(member,-1));
+		OSUtils::ztsnprintf(pb,sizeof(pb),"%s" ZT_PATH_SEPARATOR_S "%.16llx" ZT_PATH_SEPARATOR_S "member",_networksPath.c_str(),(unsigned long long)m->first);
+		OSUtils::ztsnprintf(p1,sizeof(p1),"%s" ZT_PATH_SEPARATOR_S "%.10llx.json.new",pb,(unsigned long long)m->second);
+		if (!writeFile(p1,data,_sync)) {
+			OSUtils::ztsnprintf(p2,sizeof(p2),"%s" ZT_PATH_SEPARATOR_S "%.16llx",_networksPath.c_str(),(unsigned long long)m->first);
+			OSUtils::mkdir(p2);
+			OSUtils::mkdir(pb);
+			if (!writeFile(p1,data,_sync)) {
+				fprintf(stderr,"WARNING: controller unable to write to path: %s" ZT_EOL_S,p1);
+				continue;
+			}
+		}
+		OSUtils::ztsnprintf(p2,sizeof(p2),"%s" ZT_PATH_SEPARATOR_S "%.10llx.json",pb,(unsigned long long)m->second);
+		renames.push_back(std::pair<std::string,std::string>(p1,p2));
+		if ((dirs.empty())||(dirs.back() != pb))
+			dirs.push_back(pb);
+	}
+	for(auto r=renames.begin();r!=renames.end();++r)
+		OSUtils::rename(r->first.c_str(),r->second.c_str());
+	if (_sync) {
+		for(auto d=dirs.begin();d!=dirs.end();++d)
+			syncDirectory(d->c_str());
+	}
+}
+
+void FileDB::_writerMain()
+{
+	std::unique_lock<std::mutex> l(_writes_l);
+	while (_run) {
+		if (_pendingWrites.empty()) {
+			_writesWake.wait(l);
+			continue;
+		}
+		const int64_t wait = (_oldestPendingWrite + (int64_t)_writeDelay) - OSUtils::now();
+		if ((wait > 0)&&(_pendingWrites.size() < ZT_CONTROLLER_FILEDB_WRITE_BATCH_MAX)) {
+			_writesWake.wait_for(l,std::chrono::milliseconds(wait));
+			continue;
+		}
+		std::set< std::pair<uint64_t,uint64_t> > batch;
+		batch.swap(_pendingWrites);
+		l.unlock();
+		_writeMembers(batch);
+		l.lock();
+	}
+}
+
 } // namespace ZeroTier
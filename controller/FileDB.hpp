@@ -21,13 +21,55 @@
 
 #include "DB.hpp"
 
+#include <condition_variable>
+#include <deque>
+#include <set>
+
+/**
+ * Maximum number of threads used to load the DB at startup
+ */
+#define ZT_CONTROLLER_FILEDB_LOAD_THREADS_MAX 16
+
+/**
+ * Number of member files loaded per unit of work
+ */
+#define ZT_CONTROLLER_FILEDB_LOAD_BATCH 256
+
+/**
+ * Default maximum time in ms a changed member is held in memory before its file is written
+ */
+#define ZT_CONTROLLER_FILEDB_DEFAULT_WRITE_DELAY 1000
+
+/**
+ * Write pending members early once this many are waiting
+ */
+#define ZT_CONTROLLER_FILEDB_WRITE_BATCH_MAX 4096
+
 namespace ZeroTier
 {
 
+/**
+ * Controller DB stored as one JSON file per network and member
+ *
+ * Files are loaded in the background by a pool of threads. A network can
+ * be used as soon as it and all its members are in, and a request for a
+ * network that is still waiting is loaded right away by the thread asking.
+ *
+ * Member changes take effect in memory at once but their files are written
+ * behind by a background thread, so many saves of one member in a short
+ * time become one write. Network changes are written right away.
+ */
 class FileDB : public DB
 {
 public:
-	FileDB(EmbeddedNetworkController *const nc,const Identity &myId,const char *path);
+	/**
+	 * @param nc Controller
+	 * @param myId Controller identity
+	 * @param path DB directory
+	 * @param writeDelay Maximum ms a changed member waits before its file is written, 0 to write it during save()
+	 * @param sync If true, flush written files to disk (fsync) before they replace old ones
+	 */
+	FileDB(EmbeddedNetworkController *const nc,const Identity &myId,const char *path,const unsigned int writeDelay = ZT_CONTROLLER_FILEDB_DEFAULT_WRITE_DELAY,const bool sync = false);
 	virtual ~FileDB();
 
 	virtual bool waitForReady();
@@ -38,8 +80,43 @@ public:
 	virtual void nodeIsOnline(const uint64_t networkId,const uint64_t memberId,const InetAddress &physicalAddress);
 
 protected:
+	struct _LoadingNetwork
+	{
+		_LoadingNetwork() : started(false),nextMember(0),busy(0) {}
+		bool started;
+		std::string membersPath;
+		std::vector<std::string> members; // member file names, set once started
+		std::size_t nextMember;
+		unsigned int busy; // threads listing this network or loading a batch of its members
+	};
+
+	virtual void _waitForNetwork(const uint64_t networkId);
+	bool _loadSome(std::unique_lock<std::mutex> &l,const uint64_t networkId);
+	void _loadNetwork(const uint64_t networkId,std::string &membersPath,std::vector<std::string> &members);
+	void _loadMembers(const std::string &membersPath,const std::string *members,const std::size_t count);
+	void _writeMembers(const std::set< std::pair<uint64_t,uint64_t> > &members);
+	void _writerMain();
+
 	std::string _networksPath;
 	std::string _tracePath;
+
+	std::unordered_map< uint64_t,_LoadingNetwork > _loading;
+	std::vector<uint64_t> _loadOrder;
+	std::size_t _loadNext;
+	std::deque<uint64_t> _loadActive; // started networks that may still have members to load
+	std::condition_variable _loadDone;
+	std::mutex _loading_l;
+	std::vector<std::thread> _loaders;
+	std::atomic<bool> _ready;
+	std::atomic<bool> _run;
+
+	const unsigned int _writeDelay;
+	const bool _sync;
+	std::set< std::pair<uint64_t,uint64_t> > _pendingWrites; // network ID, member ID
+	int64_t _oldestPendingWrite;
+	std::condition_variable _writesWake;
+	std::mutex _writes_l;
+	std::thread _writer;
 };
 
 } // namespace ZeroTier
@@ -0,0 +1,155 @@
+/*
+ * ZeroTier One - Network Virtualization Everywhere
+ * Copyright (C) 2011-2018  ZeroTier, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ZT_CONTROLLER_IPINDEX_HPP
+#define ZT_CONTROLLER_IPINDEX_HPP
+
+#include "../node/Constants.hpp"
+#include "../node/InetAddress.hpp"
+#include "../node/Utils.hpp"
+
+#include <map>
+#include <unordered_set>
+
+namespace ZeroTier
+{
+
+/**
+ * IP addresses assigned to the members of one network
+ *
+ * IPv4 addresses are kept as merged ranges of consecutive addresses, so
+ * the first free address at or after any point is found with one lookup
+ * no matter how full a pool is. IPv6 assignments are sparse (random or
+ * derived from the member address) and are kept in a hash set.
+ */
+class IpIndex
+{
+public:
+	IpIndex() {}
+
+	inline void add(const InetAddress &ip)
+	{
+		if (ip.ss_family == AF_INET) {
+			const uint32_t a = _v4(ip);
+			std::map<uint32_t,uint32_t>::iterator next(_ranges.upper_bound(a));
+			if (next != _ranges.begin()) {
+				std::map<uint32_t,uint32_t>::iterator prev(next);
+				--prev;
+				if (prev->second >= a)
+					return;
+				if ((prev->second + 1) == a) {
+					prev->second = a;
+					if ((next != _ranges.end())&&(next->first == (a + 1))) {
+						prev->second = next->second;
+						_ranges.erase(next);
+					}
+					return;
+				}
+			}
+			if ((next != _ranges.end())&&(next->first == (a + 1))) {
+				const uint32_t last = next->second;
+				_ranges.erase(next);
+				_ranges[a] = last;
+			} else {
+				_ranges[a] = a;
+			}
+		} else if (ip.ss_family == AF_INET6) {
+			InetAddress tmp(ip);
+			tmp.setPort(0);
+			_v6.insert(tmp);
+		}
+	}
+
+	inline void remove(const InetAddress &ip)
+	{
+		if (ip.ss_family == AF_INET) {
+			const uint32_t a = _v4(ip);
+			std::map<uint32_t,uint32_t>::iterator r(_ranges.upper_bound(a));
+			if (r == _ranges.begin())
+				return;
+			--r;
+			if (r->second < a)
+				return;
+			const uint32_t first = r->first;
+			const uint32_t last = r->second;
+			_ranges.erase(r);
+			if (first < a)
+				_ranges[first] = a - 1;
+			if (a < last)
+				_ranges[a + 1] = last;
+		} else if (ip.ss_family == AF_INET6) {
+			InetAddress tmp(ip);
+			tmp.setPort(0);
+			_v6.erase(tmp);
+		}
+	}
+
+	inline bool contains(const InetAddress &ip) const
+	{
+		if (ip.ss_family == AF_INET) {
+			const uint32_t a = _v4(ip);
+			std::map<uint32_t,uint32_t>::const_iterator r(_ranges.upper_bound(a));
+			if (r == _ranges.begin())
+				return false;
+			--r;
+			return (r->second >= a);
+		} else if (ip.ss_family == AF_INET6) {
+			InetAddress tmp(ip);
+			tmp.setPort(0);
+			return (_v6.find(tmp) != _v6.end());
+		}
+		return false;
+	}
+
+	/**
+	 * Find the first free IPv4 address in a range
+	 *
+	 * @param start First address (host byte order)
+	 * @param end Last address (host byte order)
+	 * @param ip Set to free address (host byte order) if found
+	 * @return True if there is a free address between start and end inclusive
+	 */
+	inline bool nextFreeIpv4(const uint32_t start,const uint32_t end,uint32_t &ip) const
+	{
+		if (start > end)
+			return false;
+		std::map<uint32_t,uint32_t>::const_iterator r(_ranges.upper_bound(start));
+		if (r != _ranges.begin()) {
+			--r;
+			if (r->second >= start) {
+				// Ranges are merged, so the address after this one is free
+				if (r->second >= end)
+					return false;
+				ip = r->second + 1;
+				return true;
+			}
+		}
+		ip = start;
+		return true;
+	}
+
+private:
+	static inline uint32_t _v4(const InetAddress &ip) { return Utils::ntoh((uint32_t)(reinterpret_cast<const struct sockaddr_in *>(&ip)->sin_addr.s_addr)); }
+
+	std::map<uint32_t,uint32_t> _ranges; // first -> last, never overlapping or adjacent
+	std::unordered_set<InetAddress,InetAddress::Hasher> _v6;
+};
+
+} // namespace ZeroTier
+
+#endif
@@ -0,0 +1,590 @@
+/*
+ * ZeroTier One - Network Virtualization Everywhere
+ * Copyright (C) 2011-2018  ZeroTier, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "LogDB.hpp"
+
+#include "../node/SHA512.hpp"
+
+#include <chrono>
+#include <algorithm>
+
+#ifdef __WINDOWS__
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
+// Files start with this followed by a 64-bit generation (see _compact())
+#define ZT_LOGDB_MAGIC "ZTLOGDB1"
+#define ZT_LOGDB_HEADER_LEN 16
+
+// Record: payload length[4], type[1], network ID[8], member ID[8], payload, checksum[8]
+#define ZT_LOGDB_RECORD_OVERHEAD 29
+
+#define ZT_LOGDB_RECORD_NETWORK 1
+#define ZT_LOGDB_RECORD_MEMBER 2
+#define ZT_LOGDB_RECORD_ERASE_NETWORK 3
+#define ZT_LOGDB_RECORD_ERASE_MEMBER 4
+
+namespace ZeroTier
+{
+
+namespace {
+
+// Read-only view of an entire file, memory-mapped where available
+class MappedFile
+{
+public:
+	MappedFile(const char *path) :
+		_data((const uint8_t *)0),
+		_len(0)
+	{
+#ifdef __WINDOWS__
+		if (OSUtils::readFile(path,_buf)) {
+			_data = (const uint8_t *)_buf.data();
+			_len = (uint64_t)_buf.length();
+		}
+#else
+		const int fd = ::open(path,O_RDONLY);
+		if (fd >= 0) {
+			struct stat st;
+			if ((fstat(fd,&st) == 0)&&(st.st_size > 0)) {
+				void *const m = mmap((void *)0,(size_t)st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+				if (m != MAP_FAILED) {
+					madvise(m,(size_t)st.st_size,MADV_SEQUENTIAL);
+					_data = (const uint8_t *)m;
+					_len = (uint64_t)st.st_size;
+				}
+			}
+			::close(fd);
+		}
+#endif
+	}
+
+	~MappedFile()
+	{
+#ifndef __WINDOWS__
+		if (_data)
+			munmap((void *)_data,(size_t)_len);
+#endif
+	}
+
+	inline const uint8_t *data() const { return _data; }
+	inline uint64_t length() const { return _len; }
+
+private:
+	MappedFile(const MappedFile &) {}
+	const MappedFile &operator=(const MappedFile &) { return *this; }
+
+	const uint8_t *_data;
+	uint64_t _len;
+#ifdef __WINDOWS__
+	std::string _buf;
+#endif
+};
+
+// Objects as of the end of replay, applied to the DB once loading is done
+struct LoadState
+{
+	std::unordered_map< uint64_t,nlohmann::json > networks;
+	std::unordered_map< uint64_t,std::unordered_map< uint64_t,nlohmann::json > > members;
+};
+
+static inline uint64_t getU64(const uint8_t *p)
+{
+	uint64_t i = 0;
+	for(unsigned int k=0;k<8;++k)
+		i = (i << 8) | (uint64_t)p[k];
+	return i;
+}
+
+static inline void appendU64(std::string &buf,const uint64_t i)
+{
+	for(int k=56;k>=0;k-=8)
+		buf.push_back((char)((i >> k) & 0xff));
+}
+
+static inline void appendHeader(std::string &buf,const uint64_t generation)
+{
+	buf.append(ZT_LOGDB_MAGIC,8);
+	appendU64(buf,generation);
+}
+
+static void appendRecord(std::string &buf,const uint8_t type,const uint64_t networkId,const uint64_t memberId,const nlohmann::json *obj)
+{
+	const std::size_t start = buf.length();
+	buf.append(4,(char)0);
+	buf.push_back((char)type);
+	appendU64(buf,networkId);
+	appendU64(buf,memberId);
+	if (obj)
+		nlohmann::json::to_msgpack(*obj,buf);
+	const uint32_t plen = (uint32_t)(buf.length() - start - (ZT_LOGDB_RECORD_OVERHEAD - 8));
+	buf[start] = (char)((plen >> 24) & 0xff);
+	buf[start + 1] = (char)((plen >> 16) & 0xff);
+	buf[start + 2] = (char)((plen >> 8) & 0xff);
+	buf[start + 3] = (char)(plen & 0xff);
+	uint8_t h[ZT_SHA512_DIGEST_LEN];
+	SHA512::hash(h,buf.data() + start + 4,(unsigned int)(buf.length() - (start + 4)));
+	buf.append((const char *)h,8);
+}
+
+// True if a whole record with a good checksum starts at p; plen is set to its payload length
+static inline bool recordAt(const uint8_t *const data,const uint64_t len,const uint64_t p,uint64_t &plen)
+{
+	if ((p + ZT_LOGDB_RECORD_OVERHEAD) > len)
+		return false;
+	plen = ((uint64_t)data[p] << 24) | ((uint64_t)data[p + 1] << 16) | ((uint64_t)data[p + 2] << 8) | (uint64_t)data[p + 3];
+	if ((p + ZT_LOGDB_RECORD_OVERHEAD + plen) > len)
+		return false;
+	uint8_t h[ZT_SHA512_DIGEST_LEN];
+	SHA512::hash(h,data + p + 4,(unsigned int)(plen + 17));
+	return (memcmp(h,data + p + 21 + plen,8) == 0);
+}
+
+static inline bool generationOf(const MappedFile &f,uint64_t &generation)
+{
+	if ((f.length() < ZT_LOGDB_HEADER_LEN)||(memcmp(f.data(),ZT_LOGDB_MAGIC,8) != 0))
+		return false;
+	generation = getU64(f.data() + 8);
+	return true;
+}
+
+// Returns the number of bytes that could not be read: damaged records, which are
+// skipped, and a record torn by a crash at the end
+static uint64_t replay(const MappedFile &f,LoadState &st)
+{
+	uint64_t generation;
+	if (!generationOf(f,generation))
+		return f.length();
+	const uint8_t *const data = f.data();
+	const uint64_t len = f.length();
+	uint64_t p = ZT_LOGDB_HEADER_LEN;
+	uint64_t damaged = 0;
+	while (p < len) {
+		uint64_t plen = 0;
+		if (!recordAt(data,len,p,plen)) {
+			// Resume at the next intact record: right after this one if only its
+			// contents are bad, otherwise wherever one is found
+			uint64_t next = p + ZT_LOGDB_RECORD_OVERHEAD + plen;
+			uint64_t nplen;
+			if ((next >= len)||(!recordAt(data,len,next,nplen))) {
+				next = p + 1;
+				while ((next < len)&&(!recordAt(data,len,next,nplen)))
+					++next;
+			}
+			damaged += next - p;
+			p = next;
+			continue;
+		}
+
+		const uint64_t networkId = getU64(data + p + 5);
+		const uint64_t memberId = getU64(data + p + 13);
+		try {
+			switch(data[p + 4]) {
+				case ZT_LOGDB_RECORD_NETWORK:
+					st.networks[networkId] = nlohmann::json::from_msgpack(data + p + 21,(std::size_t)plen);
+					break;
+				case ZT_LOGDB_RECORD_MEMBER:
+					st.members[networkId][memberId] = nlohmann::json::from_msgpack(data + p + 21,(std::size_t)plen);
+					break;
+				case ZT_LOGDB_RECORD_ERASE_NETWORK:
+					st.networks.erase(networkId);
+					st.members.erase(networkId);
+					break;
+				case ZT_LOGDB_RECORD_ERASE_MEMBER: {
+					auto m = st.members.find(networkId);
+					if (m != st.members.end())
+						m->second.erase(memberId);
+				}	break;
+			}
+		} catch ( ... ) {} // skip records that passed the checksum but will not parse
+
+		p += ZT_LOGDB_RECORD_OVERHEAD + plen;
+	}
+	return damaged;
+}
+
+static inline bool writeAll(FILE *f,const std::string &buf)
+{
+	return ((buf.length() == 0)||(fwrite(buf.data(),1,buf.length(),f) == buf.length()));
+}
+
+// Flush a file's buffered data and then the file itself to disk
+static inline bool syncFile(FILE *f)
+{
+	if (fflush(f) != 0)
+		return false;
+#ifdef __WINDOWS__
+	return (_commit(_fileno(f)) == 0);
+#else
+	return (fsync(fileno(f)) == 0);
+#endif
+}
+
+// Make renames within a directory durable (no-op where not needed or supported)
+static void syncDirectory(const char *path)
+{
+#ifndef __WINDOWS__
+	const int fd = ::open(path,O_RDONLY);
+	if (fd >= 0) {
+		fsync(fd);
+		::close(fd);
+	}
+#endif
+}
+
+// Write every network and member in a DB to a new snapshot file, on disk once this returns true
+static bool writeSnapshot(DB &db,const std::string &dir,const uint64_t generation,uint64_t &bytes)
+{
+	const std::string path(dir + ZT_PATH_SEPARATOR_S + "controller.snapshot");
+	const std::string tmpPath(path + ".new");
+	FILE *f = fopen(tmpPath.c_str(),"wb");
+	if (!f)
+		return false;
+
+	bool ok = true;
+	std::string buf;
+	appendHeader(buf,generation);
+	bytes = 0;
+
+	std::vector<uint64_t> networkIds;
+	db.networks(networkIds);
+	for(auto nwid=networkIds.begin();nwid!=networkIds.end();++nwid) {
+		nlohmann::json network;
+		std::vector<nlohmann::json> members;
+		if ((db.get(*nwid,network,members))&&(network.is_object())) {
+			appendRecord(buf,ZT_LOGDB_RECORD_NETWORK,*nwid,0,&network);
+			for(auto m=members.begin();m!=members.end();++m)
+				appendRecord(buf,ZT_LOGDB_RECORD_MEMBER,*nwid,OSUtils::jsonIntHex((*m)["id"],0ULL),&(*m));
+		}
+		if (buf.length() >= 1048576) {
+			ok &= writeAll(f,buf);
+			bytes += buf.length();
+			buf.clear();
+		}
+	}
+	ok &= writeAll(f,buf);
+	bytes += buf.length();
+	ok &= syncFile(f);
+	fclose(f);
+
+	if ((!ok)||(!OSUtils::rename(tmpPath.c_str(),path.c_str()))) {
+		OSUtils::rm(tmpPath.c_str());
+		return false;
+	}
+	syncDirectory(dir.c_str());
+	return true;
+}
+
+} // anonymous namespace
+
+LogDB::LogDB(EmbeddedNetworkController *const nc,const Identity &myId,const char *path,const bool sync) :
+	DB(nc,myId,path),
+	_snapshotPath(_path + ZT_PATH_SEPARATOR_S + "controller.snapshot"),
+	_logPath(_path + ZT_PATH_SEPARATOR_S + "controller.log"),
+	_tracePath(_path + ZT_PATH_SEPARATOR_S + "trace"),
+	_log((FILE *)0),
+	_logGeneration(0),
+	_logBytes(0),
+	_snapshotBytes(0),
+	_sync(sync),
+	_run(true)
+{
+	OSUtils::mkdir(_path.c_str());
+	OSUtils::lockDownFile(_path.c_str(),true);
+	OSUtils::mkdir(_tracePath.c_str());
+
+	// Snapshot first, then any log left over from an unfinished compaction, then the
+	// current log. Logs older than the snapshot's generation are already in it.
+	LoadState st;
+	uint64_t snapshotGeneration = 0;
+	{
+		MappedFile snapshot(_snapshotPath.c_str());
+		if (snapshot.length() > 0) {
+			generationOf(snapshot,snapshotGeneration);
+			if (replay(snapshot,st) != 0)
+				fprintf(stderr,"WARNING: controller snapshot %s is damaged, not all records could be read" ZT_EOL_S,_snapshotPath.c_str());
+			_snapshotBytes = snapshot.length();
+		}
+	}
+
+	const std::string oldLogPath(_logPath + ".old");
+	const bool haveOldLog = OSUtils::fileExists(oldLogPath.c_str(),false);
+	uint64_t nextGeneration = std::max(snapshotGeneration,(uint64_t)1);
+	if (haveOldLog) {
+		MappedFile oldLog(oldLogPath.c_str());
+		uint64_t generation = 0;
+		if ((generationOf(oldLog,generation))&&(generation >= snapshotGeneration)) {
+			replay(oldLog,st);
+			nextGeneration = std::max(nextGeneration,generation + 1);
+		}
+	}
+
+	// A damaged log is kept as it is, with a copy set aside, and compacted below so
+	// that it is replaced by a new log once everything readable is in a snapshot.
+	// Appending to it could hide new records behind a record torn by a crash.
+	uint64_t logGeneration = 0;
+	bool haveLog = false,logDamaged = false;
+	{
+		MappedFile log(_logPath.c_str());
+		const bool haveHeader = generationOf(log,logGeneration);
+		uint64_t damaged = (haveHeader) ? 0 : log.length();
+		if ((haveHeader)&&(logGeneration >= snapshotGeneration)) {
+			haveLog = true;
+			damaged = replay(log,st);
+			logDamaged = (damaged != 0);
+			_logBytes = log.length();
+		}
+		if (damaged) {
+			const std::string damagedPath(_logPath + ".damaged");
+			fprintf(stderr,"WARNING: controller log %s has %llu bytes of damaged or incomplete records, copy saved as %s" ZT_EOL_S,_logPath.c_str(),(unsigned long long)damaged,damagedPath.c_str());
+			OSUtils::writeFile(damagedPath.c_str(),log.data(),(unsigned int)log.length());
+		}
+	}
+
+	for(auto n=st.networks.begin();n!=st.networks.end();++n) {
+		nlohmann::json nullJson;
+		_networkChanged(nullJson,n->second,false);
+		auto ms = st.members.find(n->first);
+		if (ms != st.members.end()) {
+			for(auto m=ms->second.begin();m!=ms->second.end();++m) {
+				nlohmann::json nullJson2;
+				_memberChanged(nullJson2,m->second,false);
+			}
+		}
+	}
+
+	if (haveLog) {
+		_log = fopen(_logPath.c_str(),"ab");
+		_logGeneration = logGeneration;
+	} else {
+		_log = fopen(_logPath.c_str(),"wb");
+		_logGeneration = nextGeneration;
+		std::string hdr;
+		appendHeader(hdr,_logGeneration);
+		if ((!_log)||(!writeAll(_log,hdr))||(fflush(_log) != 0))
+			fprintf(stderr,"WARNING: controller unable to write to path: %s" ZT_EOL_S,_logPath.c_str());
+		_logBytes = hdr.length();
+	}
+	if (!_log)
+		fprintf(stderr,"WARNING: controller unable to write to path: %s" ZT_EOL_S,_logPath.c_str());
+
+	// The first compaction finishes an unfinished one; a damaged log takes one more to rotate out
+	if (haveOldLog)
+		_compact();
+	if ((logDamaged)&&(!_compact()))
+		fprintf(stderr,"WARNING: controller unable to replace damaged log %s, changes made now may be hidden by it after a restart" ZT_EOL_S,_logPath.c_str());
+
+	_compactor = std::thread([this]() { _compactorMain(); });
+}
+
+LogDB::~LogDB()
+{
+	_run = false;
+	_compactor.join();
+	std::lock_guard<std::mutex> l(_log_l);
+	if (_log)
+		fclose(_log);
+}
+
+bool LogDB::waitForReady() { return true; }
+bool LogDB::isReady() { return true; }
+
+void LogDB::save(nlohmann::json *orig,nlohmann::json &record)
+{
+	try {
+		if (orig) {
+			if (*orig != record) {
+				record["revision"] = OSUtils::jsonInt(record["revision"],0ULL) + 1;
+			}
+		} else {
+			record["revision"] = 1;
+		}
+
+		const std::string objtype = record["objtype"];
+		if (objtype == "network") {
+			const uint64_t nwid = OSUtils::jsonIntHex(record["id"],0ULL);
+			if (nwid) {
+				std::lock_guard<std::mutex> l(_log_l);
+				nlohmann::json old;
+				get(nwid,old);
+				if ((!old.is_object())||(old != record)) {
+					_append(ZT_LOGDB_RECORD_NETWORK,nwid,0,&record);
+					_networkChanged(old,record,true);
+				}
+			}
+		} else if (objtype == "member") {
+			const uint64_t id = OSUtils::jsonIntHex(record["id"],0ULL);
+			const uint64_t nwid = OSUtils::jsonIntHex(record["nwid"],0ULL);
+			if ((id)&&(nwid)) {
+				std::lock_guard<std::mutex> l(_log_l);
+				nlohmann::json network,old;
+				get(nwid,network,id,old);
+				if ((!old.is_object())||(old != record)) {
+					_append(ZT_LOGDB_RECORD_MEMBER,nwid,id,&record);
+					_memberChanged(old,record,true);
+				}
+			}
+		} else if (objtype == "trace") {
+			const std::string id = record["id"];
+			if (id.length() > 0) {
+				char p[4096];
+				OSUtils::ztsnprintf(p,sizeof(p),"%s" ZT_PATH_SEPARATOR_S "%s.json",_tracePath.c_str(),id.c_str());
+				OSUtils::writeFile(p,OSUtils::jsonDump(record,-1));
+			}
+		}
+	} catch ( ... ) {} // drop invalid records missing fields
+}
+
+void LogDB::eraseNetwork(const uint64_t networkId)
+{
+	std::lock_guard<std::mutex> l(_log_l);
+	nlohmann::json network,nullJson;
+	get(networkId,network);
+	_append(ZT_LOGDB_RECORD_ERASE_NETWORK,networkId,0,(const nlohmann::json *)0);
+	_networkChanged(network,nullJson,true);
+}
+
+void LogDB::eraseMember(const uint64_t networkId,const uint64_t memberId)
+{
+	std::lock_guard<std::mutex> l(_log_l);
+	nlohmann::json network,member,nullJson;
+	get(networkId,network,memberId,member);
+	if (member.is_object()) {
+		_append(ZT_LOGDB_RECORD_ERASE_MEMBER,networkId,memberId,(const nlohmann::json *)0);
+		_memberChanged(member,nullJson,true);
+	}
+}
+
+void LogDB::nodeIsOnline(const uint64_t networkId,const uint64_t memberId,const InetAddress &physicalAddress)
+{
+	// Nothing to do here, as with FileDB
+}
+
+bool LogDB::importFrom(DB &db,const char *path)
+{
+	const std::string p(path);
+	OSUtils::mkdir(p.c_str());
+	OSUtils::lockDownFile(p.c_str(),true);
+	uint64_t bytes = 0;
+	if (!writeSnapshot(db,p,1,bytes))
+		return false;
+	OSUtils::rm((p + ZT_PATH_SEPARATOR_S + "controller.log").c_str());
+	OSUtils::rm((p + ZT_PATH_SEPARATOR_S + "controller.log.old").c_str());
+	return true;
+}
+
+bool LogDB::exportTo(const char *path)
+{
+	char p1[4096],p2[4096];
+	const std::string networksPath(std::string(path) + ZT_PATH_SEPARATOR_S + "network");
+	OSUtils::mkdir(path);
+	OSUtils::lockDownFile(path,true);
+	OSUtils::mkdir(networksPath.c_str());
+
+	bool ok = true;
+	std::vector<uint64_t> networkIds;
+	networks(networkIds);
+	for(auto nwid=networkIds.begin();nwid!=networkIds.end();++nwid) {
+		nlohmann::json network;
+		std::vector<nlohmann::json> members;
+		if ((!get(*nwid,network,members))||(!network.is_object()))
+			continue;
+		OSUtils::ztsnprintf(p1,sizeof(p1),"%s" ZT_PATH_SEPARATOR_S "%.16llx.json",networksPath.c_str(),(unsigned long long)*nwid);
+		ok &= OSUtils::writeFile(p1,OSUtils::jsonDump(network,-1));
+		OSUtils::ztsnprintf(p1,sizeof(p1),"%s" ZT_PATH_SEPARATOR_S "%.16llx",networksPath.c_str(),(unsigned long long)*nwid);
+		OSUtils::mkdir(p1);
+		OSUtils::ztsnprintf(p1,sizeof(p1),"%s" ZT_PATH_SEPARATOR_S "%.16llx" ZT_PATH_SEPARATOR_S "member",networksPath.c_str(),(unsigned long long)*nwid);
+		OSUtils::mkdir(p1);
+		for(auto m=members.begin();m!=members.end();++m) {
+			OSUtils::ztsnprintf(p2,sizeof(p2),"%s" ZT_PATH_SEPARATOR_S "%.10llx.json",p1,(unsigned long long)OSUtils::jsonIntHex((*m)["id"],0ULL));
+			ok &= OSUtils::writeFile(p2,OSUtils::jsonDump(*m,-1));
+		}
+	}
+	return ok;
+}
+
+// Caller must hold _log_l
+void LogDB::_append(const uint8_t type,const uint64_t networkId,const uint64_t memberId,const nlohmann::json *obj)
+{
+	std::string buf;
+	appendRecord(buf,type,networkId,memberId,obj);
+	if ((!_log)||(!writeAll(_log,buf))||(!((_sync) ? syncFile(_log) : (fflush(_log) == 0))))
+		fprintf(stderr,"WARNING: controller unable to write to path: %s" ZT_EOL_S,_logPath.c_str());
+	_logBytes += buf.length();
+}
+
+bool LogDB::_compact()
+{
+	// The log is rotated under the lock, so everything in it is already in memory
+	// and in the snapshot written below. Records appended to the new log while the
+	// snapshot is written may also end up in it, which is harmless since replaying
+	// the new log on top of the snapshot just writes the same objects again. The
+	// snapshot is tagged with the new log's generation so older logs are skipped.
+	const std::string oldLogPath(_logPath + ".old");
+	uint64_t generation;
+	bool rotated = false;
+	{
+		std::lock_guard<std::mutex> l(_log_l);
+		if (!OSUtils::fileExists(oldLogPath.c_str(),false)) {
+			if (_log)
+				fclose(_log);
+			_log = (FILE *)0;
+			if (OSUtils::rename(_logPath.c_str(),oldLogPath.c_str())) {
+				std::string hdr;
+				appendHeader(hdr,++_logGeneration);
+				_log = fopen(_logPath.c_str(),"wb");
+				if ((!_log)||(!writeAll(_log,hdr))||(fflush(_log) != 0))
+					fprintf(stderr,"WARNING: controller unable to write to path: %s" ZT_EOL_S,_logPath.c_str());
+				_logBytes = hdr.length();
+				rotated = true;
+			} else {
+				_log = fopen(_logPath.c_str(),"ab");
+				return false;
+			}
+		}
+		generation = _logGeneration;
+	}
+
+	// Only delete the old log once the snapshot replacing it is on disk
+	uint64_t bytes = 0;
+	if (writeSnapshot(*this,_path,generation,bytes)) {
+		_snapshotBytes = bytes;
+		OSUtils::rm(oldLogPath.c_str());
+		return rotated;
+	}
+	fprintf(stderr,"WARNING: controller unable to write to path: %s" ZT_EOL_S,_snapshotPath.c_str());
+	return false;
+}
+
+void LogDB::_compactorMain()
+{
+	while (_run) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(250));
+		const uint64_t logBytes = _logBytes;
+		if ((logBytes >= ZT_CONTROLLER_LOGDB_COMPACT_MIN_BYTES)&&(logBytes > _snapshotBytes))
+			_compact();
+	}
+}
+
+} // namespace ZeroTier
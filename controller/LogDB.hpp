@@ -0,0 +1,108 @@
+/*
+ * ZeroTier One - Network Virtualization Everywhere
+ * Copyright (C) 2011-2018  ZeroTier, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ZT_CONTROLLER_LOGDB_HPP
+#define ZT_CONTROLLER_LOGDB_HPP
+
+#include "DB.hpp"
+
+#include <stdio.h>
+
+/**
+ * Compact the log into a new snapshot once it is at least this big (and bigger than the snapshot)
+ */
+#define ZT_CONTROLLER_LOGDB_COMPACT_MIN_BYTES 16777216
+
+namespace ZeroTier
+{
+
+/**
+ * Controller DB kept in a binary append-only log plus a snapshot
+ *
+ * Selected with a controller DB path of "logdb:<directory>". Every change
+ * is appended to controller.log as one checksummed record holding the
+ * object as msgpack. Startup memory-maps controller.snapshot and the log
+ * and replays them, so there is no per-object file I/O. Damaged records,
+ * including one torn by a crash during a write, are skipped; a damaged log
+ * is copied aside and then replaced through a compaction instead of being
+ * truncated. When the log grows large it is rotated and a new snapshot is
+ * written from memory in the background. Snapshots are always flushed to
+ * disk before the log they replace is deleted.
+ */
+class LogDB : public DB
+{
+public:
+	/**
+	 * @param nc Controller
+	 * @param myId Controller identity
+	 * @param path LogDB directory
+	 * @param sync If true, flush each appended record to disk (fsync) before returning
+	 */
+	LogDB(EmbeddedNetworkController *const nc,const Identity &myId,const char *path,const bool sync = false);
+	virtual ~LogDB();
+
+	virtual bool waitForReady();
+	virtual bool isReady();
+	virtual void save(nlohmann::json *orig,nlohmann::json &record);
+	virtual void eraseNetwork(const uint64_t networkId);
+	virtual void eraseMember(const uint64_t networkId,const uint64_t memberId);
+	virtual void nodeIsOnline(const uint64_t networkId,const uint64_t memberId,const InetAddress &physicalAddress);
+
+	/**
+	 * Write all networks and members in a DB to a new LogDB directory
+	 *
+	 * This is used to import a FileDB tree. Anything already in the
+	 * destination directory is replaced.
+	 *
+	 * @param db Source DB
+	 * @param path LogDB directory
+	 * @return True on success
+	 */
+	static bool importFrom(DB &db,const char *path);
+
+	/**
+	 * Write all networks and members in this DB as a FileDB tree
+	 *
+	 * @param path FileDB directory (created if missing)
+	 * @return True on success
+	 */
+	bool exportTo(const char *path);
+
+protected:
+	void _append(const uint8_t type,const uint64_t networkId,const uint64_t memberId,const nlohmann::json *obj);
+	bool _compact();
+	void _compactorMain();
+
+	const std::string _snapshotPath;
+	const std::string _logPath;
+	const std::string _tracePath;
+
+	FILE *_log;
+	uint64_t _logGeneration;
+	std::atomic<uint64_t> _logBytes;
+	std::atomic<uint64_t> _snapshotBytes;
+	const bool _sync;
+	std::mutex _log_l;
+
+	std::thread _compactor;
+	std::atomic<bool> _run;
+};
+
+} // namespace ZeroTier
+
+#endif
@@ -163,3 +163,59 @@ extern void ed25519_amd64_asm_sign(const unsigned char *sk,const unsigned char *
 
   sc25519_to32bytes(sig + 32,&scs);
 }
+
+/* Sign up to any number of digests with an already expanded key (az is the
+ * clamped scalar a followed by the nonce prefix z, as in crypto_sign above).
+ * Each sig[i] must hold its 32-byte message digest at sig[i] + 64. The R
+ * points of each group share one field inversion (Montgomery's trick). */
+extern void ed25519_amd64_asm_sign_batch(const unsigned char *az,const unsigned char *pk,unsigned char *const *sig,const unsigned int count)
+{
+  unsigned char nonce[64];
+  unsigned char hram[64];
+  sc25519 sck[32], scs, scsk;
+  ge25519 ger[32];
+  fe25519 acc[32], inv, tinv, zi, tx, ty;
+  unsigned int i, j, n;
+
+  sc25519_from32bytes(&scsk, az);
+
+  for(j=0;j<count;j+=n) {
+    n = count - j;
+    if (n > 32)
+      n = 32;
+
+    for(i=0;i<n;i++) {
+      memmove(sig[j + i] + 32,az + 32,32);
+      ZT_sha512internal(nonce,sig[j + i] + 32,64);
+      sc25519_from64bytes(&sck[i], nonce);
+      ge25519_scalarmult_base(&ger[i], &sck[i]);
+    }
+
+    acc[0] = ger[0].z;
+    for(i=1;i<n;i++)
+      fe25519_mul(&acc[i], &acc[i - 1], &ger[i].z);
+    fe25519_invert(&inv, &acc[n - 1]);
+    for(i=n;i-->0;) {
+      if (i) {
+        fe25519_mul(&zi, &inv, &acc[i - 1]);
+        fe25519_mul(&tinv, &inv, &ger[i].z);
+        inv = tinv;
+      } else {
+        zi = inv;
+      }
+      fe25519_mul(&tx, &ger[i].x, &zi);
+      fe25519_mul(&ty, &ger[i].y, &zi);
+      fe25519_pack(sig[j + i], &ty);
+      sig[j + i][31] ^= fe25519_getparity(&tx) << 7;
+    }
+
+    for(i=0;i<n;i++) {
+      memmove(sig[j + i] + 32,pk,32);
+      ZT_sha512internal(hram,sig[j + i],96);
+      sc25519_from64bytes(&scs, hram);
+      sc25519_mul(&scs, &scs, &scsk);
+      sc25519_add(&scs, &scs, &sck[i]);
+      sc25519_to32bytes(sig[j + i] + 32,&scs);
+    }
+  }
+}
@@ -177,6 +177,14 @@ extern "C" {
  */
 #define ZT_MAX_PEER_NETWORK_PATHS 16
 
+/**
+ * Number of buckets in per-path round trip time histograms
+ *
+ * Buckets hold round trips under 5, 10, 25, 50, 100, 250, and 500 ms, and
+ * the last holds everything slower.
+ */
+#define ZT_PATH_RTT_HISTOGRAM_BUCKETS 8
+
 /**
  * Maximum number of path configurations that can be set
  */
@@ -618,6 +626,26 @@ typedef struct
 	 * True if some kind of connectivity appears available
 	 */
 	int online;
+
+	/**
+	 * Partially reassembled packets dropped because the receive queue was full
+	 */
+	uint64_t rxQueueFragmentDrops;
+
+	/**
+	 * Packets awaiting WHOIS dropped because the receive queue was full
+	 */
+	uint64_t rxQueueWaitingDrops;
+
+	/**
+	 * Credential signature checks answered from the verified signature cache
+	 */
+	uint64_t signatureCacheHits;
+
+	/**
+	 * Credential signature checks that required Ed25519 verification
+	 */
+	uint64_t signatureCacheMisses;
 } ZT_NodeStatus;
 
 /**
@@ -986,6 +1014,35 @@ enum ZT_PeerRole
 	ZT_PEER_ROLE_PLANET = 2      // planetary root
 };
 
+/**
+ * How traffic to a peer is spread over its direct paths
+ */
+enum ZT_MultipathMode
+{
+	/**
+	 * Send everything over the single best path (default)
+	 */
+	ZT_MULTIPATH_NONE = 0,
+
+	/**
+	 * Pin each IP flow (addresses, protocol, ports) to one live path
+	 *
+	 * Packets within a flow are never reordered by the bundle. Flows move
+	 * only when the set of live paths changes.
+	 */
+	ZT_MULTIPATH_FLOW_HASH = 1,
+
+	/**
+	 * Spread frames over live paths by weighted round robin
+	 *
+	 * Weights are inverse to each path's quality (round trip latency, jitter,
+	 * and probe loss as measured locally), so lower latency paths carry more.
+	 * This gives the most aggregate bandwidth but may reorder packets within
+	 * a flow.
+	 */
+	ZT_MULTIPATH_BALANCE = 2
+};
+
 /**
  * Vendor ID
  */
@@ -1194,6 +1251,26 @@ typedef struct
 	 * Is path preferred?
 	 */
 	int preferred;
+
+	/**
+	 * Round trip latency in milliseconds or -1 if unknown
+	 */
+	int latency;
+
+	/**
+	 * Mean deviation between successive round trip times in milliseconds
+	 */
+	int jitter;
+
+	/**
+	 * Fraction of recent probes that got no reply (0.0 to 1.0)
+	 */
+	float packetLoss;
+
+	/**
+	 * Recent round trip time counts by bucket (see ZT_PATH_RTT_HISTOGRAM_BUCKETS)
+	 */
+	unsigned int rttHistogram[ZT_PATH_RTT_HISTOGRAM_BUCKETS];
 } ZT_PeerPhysicalPath;
 
 /**
@@ -1251,6 +1328,44 @@ typedef struct
 	unsigned long peerCount;
 } ZT_PeerList;
 
+/**
+ * Peer fields to fill in with ZT_Node_peer() and ZT_Node_peersAfter()
+ *
+ * The address is always filled in. Fields not asked for are zero.
+ */
+enum ZT_PeerField
+{
+	/**
+	 * versionMajor, versionMinor, and versionRev
+	 */
+	ZT_PEER_FIELD_VERSION = 0x01,
+
+	/**
+	 * latency
+	 */
+	ZT_PEER_FIELD_LATENCY = 0x02,
+
+	/**
+	 * role
+	 */
+	ZT_PEER_FIELD_ROLE = 0x04,
+
+	/**
+	 * pathCount and paths[] except for per-path statistics
+	 */
+	ZT_PEER_FIELD_PATHS = 0x08,
+
+	/**
+	 * Per-path latency, jitter, packetLoss, and rttHistogram (implies ZT_PEER_FIELD_PATHS)
+	 */
+	ZT_PEER_FIELD_PATH_STATS = 0x10,
+
+	/**
+	 * All of the above
+	 */
+	ZT_PEER_FIELD_ALL = 0x1f
+};
+
 /**
  * ZeroTier core state objects
  */
@@ -1786,6 +1901,38 @@ ZT_SDK_API void ZT_Node_status(ZT_Node *node,ZT_NodeStatus *status);
  */
 ZT_SDK_API ZT_PeerList *ZT_Node_peers(ZT_Node *node);
 
+/**
+ * Get the status of one peer
+ *
+ * This looks up one peer without building a list of all of them. The
+ * pointer returned here must be freed with freeQueryResult() when you are
+ * done with it.
+ *
+ * @param node Node instance
+ * @param address ZeroTier address of peer (least significant 40 bits)
+ * @param fields Fields to fill in (ZT_PeerField bits)
+ * @return Peer or NULL if not found
+ */
+ZT_SDK_API ZT_Peer *ZT_Node_peer(ZT_Node *node,uint64_t address,unsigned int fields);
+
+/**
+ * Get one page of known peers in address order
+ *
+ * Start with after set to 0, then pass the address of the last peer in
+ * each page to get the next one. A page with fewer than maxPeers peers is
+ * the last. Each call costs about the size of the page, not the size of
+ * the peer table, so busy nodes with many peers are not held up for long.
+ * The pointer returned here must be freed with freeQueryResult() when you
+ * are done with it.
+ *
+ * @param node Node instance
+ * @param after Get peers with addresses greater than this
+ * @param maxPeers Maximum number of peers to get
+ * @param fields Fields to fill in (ZT_PeerField bits)
+ * @return List of peers or NULL on failure
+ */
+ZT_SDK_API ZT_PeerList *ZT_Node_peersAfter(ZT_Node *node,uint64_t after,unsigned int maxPeers,unsigned int fields);
+
 /**
  * Get the status of a virtual network
  *
@@ -1888,6 +2035,30 @@ ZT_SDK_API void ZT_Node_setNetconfMaster(ZT_Node *node,void *networkConfigMaster
  */
 ZT_SDK_API enum ZT_ResultCode ZT_Node_setPhysicalPathConfiguration(ZT_Node *node,const struct sockaddr_storage *pathNetwork,const ZT_PhysicalPathConfiguration *pathConfig);
 
+/**
+ * Set the size of the receive queue used for fragment reassembly and WHOIS waits
+ *
+ * The default is small enough for ordinary nodes. Busy roots and relays may
+ * want a larger queue; see the rxQueue*Drops fields in ZT_NodeStatus. Size
+ * is rounded up to a power of two. Packets pending in the old queue are
+ * dropped, so this should be called once at startup.
+ *
+ * @param node Node instance
+ * @param entries Desired number of queue entries
+ */
+ZT_SDK_API void ZT_Node_setReceiveQueueSize(ZT_Node *node,unsigned int entries);
+
+/**
+ * Set how network frames to a peer are spread over its live direct paths
+ *
+ * Control traffic and peers with only one live path always use the best
+ * path. Paths join or leave the bundle as they become alive or dead.
+ *
+ * @param node Node instance
+ * @param mode Multipath mode
+ */
+ZT_SDK_API void ZT_Node_setMultipathMode(ZT_Node *node,enum ZT_MultipathMode mode);
+
 /**
  * Get ZeroTier One version
  *
@@ -90,6 +90,11 @@ ifeq ($(ZT_USE_TEST_TAP),1)
 	override DEFS+=-DZT_USE_TEST_TAP
 endif
 
+# Use select() instead of epoll() in Phy<>
+ifeq ($(ZT_PHY_NO_EPOLL),1)
+	override DEFS+=-DZT_PHY_NO_EPOLL
+endif
+
 # Uncomment for gprof profile build
 #CFLAGS=-Wall -g -pg -pthread $(INCLUDES) $(DEFS)
 #CXXFLAGS=-Wall -g -pg -pthread $(INCLUDES) $(DEFS)
@@ -11,6 +11,9 @@ Derived from public domain code by D. J. Bernstein.
 #include <stdlib.h>
 #include <string.h>
 
+#include <vector>
+#include <algorithm>
+
 #include "Constants.hpp"
 #include "C25519.hpp"
 #include "SHA512.hpp"
@@ -1990,13 +1993,205 @@ void get_hram(unsigned char *hram, const unsigned char *sm, const unsigned char
 	ZeroTier::SHA512::hash(hram,playground,(unsigned int)smlen);
 }
 
+int ge25519_isneutral_vartime(const ge25519_p3 *p)
+{
+	fe25519 zero;
+	fe25519_setzero(&zero);
+	return (fe25519_iseq_vartime(&p->x,&zero) && fe25519_iseq_vartime(&p->y,&p->z));
+}
+
+/* signed sliding window with odd digits in -15..15, from ref10 */
+void slide(signed char r[256],const unsigned char a[32])
+{
+	int i,b,k;
+	for(i=0;i<256;++i)
+		r[i] = 1 & (a[i >> 3] >> (i & 7));
+	for(i=0;i<256;++i) {
+		if (r[i]) {
+			for(b=1;(b<=6)&&((i+b)<256);++b) {
+				if (r[i+b]) {
+					if ((r[i] + (r[i+b] << b)) <= 15) {
+						r[i] += r[i+b] << b;
+						r[i+b] = 0;
+					} else if ((r[i] - (r[i+b] << b)) >= -15) {
+						r[i] -= r[i+b] << b;
+						for(k=i+b;k<256;++k) {
+							if (!r[k]) {
+								r[k] = 1;
+								break;
+							}
+							r[k] = 0;
+						}
+					} else break;
+				}
+			}
+		}
+	}
+}
+
+/* computes sum of [s[k]]p[k] (Straus), pre needs room for 8*n points and d for 256*n digits */
+void ge25519_multi_scalarmult_vartime(ge25519_p3 *r,const ge25519_p3 *p,const sc25519 *s,const unsigned int n,ge25519_p3 *pre,signed char *d)
+{
+	ge25519_p1p1 tp1p1;
+	ge25519_p3 p2,neg;
+	unsigned char b[32];
+	int i,top = -1;
+	unsigned int k,j;
+
+	/* odd multiples P,3P,...,15P of each point */
+	for(k=0;k<n;++k) {
+		ge25519_p3 *const pk = pre + (8 * k);
+		signed char *const dk = d + (256 * k);
+		sc25519_to32bytes(b,&s[k]);
+		slide(dk,b);
+		for(i=255;i>top;--i) {
+			if (dk[i]) {
+				top = i;
+				break;
+			}
+		}
+		pk[0] = p[k];
+		dbl_p1p1(&tp1p1,(const ge25519_p2 *)&p[k]); p1p1_to_p3(&p2,&tp1p1);
+		for(j=1;j<8;++j) {
+			add_p1p1(&tp1p1,&pk[j-1],&p2);
+			p1p1_to_p3(&pk[j],&tp1p1);
+		}
+	}
+
+	setneutral(r);
+	for(i=top;i>=0;--i) {
+		dbl_p1p1(&tp1p1,(const ge25519_p2 *)r);
+		for(k=0;k<n;++k) {
+			const int c = d[(256 * k) + i];
+			if (c > 0) {
+				p1p1_to_p3(r,&tp1p1);
+				add_p1p1(&tp1p1,r,&pre[(8 * k) + (c >> 1)]);
+			} else if (c < 0) {
+				p1p1_to_p3(r,&tp1p1);
+				neg = pre[(8 * k) + ((-c) >> 1)];
+				fe25519_neg(&neg.x,&neg.x);
+				fe25519_neg(&neg.t,&neg.t);
+				add_p1p1(&tp1p1,r,&neg);
+			}
+		}
+		p1p1_to_p3(r,&tp1p1);
+	}
+}
+
+/* verifies the Ed25519 part of a signature whose SHA-512 message digest has already been checked */
+bool ed25519_verify_hashed(const unsigned char *pk,const unsigned char *sig)
+{
+	unsigned char t2[32];
+	ge25519 get1, get2;
+	sc25519 schram, scs;
+	unsigned char hram[crypto_hash_sha512_BYTES];
+	unsigned char m[96];
+
+	if (ge25519_unpackneg_vartime(&get1,pk))
+		return false;
+
+	get_hram(hram,sig,pk,m,96);
+
+	sc25519_from64bytes(&schram, hram);
+
+	sc25519_from32bytes(&scs, sig+32);
+
+	ge25519_double_scalarmult_vartime(&get2, &get1, &schram, &ge25519_base, &scs);
+	ge25519_pack(t2, &get2);
+
+	return ZeroTier::Utils::secureEq(sig,t2,32);
+}
+
+/* true if R is a canonical point encoding and S is reduced mod L; verify() rejects any non-canonical R since it compares against a packed point */
+bool ed25519_is_canonical(const unsigned char *sig)
+{
+	static const unsigned char L[32] = { 0xed,0xd3,0xf5,0x5c,0x1a,0x63,0x12,0x58,0xd6,0x9c,0xf7,0xa2,0xde,0xf9,0xde,0x14,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x10 };
+	unsigned int i;
+
+	/* y >= p, or x == 0 (y == p-1) with the sign bit set */
+	for (i = 1;i < 31;++i) {
+		if (sig[i] != 0xff)
+			break;
+	}
+	if ((i == 31)&&((sig[31] & 0x7f) == 0x7f)&&((sig[0] >= 0xed)||((sig[0] == 0xec)&&(sig[31] & 0x80))))
+		return false;
+
+	/* x == 0 (y == 1) with the sign bit set */
+	if (sig[31] == 0x80) {
+		for (i = 1;i < 31;++i) {
+			if (sig[i])
+				break;
+		}
+		if ((i == 31)&&(sig[0] == 0x01))
+			return false;
+	}
+
+	for (i = 32;i-- > 0;) {
+		if (sig[32 + i] != L[i])
+			return (sig[32 + i] < L[i]);
+	}
+	return false;
+}
+
+#ifndef ZT_USE_FAST_X64_ED25519
+// Each sig[i] holds its 32-byte message digest at sig[i] + 64; the R points
+// of each group share one field inversion (Montgomery's trick)
+void ed25519_sign_batch(const unsigned char *az,const unsigned char *pk,unsigned char *const *sig,const unsigned int count)
+{
+	unsigned char nonce[crypto_hash_sha512_BYTES];
+	unsigned char hram[crypto_hash_sha512_BYTES];
+	sc25519 sck[ZT_C25519_SIGN_BATCH_MAX], scs, scsk;
+	ge25519 ger[ZT_C25519_SIGN_BATCH_MAX];
+	fe25519 acc[ZT_C25519_SIGN_BATCH_MAX], inv, tinv, zi, tx, ty;
+
+	sc25519_from32bytes(&scsk,az);
+
+	for(unsigned int j=0,n=0;j<count;j+=n) {
+		n = std::min(count - j,(unsigned int)ZT_C25519_SIGN_BATCH_MAX);
+
+		for(unsigned int i=0;i<n;++i) {
+			memcpy(sig[j + i] + 32,az + 32,32);
+			ZeroTier::SHA512::hash(nonce,sig[j + i] + 32,64);
+			sc25519_from64bytes(&sck[i],nonce);
+			ge25519_scalarmult_base(&ger[i],&sck[i]);
+		}
+
+		acc[0] = ger[0].z;
+		for(unsigned int i=1;i<n;++i)
+			fe25519_mul(&acc[i],&acc[i - 1],&ger[i].z);
+		fe25519_invert(&inv,&acc[n - 1]);
+		for(unsigned int i=n;i-->0;) {
+			if (i) {
+				fe25519_mul(&zi,&inv,&acc[i - 1]);
+				fe25519_mul(&tinv,&inv,&ger[i].z);
+				inv = tinv;
+			} else {
+				zi = inv;
+			}
+			fe25519_mul(&tx,&ger[i].x,&zi);
+			fe25519_mul(&ty,&ger[i].y,&zi);
+			fe25519_pack(sig[j + i],&ty);
+			sig[j + i][31] ^= fe25519_getparity(&tx) << 7;
+		}
+
+		for(unsigned int i=0;i<n;++i) {
+			get_hram(hram,sig[j + i],pk,sig[j + i],96);
+			sc25519_from64bytes(&scs,hram);
+			sc25519_mul(&scs,&scs,&scsk);
+			sc25519_add(&scs,&scs,&sck[i]);
+			sc25519_to32bytes(sig[j + i] + 32,&scs);
+		}
+	}
+}
+#endif
+
 //////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////
 
 } // anonymous namespace
 
 #ifdef ZT_USE_FAST_X64_ED25519
-extern "C" void ed25519_amd64_asm_sign(const unsigned char *sk,const unsigned char *pk,const unsigned char *m,const unsigned int mlen,unsigned char *sig);
+extern "C" void ed25519_amd64_asm_sign_batch(const unsigned char *az,const unsigned char *pk,unsigned char *const *sig,const unsigned int count);
 #endif
 
 namespace ZeroTier {
@@ -2019,63 +2214,37 @@ void C25519::agree(const C25519::Private &mine,const C25519::Public &their,void
 
 void C25519::sign(const C25519::Private &myPrivate,const C25519::Public &myPublic,const void *msg,unsigned int len,void *signature)
 {
-#ifdef ZT_USE_FAST_X64_ED25519
-	ed25519_amd64_asm_sign(myPrivate.data + 32,myPublic.data + 32,(const unsigned char *)msg,len,(unsigned char *)signature);
-#else
-	sc25519 sck, scs, scsk;
-	ge25519 ger;
-	unsigned char r[32];
-	unsigned char s[32];
-	unsigned char extsk[64];
-	unsigned char hmg[crypto_hash_sha512_BYTES];
-	unsigned char hram[crypto_hash_sha512_BYTES];
-	unsigned char *sig = (unsigned char *)signature;
-	unsigned char digest[64]; // we sign the first 32 bytes of SHA-512(msg)
-
-	SHA512::hash(digest,msg,len);
-
-	SHA512::hash(extsk,myPrivate.data + 32,32);
-	extsk[0] &= 248;
-	extsk[31] &= 127;
-	extsk[31] |= 64;
-
-	for(unsigned int i=0;i<32;i++)
-		sig[32 + i] = extsk[32 + i];
-	for(unsigned int i=0;i<32;i++)
-		sig[64 + i] = digest[i];
-
-	SHA512::hash(hmg,sig + 32,64);
-
-	/* Computation of R */
-	sc25519_from64bytes(&sck, hmg);
-	ge25519_scalarmult_base(&ger, &sck);
-	ge25519_pack(r, &ger);
-
-	/* Computation of s */
-	for(unsigned int i=0;i<32;i++)
-		sig[i] = r[i];
-
-	get_hram(hram,sig,myPublic.data + 32,sig,96);
-
-	sc25519_from64bytes(&scs, hram);
-	sc25519_from32bytes(&scsk, extsk);
-	sc25519_mul(&scs, &scs, &scsk);
+	SigningKey key;
+	expand(myPrivate,myPublic,key);
+	signBatch(key,&msg,&len,&signature,1);
+	Utils::burn(&key,sizeof(key));
+}
 
-	sc25519_add(&scs, &scs, &sck);
+void C25519::expand(const C25519::Private &myPrivate,const C25519::Public &myPublic,C25519::SigningKey &key)
+{
+	SHA512::hash(key.az,myPrivate.data + 32,32);
+	key.az[0] &= 248;
+	key.az[31] &= 127;
+	key.az[31] |= 64;
+	memcpy(key.pub,myPublic.data + 32,32);
+}
 
-	sc25519_to32bytes(s,&scs); /* cat s */
-	for(unsigned int i=0;i<32;i++)
-		sig[32 + i] = s[i];
+void C25519::signBatch(const C25519::SigningKey &key,const void *const *msg,const unsigned int *len,void *const *signature,const unsigned int count)
+{
+	unsigned char digest[64]; // we sign the first 32 bytes of SHA-512(msg)
+	for(unsigned int i=0;i<count;++i) {
+		SHA512::hash(digest,msg[i],len[i]);
+		memcpy(reinterpret_cast<unsigned char *>(signature[i]) + 64,digest,32);
+	}
+#ifdef ZT_USE_FAST_X64_ED25519
+	ed25519_amd64_asm_sign_batch(key.az,key.pub,reinterpret_cast<unsigned char *const *>(signature),count);
+#else
+	ed25519_sign_batch(key.az,key.pub,reinterpret_cast<unsigned char *const *>(signature),count);
 #endif
 }
 
 bool C25519::verify(const C25519::Public &their,const void *msg,unsigned int len,const void *signature)
 {
-	unsigned char t2[32];
-	ge25519 get1, get2;
-	sc25519 schram, scs;
-	unsigned char hram[crypto_hash_sha512_BYTES];
-	unsigned char m[96];
 	unsigned char digest[64]; // we sign the first 32 bytes of SHA-512(msg)
 	const unsigned char *sig = (const unsigned char *)signature;
 
@@ -2084,19 +2253,113 @@ bool C25519::verify(const C25519::Public &their,const void *msg,unsigned int len
 	if (!Utils::secureEq(sig + 64,digest,32))
 		return false;
 
-	if (ge25519_unpackneg_vartime(&get1,their.data + 32))
-		return false;
-
-	get_hram(hram,sig,their.data + 32,m,96);
-
-	sc25519_from64bytes(&schram, hram);
-
-	sc25519_from32bytes(&scs, sig+32);
+	return ed25519_verify_hashed(their.data + 32,sig);
+}
 
-	ge25519_double_scalarmult_vartime(&get2, &get1, &schram, &ge25519_base, &scs);
-	ge25519_pack(t2, &get2);
+bool C25519::verifyBatch(const C25519::Public *const *their,const void *const *msg,const unsigned int *len,const void *const *signature,bool *ok,const unsigned int count)
+{
+	unsigned char digest[64];
+	unsigned char hram[crypto_hash_sha512_BYTES];
+	unsigned char m[96];
+	unsigned char z[ZT_C25519_VERIFY_BATCH_MAX][32];
+	unsigned int idx[ZT_C25519_VERIFY_BATCH_MAX];
+	unsigned int keyOf[ZT_C25519_VERIFY_BATCH_MAX];
+	sc25519 zs,t;
+	std::vector<ge25519_p3> points,pre;
+	std::vector<sc25519> scalars;
+	std::vector<signed char> d;
+	ge25519_p3 sum;
+	bool all = true;
+
+	// Message digests are checked individually; only signatures that pass go into a batch
+	unsigned int n = 0;
+	for(unsigned int i=0;i<=count;++i) {
+		if (i < count) {
+			SHA512::hash(digest,msg[i],len[i]);
+			ok[i] = Utils::secureEq((const unsigned char *)signature[i] + 64,digest,32);
+			if (ok[i]) {
+				// a group only checks points, not encodings, so odd encodings are checked exactly as verify() does
+				if (ed25519_is_canonical((const unsigned char *)signature[i])) {
+					idx[n++] = i;
+				} else {
+					ok[i] = ed25519_verify_hashed(their[i]->data + 32,(const unsigned char *)signature[i]);
+					all &= ok[i];
+				}
+			} else all = false;
+		}
+		if ((n == ZT_C25519_VERIFY_BATCH_MAX)||((i == count)&&(n))) {
+			bool batchOk = (n >= ZT_C25519_VERIFY_BATCH_MIN);
+			if (batchOk) {
+				// points: B, then -A for each distinct key, then -R for each signature
+				points.resize(1);
+				scalars.resize(1);
+				points[0] = ge25519_base;
+				Utils::getSecureRandom(z,sizeof(z));
+				for(unsigned int k=0;k<n;++k) {
+					const unsigned char *const pk = their[idx[k]]->data + 32;
+					unsigned int a = 0;
+					for(;a<k;++a) {
+						if (!memcmp(their[idx[a]]->data + 32,pk,32))
+							break;
+					}
+					if (a == k) {
+						keyOf[k] = (unsigned int)points.size();
+						points.push_back(ge25519_p3());
+						scalars.push_back(sc25519());
+						memset(&(scalars.back()),0,sizeof(sc25519));
+						if (ge25519_unpackneg_vartime(&(points.back()),pk)) {
+							batchOk = false;
+							break;
+						}
+					} else keyOf[k] = keyOf[a];
+				}
+				const unsigned int rStart = (unsigned int)points.size();
+				if (batchOk) {
+					points.resize(rStart + n);
+					scalars.resize(rStart + n);
+					memset(&(scalars[0]),0,sizeof(sc25519));
+					for(unsigned int k=0;k<n;++k) {
+						const unsigned char *const sig = (const unsigned char *)signature[idx[k]];
+						if (ge25519_unpackneg_vartime(&points[rStart + k],sig)) {
+							batchOk = false;
+							break;
+						}
+
+						// random odd 128-bit multiplier, odd so a small-order component in a lone bad signature can't vanish
+						memset(z[k] + 16,0,16);
+						z[k][0] |= 1;
+						sc25519_from32bytes(&zs,z[k]);
+						scalars[rStart + k] = zs;
+
+						sc25519_from32bytes(&t,sig + 32);
+						sc25519_mul(&t,&t,&zs);
+						sc25519_add(&scalars[0],&scalars[0],&t);
+
+						get_hram(hram,sig,their[idx[k]]->data + 32,m,96);
+						sc25519_from64bytes(&t,hram);
+						sc25519_mul(&t,&t,&zs);
+						sc25519_add(&scalars[keyOf[k]],&scalars[keyOf[k]],&t);
+					}
+				}
+				if (batchOk) {
+					// [sum z*s]B - sum [z*h]A - sum [z]R is neutral if all signatures are valid
+					pre.resize(points.size() * 8);
+					d.resize(points.size() * 256);
+					ge25519_multi_scalarmult_vartime(&sum,&(points[0]),&(scalars[0]),(unsigned int)points.size(),&(pre[0]),&(d[0]));
+					batchOk = (ge25519_isneutral_vartime(&sum) != 0);
+				}
+			}
+			if (!batchOk) {
+				for(unsigned int k=0;k<n;++k) {
+					ok[idx[k]] = ed25519_verify_hashed(their[idx[k]]->data + 32,(const unsigned char *)signature[idx[k]]);
+					all &= ok[idx[k]];
+				}
+			}
+			n = 0;
+		}
+	}
 
-	return Utils::secureEq(sig,t2,32);
+	return all;
 }
 
 void C25519::_calcPubDH(C25519::Pair &kp)
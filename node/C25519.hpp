@@ -35,6 +35,21 @@ namespace ZeroTier {
 #define ZT_C25519_PRIVATE_KEY_LEN 64
 #define ZT_C25519_SIGNATURE_LEN 96
 
+/**
+ * Smallest number of signatures verifyBatch() checks as a batch
+ */
+#define ZT_C25519_VERIFY_BATCH_MIN 2
+
+/**
+ * Largest number of signatures combined into one multi-scalar multiplication
+ */
+#define ZT_C25519_VERIFY_BATCH_MAX 32
+
+/**
+ * Largest number of signatures signBatch() computes with one shared field inversion
+ */
+#define ZT_C25519_SIGN_BATCH_MAX 32
+
 /**
  * A combined Curve25519 ECDH and Ed25519 signature engine
  */
@@ -46,6 +61,18 @@ public:
 	struct Signature { uint8_t data[ZT_C25519_SIGNATURE_LEN]; };
 	struct Pair { Public pub; Private priv; };
 
+	/**
+	 * An Ed25519 signing key with its secret scalar and nonce prefix expanded
+	 *
+	 * sign() derives these from the private key on every call. Signers that
+	 * sign many messages with one key expand it once with expand().
+	 */
+	struct SigningKey
+	{
+		uint8_t az[64]; // clamped secret scalar a, nonce prefix z
+		uint8_t pub[32]; // Ed25519 public key A
+	};
+
 	/**
 	 * Generate a C25519 elliptic curve key pair
 	 */
@@ -144,6 +171,31 @@ public:
 		return sig;
 	}
 
+	/**
+	 * Expand a key pair's Ed25519 signing key
+	 *
+	 * @param myPrivate My private key
+	 * @param myPublic My public key
+	 * @param key Key to fill
+	 */
+	static void expand(const Private &myPrivate,const Public &myPublic,SigningKey &key);
+
+	/**
+	 * Sign many messages with one expanded key
+	 *
+	 * Signatures are identical to those from sign(). Each group of up to
+	 * ZT_C25519_SIGN_BATCH_MAX signatures shares the field inversion that
+	 * encodes its R points.
+	 *
+	 * @param key Expanded signing key
+	 * @param msg Messages to sign
+	 * @param len Lengths of messages in bytes
+	 * @param signature Buffers to fill with signatures -- MUST each be 96 bytes in length
+	 * @param count Number of messages
+	 */
+	static void signBatch(const SigningKey &key,const void *const *msg,const unsigned int *len,void *const *signature,const unsigned int count);
+	static inline void sign(const SigningKey &key,const void *msg,unsigned int len,void *signature) { signBatch(key,&msg,&len,&signature,1); }
+
 	/**
 	 * Verify a message's signature
 	 *
@@ -169,6 +221,33 @@ public:
 		return verify(their,msg,len,signature.data);
 	}
 
+	/**
+	 * Verify many signatures at once
+	 *
+	 * Signatures are checked in groups with one random linear combination
+	 * and a single multi-scalar multiplication per group. Signatures signed
+	 * by the same key share one term. If a group fails its signatures are
+	 * checked one at a time to find the bad ones. Signatures with a
+	 * non-canonical R or an S not reduced mod L never go into a group and
+	 * are checked exactly as verify() checks them.
+	 *
+	 * Results match verify() for every input except one: a group holding
+	 * two or more signatures that verify() rejects only because R or the
+	 * public key has a small-order (torsion) component can pass if those
+	 * components cancel under the random odd multipliers (two order-2
+	 * components always do). Making such signatures takes the private key
+	 * of every signer involved. A single such signature never passes.
+	 *
+	 * @param their Public keys to verify against
+	 * @param msg Messages
+	 * @param len Message lengths in bytes
+	 * @param signature 96-byte signatures
+	 * @param ok Set to the result of each verification
+	 * @param count Number of signatures
+	 * @return True if all signatures are valid
+	 */
+	static bool verifyBatch(const Public *const *their,const void *const *msg,const unsigned int *len,const void *const *signature,bool *ok,const unsigned int count);
+
 private:
 	// derive first 32 bytes of kp.pub from first 32 bytes of kp.priv
 	// this is the ECDH key
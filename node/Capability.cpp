@@ -35,6 +35,13 @@
 namespace ZeroTier {
 
 int Capability::verify(const RuntimeEnvironment *RR,void *tPtr) const
+{
+	SignatureBatch sb;
+	const int r = verify(RR,tPtr,sb);
+	return (((r == 0)&&(!sb.verify(RR->sc,RR->node->now()))) ? -1 : r);
+}
+
+int Capability::verify(const RuntimeEnvironment *RR,void *tPtr,SignatureBatch &sb) const
 {
 	try {
 		// There must be at least one entry, and sanity check for bad chain max length
@@ -57,8 +64,7 @@ int Capability::verify(const RuntimeEnvironment *RR,void *tPtr) const
 
 			const Identity id(RR->topology->getIdentity(tPtr,_custody[c].from));
 			if (id) {
-				if (!id.verify(tmp.data(),tmp.size(),_custody[c].signature))
-					return -1;
+				sb.add(id,tmp.data(),tmp.size(),_custody[c].signature,_ts);
 			} else {
 				RR->sw->requestWhois(tPtr,RR->node->now(),_custody[c].from);
 				return 1;
@@ -166,6 +166,28 @@ public:
 		return false;
 	}
 
+	/**
+	 * Add a signature to this capability's chain of custody when a signing batch is signed
+	 *
+	 * @param sb Signing batch (this capability must not move until sb.sign())
+	 * @param to Recipient of this signature
+	 * @return True if chain of custody appended, false if there is no more room
+	 */
+	inline bool sign(SigningBatch &sb,const Address &to)
+	{
+		for(unsigned int i=0;((i<_maxCustodyChainLength)&&(i<ZT_MAX_CAPABILITY_CUSTODY_CHAIN_LENGTH));++i) {
+			if (!(_custody[i].to)) {
+				Buffer<(sizeof(Capability) * 2)> tmp;
+				this->serialize(tmp,true);
+				_custody[i].to = to;
+				_custody[i].from = sb.signer();
+				sb.add(tmp.data(),tmp.size(),_custody[i].signature);
+				return true;
+			}
+		}
+		return false;
+	}
+
 	/**
 	 * Verify this capability's chain of custody and signatures
 	 *
@@ -174,6 +196,16 @@ public:
 	 */
 	int verify(const RuntimeEnvironment *RR,void *tPtr) const;
 
+	/**
+	 * Check this capability's chain of custody and add its signatures to a batch instead of verifying them
+	 *
+	 * @param RR Runtime environment to provide for peer lookup, etc.
+	 * @param tPtr Thread pointer to be handed through to any callbacks called as a result of this call
+	 * @param sb Signature batch
+	 * @return 0 == OK if signatures in batch are valid, 1 == waiting for WHOIS, -1 == BAD chain
+	 */
+	int verify(const RuntimeEnvironment *RR,void *tPtr,SignatureBatch &sb) const;
+
 	template<unsigned int C>
 	static inline void serializeRules(Buffer<C> &b,const ZT_VirtualNetworkRule *rules,unsigned int ruleCount)
 	{
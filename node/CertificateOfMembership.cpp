@@ -217,7 +217,27 @@ bool CertificateOfMembership::sign(const Identity &with)
 	}
 }
 
+void CertificateOfMembership::sign(SigningBatch &sb)
+{
+	uint64_t buf[ZT_NETWORK_COM_MAX_QUALIFIERS * 3];
+	unsigned int ptr = 0;
+	for(unsigned int i=0;i<_qualifierCount;++i) {
+		buf[ptr++] = Utils::hton(_qualifiers[i].id);
+		buf[ptr++] = Utils::hton(_qualifiers[i].value);
+		buf[ptr++] = Utils::hton(_qualifiers[i].maxDelta);
+	}
+	sb.add(buf,ptr * sizeof(uint64_t),_signature);
+	_signedBy = sb.signer();
+}
+
 int CertificateOfMembership::verify(const RuntimeEnvironment *RR,void *tPtr) const
+{
+	SignatureBatch sb;
+	const int r = verify(RR,tPtr,sb);
+	return (((r == 0)&&(!sb.verify(RR->sc,RR->node->now()))) ? -1 : r);
+}
+
+int CertificateOfMembership::verify(const RuntimeEnvironment *RR,void *tPtr,SignatureBatch &sb) const
 {
 	if ((!_signedBy)||(_signedBy != Network::controllerFor(networkId()))||(_qualifierCount > ZT_NETWORK_COM_MAX_QUALIFIERS))
 		return -1;
@@ -235,7 +255,8 @@ int CertificateOfMembership::verify(const RuntimeEnvironment *RR,void *tPtr) con
 		buf[ptr++] = Utils::hton(_qualifiers[i].value);
 		buf[ptr++] = Utils::hton(_qualifiers[i].maxDelta);
 	}
-	return (id.verify(buf,ptr * sizeof(uint64_t),_signature) ? 0 : -1);
+	sb.add(id,buf,ptr * sizeof(uint64_t),_signature,timestamp());
+	return 0;
 }
 
 } // namespace ZeroTier
@@ -262,6 +262,13 @@ public:
 	 */
 	bool sign(const Identity &with);
 
+	/**
+	 * Sign this certificate when a signing batch is signed
+	 *
+	 * @param sb Signing batch (this certificate must not move until sb.sign())
+	 */
+	void sign(SigningBatch &sb);
+
 	/**
 	 * Verify this COM and its signature
 	 *
@@ -271,6 +278,16 @@ public:
 	 */
 	int verify(const RuntimeEnvironment *RR,void *tPtr) const;
 
+	/**
+	 * Check this COM and add its signatures to a batch instead of verifying them
+	 *
+	 * @param RR Runtime environment for looking up peers
+	 * @param tPtr Thread pointer to be handed through to any callbacks called as a result of this call
+	 * @param sb Signature batch
+	 * @return 0 == OK if signature in batch is valid, 1 == waiting for WHOIS, -1 == BAD credential
+	 */
+	int verify(const RuntimeEnvironment *RR,void *tPtr,SignatureBatch &sb) const;
+
 	/**
 	 * @return True if signed
 	 */
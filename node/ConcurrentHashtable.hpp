@@ -0,0 +1,412 @@
+/*
+ * ZeroTier One - Network Virtualization Everywhere
+ * Copyright (C) 2011-2018  ZeroTier, Inc.  https://www.zerotier.com/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * --
+ *
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial closed-source software that incorporates or links
+ * directly against ZeroTier software without disclosing the source code
+ * of your own application.
+ */
+
+
+#ifndef ZT_CONCURRENTHASHTABLE_HPP
+#define ZT_CONCURRENTHASHTABLE_HPP
+
+#include "Constants.hpp"
+#include "Mutex.hpp"
+#include "AtomicCounter.hpp"
+#include "SharedPtr.hpp"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <vector>
+#include <utility>
+
+#ifndef __GNUC__
+#include <atomic>
+#endif
+
+/**
+ * A ConcurrentHashtable has 2^this independently locked shards
+ */
+#define ZT_CONCURRENTHASHTABLE_SHARD_BITS 4
+#define ZT_CONCURRENTHASHTABLE_SHARDS (1 << ZT_CONCURRENTHASHTABLE_SHARD_BITS)
+
+namespace ZeroTier {
+
+/**
+ * A hash table of shared pointers whose lookups take no locks
+ *
+ * Keys are spread over shards that each have their own writer lock. A
+ * shard is an open-addressed array of pointers to immutable entries, and
+ * writers publish new entries and grown arrays with single pointer stores,
+ * so get() only reads memory. Entries and arrays that writers unlink are
+ * retired instead of freed, and reclaim() frees them once no lookup that
+ * could have seen them is still running.
+ *
+ * Lookups announce themselves on a per-shard counter for the current epoch.
+ * Two epochs alternate: reclaim() frees what was retired during the epoch
+ * before the current one if that epoch's counters have drained, then
+ * advances the epoch. It never waits, so it is cheap to call from periodic
+ * housekeeping; if a lookup is still running it just tries again next time.
+ *
+ * K must have hashCode(). V must be a class usable with SharedPtr.
+ */
+template<typename K,typename V>
+class ConcurrentHashtable
+{
+private:
+	struct _Entry
+	{
+		_Entry(const K &kk,const SharedPtr<V> &vv) : k(kk),v(vv) {}
+		const K k;
+		SharedPtr<V> v;
+	};
+
+	struct _Table
+	{
+		_Table(const unsigned long c) : mask(c - 1),used(0),slots(new _Entry *[c])
+		{
+			for(unsigned long i=0;i<c;++i)
+				slots[i] = (_Entry *)0;
+		}
+		~_Table() { delete [] slots; }
+
+		const unsigned long mask; // capacity - 1, capacity is a power of two
+		unsigned long used; // live entries plus tombstones, changed only under shard lock
+		_Entry **const slots;
+	};
+
+	struct _Shard
+	{
+		_Shard() : t(new _Table(16)),live(0) {}
+		_Table *t;
+		unsigned long live;
+		Mutex lock;
+		AtomicCounter readers[2]; // lookups in progress by epoch parity
+		char pad[64]; // keep shards' reader counters off each other's cache lines
+	};
+
+	// Marks a lookup in progress on one shard for as long as it exists
+	class _ReadSection
+	{
+	public:
+		_ReadSection(const ConcurrentHashtable &ht,const unsigned long shard) :
+			_c(ht._enter(const_cast<_Shard &>(ht._shards[shard]))) {}
+		~_ReadSection() { --(*_c); }
+	private:
+		AtomicCounter *const _c;
+	};
+
+public:
+	ConcurrentHashtable() :
+		_epoch(0)
+	{
+	}
+
+	~ConcurrentHashtable()
+	{
+		for(unsigned long s=0;s<ZT_CONCURRENTHASHTABLE_SHARDS;++s) {
+			_Table *const t = _shards[s].t;
+			for(unsigned long i=0;i<=t->mask;++i) {
+				if ((t->slots[i])&&(t->slots[i] != _tombstone()))
+					delete t->slots[i];
+			}
+			delete t;
+		}
+		for(unsigned int e=0;e<2;++e)
+			_free(e);
+	}
+
+	/**
+	 * Look up a key without taking any lock
+	 *
+	 * @param k Key
+	 * @return Value or NULL pointer if not found
+	 */
+	inline SharedPtr<V> get(const K &k) const
+	{
+		const unsigned long h = _hc(k);
+		const unsigned long s = h & (ZT_CONCURRENTHASHTABLE_SHARDS - 1);
+		_ReadSection _r(*this,s);
+		const _Entry *const e = _find(_load(&(_shards[s].t)),h,k);
+		if (e)
+			return e->v;
+		return SharedPtr<V>();
+	}
+
+	/**
+	 * Add a value if its key is not already present
+	 *
+	 * @param k Key
+	 * @param v Value to add
+	 * @return Value now in table for k (v or the existing value)
+	 */
+	inline SharedPtr<V> add(const K &k,const SharedPtr<V> &v)
+	{
+		const unsigned long h = _hc(k);
+		_Shard &sh = _shards[h & (ZT_CONCURRENTHASHTABLE_SHARDS - 1)];
+		Mutex::Lock _l(sh.lock);
+		const _Entry *const e = _find(sh.t,h,k);
+		if (e)
+			return e->v;
+		if (((sh.t->used + 1) * 4) > ((sh.t->mask + 1) * 3))
+			_rehash(sh);
+		_Table *const t = sh.t;
+		unsigned long i = (h >> ZT_CONCURRENTHASHTABLE_SHARD_BITS) & t->mask;
+		while ((t->slots[i])&&(t->slots[i] != _tombstone()))
+			i = (i + 1) & t->mask;
+		if (!t->slots[i])
+			++t->used;
+		++sh.live;
+		_store(&(t->slots[i]),new _Entry(k,v));
+		return v;
+	}
+
+	/**
+	 * @param k Key to erase
+	 * @return True if key was present
+	 */
+	inline bool erase(const K &k)
+	{
+		const unsigned long h = _hc(k);
+		_Shard &sh = _shards[h & (ZT_CONCURRENTHASHTABLE_SHARDS - 1)];
+		Mutex::Lock _l(sh.lock);
+		_Table *const t = sh.t;
+		for(unsigned long i=(h >> ZT_CONCURRENTHASHTABLE_SHARD_BITS) & t->mask;t->slots[i];i=(i + 1) & t->mask) {
+			_Entry *const e = t->slots[i];
+			if ((e != _tombstone())&&(e->k == k)) {
+				_store(&(t->slots[i]),_tombstone());
+				--sh.live;
+				_retire(e,(_Table *)0);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/**
+	 * Erase all entries for which a function returns true
+	 *
+	 * The function is called as f(key,value) with each shard locked in turn,
+	 * so it must not call back into this table. The value is the table's own
+	 * reference, so references() on it counts the table plus outside holders.
+	 *
+	 * @param f Function or function object
+	 * @return Number of entries erased
+	 */
+	template<typename F>
+	inline unsigned long eraseIf(F &f)
+	{
+		unsigned long n = 0;
+		for(unsigned long s=0;s<ZT_CONCURRENTHASHTABLE_SHARDS;++s) {
+			_Shard &sh = _shards[s];
+			Mutex::Lock _l(sh.lock);
+			_Table *const t = sh.t;
+			for(unsigned long i=0;i<=t->mask;++i) {
+				_Entry *const e = t->slots[i];
+				if ((e)&&(e != _tombstone())&&(f(e->k,e->v))) {
+					_store(&(t->slots[i]),_tombstone());
+					--sh.live;
+					_retire(e,(_Table *)0);
+					++n;
+				}
+			}
+		}
+		return n;
+	}
+
+	/**
+	 * Apply a function to every entry without taking any lock
+	 *
+	 * The function is called as f(key,value). Entries added or erased while
+	 * this runs may or may not be seen. The function may call back into this
+	 * table.
+	 *
+	 * @param f Function or function object
+	 */
+	template<typename F>
+	inline void each(F &f) const
+	{
+		for(unsigned long s=0;s<ZT_CONCURRENTHASHTABLE_SHARDS;++s) {
+			_ReadSection _r(*this,s);
+			const _Table *const t = _load(&(_shards[s].t));
+			for(unsigned long i=0;i<=t->mask;++i) {
+				const _Entry *const e = _load(&(t->slots[i]));
+				if ((e)&&(e != _tombstone()))
+					f(e->k,e->v);
+			}
+		}
+	}
+
+	/**
+	 * @return All entries (unsorted)
+	 */
+	inline std::vector< std::pair< K,SharedPtr<V> > > entries() const
+	{
+		_Entries en;
+		en.v.reserve(size());
+		each(en);
+		return en.v;
+	}
+
+	/**
+	 * @return Number of entries
+	 */
+	inline unsigned long size() const
+	{
+		unsigned long n = 0;
+		for(unsigned long s=0;s<ZT_CONCURRENTHASHTABLE_SHARDS;++s) {
+			Mutex::Lock _l(const_cast<_Shard &>(_shards[s]).lock);
+			n += _shards[s].live;
+		}
+		return n;
+	}
+
+	/**
+	 * Free entries and arrays retired before the previous epoch if no lookup could still see them
+	 *
+	 * @return True if anything could be freed and the epoch was advanced
+	 */
+	inline bool reclaim()
+	{
+		Mutex::Lock _l(_retired_m);
+		const unsigned int prev = (_epoch - 1) & 1;
+		for(unsigned long s=0;s<ZT_CONCURRENTHASHTABLE_SHARDS;++s) {
+			if (_shards[s].readers[prev].load() != 0)
+				return false;
+		}
+		_free(prev);
+		_store(&_epoch,_epoch + 1);
+		return true;
+	}
+
+private:
+	struct _Entries
+	{
+		inline void operator()(const K &k,const SharedPtr<V> &v) { this->v.push_back(std::pair< K,SharedPtr<V> >(k,v)); }
+		std::vector< std::pair< K,SharedPtr<V> > > v;
+	};
+
+	static inline _Entry *_tombstone() { return reinterpret_cast<_Entry *>(1); }
+
+	static inline unsigned long _hc(const K &k)
+	{
+		// Mix so both shard (low bits) and slot (bits above those) selection see the whole key
+		const uint64_t x = (uint64_t)k.hashCode() * 0x9e3779b97f4a7c15ULL;
+		return (unsigned long)(x ^ (x >> 32));
+	}
+
+#if defined(__GNUC__) && defined(__ATOMIC_ACQUIRE)
+	template<typename P>
+	static inline P _load(P const *p) { return __atomic_load_n(p,__ATOMIC_ACQUIRE); }
+	template<typename P>
+	static inline void _store(P *p,P v) { __atomic_store_n(p,v,__ATOMIC_RELEASE); }
+#elif defined(__GNUC__)
+	template<typename P>
+	static inline P _load(P const *p) { const P v = *((volatile P const *)p); __sync_synchronize(); return v; }
+	template<typename P>
+	static inline void _store(P *p,P v) { __sync_synchronize(); *((volatile P *)p) = v; }
+#else
+	template<typename P>
+	static inline P _load(P const *p) { const P v = *((volatile P const *)p); std::atomic_thread_fence(std::memory_order_acquire); return v; }
+	template<typename P>
+	static inline void _store(P *p,P v) { std::atomic_thread_fence(std::memory_order_release); *((volatile P *)p) = v; }
+#endif
+
+	inline AtomicCounter *_enter(_Shard &sh) const
+	{
+		for(;;) {
+			const unsigned int e = _load(&_epoch);
+			AtomicCounter *const c = &(sh.readers[e & 1]);
+			++(*c); // full barrier
+			if (_load(&_epoch) == e)
+				return c;
+			--(*c); // reclaim() advanced the epoch in between, so announce under the new one
+		}
+	}
+
+	static inline const _Entry *_find(const _Table *const t,const unsigned long h,const K &k)
+	{
+		for(unsigned long i=(h >> ZT_CONCURRENTHASHTABLE_SHARD_BITS) & t->mask;;i=(i + 1) & t->mask) {
+			const _Entry *const e = _load(&(t->slots[i]));
+			if (!e)
+				return (const _Entry *)0;
+			if ((e != _tombstone())&&(e->k == k))
+				return e;
+		}
+	}
+
+	// Caller must hold shard lock
+	inline void _rehash(_Shard &sh)
+	{
+		_Table *const ot = sh.t;
+		unsigned long c = ot->mask + 1;
+		while ((sh.live * 2) >= c) // keep at most half full after rehash
+			c <<= 1;
+		_Table *const nt = new _Table(c);
+		for(unsigned long i=0;i<=ot->mask;++i) {
+			_Entry *const e = ot->slots[i];
+			if ((e)&&(e != _tombstone())) {
+				unsigned long j = (_hc(e->k) >> ZT_CONCURRENTHASHTABLE_SHARD_BITS) & nt->mask;
+				while (nt->slots[j])
+					j = (j + 1) & nt->mask;
+				nt->slots[j] = e;
+				++nt->used;
+			}
+		}
+		_store(&(sh.t),nt);
+		_retire((_Entry *)0,ot);
+	}
+
+	inline void _retire(_Entry *const e,_Table *const t)
+	{
+		Mutex::Lock _l(_retired_m);
+		const unsigned int ep = _epoch & 1;
+		if (e)
+			_retiredEntries[ep].push_back(e);
+		if (t)
+			_retiredTables[ep].push_back(t);
+	}
+
+	// Caller must hold _retired_m or be the destructor
+	inline void _free(const unsigned int ep)
+	{
+		for(typename std::vector<_Entry *>::iterator e(_retiredEntries[ep].begin());e!=_retiredEntries[ep].end();++e)
+			delete *e;
+		_retiredEntries[ep].clear();
+		for(typename std::vector<_Table *>::iterator t(_retiredTables[ep].begin());t!=_retiredTables[ep].end();++t)
+			delete *t;
+		_retiredTables[ep].clear();
+	}
+
+	_Shard _shards[ZT_CONCURRENTHASHTABLE_SHARDS];
+	unsigned int _epoch;
+	std::vector<_Entry *> _retiredEntries[2];
+	std::vector<_Table *> _retiredTables[2];
+	Mutex _retired_m;
+
+	ConcurrentHashtable(const ConcurrentHashtable &) {}
+	const ConcurrentHashtable &operator=(const ConcurrentHashtable &) { return *this; }
+};
+
+} // namespace ZeroTier
+
+#endif
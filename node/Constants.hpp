@@ -186,13 +186,25 @@
 #define ZT_MAX_PACKET_FRAGMENTS 7
 
 /**
- * Size of RX queue
+ * Default size of RX queue (must be a power of two)
  *
- * This is about 2mb, and can be decreased for small devices. A queue smaller
- * than about 4 is probably going to cause a lot of lost packets.
+ * Each entry holds a full packet and its fragments. The size can be changed
+ * at runtime with ZT_Node_setReceiveQueueSize(), e.g. for busy roots and
+ * relays. A queue smaller than about 4 is probably going to cause a lot of
+ * lost packets.
  */
 #define ZT_RX_QUEUE_SIZE 64
 
+/**
+ * Maximum size of RX queue
+ */
+#define ZT_RX_QUEUE_MAX_SIZE 4096
+
+/**
+ * Maximum number of RX queue slots examined when looking up a packet ID
+ */
+#define ZT_RX_QUEUE_PROBE_LIMIT 16
+
 /**
  * Size of TX queue
  *
@@ -280,6 +292,35 @@
  */
 #define ZT_PATH_HEARTBEAT_PERIOD 14000
 
+/**
+ * How often to probe each path to an active peer for round trip time and loss
+ *
+ * Probes are ECHOs (or HELLOs) that go out with heartbeats, but they are
+ * sent on this schedule even when a busy path needs no heartbeat. Peers
+ * rate limit ECHO replies, so at most one probe per peer goes out per
+ * ping check.
+ */
+#define ZT_PATH_PROBE_INTERVAL 10000
+
+/**
+ * Latency penalty in ms added to path quality for 100% probe loss (scaled by loss)
+ */
+#define ZT_PATH_LOSS_PENALTY 1000
+
+/**
+ * Round trip samples after which path RTT histogram counts are halved
+ */
+#define ZT_PATH_RTT_HISTOGRAM_WINDOW 64
+
+/**
+ * In multipath balance mode no live path gets less than 1/N of the busiest path's share
+ *
+ * This keeps some traffic on every path in the bundle, including ones whose
+ * latency is not known yet or that recently lost probes, so that they stay
+ * in use while their measurements recover.
+ */
+#define ZT_MULTIPATH_MIN_SHARE 8
+
 /**
  * Do not accept HELLOs over a given path more often than this
  */
@@ -30,6 +30,8 @@
 #include <string>
 #include <memory>
 #include <stdexcept>
+#include <vector>
+#include <utility>
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -37,9 +39,14 @@
 #include <string.h>
 
 #include "Constants.hpp"
+#include "C25519.hpp"
+#include "Identity.hpp"
+#include "SignatureCache.hpp"
 
 namespace ZeroTier {
 
+class RuntimeEnvironment;
+
 /**
  * Base class for credentials
  */
@@ -58,6 +65,208 @@ public:
 		CREDENTIAL_TYPE_COO = 4,        // CertificateOfOwnership
 		CREDENTIAL_TYPE_REVOCATION = 6
 	};
+
+	/**
+	 * Signatures from one or more credentials, checked with one call to C25519::verifyBatch()
+	 *
+	 * Credentials are added with add(RR,tPtr,cred), which runs all of the
+	 * credential's checks except signature verification. After verify()
+	 * each credential is valid if all of its signatures passed.
+	 */
+	class SignatureBatch
+	{
+	public:
+		SignatureBatch() {}
+
+		/**
+		 * Check a credential and add its signatures to this batch
+		 *
+		 * @param RR Runtime environment
+		 * @param tPtr Thread pointer to be handed through to any callbacks called as a result of this call
+		 * @param cred Credential
+		 * @return Index of credential for valid() or -1 if its verify() did not return 0 (bad or waiting for WHOIS)
+		 */
+		template<typename C>
+		inline int add(const RuntimeEnvironment *RR,void *tPtr,const C &cred)
+		{
+			const unsigned int start = size();
+			if (cred.verify(RR,tPtr,*this) != 0)
+				return -1;
+			_credentials.push_back(std::pair<unsigned int,unsigned int>(start,size()));
+			return (int)_credentials.size() - 1;
+		}
+
+		/**
+		 * Add a signature to this batch
+		 *
+		 * @param signer Identity of signer
+		 * @param data Signed data
+		 * @param len Length of signed data
+		 * @param signature Signature
+		 * @param timestamp Credential timestamp, used to expire cached results (0 to never cache)
+		 */
+		inline void add(const Identity &signer,const void *data,const unsigned int len,const C25519::Signature &signature,const int64_t timestamp)
+		{
+			_keys.push_back(signer.publicKey());
+			_signatures.push_back(signature);
+			_timestamps.push_back(timestamp);
+			_dataStart.push_back((unsigned int)_data.size());
+			_dataLen.push_back(len);
+			_data.insert(_data.end(),(const uint8_t *)data,(const uint8_t *)data + len);
+		}
+
+		/**
+		 * @return Number of signatures added so far
+		 */
+		inline unsigned int size() const { return (unsigned int)_signatures.size(); }
+
+		/**
+		 * Verify all signatures added so far
+		 *
+		 * Signatures found in the cache are not verified again, and those
+		 * that pass are added to it.
+		 *
+		 * @param cache Cache of verified signatures or NULL for none
+		 * @param now Current time
+		 * @return True if all signatures are valid
+		 */
+		inline bool verify(SignatureCache *const cache,const int64_t now)
+		{
+			const unsigned int n = size();
+			_ok.assign(n,true);
+			std::vector<SignatureCache::Key> cacheKeys(n);
+			std::vector<unsigned int> idx;
+			for(unsigned int i=0;i<n;++i) {
+				if (cache) {
+					SignatureCache::key(cacheKeys[i],_keys[i],(_dataLen[i]) ? (const void *)&(_data[_dataStart[i]]) : (const void *)0,_dataLen[i],_signatures[i].data);
+					if (cache->check(cacheKeys[i],now))
+						continue;
+				}
+				idx.push_back(i);
+			}
+			const unsigned int vn = (unsigned int)idx.size();
+			if (!vn)
+				return true;
+
+			std::vector<const C25519::Public *> keys(vn);
+			std::vector<const void *> msgs(vn);
+			std::vector<unsigned int> lens(vn);
+			std::vector<const void *> sigs(vn);
+			for(unsigned int k=0;k<vn;++k) {
+				const unsigned int i = idx[k];
+				keys[k] = &(_keys[i]);
+				msgs[k] = (_dataLen[i]) ? (const void *)&(_data[_dataStart[i]]) : (const void *)0;
+				lens[k] = _dataLen[i];
+				sigs[k] = _signatures[i].data;
+			}
+			bool *const ok = new bool[vn];
+			const bool all = C25519::verifyBatch(&(keys[0]),&(msgs[0]),&(lens[0]),&(sigs[0]),ok,vn);
+			for(unsigned int k=0;k<vn;++k) {
+				const unsigned int i = idx[k];
+				_ok[i] = ok[k];
+				if ((ok[k])&&(cache))
+					cache->add(cacheKeys[i],_timestamps[i],now);
+			}
+			delete [] ok;
+			return all;
+		}
+
+		/**
+		 * @param c Index of credential returned by add()
+		 * @return True if credential was added and all its signatures passed verify()
+		 */
+		inline bool valid(const int c) const
+		{
+			if ((c < 0)||((unsigned int)c >= _credentials.size()))
+				return false;
+			for(unsigned int i=_credentials[c].first;i<_credentials[c].second;++i) {
+				if ((i >= _ok.size())||(!_ok[i]))
+					return false;
+			}
+			return true;
+		}
+
+	private:
+		std::vector<C25519::Public> _keys;
+		std::vector<C25519::Signature> _signatures;
+		std::vector<int64_t> _timestamps;
+		std::vector<unsigned int> _dataStart;
+		std::vector<unsigned int> _dataLen;
+		std::vector<uint8_t> _data;
+		std::vector<bool> _ok;
+		std::vector< std::pair<unsigned int,unsigned int> > _credentials;
+	};
+
+	/**
+	 * Signatures for one or more credentials, computed with one call to C25519::signBatch()
+	 *
+	 * Credentials add themselves with their sign(SigningBatch &) methods,
+	 * which fill in the signer and queue their signed data. Signatures are
+	 * written when sign() is called, so credentials must stay in place until
+	 * then.
+	 */
+	class SigningBatch
+	{
+	public:
+		/**
+		 * @param signer Address of signer
+		 * @param key Signer's expanded signing key (see Identity::expandSigningKey())
+		 */
+		SigningBatch(const Address &signer,const C25519::SigningKey &key) :
+			_signer(signer),
+			_key(key) {}
+
+		/**
+		 * @return Address of signer
+		 */
+		inline const Address &signer() const { return _signer; }
+
+		/**
+		 * Queue data to be signed
+		 *
+		 * @param data Data to sign
+		 * @param len Length of data
+		 * @param signature Signature to fill in when sign() is called
+		 */
+		inline void add(const void *data,const unsigned int len,C25519::Signature &signature)
+		{
+			_dataStart.push_back((unsigned int)_data.size());
+			_dataLen.push_back(len);
+			_data.insert(_data.end(),(const uint8_t *)data,(const uint8_t *)data + len);
+			_signatures.push_back(signature.data);
+		}
+
+		/**
+		 * @return Number of signatures queued
+		 */
+		inline unsigned int size() const { return (unsigned int)_signatures.size(); }
+
+		/**
+		 * Compute and fill in all queued signatures
+		 */
+		inline void sign()
+		{
+			const unsigned int n = size();
+			if (!n)
+				return;
+			std::vector<const void *> msgs(n);
+			for(unsigned int i=0;i<n;++i)
+				msgs[i] = (_dataLen[i]) ? (const void *)&(_data[_dataStart[i]]) : (const void *)0;
+			C25519::signBatch(_key,&(msgs[0]),&(_dataLen[0]),reinterpret_cast<void *const *>(&(_signatures[0])),n);
+			_dataStart.clear();
+			_dataLen.clear();
+			_data.clear();
+			_signatures.clear();
+		}
+
+	private:
+		const Address _signer;
+		const C25519::SigningKey &_key;
+		std::vector<unsigned int> _dataStart;
+		std::vector<unsigned int> _dataLen;
+		std::vector<uint8_t> _data;
+		std::vector<uint8_t *> _signatures;
+	};
 };
 
 } // namespace ZeroTier
@@ -150,6 +150,21 @@ public:
 		throw ZT_EXCEPTION_PRIVATE_KEY_REQUIRED;
 	}
 
+	/**
+	 * Expand this identity's signing key for repeated use with C25519::signBatch()
+	 *
+	 * @param key Key to fill
+	 * @return True if this identity has a private key and key was filled
+	 */
+	inline bool expandSigningKey(C25519::SigningKey &key) const
+	{
+		if (_privateKey) {
+			C25519::expand(*_privateKey,_publicKey,key);
+			return true;
+		}
+		return false;
+	}
+
 	/**
 	 * Verify a message signature against this identity
 	 *
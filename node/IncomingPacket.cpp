@@ -77,7 +77,7 @@ bool IncomingPacket::tryDecode(const RuntimeEnvironment *RR,void *tPtr)
 
 		const SharedPtr<Peer> peer(RR->topology->getPeer(tPtr,sourceAddress));
 		if (peer) {
-			if (!trusted) {
+			if ((!trusted)&&(!_authenticated)) {
 				if (!dearmor(peer->key())) {
 					RR->t->incomingPacketMessageAuthenticationFailure(tPtr,_path,packetId(),sourceAddress,hops(),"invalid MAC");
 					return true;
@@ -123,6 +123,31 @@ bool IncomingPacket::tryDecode(const RuntimeEnvironment *RR,void *tPtr)
 	}
 }
 
+void IncomingPacket::dearmorBatch(IncomingPacket *const *packets,const unsigned int count,const SharedPtr<Peer> &peer)
+{
+	Packet *batch[ZT_PROTO_ARMOR_BATCH_SIZE];
+	const void *keys[ZT_PROTO_ARMOR_BATCH_SIZE];
+	bool ok[ZT_PROTO_ARMOR_BATCH_SIZE];
+	IncomingPacket *ip[ZT_PROTO_ARMOR_BATCH_SIZE];
+	unsigned int n = 0;
+	for(unsigned int i=0;i<=count;++i) {
+		if (i < count) {
+			IncomingPacket *const p = packets[i];
+			if ((!p->_authenticated)&&(p->source() == peer->address())&&(p->usesPeerKey())) {
+				batch[n] = p;
+				keys[n] = peer->key();
+				ip[n++] = p;
+			}
+		}
+		if ((n == ZT_PROTO_ARMOR_BATCH_SIZE)||((i == count)&&(n))) {
+			Packet::dearmorBatch(batch,keys,ok,n);
+			for(unsigned int k=0;k<n;++k)
+				ip[k]->_authenticated = ok[k];
+			n = 0;
+		}
+	}
+}
+
 bool IncomingPacket::_doERROR(const RuntimeEnvironment *RR,void *tPtr,const SharedPtr<Peer> &peer)
 {
 	const Packet::Verb inReVerb = (Packet::Verb)(*this)[ZT_PROTO_VERB_ERROR_IDX_IN_RE_VERB];
@@ -446,7 +471,7 @@ bool IncomingPacket::_doOK(const RuntimeEnvironment *RR,void *tPtr,const SharedP
 			}
 
 			if (!hops())
-				_path->updateLatency((unsigned int)latency);
+				_path->replyReceived(inRePacketId,(unsigned int)latency);
 
 			peer->setRemoteVersion(vProto,vMajor,vMinor,vRevision);
 
@@ -454,6 +479,15 @@ bool IncomingPacket::_doOK(const RuntimeEnvironment *RR,void *tPtr,const SharedP
 				RR->sa->iam(tPtr,peer->address(),_path->localSocket(),_path->address(),externalSurfaceAddress,RR->topology->isUpstream(peer->identity()),RR->node->now());
 		}	break;
 
+		case Packet::VERB_ECHO:
+			// ECHOs from Peer::attemptToContactAt() carry their send time
+			if ((!hops())&&(size() >= (ZT_PROTO_VERB_OK_IDX_PAYLOAD + 8))) {
+				const int64_t latency = RR->node->now() - (int64_t)at<uint64_t>(ZT_PROTO_VERB_OK_IDX_PAYLOAD);
+				if ((latency >= 0)&&(latency <= ZT_HELLO_MAX_ALLOWABLE_LATENCY))
+					_path->replyReceived(inRePacketId,(unsigned int)latency);
+			}
+			break;
+
 		case Packet::VERB_WHOIS:
 			if (RR->topology->isUpstream(peer->identity())) {
 				const Identity id(*this,ZT_PROTO_VERB_WHOIS__OK__IDX_IDENTITY);
@@ -745,124 +779,172 @@ bool IncomingPacket::_doMULTICAST_LIKE(const RuntimeEnvironment *RR,void *tPtr,c
 	return true;
 }
 
+// Add a credential to a signature batch if its network will have to verify it
+template<typename C>
+static inline int _batchCredential(const RuntimeEnvironment *RR,void *tPtr,SharedPtr<Network> &network,Credential::SignatureBatch &sb,const C &cred)
+{
+	if ((!network)||(network->id() != cred.networkId()))
+		network = RR->node->network(cred.networkId());
+	return (((network)&&(network->credentialNeedsVerify(cred))) ? sb.add(RR,tPtr,cred) : -1);
+}
+
 bool IncomingPacket::_doNETWORK_CREDENTIALS(const RuntimeEnvironment *RR,void *tPtr,const SharedPtr<Peer> &peer)
 {
 	if (!peer->rateGateCredentialsReceived(RR->node->now()))
 		return true;
 
-	CertificateOfMembership com;
-	Capability cap;
-	Tag tag;
-	Revocation revocation;
-	CertificateOfOwnership coo;
+	std::vector<CertificateOfMembership> coms;
+	std::vector<Capability> caps;
+	std::vector<Tag> tags;
+	std::vector<Revocation> revocations;
+	std::vector<CertificateOfOwnership> coos;
+	bool truncated = false;
 	bool trustEstablished = false;
 	SharedPtr<Network> network;
 
+	// Parse all credentials first so their signatures can be checked in one batch
 	unsigned int p = ZT_PACKET_IDX_PAYLOAD;
 	while ((p < size())&&((*this)[p] != 0)) {
-		p += com.deserialize(*this,p);
-		if (com) {
-			network = RR->node->network(com.networkId());
-			if (network) {
-				switch (network->addCredential(tPtr,com)) {
-					case Membership::ADD_REJECTED:
-						break;
-					case Membership::ADD_ACCEPTED_NEW:
-					case Membership::ADD_ACCEPTED_REDUNDANT:
-						trustEstablished = true;
-						break;
-					case Membership::ADD_DEFERRED_FOR_WHOIS:
-						return false;
-				}
-			} else RR->mc->addCredential(tPtr,com,false);
-		}
+		coms.push_back(CertificateOfMembership());
+		p += coms.back().deserialize(*this,p);
+		if (!coms.back())
+			coms.pop_back();
 	}
 	++p; // skip trailing 0 after COMs if present
 
 	if (p < size()) { // older ZeroTier versions do not send capabilities, tags, or revocations
 		const unsigned int numCapabilities = at<uint16_t>(p); p += 2;
 		for(unsigned int i=0;i<numCapabilities;++i) {
-			p += cap.deserialize(*this,p);
-			if ((!network)||(network->id() != cap.networkId()))
-				network = RR->node->network(cap.networkId());
-			if (network) {
-				switch (network->addCredential(tPtr,cap)) {
-					case Membership::ADD_REJECTED:
-						break;
-					case Membership::ADD_ACCEPTED_NEW:
-					case Membership::ADD_ACCEPTED_REDUNDANT:
-						trustEstablished = true;
-						break;
-					case Membership::ADD_DEFERRED_FOR_WHOIS:
-						return false;
-				}
-			}
+			caps.push_back(Capability());
+			p += caps.back().deserialize(*this,p);
 		}
+		if (p < size()) {
+			const unsigned int numTags = at<uint16_t>(p); p += 2;
+			for(unsigned int i=0;i<numTags;++i) {
+				tags.push_back(Tag());
+				p += tags.back().deserialize(*this,p);
+			}
+			if (p < size()) {
+				const unsigned int numRevocations = at<uint16_t>(p); p += 2;
+				for(unsigned int i=0;i<numRevocations;++i) {
+					revocations.push_back(Revocation());
+					p += revocations.back().deserialize(*this,p);
+				}
+				if (p < size()) {
+					const unsigned int numCoos = at<uint16_t>(p); p += 2;
+					for(unsigned int i=0;i<numCoos;++i) {
+						coos.push_back(CertificateOfOwnership());
+						p += coos.back().deserialize(*this,p);
+					}
+				} else truncated = true;
+			} else truncated = true;
+		} else truncated = true;
+	}
 
-		if (p >= size()) return true;
+	// Credentials that are old, revoked, or already known are skipped here as they are in addCredential()
+	Credential::SignatureBatch sb;
+	std::vector<int> comSigs,capSigs,tagSigs,revocationSigs,cooSigs;
+	for(std::vector<CertificateOfMembership>::const_iterator c(coms.begin());c!=coms.end();++c)
+		comSigs.push_back(_batchCredential(RR,tPtr,network,sb,*c));
+	for(std::vector<Capability>::const_iterator c(caps.begin());c!=caps.end();++c)
+		capSigs.push_back(_batchCredential(RR,tPtr,network,sb,*c));
+	for(std::vector<Tag>::const_iterator c(tags.begin());c!=tags.end();++c)
+		tagSigs.push_back(_batchCredential(RR,tPtr,network,sb,*c));
+	for(std::vector<Revocation>::const_iterator c(revocations.begin());c!=revocations.end();++c)
+		revocationSigs.push_back(_batchCredential(RR,tPtr,network,sb,*c));
+	for(std::vector<CertificateOfOwnership>::const_iterator c(coos.begin());c!=coos.end();++c)
+		cooSigs.push_back(_batchCredential(RR,tPtr,network,sb,*c));
+	sb.verify(RR->sc,RR->node->now());
+	network.zero();
+
+	// Credentials that failed or missed the batch are verified again (and traced) by addCredential()
+	for(unsigned int i=0;i<coms.size();++i) {
+		network = RR->node->network(coms[i].networkId());
+		if (network) {
+			switch (network->addCredential(tPtr,coms[i],sb.valid(comSigs[i]))) {
+				case Membership::ADD_REJECTED:
+					break;
+				case Membership::ADD_ACCEPTED_NEW:
+				case Membership::ADD_ACCEPTED_REDUNDANT:
+					trustEstablished = true;
+					break;
+				case Membership::ADD_DEFERRED_FOR_WHOIS:
+					return false;
+			}
+		} else RR->mc->addCredential(tPtr,coms[i],false);
+	}
 
-		const unsigned int numTags = at<uint16_t>(p); p += 2;
-		for(unsigned int i=0;i<numTags;++i) {
-			p += tag.deserialize(*this,p);
-			if ((!network)||(network->id() != tag.networkId()))
-				network = RR->node->network(tag.networkId());
-			if (network) {
-				switch (network->addCredential(tPtr,tag)) {
-					case Membership::ADD_REJECTED:
-						break;
-					case Membership::ADD_ACCEPTED_NEW:
-					case Membership::ADD_ACCEPTED_REDUNDANT:
-						trustEstablished = true;
-						break;
-					case Membership::ADD_DEFERRED_FOR_WHOIS:
-						return false;
-				}
+	for(unsigned int i=0;i<caps.size();++i) {
+		if ((!network)||(network->id() != caps[i].networkId()))
+			network = RR->node->network(caps[i].networkId());
+		if (network) {
+			switch (network->addCredential(tPtr,caps[i],sb.valid(capSigs[i]))) {
+				case Membership::ADD_REJECTED:
+					break;
+				case Membership::ADD_ACCEPTED_NEW:
+				case Membership::ADD_ACCEPTED_REDUNDANT:
+					trustEstablished = true;
+					break;
+				case Membership::ADD_DEFERRED_FOR_WHOIS:
+					return false;
 			}
 		}
+	}
 
-		if (p >= size()) return true;
-
-		const unsigned int numRevocations = at<uint16_t>(p); p += 2;
-		for(unsigned int i=0;i<numRevocations;++i) {
-			p += revocation.deserialize(*this,p);
-			if ((!network)||(network->id() != revocation.networkId()))
-				network = RR->node->network(revocation.networkId());
-			if (network) {
-				switch(network->addCredential(tPtr,peer->address(),revocation)) {
-					case Membership::ADD_REJECTED:
-						break;
-					case Membership::ADD_ACCEPTED_NEW:
-					case Membership::ADD_ACCEPTED_REDUNDANT:
-						trustEstablished = true;
-						break;
-					case Membership::ADD_DEFERRED_FOR_WHOIS:
-						return false;
-				}
+	for(unsigned int i=0;i<tags.size();++i) {
+		if ((!network)||(network->id() != tags[i].networkId()))
+			network = RR->node->network(tags[i].networkId());
+		if (network) {
+			switch (network->addCredential(tPtr,tags[i],sb.valid(tagSigs[i]))) {
+				case Membership::ADD_REJECTED:
+					break;
+				case Membership::ADD_ACCEPTED_NEW:
+				case Membership::ADD_ACCEPTED_REDUNDANT:
+					trustEstablished = true;
+					break;
+				case Membership::ADD_DEFERRED_FOR_WHOIS:
+					return false;
 			}
 		}
+	}
 
-		if (p >= size()) return true;
+	for(unsigned int i=0;i<revocations.size();++i) {
+		if ((!network)||(network->id() != revocations[i].networkId()))
+			network = RR->node->network(revocations[i].networkId());
+		if (network) {
+			switch(network->addCredential(tPtr,peer->address(),revocations[i],sb.valid(revocationSigs[i]))) {
+				case Membership::ADD_REJECTED:
+					break;
+				case Membership::ADD_ACCEPTED_NEW:
+				case Membership::ADD_ACCEPTED_REDUNDANT:
+					trustEstablished = true;
+					break;
+				case Membership::ADD_DEFERRED_FOR_WHOIS:
+					return false;
+			}
+		}
+	}
 
-		const unsigned int numCoos = at<uint16_t>(p); p += 2;
-		for(unsigned int i=0;i<numCoos;++i) {
-			p += coo.deserialize(*this,p);
-			if ((!network)||(network->id() != coo.networkId()))
-				network = RR->node->network(coo.networkId());
-			if (network) {
-				switch(network->addCredential(tPtr,coo)) {
-					case Membership::ADD_REJECTED:
-						break;
-					case Membership::ADD_ACCEPTED_NEW:
-					case Membership::ADD_ACCEPTED_REDUNDANT:
-						trustEstablished = true;
-						break;
-					case Membership::ADD_DEFERRED_FOR_WHOIS:
-						return false;
-				}
+	for(unsigned int i=0;i<coos.size();++i) {
+		if ((!network)||(network->id() != coos[i].networkId()))
+			network = RR->node->network(coos[i].networkId());
+		if (network) {
+			switch(network->addCredential(tPtr,coos[i],sb.valid(cooSigs[i]))) {
+				case Membership::ADD_REJECTED:
+					break;
+				case Membership::ADD_ACCEPTED_NEW:
+				case Membership::ADD_ACCEPTED_REDUNDANT:
+					trustEstablished = true;
+					break;
+				case Membership::ADD_DEFERRED_FOR_WHOIS:
+					return false;
 			}
 		}
 	}
 
+	if (truncated)
+		return true;
+
 	peer->received(tPtr,_path,hops(),packetId(),Packet::VERB_NETWORK_CREDENTIALS,0,Packet::VERB_NOP,trustEstablished,(network) ? network->id() : 0);
 
 	return true;
@@ -64,7 +64,8 @@ class IncomingPacket : public Packet
 public:
 	IncomingPacket() :
 		Packet(),
-		_receiveTime(0)
+		_receiveTime(0),
+		_authenticated(false)
 	{
 	}
 
@@ -80,7 +81,8 @@ public:
 	IncomingPacket(const void *data,unsigned int len,const SharedPtr<Path> &path,int64_t now) :
 		Packet(data,len),
 		_receiveTime(now),
-		_path(path)
+		_path(path),
+		_authenticated(false)
 	{
 	}
 
@@ -98,6 +100,7 @@ public:
 		copyFrom(data,len);
 		_receiveTime = now;
 		_path = path;
+		_authenticated = false;
 	}
 
 	/**
@@ -115,11 +118,38 @@ public:
 	 */
 	bool tryDecode(const RuntimeEnvironment *RR,void *tPtr);
 
+	/**
+	 * Authenticate and decrypt several packets from one peer together
+	 *
+	 * Packets from this peer that use its key are dearmored as a batch, and
+	 * those that pass are marked so tryDecode() does not do it again. Others
+	 * are left for tryDecode() to handle (and report) as usual.
+	 *
+	 * @param packets Packets (must be distinct)
+	 * @param count Number of packets
+	 * @param peer Peer whose key to use
+	 */
+	static void dearmorBatch(IncomingPacket *const *packets,const unsigned int count,const SharedPtr<Peer> &peer);
+
+	/**
+	 * @return True if this is authenticated with the sender's key (not via a trusted path or a HELLO in the clear)
+	 */
+	inline bool usesPeerKey() const
+	{
+		const unsigned int c = cipher();
+		return ((c != ZT_PROTO_CIPHER_SUITE__NO_CRYPTO_TRUSTED_PATH)&&((c != ZT_PROTO_CIPHER_SUITE__C25519_POLY1305_NONE)||(verb() != Packet::VERB_HELLO)));
+	}
+
 	/**
 	 * @return Time of packet receipt / start of decode
 	 */
 	inline uint64_t receiveTime() const { return _receiveTime; }
 
+	/**
+	 * @return Path over which packet arrived
+	 */
+	inline const SharedPtr<Path> &path() const { return _path; }
+
 private:
 	// These are called internally to handle packet contents once it has
 	// been authenticated, decrypted, decompressed, and classified.
@@ -145,6 +175,7 @@ private:
 
 	uint64_t _receiveTime;
 	SharedPtr<Path> _path;
+	bool _authenticated; // already dearmored by dearmorBatch()
 };
 
 } // namespace ZeroTier
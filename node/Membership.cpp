@@ -125,7 +125,16 @@ void Membership::pushCredentials(const RuntimeEnvironment *RR,void *tPtr,const i
 	}
 }
 
-Membership::AddCredentialResult Membership::addCredential(const RuntimeEnvironment *RR,void *tPtr,const NetworkConfig &nconf,const CertificateOfMembership &com)
+bool Membership::needsVerify(const CertificateOfMembership &com) const
+{
+	const int64_t newts = com.timestamp();
+	if (newts <= _comRevocationThreshold)
+		return false;
+	const int64_t oldts = _com.timestamp();
+	return ((newts > oldts)||((newts == oldts)&&(_com != com)));
+}
+
+Membership::AddCredentialResult Membership::addCredential(const RuntimeEnvironment *RR,void *tPtr,const NetworkConfig &nconf,const CertificateOfMembership &com,const bool alreadyValidated)
 {
 	const int64_t newts = com.timestamp();
 	if (newts <= _comRevocationThreshold) {
@@ -141,7 +150,7 @@ Membership::AddCredentialResult Membership::addCredential(const RuntimeEnvironme
 	if ((newts == oldts)&&(_com == com))
 		return ADD_ACCEPTED_REDUNDANT;
 
-	switch(com.verify(RR,tPtr)) {
+	switch((alreadyValidated) ? 0 : com.verify(RR,tPtr)) {
 		default:
 			RR->t->credentialRejected(tPtr,com,"invalid");
 			return ADD_REJECTED;
@@ -155,7 +164,7 @@ Membership::AddCredentialResult Membership::addCredential(const RuntimeEnvironme
 
 // Template out addCredential() for many cred types to avoid copypasta
 template<typename C>
-static Membership::AddCredentialResult _addCredImpl(Hashtable<uint32_t,C> &remoteCreds,const Hashtable<uint64_t,int64_t> &revocations,const RuntimeEnvironment *RR,void *tPtr,const NetworkConfig &nconf,const C &cred)
+static Membership::AddCredentialResult _addCredImpl(Hashtable<uint32_t,C> &remoteCreds,const Hashtable<uint64_t,int64_t> &revocations,const RuntimeEnvironment *RR,void *tPtr,const NetworkConfig &nconf,const C &cred,const bool alreadyValidated)
 {
 	C *rc = remoteCreds.get(cred.id());
 	if (rc) {
@@ -173,7 +182,7 @@ static Membership::AddCredentialResult _addCredImpl(Hashtable<uint32_t,C> &remot
 		return Membership::ADD_REJECTED;
 	}
 
-	switch(cred.verify(RR,tPtr)) {
+	switch((alreadyValidated) ? 0 : cred.verify(RR,tPtr)) {
 		default:
 			RR->t->credentialRejected(tPtr,cred,"invalid");
 			return Membership::ADD_REJECTED;
@@ -187,14 +196,28 @@ static Membership::AddCredentialResult _addCredImpl(Hashtable<uint32_t,C> &remot
 	}
 }
 
-Membership::AddCredentialResult Membership::addCredential(const RuntimeEnvironment *RR,void *tPtr,const NetworkConfig &nconf,const Tag &tag) { return _addCredImpl<Tag>(_remoteTags,_revocations,RR,tPtr,nconf,tag); }
-Membership::AddCredentialResult Membership::addCredential(const RuntimeEnvironment *RR,void *tPtr,const NetworkConfig &nconf,const Capability &cap) { return _addCredImpl<Capability>(_remoteCaps,_revocations,RR,tPtr,nconf,cap); }
-Membership::AddCredentialResult Membership::addCredential(const RuntimeEnvironment *RR,void *tPtr,const NetworkConfig &nconf,const CertificateOfOwnership &coo) { return _addCredImpl<CertificateOfOwnership>(_remoteCoos,_revocations,RR,tPtr,nconf,coo); }
+template<typename C>
+static bool _needsVerifyImpl(const Hashtable<uint32_t,C> &remoteCreds,const Hashtable<uint64_t,int64_t> &revocations,const C &cred)
+{
+	const C *const rc = remoteCreds.get(cred.id());
+	if ((rc)&&((rc->timestamp() > cred.timestamp())||(*rc == cred)))
+		return false;
+	const int64_t *const rt = revocations.get(Membership::credentialKey(C::credentialType(),cred.id()));
+	return ((!rt)||(*rt < cred.timestamp()));
+}
+
+bool Membership::needsVerify(const Tag &tag) const { return _needsVerifyImpl<Tag>(_remoteTags,_revocations,tag); }
+bool Membership::needsVerify(const Capability &cap) const { return _needsVerifyImpl<Capability>(_remoteCaps,_revocations,cap); }
+bool Membership::needsVerify(const CertificateOfOwnership &coo) const { return _needsVerifyImpl<CertificateOfOwnership>(_remoteCoos,_revocations,coo); }
+
+Membership::AddCredentialResult Membership::addCredential(const RuntimeEnvironment *RR,void *tPtr,const NetworkConfig &nconf,const Tag &tag,const bool alreadyValidated) { return _addCredImpl<Tag>(_remoteTags,_revocations,RR,tPtr,nconf,tag,alreadyValidated); }
+Membership::AddCredentialResult Membership::addCredential(const RuntimeEnvironment *RR,void *tPtr,const NetworkConfig &nconf,const Capability &cap,const bool alreadyValidated) { return _addCredImpl<Capability>(_remoteCaps,_revocations,RR,tPtr,nconf,cap,alreadyValidated); }
+Membership::AddCredentialResult Membership::addCredential(const RuntimeEnvironment *RR,void *tPtr,const NetworkConfig &nconf,const CertificateOfOwnership &coo,const bool alreadyValidated) { return _addCredImpl<CertificateOfOwnership>(_remoteCoos,_revocations,RR,tPtr,nconf,coo,alreadyValidated); }
 
-Membership::AddCredentialResult Membership::addCredential(const RuntimeEnvironment *RR,void *tPtr,const NetworkConfig &nconf,const Revocation &rev)
+Membership::AddCredentialResult Membership::addCredential(const RuntimeEnvironment *RR,void *tPtr,const NetworkConfig &nconf,const Revocation &rev,const bool alreadyValidated)
 {
 	int64_t *rt;
-	switch(rev.verify(RR,tPtr)) {
+	switch((alreadyValidated) ? 0 : rev.verify(RR,tPtr)) {
 		default:
 			RR->t->credentialRejected(tPtr,rev,"invalid");
 			return ADD_REJECTED;
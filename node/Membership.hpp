@@ -149,30 +149,47 @@ public:
 		return (((t)&&(_isCredentialTimestampValid(nconf,*t))) ? t : (Tag *)0);
 	}
 
+	/**
+	 * Check whether addCredential() would verify a credential
+	 *
+	 * Credentials that are old, revoked, or already known are settled
+	 * without checking their signatures.
+	 *
+	 * @return True if credential's signature would be checked
+	 */
+	bool needsVerify(const CertificateOfMembership &com) const;
+	bool needsVerify(const Tag &tag) const;
+	bool needsVerify(const Capability &cap) const;
+	bool needsVerify(const CertificateOfOwnership &coo) const;
+	inline bool needsVerify(const Revocation &rev) const { return true; }
+
 	/**
 	 * Validate and add a credential if signature is okay and it's otherwise good
+	 *
+	 * If alreadyValidated is true the credential must already have passed
+	 * verify(), e.g. as part of a Credential::SignatureBatch.
 	 */
-	AddCredentialResult addCredential(const RuntimeEnvironment *RR,void *tPtr,const NetworkConfig &nconf,const CertificateOfMembership &com);
+	AddCredentialResult addCredential(const RuntimeEnvironment *RR,void *tPtr,const NetworkConfig &nconf,const CertificateOfMembership &com,const bool alreadyValidated = false);
 
 	/**
 	 * Validate and add a credential if signature is okay and it's otherwise good
 	 */
-	AddCredentialResult addCredential(const RuntimeEnvironment *RR,void *tPtr,const NetworkConfig &nconf,const Tag &tag);
+	AddCredentialResult addCredential(const RuntimeEnvironment *RR,void *tPtr,const NetworkConfig &nconf,const Tag &tag,const bool alreadyValidated = false);
 
 	/**
 	 * Validate and add a credential if signature is okay and it's otherwise good
 	 */
-	AddCredentialResult addCredential(const RuntimeEnvironment *RR,void *tPtr,const NetworkConfig &nconf,const Capability &cap);
+	AddCredentialResult addCredential(const RuntimeEnvironment *RR,void *tPtr,const NetworkConfig &nconf,const Capability &cap,const bool alreadyValidated = false);
 
 	/**
 	 * Validate and add a credential if signature is okay and it's otherwise good
 	 */
-	AddCredentialResult addCredential(const RuntimeEnvironment *RR,void *tPtr,const NetworkConfig &nconf,const CertificateOfOwnership &coo);
+	AddCredentialResult addCredential(const RuntimeEnvironment *RR,void *tPtr,const NetworkConfig &nconf,const CertificateOfOwnership &coo,const bool alreadyValidated = false);
 
 	/**
 	 * Validate and add a credential if signature is okay and it's otherwise good
 	 */
-	AddCredentialResult addCredential(const RuntimeEnvironment *RR,void *tPtr,const NetworkConfig &nconf,const Revocation &rev);
+	AddCredentialResult addCredential(const RuntimeEnvironment *RR,void *tPtr,const NetworkConfig &nconf,const Revocation &rev,const bool alreadyValidated = false);
 
 	/**
 	 * Clean internal databases of stale entries
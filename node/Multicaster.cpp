@@ -42,7 +42,6 @@ namespace ZeroTier {
 
 Multicaster::Multicaster(const RuntimeEnvironment *renv) :
 	RR(renv),
-	_groups(256),
 	_gatherAuth(256)
 {
 }
@@ -55,8 +54,10 @@ void Multicaster::addMultiple(void *tPtr,int64_t now,uint64_t nwid,const Multica
 {
 	const unsigned char *p = (const unsigned char *)addresses;
 	const unsigned char *e = p + (5 * count);
-	Mutex::Lock _l(_groups_m);
-	MulticastGroupStatus &gs = _groups[Multicaster::Key(nwid,mg)];
+	const Multicaster::Key gk(nwid,mg);
+	const unsigned int sh = _shard(gk);
+	Mutex::Lock _l(_groups_m[sh]);
+	MulticastGroupStatus &gs = _groups[sh][gk];
 	while (p != e) {
 		_add(tPtr,now,nwid,mg,gs,Address(p,5));
 		p += 5;
@@ -65,8 +66,10 @@ void Multicaster::addMultiple(void *tPtr,int64_t now,uint64_t nwid,const Multica
 
 void Multicaster::remove(uint64_t nwid,const MulticastGroup &mg,const Address &member)
 {
-	Mutex::Lock _l(_groups_m);
-	MulticastGroupStatus *s = _groups.get(Multicaster::Key(nwid,mg));
+	const Multicaster::Key gk(nwid,mg);
+	const unsigned int sh = _shard(gk);
+	Mutex::Lock _l(_groups_m[sh]);
+	MulticastGroupStatus *s = _groups[sh].get(gk);
 	if (s) {
 		for(std::vector<MulticastGroupMember>::iterator m(s->members.begin());m!=s->members.end();++m) {
 			if (m->address == member) {
@@ -102,9 +105,11 @@ unsigned int Multicaster::gather(const Address &queryingPeer,uint64_t nwid,const
 		}
 	}
 
-	Mutex::Lock _l(_groups_m);
+	const Multicaster::Key gk(nwid,mg);
+	const unsigned int sh = _shard(gk);
+	Mutex::Lock _l(_groups_m[sh]);
 
-	const MulticastGroupStatus *s = _groups.get(Multicaster::Key(nwid,mg));
+	const MulticastGroupStatus *s = _groups[sh].get(gk);
 	if ((s)&&(!s->members.empty())) {
 		totalKnown += (unsigned int)s->members.size();
 
@@ -145,8 +150,10 @@ restart_member_scan:
 std::vector<Address> Multicaster::getMembers(uint64_t nwid,const MulticastGroup &mg,unsigned int limit) const
 {
 	std::vector<Address> ls;
-	Mutex::Lock _l(_groups_m);
-	const MulticastGroupStatus *s = _groups.get(Multicaster::Key(nwid,mg));
+	const Multicaster::Key gk(nwid,mg);
+	const unsigned int sh = _shard(gk);
+	Mutex::Lock _l(_groups_m[sh]);
+	const MulticastGroupStatus *s = _groups[sh].get(gk);
 	if (!s)
 		return ls;
 	for(std::vector<MulticastGroupMember>::const_reverse_iterator m(s->members.rbegin());m!=s->members.rend();++m) {
@@ -217,8 +224,10 @@ void Multicaster::send(
 	}
 
 	try {
-		Mutex::Lock _l(_groups_m);
-		MulticastGroupStatus &gs = _groups[Multicaster::Key(network->id(),mg)];
+		const Multicaster::Key gk(network->id(),mg);
+		const unsigned int sh = _shard(gk);
+		Mutex::Lock _l(_groups_m[sh]);
+		MulticastGroupStatus &gs = _groups[sh][gk];
 
 		if (!gs.members.empty()) {
 			// Allocate a memory buffer if group is monstrous
@@ -257,24 +266,26 @@ void Multicaster::send(
 				data,
 				len);
 
-			unsigned int count = 0;
+			std::vector<Address> recipients;
+			recipients.reserve(limit);
 
 			for(unsigned int i=0;i<activeBridgeCount;++i) {
 				if ((activeBridges[i] != RR->identity.address())&&(activeBridges[i] != origin)) {
-					out.sendOnly(RR,tPtr,activeBridges[i]); // optimization: don't use dedup log if it's a one-pass send
-					if (++count >= limit)
+					recipients.push_back(activeBridges[i]);
+					if (recipients.size() >= limit)
 						break;
 				}
 			}
 
 			unsigned long idx = 0;
-			while ((count < limit)&&(idx < gs.members.size())) {
+			while ((recipients.size() < limit)&&(idx < gs.members.size())) {
 				const Address ma(gs.members[indexes[idx++]].address);
-				if ((std::find(activeBridges,activeBridges + activeBridgeCount,ma) == (activeBridges + activeBridgeCount))&&(ma != origin)) {
-					out.sendOnly(RR,tPtr,ma); // optimization: don't use dedup log if it's a one-pass send
-					++count;
-				}
+				if ((std::find(activeBridges,activeBridges + activeBridgeCount,ma) == (activeBridges + activeBridgeCount))&&(ma != origin))
+					recipients.push_back(ma);
 			}
+
+			if (!recipients.empty())
+				out.sendOnly(RR,tPtr,recipients.data(),(unsigned int)recipients.size()); // optimization: don't use dedup log if it's a one-pass send
 		} else {
 			const unsigned int gatherLimit = (limit - (unsigned int)gs.members.size()) + 1;
 
@@ -352,24 +363,26 @@ void Multicaster::send(
 			if (origin)
 				out.logAsSent(origin);
 
-			unsigned int count = 0;
+			std::vector<Address> recipients;
+			recipients.reserve(limit);
 
 			for(unsigned int i=0;i<activeBridgeCount;++i) {
 				if (activeBridges[i] != RR->identity.address()) {
-					out.sendAndLog(RR,tPtr,activeBridges[i]);
-					if (++count >= limit)
+					recipients.push_back(activeBridges[i]);
+					if (recipients.size() >= limit)
 						break;
 				}
 			}
 
 			unsigned long idx = 0;
-			while ((count < limit)&&(idx < gs.members.size())) {
+			while ((recipients.size() < limit)&&(idx < gs.members.size())) {
 				Address ma(gs.members[indexes[idx++]].address);
-				if (std::find(activeBridges,activeBridges + activeBridgeCount,ma) == (activeBridges + activeBridgeCount)) {
-					out.sendAndLog(RR,tPtr,ma);
-					++count;
-				}
+				if (std::find(activeBridges,activeBridges + activeBridgeCount,ma) == (activeBridges + activeBridgeCount))
+					recipients.push_back(ma);
 			}
+
+			if (!recipients.empty())
+				out.sendAndLog(RR,tPtr,recipients.data(),(unsigned int)recipients.size());
 		}
 	} catch ( ... ) {} // this is a sanity check to catch any failures and make sure indexes[] still gets deleted
 
@@ -380,11 +393,11 @@ void Multicaster::send(
 
 void Multicaster::clean(int64_t now)
 {
-	{
-		Mutex::Lock _l(_groups_m);
+	for(unsigned int sh=0;sh<ZT_MULTICASTER_GROUP_SHARDS;++sh) {
+		Mutex::Lock _l(_groups_m[sh]);
 		Multicaster::Key *k = (Multicaster::Key *)0;
 		MulticastGroupStatus *s = (MulticastGroupStatus *)0;
-		Hashtable<Multicaster::Key,MulticastGroupStatus>::Iterator mm(_groups);
+		Hashtable<Multicaster::Key,MulticastGroupStatus>::Iterator mm(_groups[sh]);
 		while (mm.next(k,s)) {
 			for(std::list<OutboundMulticast>::iterator tx(s->txQueue.begin());tx!=s->txQueue.end();) {
 				if ((tx->expired(now))||(tx->atLimit()))
@@ -409,7 +422,7 @@ void Multicaster::clean(int64_t now)
 			if (count) {
 				s->members.resize(count);
 			} else if (s->txQueue.empty()) {
-				_groups.erase(*k);
+				_groups[sh].erase(*k);
 			} else {
 				s->members.clear();
 			}
@@ -438,7 +451,7 @@ void Multicaster::addCredential(void *tPtr,const CertificateOfMembership &com,bo
 
 void Multicaster::_add(void *tPtr,int64_t now,uint64_t nwid,const MulticastGroup &mg,MulticastGroupStatus &gs,const Address &member)
 {
-	// assumes _groups_m is locked
+	// assumes the _groups_m shard containing gs is locked
 
 	// Do not add self -- even if someone else returns it
 	if (member == RR->identity.address())
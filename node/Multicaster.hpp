@@ -44,6 +44,9 @@
 #include "Mutex.hpp"
 #include "SharedPtr.hpp"
 
+// Number of independently locked shards in the multicast group table
+#define ZT_MULTICASTER_GROUP_SHARDS 16
+
 namespace ZeroTier {
 
 class RuntimeEnvironment;
@@ -70,8 +73,10 @@ public:
 	 */
 	inline void add(void *tPtr,int64_t now,uint64_t nwid,const MulticastGroup &mg,const Address &member)
 	{
-		Mutex::Lock _l(_groups_m);
-		_add(tPtr,now,nwid,mg,_groups[Multicaster::Key(nwid,mg)],member);
+		const Multicaster::Key k(nwid,mg);
+		const unsigned int sh = _shard(k);
+		Mutex::Lock _l(_groups_m[sh]);
+		_add(tPtr,now,nwid,mg,_groups[sh][k],member);
 	}
 
 	/**
@@ -220,8 +225,11 @@ private:
 
 	const RuntimeEnvironment *const RR;
 
-	Hashtable<Multicaster::Key,MulticastGroupStatus> _groups;
-	Mutex _groups_m;
+	// Groups are split across independently locked shards so that concurrent
+	// I/O threads working on different groups do not contend on one lock.
+	static inline unsigned int _shard(const Multicaster::Key &k) { return (unsigned int)(((uint64_t)k.hashCode() * 0x9e3779b97f4a7c15ULL) >> 56) % ZT_MULTICASTER_GROUP_SHARDS; }
+	Hashtable<Multicaster::Key,MulticastGroupStatus> _groups[ZT_MULTICASTER_GROUP_SHARDS];
+	Mutex _groups_m[ZT_MULTICASTER_GROUP_SHARDS];
 
 	struct _GatherAuthKey
 	{
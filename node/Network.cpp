@@ -43,507 +43,12 @@
 #include "Node.hpp"
 #include "Peer.hpp"
 #include "Trace.hpp"
+#include "RuleProgram.hpp"
 
 #include <set>
 
 namespace ZeroTier {
 
-namespace {
-
-// Returns true if packet appears valid; pos and proto will be set
-static bool _ipv6GetPayload(const uint8_t *frameData,unsigned int frameLen,unsigned int &pos,unsigned int &proto)
-{
-	if (frameLen < 40)
-		return false;
-	pos = 40;
-	proto = frameData[6];
-	while (pos <= frameLen) {
-		switch(proto) {
-			case 0: // hop-by-hop options
-			case 43: // routing
-			case 60: // destination options
-			case 135: // mobility options
-				if ((pos + 8) > frameLen)
-					return false; // invalid!
-				proto = frameData[pos];
-				pos += ((unsigned int)frameData[pos + 1] * 8) + 8;
-				break;
-
-			//case 44: // fragment -- we currently can't parse these and they are deprecated in IPv6 anyway
-			//case 50:
-			//case 51: // IPSec ESP and AH -- we have to stop here since this is encrypted stuff
-			default:
-				return true;
-		}
-	}
-	return false; // overflow == invalid
-}
-
-enum _doZtFilterResult
-{
-	DOZTFILTER_NO_MATCH,
-	DOZTFILTER_DROP,
-	DOZTFILTER_REDIRECT,
-	DOZTFILTER_ACCEPT,
-	DOZTFILTER_SUPER_ACCEPT
-};
-
-static _doZtFilterResult _doZtFilter(
-	const RuntimeEnvironment *RR,
-	Trace::RuleResultLog &rrl,
-	const NetworkConfig &nconf,
-	const Membership *membership, // can be NULL
-	const bool inbound,
-	const Address &ztSource,
-	Address &ztDest, // MUTABLE -- is changed on REDIRECT actions
-	const MAC &macSource,
-	const MAC &macDest,
-	const uint8_t *const frameData,
-	const unsigned int frameLen,
-	const unsigned int etherType,
-	const unsigned int vlanId,
-	const ZT_VirtualNetworkRule *rules, // cannot be NULL
-	const unsigned int ruleCount,
-	Address &cc, // MUTABLE -- set to TEE destination if TEE action is taken or left alone otherwise
-	unsigned int &ccLength, // MUTABLE -- set to length of packet payload to TEE
-	bool &ccWatch) // MUTABLE -- set to true for WATCH target as opposed to normal TEE
-{
-	// Set to true if we are a TEE/REDIRECT/WATCH target
-	bool superAccept = false;
-
-	// The default match state for each set of entries starts as 'true' since an
-	// ACTION with no MATCH entries preceding it is always taken.
-	uint8_t thisSetMatches = 1;
-
-	rrl.clear();
-
-	for(unsigned int rn=0;rn<ruleCount;++rn) {
-		const ZT_VirtualNetworkRuleType rt = (ZT_VirtualNetworkRuleType)(rules[rn].t & 0x3f);
-
-		// First check if this is an ACTION
-		if ((unsigned int)rt <= (unsigned int)ZT_NETWORK_RULE_ACTION__MAX_ID) {
-			if (thisSetMatches) {
-				switch(rt) {
-					case ZT_NETWORK_RULE_ACTION_DROP:
-						return DOZTFILTER_DROP;
-
-					case ZT_NETWORK_RULE_ACTION_ACCEPT:
-						return (superAccept ? DOZTFILTER_SUPER_ACCEPT : DOZTFILTER_ACCEPT); // match, accept packet
-
-					// These are initially handled together since preliminary logic is common
-					case ZT_NETWORK_RULE_ACTION_TEE:
-					case ZT_NETWORK_RULE_ACTION_WATCH:
-					case ZT_NETWORK_RULE_ACTION_REDIRECT:	{
-						const Address fwdAddr(rules[rn].v.fwd.address);
-						if (fwdAddr == ztSource) {
-							// Skip as no-op since source is target
-						} else if (fwdAddr == RR->identity.address()) {
-							if (inbound) {
-								return DOZTFILTER_SUPER_ACCEPT;
-							} else {
-							}
-						} else if (fwdAddr == ztDest) {
-						} else {
-							if (rt == ZT_NETWORK_RULE_ACTION_REDIRECT) {
-								ztDest = fwdAddr;
-								return DOZTFILTER_REDIRECT;
-							} else {
-								cc = fwdAddr;
-								ccLength = (rules[rn].v.fwd.length != 0) ? ((frameLen < (unsigned int)rules[rn].v.fwd.length) ? frameLen : (unsigned int)rules[rn].v.fwd.length) : frameLen;
-								ccWatch = (rt == ZT_NETWORK_RULE_ACTION_WATCH);
-							}
-						}
-					}	continue;
-
-					case ZT_NETWORK_RULE_ACTION_BREAK:
-						return DOZTFILTER_NO_MATCH;
-
-					// Unrecognized ACTIONs are ignored as no-ops
-					default:
-						continue;
-				}
-			} else {
-				// If this is an incoming packet and we are a TEE or REDIRECT target, we should
-				// super-accept if we accept at all. This will cause us to accept redirected or
-				// tee'd packets in spite of MAC and ZT addressing checks.
-				if (inbound) {
-					switch(rt) {
-						case ZT_NETWORK_RULE_ACTION_TEE:
-						case ZT_NETWORK_RULE_ACTION_WATCH:
-						case ZT_NETWORK_RULE_ACTION_REDIRECT:
-							if (RR->identity.address() == rules[rn].v.fwd.address)
-								superAccept = true;
-							break;
-						default:
-							break;
-					}
-				}
-
-				thisSetMatches = 1; // reset to default true for next batch of entries
-				continue;
-			}
-		}
-
-		// Circuit breaker: no need to evaluate an AND if the set's match state
-		// is currently false since anything AND false is false.
-		if ((!thisSetMatches)&&(!(rules[rn].t & 0x40))) {
-			rrl.logSkipped(rn,thisSetMatches);
-			continue;
-		}
-
-		// If this was not an ACTION evaluate next MATCH and update thisSetMatches with (AND [result])
-		uint8_t thisRuleMatches = 0;
-		uint64_t ownershipVerificationMask = 1; // this magic value means it hasn't been computed yet -- this is done lazily the first time it's needed
-		switch(rt) {
-			case ZT_NETWORK_RULE_MATCH_SOURCE_ZEROTIER_ADDRESS:
-				thisRuleMatches = (uint8_t)(rules[rn].v.zt == ztSource.toInt());
-				break;
-			case ZT_NETWORK_RULE_MATCH_DEST_ZEROTIER_ADDRESS:
-				thisRuleMatches = (uint8_t)(rules[rn].v.zt == ztDest.toInt());
-				break;
-			case ZT_NETWORK_RULE_MATCH_VLAN_ID:
-				thisRuleMatches = (uint8_t)(rules[rn].v.vlanId == (uint16_t)vlanId);
-				break;
-			case ZT_NETWORK_RULE_MATCH_VLAN_PCP:
-				// NOT SUPPORTED YET
-				thisRuleMatches = (uint8_t)(rules[rn].v.vlanPcp == 0);
-				break;
-			case ZT_NETWORK_RULE_MATCH_VLAN_DEI:
-				// NOT SUPPORTED YET
-				thisRuleMatches = (uint8_t)(rules[rn].v.vlanDei == 0);
-				break;
-			case ZT_NETWORK_RULE_MATCH_MAC_SOURCE:
-				thisRuleMatches = (uint8_t)(MAC(rules[rn].v.mac,6) == macSource);
-				break;
-			case ZT_NETWORK_RULE_MATCH_MAC_DEST:
-				thisRuleMatches = (uint8_t)(MAC(rules[rn].v.mac,6) == macDest);
-				break;
-			case ZT_NETWORK_RULE_MATCH_IPV4_SOURCE:
-				if ((etherType == ZT_ETHERTYPE_IPV4)&&(frameLen >= 20)) {
-					thisRuleMatches = (uint8_t)(InetAddress((const void *)&(rules[rn].v.ipv4.ip),4,rules[rn].v.ipv4.mask).containsAddress(InetAddress((const void *)(frameData + 12),4,0)));
-				} else {
-					thisRuleMatches = 0;
-				}
-				break;
-			case ZT_NETWORK_RULE_MATCH_IPV4_DEST:
-				if ((etherType == ZT_ETHERTYPE_IPV4)&&(frameLen >= 20)) {
-					thisRuleMatches = (uint8_t)(InetAddress((const void *)&(rules[rn].v.ipv4.ip),4,rules[rn].v.ipv4.mask).containsAddress(InetAddress((const void *)(frameData + 16),4,0)));
-				} else {
-					thisRuleMatches = 0;
-				}
-				break;
-			case ZT_NETWORK_RULE_MATCH_IPV6_SOURCE:
-				if ((etherType == ZT_ETHERTYPE_IPV6)&&(frameLen >= 40)) {
-					thisRuleMatches = (uint8_t)(InetAddress((const void *)rules[rn].v.ipv6.ip,16,rules[rn].v.ipv6.mask).containsAddress(InetAddress((const void *)(frameData + 8),16,0)));
-				} else {
-					thisRuleMatches = 0;
-				}
-				break;
-			case ZT_NETWORK_RULE_MATCH_IPV6_DEST:
-				if ((etherType == ZT_ETHERTYPE_IPV6)&&(frameLen >= 40)) {
-					thisRuleMatches = (uint8_t)(InetAddress((const void *)rules[rn].v.ipv6.ip,16,rules[rn].v.ipv6.mask).containsAddress(InetAddress((const void *)(frameData + 24),16,0)));
-				} else {
-					thisRuleMatches = 0;
-				}
-				break;
-			case ZT_NETWORK_RULE_MATCH_IP_TOS:
-				if ((etherType == ZT_ETHERTYPE_IPV4)&&(frameLen >= 20)) {
-					const uint8_t tosMasked = frameData[1] & rules[rn].v.ipTos.mask;
-					thisRuleMatches = (uint8_t)((tosMasked >= rules[rn].v.ipTos.value[0])&&(tosMasked <= rules[rn].v.ipTos.value[1]));
-				} else if ((etherType == ZT_ETHERTYPE_IPV6)&&(frameLen >= 40)) {
-					const uint8_t tosMasked = (((frameData[0] << 4) & 0xf0) | ((frameData[1] >> 4) & 0x0f)) & rules[rn].v.ipTos.mask;
-					thisRuleMatches = (uint8_t)((tosMasked >= rules[rn].v.ipTos.value[0])&&(tosMasked <= rules[rn].v.ipTos.value[1]));
-				} else {
-					thisRuleMatches = 0;
-				}
-				break;
-			case ZT_NETWORK_RULE_MATCH_IP_PROTOCOL:
-				if ((etherType == ZT_ETHERTYPE_IPV4)&&(frameLen >= 20)) {
-					thisRuleMatches = (uint8_t)(rules[rn].v.ipProtocol == frameData[9]);
-				} else if (etherType == ZT_ETHERTYPE_IPV6) {
-					unsigned int pos = 0,proto = 0;
-					if (_ipv6GetPayload(frameData,frameLen,pos,proto)) {
-						thisRuleMatches = (uint8_t)(rules[rn].v.ipProtocol == (uint8_t)proto);
-					} else {
-						thisRuleMatches = 0;
-					}
-				} else {
-					thisRuleMatches = 0;
-				}
-				break;
-			case ZT_NETWORK_RULE_MATCH_ETHERTYPE:
-				thisRuleMatches = (uint8_t)(rules[rn].v.etherType == (uint16_t)etherType);
-				break;
-			case ZT_NETWORK_RULE_MATCH_ICMP:
-				if ((etherType == ZT_ETHERTYPE_IPV4)&&(frameLen >= 20)) {
-					if (frameData[9] == 0x01) { // IP protocol == ICMP
-						const unsigned int ihl = (frameData[0] & 0xf) * 4;
-						if (frameLen >= (ihl + 2)) {
-							if (rules[rn].v.icmp.type == frameData[ihl]) {
-								if ((rules[rn].v.icmp.flags & 0x01) != 0) {
-									thisRuleMatches = (uint8_t)(frameData[ihl+1] == rules[rn].v.icmp.code);
-								} else {
-									thisRuleMatches = 1;
-								}
-							} else {
-								thisRuleMatches = 0;
-							}
-						} else {
-							thisRuleMatches = 0;
-						}
-					} else {
-						thisRuleMatches = 0;
-					}
-				} else if (etherType == ZT_ETHERTYPE_IPV6) {
-					unsigned int pos = 0,proto = 0;
-					if (_ipv6GetPayload(frameData,frameLen,pos,proto)) {
-						if ((proto == 0x3a)&&(frameLen >= (pos+2))) {
-							if (rules[rn].v.icmp.type == frameData[pos]) {
-								if ((rules[rn].v.icmp.flags & 0x01) != 0) {
-									thisRuleMatches = (uint8_t)(frameData[pos+1] == rules[rn].v.icmp.code);
-								} else {
-									thisRuleMatches = 1;
-								}
-							} else {
-								thisRuleMatches = 0;
-							}
-						} else {
-							thisRuleMatches = 0;
-						}
-					} else {
-						thisRuleMatches = 0;
-					}
-				} else {
-					thisRuleMatches = 0;
-				}
-				break;
-			case ZT_NETWORK_RULE_MATCH_IP_SOURCE_PORT_RANGE:
-			case ZT_NETWORK_RULE_MATCH_IP_DEST_PORT_RANGE:
-				if ((etherType == ZT_ETHERTYPE_IPV4)&&(frameLen >= 20)) {
-					const unsigned int headerLen = 4 * (frameData[0] & 0xf);
-					int p = -1;
-					switch(frameData[9]) { // IP protocol number
-						// All these start with 16-bit source and destination port in that order
-						case 0x06: // TCP
-						case 0x11: // UDP
-						case 0x84: // SCTP
-						case 0x88: // UDPLite
-							if (frameLen > (headerLen + 4)) {
-								unsigned int pos = headerLen + ((rt == ZT_NETWORK_RULE_MATCH_IP_DEST_PORT_RANGE) ? 2 : 0);
-								p = (int)frameData[pos++] << 8;
-								p |= (int)frameData[pos];
-							}
-							break;
-					}
-
-					thisRuleMatches = (p >= 0) ? (uint8_t)((p >= (int)rules[rn].v.port[0])&&(p <= (int)rules[rn].v.port[1])) : (uint8_t)0;
-				} else if (etherType == ZT_ETHERTYPE_IPV6) {
-					unsigned int pos = 0,proto = 0;
-					if (_ipv6GetPayload(frameData,frameLen,pos,proto)) {
-						int p = -1;
-						switch(proto) { // IP protocol number
-							// All these start with 16-bit source and destination port in that order
-							case 0x06: // TCP
-							case 0x11: // UDP
-							case 0x84: // SCTP
-							case 0x88: // UDPLite
-								if (frameLen > (pos + 4)) {
-									if (rt == ZT_NETWORK_RULE_MATCH_IP_DEST_PORT_RANGE) pos += 2;
-									p = (int)frameData[pos++] << 8;
-									p |= (int)frameData[pos];
-								}
-								break;
-						}
-						thisRuleMatches = (p > 0) ? (uint8_t)((p >= (int)rules[rn].v.port[0])&&(p <= (int)rules[rn].v.port[1])) : (uint8_t)0;
-					} else {
-						thisRuleMatches = 0;
-					}
-				} else {
-					thisRuleMatches = 0;
-				}
-				break;
-			case ZT_NETWORK_RULE_MATCH_CHARACTERISTICS: {
-				uint64_t cf = (inbound) ? ZT_RULE_PACKET_CHARACTERISTICS_INBOUND : 0ULL;
-				if (macDest.isMulticast()) cf |= ZT_RULE_PACKET_CHARACTERISTICS_MULTICAST;
-				if (macDest.isBroadcast()) cf |= ZT_RULE_PACKET_CHARACTERISTICS_BROADCAST;
-				if (ownershipVerificationMask == 1) {
-					ownershipVerificationMask = 0;
-					InetAddress src;
-					if ((etherType == ZT_ETHERTYPE_IPV4)&&(frameLen >= 20)) {
-						src.set((const void *)(frameData + 12),4,0);
-					} else if ((etherType == ZT_ETHERTYPE_IPV6)&&(frameLen >= 40)) {
-						// IPv6 NDP requires special handling, since the src and dest IPs in the packet are empty or link-local.
-						if ( (frameLen >= (40 + 8 + 16)) && (frameData[6] == 0x3a) && ((frameData[40] == 0x87)||(frameData[40] == 0x88)) ) {
-							if (frameData[40] == 0x87) {
-								// Neighbor solicitations contain no reliable source address, so we implement a small
-								// hack by considering them authenticated. Otherwise you would pretty much have to do
-								// this manually in the rule set for IPv6 to work at all.
-								ownershipVerificationMask |= ZT_RULE_PACKET_CHARACTERISTICS_SENDER_IP_AUTHENTICATED;
-							} else {
-								// Neighbor advertisements on the other hand can absolutely be authenticated.
-								src.set((const void *)(frameData + 40 + 8),16,0);
-							}
-						} else {
-							// Other IPv6 packets can be handled normally
-							src.set((const void *)(frameData + 8),16,0);
-						}
-					} else if ((etherType == ZT_ETHERTYPE_ARP)&&(frameLen >= 28)) {
-						src.set((const void *)(frameData + 14),4,0);
-					}
-					if (inbound) {
-						if (membership) {
-							if ((src)&&(membership->hasCertificateOfOwnershipFor<InetAddress>(nconf,src)))
-								ownershipVerificationMask |= ZT_RULE_PACKET_CHARACTERISTICS_SENDER_IP_AUTHENTICATED;
-							if (membership->hasCertificateOfOwnershipFor<MAC>(nconf,macSource))
-								ownershipVerificationMask |= ZT_RULE_PACKET_CHARACTERISTICS_SENDER_MAC_AUTHENTICATED;
-						}
-					} else {
-						for(unsigned int i=0;i<nconf.certificateOfOwnershipCount;++i) {
-							if ((src)&&(nconf.certificatesOfOwnership[i].owns(src)))
-								ownershipVerificationMask |= ZT_RULE_PACKET_CHARACTERISTICS_SENDER_IP_AUTHENTICATED;
-							if (nconf.certificatesOfOwnership[i].owns(macSource))
-								ownershipVerificationMask |= ZT_RULE_PACKET_CHARACTERISTICS_SENDER_MAC_AUTHENTICATED;
-						}
-					}
-				}
-				cf |= ownershipVerificationMask;
-				if ((etherType == ZT_ETHERTYPE_IPV4)&&(frameLen >= 20)&&(frameData[9] == 0x06)) {
-					const unsigned int headerLen = 4 * (frameData[0] & 0xf);
-					cf |= (uint64_t)frameData[headerLen + 13];
-					cf |= (((uint64_t)(frameData[headerLen + 12] & 0x0f)) << 8);
-				} else if (etherType == ZT_ETHERTYPE_IPV6) {
-					unsigned int pos = 0,proto = 0;
-					if (_ipv6GetPayload(frameData,frameLen,pos,proto)) {
-						if ((proto == 0x06)&&(frameLen > (pos + 14))) {
-							cf |= (uint64_t)frameData[pos + 13];
-							cf |= (((uint64_t)(frameData[pos + 12] & 0x0f)) << 8);
-						}
-					}
-				}
-				thisRuleMatches = (uint8_t)((cf & rules[rn].v.characteristics) != 0);
-			}	break;
-			case ZT_NETWORK_RULE_MATCH_FRAME_SIZE_RANGE:
-				thisRuleMatches = (uint8_t)((frameLen >= (unsigned int)rules[rn].v.frameSize[0])&&(frameLen <= (unsigned int)rules[rn].v.frameSize[1]));
-				break;
-			case ZT_NETWORK_RULE_MATCH_RANDOM:
-				thisRuleMatches = (uint8_t)((uint32_t)(RR->node->prng() & 0xffffffffULL) <= rules[rn].v.randomProbability);
-				break;
-			case ZT_NETWORK_RULE_MATCH_TAGS_DIFFERENCE:
-			case ZT_NETWORK_RULE_MATCH_TAGS_BITWISE_AND:
-			case ZT_NETWORK_RULE_MATCH_TAGS_BITWISE_OR:
-			case ZT_NETWORK_RULE_MATCH_TAGS_BITWISE_XOR:
-			case ZT_NETWORK_RULE_MATCH_TAGS_EQUAL: {
-				const Tag *const localTag = std::lower_bound(&(nconf.tags[0]),&(nconf.tags[nconf.tagCount]),rules[rn].v.tag.id,Tag::IdComparePredicate());
-				if ((localTag != &(nconf.tags[nconf.tagCount]))&&(localTag->id() == rules[rn].v.tag.id)) {
-					const Tag *const remoteTag = ((membership) ? membership->getTag(nconf,rules[rn].v.tag.id) : (const Tag *)0);
-					if (remoteTag) {
-						const uint32_t ltv = localTag->value();
-						const uint32_t rtv = remoteTag->value();
-						if (rt == ZT_NETWORK_RULE_MATCH_TAGS_DIFFERENCE) {
-							const uint32_t diff = (ltv > rtv) ? (ltv - rtv) : (rtv - ltv);
-							thisRuleMatches = (uint8_t)(diff <= rules[rn].v.tag.value);
-						} else if (rt == ZT_NETWORK_RULE_MATCH_TAGS_BITWISE_AND) {
-							thisRuleMatches = (uint8_t)((ltv & rtv) == rules[rn].v.tag.value);
-						} else if (rt == ZT_NETWORK_RULE_MATCH_TAGS_BITWISE_OR) {
-							thisRuleMatches = (uint8_t)((ltv | rtv) == rules[rn].v.tag.value);
-						} else if (rt == ZT_NETWORK_RULE_MATCH_TAGS_BITWISE_XOR) {
-							thisRuleMatches = (uint8_t)((ltv ^ rtv) == rules[rn].v.tag.value);
-						} else if (rt == ZT_NETWORK_RULE_MATCH_TAGS_EQUAL) {
-							thisRuleMatches = (uint8_t)((ltv == rules[rn].v.tag.value)&&(rtv == rules[rn].v.tag.value));
-						} else { // sanity check, can't really happen
-							thisRuleMatches = 0;
-						}
-					} else {
-						if ((inbound)&&(!superAccept)) {
-							thisRuleMatches = 0;
-						} else {
-							// Outbound side is not strict since if we have to match both tags and
-							// we are sending a first packet to a recipient, we probably do not know
-							// about their tags yet. They will filter on inbound and we will filter
-							// once we get their tag. If we are a tee/redirect target we are also
-							// not strict since we likely do not have these tags.
-							thisRuleMatches = 1;
-						}
-					}
-				} else {
-					thisRuleMatches = 0;
-				}
-			}	break;
-			case ZT_NETWORK_RULE_MATCH_TAG_SENDER:
-			case ZT_NETWORK_RULE_MATCH_TAG_RECEIVER: {
-				if (superAccept) {
-					thisRuleMatches = 1;
-				} else if ( ((rt == ZT_NETWORK_RULE_MATCH_TAG_SENDER)&&(inbound)) || ((rt == ZT_NETWORK_RULE_MATCH_TAG_RECEIVER)&&(!inbound)) ) {
-					const Tag *const remoteTag = ((membership) ? membership->getTag(nconf,rules[rn].v.tag.id) : (const Tag *)0);
-					if (remoteTag) {
-						thisRuleMatches = (uint8_t)(remoteTag->value() == rules[rn].v.tag.value);
-					} else {
-						if (rt == ZT_NETWORK_RULE_MATCH_TAG_RECEIVER) {
-							// If we are checking the receiver and this is an outbound packet, we
-							// can't be strict since we may not yet know the receiver's tag.
-							thisRuleMatches = 1;
-						} else {
-							thisRuleMatches = 0;
-						}
-					}
-				} else { // sender and outbound or receiver and inbound
-					const Tag *const localTag = std::lower_bound(&(nconf.tags[0]),&(nconf.tags[nconf.tagCount]),rules[rn].v.tag.id,Tag::IdComparePredicate());
-					if ((localTag != &(nconf.tags[nconf.tagCount]))&&(localTag->id() == rules[rn].v.tag.id)) {
-						thisRuleMatches = (uint8_t)(localTag->value() == rules[rn].v.tag.value);
-					} else {
-						thisRuleMatches = 0;
-					}
-				}
-			}	break;
-			case ZT_NETWORK_RULE_MATCH_INTEGER_RANGE: {
-				uint64_t integer = 0;
-				const unsigned int bits = (rules[rn].v.intRange.format & 63) + 1;
-				const unsigned int bytes = ((bits + 8 - 1) / 8); // integer ceiling of division by 8
-				if ((rules[rn].v.intRange.format & 0x80) == 0) {
-					// Big-endian
-					unsigned int idx = rules[rn].v.intRange.idx + (8 - bytes);
-					const unsigned int eof = idx + bytes;
-					if (eof <= frameLen) {
-						while (idx < eof) {
-							integer <<= 8;
-							integer |= frameData[idx++];
-						}
-					}
-					integer &= 0xffffffffffffffffULL >> (64 - bits);
-				} else {
-					// Little-endian
-					unsigned int idx = rules[rn].v.intRange.idx;
-					const unsigned int eof = idx + bytes;
-					if (eof <= frameLen) {
-						while (idx < eof) {
-							integer >>= 8;
-							integer |= ((uint64_t)frameData[idx++]) << 56;
-						}
-					}
-					integer >>= (64 - bits);
-				}
-				thisRuleMatches = (uint8_t)((integer >= rules[rn].v.intRange.start)&&(integer <= (rules[rn].v.intRange.start + (uint64_t)rules[rn].v.intRange.end)));
-			}	break;
-
-			// The result of an unsupported MATCH is configurable at the network
-			// level via a flag.
-			default:
-				thisRuleMatches = (uint8_t)((nconf.flags & ZT_NETWORKCONFIG_FLAG_RULES_RESULT_OF_UNSUPPORTED_MATCH) != 0);
-				break;
-		}
-
-		rrl.log(rn,thisRuleMatches,thisSetMatches);
-
-		if ((rules[rn].t & 0x40))
-			thisSetMatches |= (thisRuleMatches ^ ((rules[rn].t >> 7) & 1));
-		else thisSetMatches &= (thisRuleMatches ^ ((rules[rn].t >> 7) & 1));
-	}
-
-	return DOZTFILTER_NO_MATCH;
-}
-
-} // anonymous namespace
-
 const ZeroTier::MulticastGroup Network::BROADCAST(ZeroTier::MAC(0xffffffffffffULL),0);
 
 Network::Network(const RuntimeEnvironment *renv,void *tPtr,uint64_t nwid,void *uptr,const NetworkConfig *nconf) :
@@ -553,6 +58,8 @@ Network::Network(const RuntimeEnvironment *renv,void *tPtr,uint64_t nwid,void *u
 	_lastAnnouncedMulticastGroupsUpstream(0),
 	_mac(renv->identity.address(),nwid),
 	_portInitialized(false),
+	_capabilityProgramsCacheable(true),
+	_filterByRecipientClass(false),
 	_lastConfigUpdate(0),
 	_destroyed(false),
 	_netconfFailure(NETCONF_FAILURE_NONE),
@@ -624,98 +131,123 @@ bool Network::filterOutgoingPacket(
 	const unsigned int vlanId)
 {
 	const int64_t now = RR->node->now();
-	Address ztFinalDest(ztDest);
-	int localCapabilityIndex = -1;
-	int accept = 0;
 	Trace::RuleResultLog rrl,crrl;
-	Address cc;
-	unsigned int ccLength = 0;
-	bool ccWatch = false;
 
 	Mutex::Lock _l(_lock);
 
 	Membership *const membership = (ztDest) ? _memberships.get(ztDest) : (Membership *)0;
 
-	switch(_doZtFilter(RR,rrl,_config,membership,false,ztSource,ztFinalDest,macSource,macDest,frameData,frameLen,etherType,vlanId,_config.rules,_config.ruleCount,cc,ccLength,ccWatch)) {
-
-		case DOZTFILTER_NO_MATCH: {
-			for(unsigned int c=0;c<_config.capabilityCount;++c) {
-				ztFinalDest = ztDest; // sanity check, shouldn't be possible if there was no match
-				Address cc2;
-				unsigned int ccLength2 = 0;
-				bool ccWatch2 = false;
-				switch (_doZtFilter(RR,crrl,_config,membership,false,ztSource,ztFinalDest,macSource,macDest,frameData,frameLen,etherType,vlanId,_config.capabilities[c].rules(),_config.capabilities[c].ruleCount(),cc2,ccLength2,ccWatch2)) {
-					case DOZTFILTER_NO_MATCH:
-					case DOZTFILTER_DROP: // explicit DROP in a capability just terminates its evaluation and is an anti-pattern
-						break;
+	// Traced networks use the interpreter since it records per-rule results
+	const bool traced = (_config.remoteTraceTarget);
+	const bool cacheable = ((!traced)&&(_ruleProgram.cacheable())&&(_capabilityProgramsCacheable));
+	const RuleProgram::Flow flow(ztSource,ztDest,macSource,macDest,frameData,frameLen,etherType,vlanId);
+	RuleProgram::Flow::Key fk;
+	const _FilterVerdict *cached = (const _FilterVerdict *)0;
+	if (cacheable) {
+		flow.key(fk,false);
+		if (_filterByRecipientClass)
+			_recipientClassKey(fk,membership);
+		cached = _flowCache.get(fk);
+	}
 
-					case DOZTFILTER_REDIRECT: // interpreted as ACCEPT but ztFinalDest will have been changed in _doZtFilter()
-					case DOZTFILTER_ACCEPT:
-					case DOZTFILTER_SUPER_ACCEPT: // no difference in behavior on outbound side in capabilities
-						localCapabilityIndex = (int)c;
-						accept = 1;
-
-						if ((!noTee)&&(cc2)) {
-							Membership &m2 = _membership(cc2);
-							m2.pushCredentials(RR,tPtr,now,cc2,_config,localCapabilityIndex,false);
-
-							Packet outp(cc2,RR->identity.address(),Packet::VERB_EXT_FRAME);
-							outp.append(_id);
-							outp.append((uint8_t)(ccWatch2 ? 0x16 : 0x02));
-							macDest.appendTo(outp);
-							macSource.appendTo(outp);
-							outp.append((uint16_t)etherType);
-							outp.append(frameData,ccLength2);
-							outp.compress();
-							RR->sw->send(tPtr,outp,true);
-						}
+	_FilterVerdict v;
+	if (cached) {
+		v = *cached;
+		if (_filterByRecipientClass)
+			v.finalDest = ztDest; // shared by recipients of a class, and rules with REDIRECT are never keyed that way
+		if (v.ccLength > frameLen) v.ccLength = frameLen;
+		if (v.capCcLength > frameLen) v.capCcLength = frameLen;
+	} else {
+		v.finalDest = ztDest;
+		switch((traced) ?
+			RuleProgram::interpret(RR,rrl,_config,membership,false,ztSource,v.finalDest,macSource,macDest,frameData,frameLen,etherType,vlanId,_config.rules,_config.ruleCount,v.cc,v.ccLength,v.ccWatch) :
+			_ruleProgram.run(RR,_config,membership,false,ztSource,v.finalDest,macSource,macDest,flow,v.cc,v.ccLength,v.ccWatch)) {
+
+			case RuleProgram::NO_MATCH: {
+				for(unsigned int c=0;c<_config.capabilityCount;++c) {
+					v.finalDest = ztDest; // sanity check, shouldn't be possible if there was no match
+					Address cc2;
+					unsigned int ccLength2 = 0;
+					bool ccWatch2 = false;
+					switch ((traced) ?
+						RuleProgram::interpret(RR,crrl,_config,membership,false,ztSource,v.finalDest,macSource,macDest,frameData,frameLen,etherType,vlanId,_config.capabilities[c].rules(),_config.capabilities[c].ruleCount(),cc2,ccLength2,ccWatch2) :
+						_capabilityPrograms[c].run(RR,_config,membership,false,ztSource,v.finalDest,macSource,macDest,flow,cc2,ccLength2,ccWatch2)) {
+						case RuleProgram::NO_MATCH:
+						case RuleProgram::DROP: // explicit DROP in a capability just terminates its evaluation and is an anti-pattern
+							break;
 
+						case RuleProgram::REDIRECT: // interpreted as ACCEPT but v.finalDest will have been changed by rule evaluation
+						case RuleProgram::ACCEPT:
+						case RuleProgram::SUPER_ACCEPT: // no difference in behavior on outbound side in capabilities
+							v.capability = (int)c;
+							v.accept = 1;
+							v.capCc = cc2;
+							v.capCcLength = ccLength2;
+							v.capCcWatch = ccWatch2;
+							break;
+					}
+					if (v.accept)
 						break;
 				}
-				if (accept)
-					break;
-			}
-		}	break;
+			}	break;
 
-		case DOZTFILTER_DROP:
-			if (_config.remoteTraceTarget)
-				RR->t->networkFilter(tPtr,*this,rrl,(Trace::RuleResultLog *)0,(Capability *)0,ztSource,ztDest,macSource,macDest,frameData,frameLen,etherType,vlanId,noTee,false,0);
-			return false;
+			case RuleProgram::DROP:
+				break;
 
-		case DOZTFILTER_REDIRECT: // interpreted as ACCEPT but ztFinalDest will have been changed in _doZtFilter()
-		case DOZTFILTER_ACCEPT:
-			accept = 1;
-			break;
+			case RuleProgram::REDIRECT: // interpreted as ACCEPT but v.finalDest will have been changed by rule evaluation
+			case RuleProgram::ACCEPT:
+				v.accept = 1;
+				break;
 
-		case DOZTFILTER_SUPER_ACCEPT:
-			accept = 2;
-			break;
+			case RuleProgram::SUPER_ACCEPT:
+				v.accept = 2;
+				break;
+		}
+
+		if (cacheable)
+			_cacheFilterVerdict(fk,v,frameLen);
 	}
 
-	if (accept) {
+	const int localCapabilityIndex = v.capability;
+	if (v.accept) {
+		if ((!noTee)&&(v.capCc)) {
+			Membership &m2 = _membership(v.capCc);
+			m2.pushCredentials(RR,tPtr,now,v.capCc,_config,localCapabilityIndex,false);
+
+			Packet outp(v.capCc,RR->identity.address(),Packet::VERB_EXT_FRAME);
+			outp.append(_id);
+			outp.append((uint8_t)(v.capCcWatch ? 0x16 : 0x02));
+			macDest.appendTo(outp);
+			macSource.appendTo(outp);
+			outp.append((uint16_t)etherType);
+			outp.append(frameData,v.capCcLength);
+			outp.compress();
+			RR->sw->send(tPtr,outp,true);
+		}
+
 		if (membership)
 			membership->pushCredentials(RR,tPtr,now,ztDest,_config,localCapabilityIndex,false);
 
-		if ((!noTee)&&(cc)) {
-			Membership &m2 = _membership(cc);
-			m2.pushCredentials(RR,tPtr,now,cc,_config,localCapabilityIndex,false);
+		if ((!noTee)&&(v.cc)) {
+			Membership &m2 = _membership(v.cc);
+			m2.pushCredentials(RR,tPtr,now,v.cc,_config,localCapabilityIndex,false);
 
-			Packet outp(cc,RR->identity.address(),Packet::VERB_EXT_FRAME);
+			Packet outp(v.cc,RR->identity.address(),Packet::VERB_EXT_FRAME);
 			outp.append(_id);
-			outp.append((uint8_t)(ccWatch ? 0x16 : 0x02));
+			outp.append((uint8_t)(v.ccWatch ? 0x16 : 0x02));
 			macDest.appendTo(outp);
 			macSource.appendTo(outp);
 			outp.append((uint16_t)etherType);
-			outp.append(frameData,ccLength);
+			outp.append(frameData,v.ccLength);
 			outp.compress();
 			RR->sw->send(tPtr,outp,true);
 		}
 
-		if ((ztDest != ztFinalDest)&&(ztFinalDest)) {
-			Membership &m2 = _membership(ztFinalDest);
-			m2.pushCredentials(RR,tPtr,now,ztFinalDest,_config,localCapabilityIndex,false);
+		if ((ztDest != v.finalDest)&&(v.finalDest)) {
+			Membership &m2 = _membership(v.finalDest);
+			m2.pushCredentials(RR,tPtr,now,v.finalDest,_config,localCapabilityIndex,false);
 
-			Packet outp(ztFinalDest,RR->identity.address(),Packet::VERB_EXT_FRAME);
+			Packet outp(v.finalDest,RR->identity.address(),Packet::VERB_EXT_FRAME);
 			outp.append(_id);
 			outp.append((uint8_t)0x04);
 			macDest.appendTo(outp);
@@ -725,16 +257,16 @@ bool Network::filterOutgoingPacket(
 			outp.compress();
 			RR->sw->send(tPtr,outp,true);
 
-			if (_config.remoteTraceTarget)
+			if (traced)
 				RR->t->networkFilter(tPtr,*this,rrl,(localCapabilityIndex >= 0) ? &crrl : (Trace::RuleResultLog *)0,(localCapabilityIndex >= 0) ? &(_config.capabilities[localCapabilityIndex]) : (Capability *)0,ztSource,ztDest,macSource,macDest,frameData,frameLen,etherType,vlanId,noTee,false,0);
 			return false; // DROP locally, since we redirected
 		} else {
-			if (_config.remoteTraceTarget)
+			if (traced)
 				RR->t->networkFilter(tPtr,*this,rrl,(localCapabilityIndex >= 0) ? &crrl : (Trace::RuleResultLog *)0,(localCapabilityIndex >= 0) ? &(_config.capabilities[localCapabilityIndex]) : (Capability *)0,ztSource,ztDest,macSource,macDest,frameData,frameLen,etherType,vlanId,noTee,false,1);
 			return true;
 		}
 	} else {
-		if (_config.remoteTraceTarget)
+		if (traced)
 			RR->t->networkFilter(tPtr,*this,rrl,(localCapabilityIndex >= 0) ? &crrl : (Trace::RuleResultLog *)0,(localCapabilityIndex >= 0) ? &(_config.capabilities[localCapabilityIndex]) : (Capability *)0,ztSource,ztDest,macSource,macDest,frameData,frameLen,etherType,vlanId,noTee,false,0);
 		return false;
 	}
@@ -751,92 +283,111 @@ int Network::filterIncomingPacket(
 	const unsigned int etherType,
 	const unsigned int vlanId)
 {
-	Address ztFinalDest(ztDest);
 	Trace::RuleResultLog rrl,crrl;
-	int accept = 0;
-	Address cc;
-	unsigned int ccLength = 0;
-	bool ccWatch = false;
 	const Capability *c = (Capability *)0;
 
 	Mutex::Lock _l(_lock);
 
 	Membership &membership = _membership(sourcePeer->address());
 
-	switch (_doZtFilter(RR,rrl,_config,&membership,true,sourcePeer->address(),ztFinalDest,macSource,macDest,frameData,frameLen,etherType,vlanId,_config.rules,_config.ruleCount,cc,ccLength,ccWatch)) {
-
-		case DOZTFILTER_NO_MATCH: {
-			Membership::CapabilityIterator mci(membership,_config);
-			while ((c = mci.next())) {
-				ztFinalDest = ztDest; // sanity check, should be unmodified if there was no match
-				Address cc2;
-				unsigned int ccLength2 = 0;
-				bool ccWatch2 = false;
-				switch(_doZtFilter(RR,crrl,_config,&membership,true,sourcePeer->address(),ztFinalDest,macSource,macDest,frameData,frameLen,etherType,vlanId,c->rules(),c->ruleCount(),cc2,ccLength2,ccWatch2)) {
-					case DOZTFILTER_NO_MATCH:
-					case DOZTFILTER_DROP: // explicit DROP in a capability just terminates its evaluation and is an anti-pattern
-						break;
-					case DOZTFILTER_REDIRECT: // interpreted as ACCEPT but ztDest will have been changed in _doZtFilter()
-					case DOZTFILTER_ACCEPT:
-						accept = 1; // ACCEPT
-						break;
-					case DOZTFILTER_SUPER_ACCEPT:
-						accept = 2; // super-ACCEPT
-						break;
-				}
+	const bool traced = (_config.remoteTraceTarget);
+	bool cacheable = ((!traced)&&(_ruleProgram.cacheable()));
+	const RuleProgram::Flow flow(sourcePeer->address(),ztDest,macSource,macDest,frameData,frameLen,etherType,vlanId);
+	RuleProgram::Flow::Key fk;
+	const _FilterVerdict *const cached = (cacheable) ? _flowCache.get(flow.key(fk,true)) : (const _FilterVerdict *)0;
+
+	_FilterVerdict v;
+	if (cached) {
+		v = *cached;
+		if (v.ccLength > frameLen) v.ccLength = frameLen;
+		if (v.capCcLength > frameLen) v.capCcLength = frameLen;
+	} else {
+		v.finalDest = ztDest;
+		switch ((traced) ?
+			RuleProgram::interpret(RR,rrl,_config,&membership,true,sourcePeer->address(),v.finalDest,macSource,macDest,frameData,frameLen,etherType,vlanId,_config.rules,_config.ruleCount,v.cc,v.ccLength,v.ccWatch) :
+			_ruleProgram.run(RR,_config,&membership,true,sourcePeer->address(),v.finalDest,macSource,macDest,flow,v.cc,v.ccLength,v.ccWatch)) {
+
+			case RuleProgram::NO_MATCH: {
+				// Capabilities presented by the remote member are not compiled and always use the interpreter
+				Membership::CapabilityIterator mci(membership,_config);
+				while ((c = mci.next())) {
+					if (!RuleProgram::cacheable(c->rules(),c->ruleCount()))
+						cacheable = false;
+					v.finalDest = ztDest; // sanity check, should be unmodified if there was no match
+					Address cc2;
+					unsigned int ccLength2 = 0;
+					bool ccWatch2 = false;
+					switch(RuleProgram::interpret(RR,crrl,_config,&membership,true,sourcePeer->address(),v.finalDest,macSource,macDest,frameData,frameLen,etherType,vlanId,c->rules(),c->ruleCount(),cc2,ccLength2,ccWatch2)) {
+						case RuleProgram::NO_MATCH:
+						case RuleProgram::DROP: // explicit DROP in a capability just terminates its evaluation and is an anti-pattern
+							break;
+						case RuleProgram::REDIRECT: // interpreted as ACCEPT but v.finalDest will have been changed by rule evaluation
+						case RuleProgram::ACCEPT:
+							v.accept = 1; // ACCEPT
+							break;
+						case RuleProgram::SUPER_ACCEPT:
+							v.accept = 2; // super-ACCEPT
+							break;
+					}
 
-				if (accept) {
-					if (cc2) {
-						_membership(cc2).pushCredentials(RR,tPtr,RR->node->now(),cc2,_config,-1,false);
-
-						Packet outp(cc2,RR->identity.address(),Packet::VERB_EXT_FRAME);
-						outp.append(_id);
-						outp.append((uint8_t)(ccWatch2 ? 0x1c : 0x08));
-						macDest.appendTo(outp);
-						macSource.appendTo(outp);
-						outp.append((uint16_t)etherType);
-						outp.append(frameData,ccLength2);
-						outp.compress();
-						RR->sw->send(tPtr,outp,true);
+					if (v.accept) {
+						v.capCc = cc2;
+						v.capCcLength = ccLength2;
+						v.capCcWatch = ccWatch2;
+						break;
 					}
-					break;
 				}
-			}
-		}	break;
-
-		case DOZTFILTER_DROP:
-			if (_config.remoteTraceTarget)
-				RR->t->networkFilter(tPtr,*this,rrl,(Trace::RuleResultLog *)0,(Capability *)0,sourcePeer->address(),ztDest,macSource,macDest,frameData,frameLen,etherType,vlanId,false,true,0);
-			return 0; // DROP
-
-		case DOZTFILTER_REDIRECT: // interpreted as ACCEPT but ztFinalDest will have been changed in _doZtFilter()
-		case DOZTFILTER_ACCEPT:
-			accept = 1; // ACCEPT
-			break;
-		case DOZTFILTER_SUPER_ACCEPT:
-			accept = 2; // super-ACCEPT
-			break;
+			}	break;
+
+			case RuleProgram::DROP:
+				break;
+
+			case RuleProgram::REDIRECT: // interpreted as ACCEPT but v.finalDest will have been changed by rule evaluation
+			case RuleProgram::ACCEPT:
+				v.accept = 1; // ACCEPT
+				break;
+			case RuleProgram::SUPER_ACCEPT:
+				v.accept = 2; // super-ACCEPT
+				break;
+		}
+
+		if (cacheable)
+			_cacheFilterVerdict(fk,v,frameLen);
 	}
 
-	if (accept) {
-		if (cc) {
-			_membership(cc).pushCredentials(RR,tPtr,RR->node->now(),cc,_config,-1,false);
+	if (v.accept) {
+		if (v.capCc) {
+			_membership(v.capCc).pushCredentials(RR,tPtr,RR->node->now(),v.capCc,_config,-1,false);
+
+			Packet outp(v.capCc,RR->identity.address(),Packet::VERB_EXT_FRAME);
+			outp.append(_id);
+			outp.append((uint8_t)(v.capCcWatch ? 0x1c : 0x08));
+			macDest.appendTo(outp);
+			macSource.appendTo(outp);
+			outp.append((uint16_t)etherType);
+			outp.append(frameData,v.capCcLength);
+			outp.compress();
+			RR->sw->send(tPtr,outp,true);
+		}
+
+		if (v.cc) {
+			_membership(v.cc).pushCredentials(RR,tPtr,RR->node->now(),v.cc,_config,-1,false);
 
-			Packet outp(cc,RR->identity.address(),Packet::VERB_EXT_FRAME);
+			Packet outp(v.cc,RR->identity.address(),Packet::VERB_EXT_FRAME);
 			outp.append(_id);
-			outp.append((uint8_t)(ccWatch ? 0x1c : 0x08));
+			outp.append((uint8_t)(v.ccWatch ? 0x1c : 0x08));
 			macDest.appendTo(outp);
 			macSource.appendTo(outp);
 			outp.append((uint16_t)etherType);
-			outp.append(frameData,ccLength);
+			outp.append(frameData,v.ccLength);
 			outp.compress();
 			RR->sw->send(tPtr,outp,true);
 		}
 
-		if ((ztDest != ztFinalDest)&&(ztFinalDest)) {
-			_membership(ztFinalDest).pushCredentials(RR,tPtr,RR->node->now(),ztFinalDest,_config,-1,false);
+		if ((ztDest != v.finalDest)&&(v.finalDest)) {
+			_membership(v.finalDest).pushCredentials(RR,tPtr,RR->node->now(),v.finalDest,_config,-1,false);
 
-			Packet outp(ztFinalDest,RR->identity.address(),Packet::VERB_EXT_FRAME);
+			Packet outp(v.finalDest,RR->identity.address(),Packet::VERB_EXT_FRAME);
 			outp.append(_id);
 			outp.append((uint8_t)0x0a);
 			macDest.appendTo(outp);
@@ -846,15 +397,15 @@ int Network::filterIncomingPacket(
 			outp.compress();
 			RR->sw->send(tPtr,outp,true);
 
-			if (_config.remoteTraceTarget)
+			if (traced)
 				RR->t->networkFilter(tPtr,*this,rrl,(c) ? &crrl : (Trace::RuleResultLog *)0,c,sourcePeer->address(),ztDest,macSource,macDest,frameData,frameLen,etherType,vlanId,false,true,0);
 			return 0; // DROP locally, since we redirected
 		}
 	}
 
-	if (_config.remoteTraceTarget)
-		RR->t->networkFilter(tPtr,*this,rrl,(c) ? &crrl : (Trace::RuleResultLog *)0,c,sourcePeer->address(),ztDest,macSource,macDest,frameData,frameLen,etherType,vlanId,false,true,accept);
-	return accept;
+	if (traced)
+		RR->t->networkFilter(tPtr,*this,rrl,(c) ? &crrl : (Trace::RuleResultLog *)0,c,sourcePeer->address(),ztDest,macSource,macDest,frameData,frameLen,etherType,vlanId,false,true,v.accept);
+	return v.accept;
 }
 
 bool Network::subscribedToMulticastGroup(const MulticastGroup &mg,bool includeBridgedGroups) const
@@ -1033,6 +584,24 @@ int Network::setConfiguration(void *tPtr,const NetworkConfig &nconf,bool saveToD
 			Mutex::Lock _l(_lock);
 
 			_config = nconf;
+			_ruleProgram.compile(_config.rules,_config.ruleCount);
+			_capabilityPrograms.resize(_config.capabilityCount);
+			_capabilityProgramsCacheable = true;
+			for(unsigned int c=0;c<_config.capabilityCount;++c) {
+				_capabilityPrograms[c].compile(_config.capabilities[c].rules(),_config.capabilities[c].ruleCount());
+				_capabilityProgramsCacheable &= _capabilityPrograms[c].cacheable();
+			}
+			_filterByRecipientClass = _ruleProgram.destinationIndependent();
+			_filterClassTagIds = _ruleProgram.tagIds();
+			for(unsigned int c=0;c<_config.capabilityCount;++c) {
+				_filterByRecipientClass &= _capabilityPrograms[c].destinationIndependent();
+				_filterClassTagIds.insert(_filterClassTagIds.end(),_capabilityPrograms[c].tagIds().begin(),_capabilityPrograms[c].tagIds().end());
+			}
+			std::sort(_filterClassTagIds.begin(),_filterClassTagIds.end());
+			_filterClassTagIds.erase(std::unique(_filterClassTagIds.begin(),_filterClassTagIds.end()),_filterClassTagIds.end());
+			if (_filterClassTagIds.size() > ZT_NETWORK_FLOW_CACHE_MAX_CLASS_TAGS)
+				_filterByRecipientClass = false;
+			_flowCache.clear();
 			_lastConfigUpdate = RR->node->now();
 			_netconfFailure = NETCONF_FAILURE_NONE;
 
@@ -1282,6 +851,9 @@ void Network::clean()
 	if (_destroyed)
 		return;
 
+	// Memberships and their credentials may expire below
+	_flowCache.clear();
+
 	{
 		Hashtable< MulticastGroup,uint64_t >::Iterator i(_multicastGroupsBehindMe);
 		MulticastGroup *mg = (MulticastGroup *)0;
@@ -1350,14 +922,14 @@ void Network::learnBridgedMulticastGroup(void *tPtr,const MulticastGroup &mg,int
 		_sendUpdatesToMembers(tPtr,&mg);
 }
 
-Membership::AddCredentialResult Network::addCredential(void *tPtr,const CertificateOfMembership &com)
+Membership::AddCredentialResult Network::addCredential(void *tPtr,const CertificateOfMembership &com,const bool alreadyValidated)
 {
 	if (com.networkId() != _id)
 		return Membership::ADD_REJECTED;
 	const Address a(com.issuedTo());
 	Mutex::Lock _l(_lock);
 	Membership &m = _membership(a);
-	const Membership::AddCredentialResult result = m.addCredential(RR,tPtr,_config,com);
+	const Membership::AddCredentialResult result = m.addCredential(RR,tPtr,_config,com,alreadyValidated);
 	if ((result == Membership::ADD_ACCEPTED_NEW)||(result == Membership::ADD_ACCEPTED_REDUNDANT)) {
 		m.pushCredentials(RR,tPtr,RR->node->now(),a,_config,-1,false);
 		RR->mc->addCredential(tPtr,com,true);
@@ -1365,7 +937,7 @@ Membership::AddCredentialResult Network::addCredential(void *tPtr,const Certific
 	return result;
 }
 
-Membership::AddCredentialResult Network::addCredential(void *tPtr,const Address &sentFrom,const Revocation &rev)
+Membership::AddCredentialResult Network::addCredential(void *tPtr,const Address &sentFrom,const Revocation &rev,const bool alreadyValidated)
 {
 	if (rev.networkId() != _id)
 		return Membership::ADD_REJECTED;
@@ -1373,7 +945,9 @@ Membership::AddCredentialResult Network::addCredential(void *tPtr,const Address
 	Mutex::Lock _l(_lock);
 	Membership &m = _membership(rev.target());
 
-	const Membership::AddCredentialResult result = m.addCredential(RR,tPtr,_config,rev);
+	const Membership::AddCredentialResult result = m.addCredential(RR,tPtr,_config,rev,alreadyValidated);
+	if (result == Membership::ADD_ACCEPTED_NEW)
+		_flowCache.clear();
 
 	if ((result == Membership::ADD_ACCEPTED_NEW)&&(rev.fastPropagate())) {
 		Address *a = (Address *)0;
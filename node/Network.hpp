@@ -50,10 +50,21 @@
 #include "Membership.hpp"
 #include "NetworkConfig.hpp"
 #include "CertificateOfMembership.hpp"
+#include "RuleProgram.hpp"
 
 #define ZT_NETWORK_MAX_INCOMING_UPDATES 3
 #define ZT_NETWORK_MAX_UPDATE_CHUNKS ((ZT_NETWORKCONFIG_DICT_CAPACITY / 1024) + 1)
 
+/**
+ * Maximum number of cached per-flow filter verdicts per network (cache is flushed when full)
+ */
+#define ZT_NETWORK_FLOW_CACHE_SIZE 4096
+
+/**
+ * Maximum number of distinct tags rules may test for verdicts to be shared by recipients with equal tags
+ */
+#define ZT_NETWORK_FLOW_CACHE_MAX_CLASS_TAGS 4
+
 namespace ZeroTier {
 
 class RuntimeEnvironment;
@@ -309,46 +320,71 @@ public:
 	/**
 	 * Validate a credential and learn it if it passes certificate and other checks
 	 */
-	Membership::AddCredentialResult addCredential(void *tPtr,const CertificateOfMembership &com);
+	Membership::AddCredentialResult addCredential(void *tPtr,const CertificateOfMembership &com,const bool alreadyValidated = false);
 
 	/**
 	 * Validate a credential and learn it if it passes certificate and other checks
 	 */
-	inline Membership::AddCredentialResult addCredential(void *tPtr,const Capability &cap)
+	inline Membership::AddCredentialResult addCredential(void *tPtr,const Capability &cap,const bool alreadyValidated = false)
 	{
 		if (cap.networkId() != _id)
 			return Membership::ADD_REJECTED;
 		Mutex::Lock _l(_lock);
-		return _membership(cap.issuedTo()).addCredential(RR,tPtr,_config,cap);
+		const Membership::AddCredentialResult result = _membership(cap.issuedTo()).addCredential(RR,tPtr,_config,cap,alreadyValidated);
+		if (result == Membership::ADD_ACCEPTED_NEW)
+			_flowCache.clear();
+		return result;
 	}
 
 	/**
 	 * Validate a credential and learn it if it passes certificate and other checks
 	 */
-	inline Membership::AddCredentialResult addCredential(void *tPtr,const Tag &tag)
+	inline Membership::AddCredentialResult addCredential(void *tPtr,const Tag &tag,const bool alreadyValidated = false)
 	{
 		if (tag.networkId() != _id)
 			return Membership::ADD_REJECTED;
 		Mutex::Lock _l(_lock);
-		return _membership(tag.issuedTo()).addCredential(RR,tPtr,_config,tag);
+		const Membership::AddCredentialResult result = _membership(tag.issuedTo()).addCredential(RR,tPtr,_config,tag,alreadyValidated);
+		if (result == Membership::ADD_ACCEPTED_NEW)
+			_flowCache.clear();
+		return result;
 	}
 
 	/**
 	 * Validate a credential and learn it if it passes certificate and other checks
 	 */
-	Membership::AddCredentialResult addCredential(void *tPtr,const Address &sentFrom,const Revocation &rev);
+	Membership::AddCredentialResult addCredential(void *tPtr,const Address &sentFrom,const Revocation &rev,const bool alreadyValidated = false);
 
 	/**
 	 * Validate a credential and learn it if it passes certificate and other checks
 	 */
-	inline Membership::AddCredentialResult addCredential(void *tPtr,const CertificateOfOwnership &coo)
+	inline Membership::AddCredentialResult addCredential(void *tPtr,const CertificateOfOwnership &coo,const bool alreadyValidated = false)
 	{
 		if (coo.networkId() != _id)
 			return Membership::ADD_REJECTED;
 		Mutex::Lock _l(_lock);
-		return _membership(coo.issuedTo()).addCredential(RR,tPtr,_config,coo);
+		return _membership(coo.issuedTo()).addCredential(RR,tPtr,_config,coo,alreadyValidated);
 	}
 
+	/**
+	 * Check whether addCredential() would verify a credential's signature
+	 *
+	 * This lets credentials received together be verified as one batch.
+	 *
+	 * @param cred Credential
+	 * @return True if credential is for this network and is not old, revoked, or already known
+	 */
+	template<typename C>
+	inline bool credentialNeedsVerify(const C &cred)
+	{
+		if (cred.networkId() != _id)
+			return false;
+		Mutex::Lock _l(_lock);
+		const Membership *const m = _memberships.get(cred.issuedTo());
+		return ((!m)||(m->needsVerify(cred)));
+	}
+	inline bool credentialNeedsVerify(const Revocation &rev) { return (rev.networkId() == _id); }
+
 	/**
 	 * Force push credentials (COM, etc.) to a peer now
 	 *
@@ -395,6 +431,47 @@ private:
 	std::vector<MulticastGroup> _allMulticastGroups() const;
 	Membership &_membership(const Address &a);
 
+	// Result of filtering a frame, cached per flow when rules allow
+	struct _FilterVerdict
+	{
+		_FilterVerdict() : accept(0),capability(-1),ccLength(0),ccWatch(false),capCcLength(0),capCcWatch(false) {}
+		int accept; // 0 (drop), 1 (accept), or 2 (super-accept)
+		int capability; // index of accepting local capability or -1
+		Address finalDest; // ZeroTier destination after any REDIRECT
+		Address cc; // TEE/WATCH target from network rules
+		unsigned int ccLength;
+		bool ccWatch;
+		Address capCc; // TEE/WATCH target from accepting capability
+		unsigned int capCcLength;
+		bool capCcWatch;
+	};
+
+	// Replaces the destination in an outbound flow key with the values of the
+	// recipient's tags tested by the rules, so that recipients with equal tags
+	// share one verdict. Assumes _lock is locked.
+	inline void _recipientClassKey(RuleProgram::Flow::Key &fk,const Membership *membership) const
+	{
+		fk.k[1] = 0x8000000000000000ULL; // ZeroTier addresses are 40 bits, so this can't collide with one
+		for(unsigned int i=0;i<(unsigned int)_filterClassTagIds.size();++i) {
+			const Tag *const t = (membership) ? membership->getTag(_config,_filterClassTagIds[i]) : (const Tag *)0;
+			if (t) {
+				fk.k[1] |= 1ULL << i;
+				fk.k[11 + (i >> 1)] |= (uint64_t)t->value() << ((i & 1) * 32);
+			}
+		}
+	}
+
+	// Assumes _lock is locked
+	inline void _cacheFilterVerdict(const RuleProgram::Flow::Key &fk,const _FilterVerdict &v,const unsigned int frameLen)
+	{
+		// TEE/WATCH lengths are cached as limits, which are only known if they truncated this frame
+		if (((v.cc)&&(v.ccLength >= frameLen))||((v.capCc)&&(v.capCcLength >= frameLen)))
+			return;
+		if (_flowCache.size() >= ZT_NETWORK_FLOW_CACHE_SIZE)
+			_flowCache.clear();
+		_flowCache.set(fk,v);
+	}
+
 	const RuntimeEnvironment *const RR;
 	void *_uPtr;
 	const uint64_t _id;
@@ -407,6 +484,12 @@ private:
 	Hashtable< MAC,Address > _remoteBridgeRoutes; // remote addresses where given MACs are reachable (for tracking devices behind remote bridges)
 
 	NetworkConfig _config;
+	RuleProgram _ruleProgram; // compiled from _config.rules
+	std::vector<RuleProgram> _capabilityPrograms; // compiled from _config.capabilities[]
+	bool _capabilityProgramsCacheable;
+	bool _filterByRecipientClass; // true if outbound verdicts depend on the destination only through _filterClassTagIds
+	std::vector<uint32_t> _filterClassTagIds;
+	Hashtable< RuleProgram::Flow::Key,_FilterVerdict > _flowCache; // cleared on config, tag, capability, and revocation changes
 	uint64_t _lastConfigUpdate;
 
 	struct _IncomingConfigChunk
@@ -47,6 +47,7 @@
 #include "SelfAwareness.hpp"
 #include "Network.hpp"
 #include "Trace.hpp"
+#include "SignatureCache.hpp"
 
 namespace ZeroTier {
 
@@ -62,7 +63,8 @@ Node::Node(void *uptr,void *tptr,const struct ZT_Node_Callbacks *callbacks,int64
 	_now(now),
 	_lastPingCheck(0),
 	_lastHousekeepingRun(0),
-	_lastMemoizedTraceSettings(0)
+	_lastMemoizedTraceSettings(0),
+	_multipathMode(ZT_MULTIPATH_NONE)
 {
 	if (callbacks->version != 0)
 		throw ZT_EXCEPTION_INVALID_ARGUMENT;
@@ -106,6 +108,7 @@ Node::Node(void *uptr,void *tptr,const struct ZT_Node_Callbacks *callbacks,int64
 				stateObjectPut(tptr,ZT_STATE_OBJECT_IDENTITY_PUBLIC,idtmp,RR->publicIdentityStr,(unsigned int)strlen(RR->publicIdentityStr));
 		}
 	}
+	RR->identity.expandSigningKey(_signingKey);
 
 	char *m = (char *)0;
 	try {
@@ -114,8 +117,9 @@ Node::Node(void *uptr,void *tptr,const struct ZT_Node_Callbacks *callbacks,int64
 		const unsigned long mcs = sizeof(Multicaster) + (((sizeof(Multicaster) & 0xf) != 0) ? (16 - (sizeof(Multicaster) & 0xf)) : 0);
 		const unsigned long topologys = sizeof(Topology) + (((sizeof(Topology) & 0xf) != 0) ? (16 - (sizeof(Topology) & 0xf)) : 0);
 		const unsigned long sas = sizeof(SelfAwareness) + (((sizeof(SelfAwareness) & 0xf) != 0) ? (16 - (sizeof(SelfAwareness) & 0xf)) : 0);
+		const unsigned long scs = sizeof(SignatureCache) + (((sizeof(SignatureCache) & 0xf) != 0) ? (16 - (sizeof(SignatureCache) & 0xf)) : 0);
 
-		m = reinterpret_cast<char *>(::malloc(16 + ts + sws + mcs + topologys + sas));
+		m = reinterpret_cast<char *>(::malloc(16 + ts + sws + mcs + topologys + sas + scs));
 		if (!m)
 			throw std::bad_alloc();
 		RR->rtmem = m;
@@ -130,7 +134,10 @@ Node::Node(void *uptr,void *tptr,const struct ZT_Node_Callbacks *callbacks,int64
 		RR->topology = new (m) Topology(RR,tptr);
 		m += topologys;
 		RR->sa = new (m) SelfAwareness(RR);
+		m += sas;
+		RR->sc = new (m) SignatureCache();
 	} catch ( ... ) {
+		if (RR->sc) RR->sc->~SignatureCache();
 		if (RR->sa) RR->sa->~SelfAwareness();
 		if (RR->topology) RR->topology->~Topology();
 		if (RR->mc) RR->mc->~Multicaster();
@@ -149,6 +156,8 @@ Node::~Node()
 		Mutex::Lock _l(_networks_m);
 		_networks.clear(); // destroy all networks before shutdown
 	}
+	Utils::burn(&_signingKey,sizeof(_signingKey));
+	if (RR->sc) RR->sc->~SignatureCache();
 	if (RR->sa) RR->sa->~SelfAwareness();
 	if (RR->topology) RR->topology->~Topology();
 	if (RR->mc) RR->mc->~Multicaster();
@@ -338,6 +347,7 @@ ZT_ResultCode Node::processBackgroundTasks(void *tptr,int64_t now,volatile int64
 			RR->topology->doPeriodicTasks(tptr,now);
 			RR->sa->clean(now);
 			RR->mc->clean(now);
+			RR->sc->clean(now);
 		} catch ( ... ) {
 			return ZT_RESULT_FATAL_ERROR_INTERNAL;
 		}
@@ -433,6 +443,10 @@ void Node::status(ZT_NodeStatus *status) const
 	status->publicIdentity = RR->publicIdentityStr;
 	status->secretIdentity = RR->secretIdentityStr;
 	status->online = _online ? 1 : 0;
+	status->rxQueueFragmentDrops = RR->sw->rxQueueFragmentDrops();
+	status->rxQueueWaitingDrops = RR->sw->rxQueueWaitingDrops();
+	status->signatureCacheHits = RR->sc->hits();
+	status->signatureCacheMisses = RR->sc->misses();
 }
 
 ZT_PeerList *Node::peers() const
@@ -447,36 +461,37 @@ ZT_PeerList *Node::peers() const
 	pl->peers = (ZT_Peer *)(buf + sizeof(ZT_PeerList));
 
 	pl->peerCount = 0;
-	for(std::vector< std::pair< Address,SharedPtr<Peer> > >::iterator pi(peers.begin());pi!=peers.end();++pi) {
-		ZT_Peer *p = &(pl->peers[pl->peerCount++]);
-		p->address = pi->second->address().toInt();
-		if (pi->second->remoteVersionKnown()) {
-			p->versionMajor = pi->second->remoteVersionMajor();
-			p->versionMinor = pi->second->remoteVersionMinor();
-			p->versionRev = pi->second->remoteVersionRevision();
-		} else {
-			p->versionMajor = -1;
-			p->versionMinor = -1;
-			p->versionRev = -1;
-		}
-		p->latency = pi->second->latency(_now);
-		if (p->latency >= 0xffff)
-			p->latency = -1;
-		p->role = RR->topology->role(pi->second->identity().address());
+	for(std::vector< std::pair< Address,SharedPtr<Peer> > >::iterator pi(peers.begin());pi!=peers.end();++pi)
+		_peerStatus(&(pl->peers[pl->peerCount++]),pi->second,ZT_PEER_FIELD_ALL);
 
-		std::vector< SharedPtr<Path> > paths(pi->second->paths(_now));
-		SharedPtr<Path> bestp(pi->second->getBestPath(_now,false));
-		p->pathCount = 0;
-		for(std::vector< SharedPtr<Path> >::iterator path(paths.begin());path!=paths.end();++path) {
-			ZT_FAST_MEMCPY(&(p->paths[p->pathCount].address),&((*path)->address()),sizeof(struct sockaddr_storage));
-			p->paths[p->pathCount].lastSend = (*path)->lastOut();
-			p->paths[p->pathCount].lastReceive = (*path)->lastIn();
-			p->paths[p->pathCount].trustedPathId = RR->topology->getOutboundPathTrust((*path)->address());
-			p->paths[p->pathCount].expired = 0;
-			p->paths[p->pathCount].preferred = ((*path) == bestp) ? 1 : 0;
-			++p->pathCount;
-		}
-	}
+	return pl;
+}
+
+ZT_Peer *Node::peer(uint64_t address,unsigned int fields) const
+{
+	const SharedPtr<Peer> p(RR->topology->getPeerNoCache(Address(address)));
+	if (!p)
+		return (ZT_Peer *)0;
+	ZT_Peer *const zp = (ZT_Peer *)::malloc(sizeof(ZT_Peer));
+	if (zp)
+		_peerStatus(zp,p,fields);
+	return zp;
+}
+
+ZT_PeerList *Node::peersAfter(uint64_t after,unsigned int maxPeers,unsigned int fields) const
+{
+	std::vector< std::pair< Address,SharedPtr<Peer> > > peers;
+	RR->topology->peersAfter(Address(after),maxPeers,peers);
+
+	char *buf = (char *)::malloc(sizeof(ZT_PeerList) + (sizeof(ZT_Peer) * peers.size()));
+	if (!buf)
+		return (ZT_PeerList *)0;
+	ZT_PeerList *pl = (ZT_PeerList *)buf;
+	pl->peers = (ZT_Peer *)(buf + sizeof(ZT_PeerList));
+
+	pl->peerCount = 0;
+	for(std::vector< std::pair< Address,SharedPtr<Peer> > >::iterator pi(peers.begin());pi!=peers.end();++pi)
+		_peerStatus(&(pl->peers[pl->peerCount++]),pi->second,fields);
 
 	return pl;
 }
@@ -563,6 +578,50 @@ void Node::setNetconfMaster(void *networkControllerInstance)
 /* Node methods used only within node/                                      */
 /****************************************************************************/
 
+void Node::_peerStatus(ZT_Peer *const p,const SharedPtr<Peer> &peer,const unsigned int fields) const
+{
+	memset(p,0,sizeof(ZT_Peer));
+	p->address = peer->address().toInt();
+	if ((fields & ZT_PEER_FIELD_VERSION) != 0) {
+		if (peer->remoteVersionKnown()) {
+			p->versionMajor = peer->remoteVersionMajor();
+			p->versionMinor = peer->remoteVersionMinor();
+			p->versionRev = peer->remoteVersionRevision();
+		} else {
+			p->versionMajor = -1;
+			p->versionMinor = -1;
+			p->versionRev = -1;
+		}
+	}
+	if ((fields & ZT_PEER_FIELD_LATENCY) != 0) {
+		p->latency = peer->latency(_now);
+		if (p->latency >= 0xffff)
+			p->latency = -1;
+	}
+	if ((fields & ZT_PEER_FIELD_ROLE) != 0)
+		p->role = RR->topology->role(peer->identity().address());
+
+	if ((fields & (ZT_PEER_FIELD_PATHS|ZT_PEER_FIELD_PATH_STATS)) != 0) {
+		std::vector< SharedPtr<Path> > paths(peer->paths(_now));
+		SharedPtr<Path> bestp(peer->getBestPath(_now,false));
+		for(std::vector< SharedPtr<Path> >::iterator path(paths.begin());path!=paths.end();++path) {
+			ZT_PeerPhysicalPath *const pp = &(p->paths[p->pathCount++]);
+			ZT_FAST_MEMCPY(&(pp->address),&((*path)->address()),sizeof(struct sockaddr_storage));
+			pp->lastSend = (*path)->lastOut();
+			pp->lastReceive = (*path)->lastIn();
+			pp->trustedPathId = RR->topology->getOutboundPathTrust((*path)->address());
+			pp->expired = 0;
+			pp->preferred = ((*path) == bestp) ? 1 : 0;
+			if ((fields & ZT_PEER_FIELD_PATH_STATS) != 0) {
+				pp->latency = ((*path)->latency() < 0xffff) ? (int)(*path)->latency() : -1;
+				pp->jitter = (int)(*path)->jitter();
+				pp->packetLoss = (float)(*path)->packetLoss() / 1000.0f;
+				(*path)->rttHistogram(pp->rttHistogram);
+			}
+		}
+	}
+}
+
 bool Node::shouldUsePathForZeroTierTraffic(void *tPtr,const Address &ztaddr,const int64_t localSocket,const InetAddress &remoteAddress)
 {
 	if (!Path::isAddressValidForPath(remoteAddress))
@@ -607,6 +666,11 @@ ZT_ResultCode Node::setPhysicalPathConfiguration(const struct sockaddr_storage *
 	return ZT_RESULT_OK;
 }
 
+void Node::setReceiveQueueSize(unsigned int entries)
+{
+	RR->sw->setRxQueueSize(entries);
+}
+
 World Node::planet() const
 {
 	return RR->topology->planet();
@@ -631,16 +695,19 @@ void Node::ncSendConfig(uint64_t nwid,uint64_t requestPacketId,const Address &de
 				if (!configUpdateId) ++configUpdateId;
 
 				const unsigned int totalSize = dconf->sizeBytes();
+				unsigned int sigStart = 0;
+				std::vector<Packet> chunks;
 				unsigned int chunkIndex = 0;
 				while (chunkIndex < totalSize) {
 					const unsigned int chunkLen = std::min(totalSize - chunkIndex,(unsigned int)(ZT_PROTO_MAX_PACKET_LENGTH - (ZT_PACKET_IDX_PAYLOAD + 256)));
-					Packet outp(destination,RR->identity.address(),(requestPacketId) ? Packet::VERB_OK : Packet::VERB_NETWORK_CONFIG);
+					chunks.push_back(Packet(destination,RR->identity.address(),(requestPacketId) ? Packet::VERB_OK : Packet::VERB_NETWORK_CONFIG));
+					Packet &outp = chunks.back();
 					if (requestPacketId) {
 						outp.append((unsigned char)Packet::VERB_NETWORK_CONFIG_REQUEST);
 						outp.append(requestPacketId);
 					}
 
-					const unsigned int sigStart = outp.size();
+					sigStart = outp.size();
 					outp.append(nwid);
 					outp.append((uint16_t)chunkLen);
 					outp.append((const void *)(dconf->data() + chunkIndex),chunkLen);
@@ -650,14 +717,30 @@ void Node::ncSendConfig(uint64_t nwid,uint64_t requestPacketId,const Address &de
 					outp.append((uint32_t)totalSize);
 					outp.append((uint32_t)chunkIndex);
 
-					C25519::Signature sig(RR->identity.sign(reinterpret_cast<const uint8_t *>(outp.data()) + sigStart,outp.size() - sigStart));
+					chunkIndex += chunkLen;
+				}
+
+				// Sign all chunks together, then send
+				const unsigned int n = (unsigned int)chunks.size();
+				std::vector<C25519::Signature> sigs(n);
+				std::vector<const void *> msgs(n);
+				std::vector<unsigned int> lens(n);
+				std::vector<void *> sigp(n);
+				for(unsigned int i=0;i<n;++i) {
+					msgs[i] = reinterpret_cast<const uint8_t *>(chunks[i].data()) + sigStart;
+					lens[i] = chunks[i].size() - sigStart;
+					sigp[i] = sigs[i].data;
+				}
+				if (n)
+					C25519::signBatch(_signingKey,&(msgs[0]),&(lens[0]),&(sigp[0]),n);
+				for(unsigned int i=0;i<n;++i) {
+					Packet &outp = chunks[i];
 					outp.append((uint8_t)1);
 					outp.append((uint16_t)ZT_C25519_SIGNATURE_LEN);
-					outp.append(sig.data,ZT_C25519_SIGNATURE_LEN);
+					outp.append(sigs[i].data,ZT_C25519_SIGNATURE_LEN);
 
 					outp.compress();
 					RR->sw->send((void *)0,outp,true);
-					chunkIndex += chunkLen;
 				}
 			}
 			delete dconf;
@@ -886,6 +969,24 @@ ZT_PeerList *ZT_Node_peers(ZT_Node *node)
 	}
 }
 
+ZT_Peer *ZT_Node_peer(ZT_Node *node,uint64_t address,unsigned int fields)
+{
+	try {
+		return reinterpret_cast<ZeroTier::Node *>(node)->peer(address,fields);
+	} catch ( ... ) {
+		return (ZT_Peer *)0;
+	}
+}
+
+ZT_PeerList *ZT_Node_peersAfter(ZT_Node *node,uint64_t after,unsigned int maxPeers,unsigned int fields)
+{
+	try {
+		return reinterpret_cast<ZeroTier::Node *>(node)->peersAfter(after,maxPeers,fields);
+	} catch ( ... ) {
+		return (ZT_PeerList *)0;
+	}
+}
+
 ZT_VirtualNetworkConfig *ZT_Node_networkConfig(ZT_Node *node,uint64_t nwid)
 {
 	try {
@@ -952,6 +1053,20 @@ enum ZT_ResultCode ZT_Node_setPhysicalPathConfiguration(ZT_Node *node,const stru
 	}
 }
 
+void ZT_Node_setReceiveQueueSize(ZT_Node *node,unsigned int entries)
+{
+	try {
+		reinterpret_cast<ZeroTier::Node *>(node)->setReceiveQueueSize(entries);
+	} catch ( ... ) {}
+}
+
+void ZT_Node_setMultipathMode(ZT_Node *node,enum ZT_MultipathMode mode)
+{
+	try {
+		reinterpret_cast<ZeroTier::Node *>(node)->setMultipathMode(mode);
+	} catch ( ... ) {}
+}
+
 void ZT_version(int *major,int *minor,int *revision)
 {
 	if (major) *major = ZEROTIER_ONE_VERSION_MAJOR;
@@ -55,6 +55,7 @@
 namespace ZeroTier {
 
 class World;
+class Peer;
 
 /**
  * Implementation of Node object as defined in CAPI
@@ -104,6 +105,8 @@ public:
 	uint64_t address() const;
 	void status(ZT_NodeStatus *status) const;
 	ZT_PeerList *peers() const;
+	ZT_Peer *peer(uint64_t address,unsigned int fields) const;
+	ZT_PeerList *peersAfter(uint64_t after,unsigned int maxPeers,unsigned int fields) const;
 	ZT_VirtualNetworkConfig *networkConfig(uint64_t nwid) const;
 	ZT_VirtualNetworkList *networks() const;
 	void freeQueryResult(void *qr);
@@ -193,6 +196,9 @@ public:
 
 	uint64_t prng();
 	ZT_ResultCode setPhysicalPathConfiguration(const struct sockaddr_storage *pathNetwork,const ZT_PhysicalPathConfiguration *pathConfig);
+	void setReceiveQueueSize(unsigned int entries);
+	inline void setMultipathMode(const ZT_MultipathMode mode) { _multipathMode = mode; }
+	inline ZT_MultipathMode multipathMode() const { return _multipathMode; }
 
 	World planet() const;
 	std::vector<World> moons() const;
@@ -261,6 +267,8 @@ public:
 	inline Trace::Level remoteTraceLevel() const { return _remoteTraceLevel; }
 
 private:
+	void _peerStatus(ZT_Peer *const p,const SharedPtr<Peer> &peer,const unsigned int fields) const;
+
 	RuntimeEnvironment _RR;
 	RuntimeEnvironment *RR;
 	void *_uPtr; // _uptr (lower case) is reserved in Visual Studio :P
@@ -279,6 +287,9 @@ private:
 	std::vector<InetAddress> _directPaths;
 	Mutex _directPaths_m;
 
+	// Our signing key, expanded once for signing network config chunks
+	C25519::SigningKey _signingKey;
+
 	Mutex _backgroundTasksLock;
 
 	Address _remoteTraceTarget;
@@ -289,6 +300,7 @@ private:
 	int64_t _lastHousekeepingRun;
 	int64_t _lastMemoizedTraceSettings;
 	volatile int64_t _prngState[2];
+	volatile ZT_MultipathMode _multipathMode;
 	bool _online;
 };
 
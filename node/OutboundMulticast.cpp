@@ -24,6 +24,8 @@
  * of your own application.
  */
 
+#include <memory>
+
 #include "Constants.hpp"
 #include "RuntimeEnvironment.hpp"
 #include "OutboundMulticast.hpp"
@@ -81,17 +83,36 @@ void OutboundMulticast::init(
 	ZT_FAST_MEMCPY(_frameData,payload,_frameLen);
 }
 
-void OutboundMulticast::sendOnly(const RuntimeEnvironment *RR,void *tPtr,const Address &toAddr)
+void OutboundMulticast::sendOnly(const RuntimeEnvironment *RR,void *tPtr,const Address *toAddrs,const unsigned int count)
 {
 	const SharedPtr<Network> nw(RR->node->network(_nwid));
-	const Address toAddr2(toAddr);
-	if ((nw)&&(nw->filterOutgoingPacket(tPtr,true,RR->identity.address(),toAddr2,_macSrc,_macDest,_frameData,_frameLen,_etherType,0))) {
-		_packet.newInitializationVector();
-		_packet.setDestination(toAddr2);
-		RR->node->expectReplyTo(_packet.packetId());
+	if (!nw)
+		return;
 
-		Packet tmp(_packet); // make a copy of packet so as not to garble the original -- GitHub issue #461
-		RR->sw->send(tPtr,tmp,true);
+	// The switch armors packets in place, so each recipient gets its own copy
+	// of the plaintext -- GitHub issue #461. Only the used part of the packet is
+	// copied, into per-thread buffers reused for every batch handed to the switch.
+	if (!count)
+		return;
+	static thread_local std::unique_ptr<Packet[]> tmp;
+	if (!tmp)
+		tmp.reset(new Packet[ZT_PROTO_ARMOR_BATCH_SIZE]);
+	const unsigned int batchSize = std::min(count,(unsigned int)ZT_PROTO_ARMOR_BATCH_SIZE);
+	Packet *batch[ZT_PROTO_ARMOR_BATCH_SIZE];
+	unsigned int n = 0;
+	for(unsigned int i=0;i<=count;++i) {
+		if ((i < count)&&(nw->filterOutgoingPacket(tPtr,true,RR->identity.address(),toAddrs[i],_macSrc,_macDest,_frameData,_frameLen,_etherType,0))) {
+			Packet &p = tmp[n];
+			p.copyFrom(_packet.data(),_packet.size());
+			p.newInitializationVector();
+			p.setDestination(toAddrs[i]);
+			RR->node->expectReplyTo(p.packetId());
+			batch[n++] = &p;
+		}
+		if ((n == batchSize)||((i == count)&&(n))) {
+			RR->sw->send(tPtr,batch,n,true);
+			n = 0;
+		}
 	}
 }
 
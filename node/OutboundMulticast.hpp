@@ -110,7 +110,21 @@ public:
 	 * @param tPtr Thread pointer to be handed through to any callbacks called as a result of this call
 	 * @param toAddr Destination address
 	 */
-	void sendOnly(const RuntimeEnvironment *RR,void *tPtr,const Address &toAddr);
+	inline void sendOnly(const RuntimeEnvironment *RR,void *tPtr,const Address &toAddr) { sendOnly(RR,tPtr,&toAddr,1); }
+
+	/**
+	 * Just send to many recipients without checking log
+	 *
+	 * The network is looked up once for the whole batch and each recipient
+	 * gets a copy of the prepared plaintext in one reused buffer, so only
+	 * filtering (usually a cache hit) and armoring happen per recipient.
+	 *
+	 * @param RR Runtime environment
+	 * @param tPtr Thread pointer to be handed through to any callbacks called as a result of this call
+	 * @param toAddrs Destination addresses
+	 * @param count Number of destination addresses
+	 */
+	void sendOnly(const RuntimeEnvironment *RR,void *tPtr,const Address *toAddrs,const unsigned int count);
 
 	/**
 	 * Just send and log but do not check sent log
@@ -122,7 +136,21 @@ public:
 	inline void sendAndLog(const RuntimeEnvironment *RR,void *tPtr,const Address &toAddr)
 	{
 		_alreadySentTo.push_back(toAddr);
-		sendOnly(RR,tPtr,toAddr);
+		sendOnly(RR,tPtr,&toAddr,1);
+	}
+
+	/**
+	 * Just send to many recipients and log but do not check sent log
+	 *
+	 * @param RR Runtime environment
+	 * @param tPtr Thread pointer to be handed through to any callbacks called as a result of this call
+	 * @param toAddrs Destination addresses
+	 * @param count Number of destination addresses
+	 */
+	inline void sendAndLog(const RuntimeEnvironment *RR,void *tPtr,const Address *toAddrs,const unsigned int count)
+	{
+		_alreadySentTo.insert(_alreadySentTo.end(),toAddrs,toAddrs + count);
+		sendOnly(RR,tPtr,toAddrs,count);
 	}
 
 	/**
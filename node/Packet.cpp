@@ -899,8 +899,8 @@ void Packet::armor(const void *key,bool encryptPayload)
 
 	_salsa20MangleKey((const unsigned char *)key,mangledKey);
 
-	if (ZT_HAS_FAST_CRYPTO()) {
-		const unsigned int encryptLen = (encryptPayload) ? (size() - ZT_PACKET_IDX_VERB) : 0;
+	const unsigned int encryptLen = (encryptPayload) ? (size() - ZT_PACKET_IDX_VERB) : 0;
+	if ((ZT_HAS_FAST_CRYPTO())&&((encryptLen < ZT_SALSA20_VECTOR_MIN_BYTES)||(!Salsa20::vectorBlocks()))) { // multi-block vector kernels beat single-stream ASM on long payloads
 		uint64_t keyStream[(ZT_PROTO_MAX_PACKET_LENGTH + 64 + 8) / 8];
 		ZT_FAST_SINGLE_PASS_SALSA2012(keyStream,encryptLen + 64,(data + ZT_PACKET_IDX_IV),mangledKey);
 		Salsa20::memxor(data + ZT_PACKET_IDX_VERB,reinterpret_cast<const uint8_t *>(keyStream + 8),encryptLen);
@@ -935,9 +935,10 @@ bool Packet::dearmor(const void *key)
 
 	if ((cs == ZT_PROTO_CIPHER_SUITE__C25519_POLY1305_NONE)||(cs == ZT_PROTO_CIPHER_SUITE__C25519_POLY1305_SALSA2012)) {
 		_salsa20MangleKey((const unsigned char *)key,mangledKey);
-		if (ZT_HAS_FAST_CRYPTO()) {
+		const unsigned int decryptLen = (cs == ZT_PROTO_CIPHER_SUITE__C25519_POLY1305_SALSA2012) ? payloadLen : 0;
+		if ((ZT_HAS_FAST_CRYPTO())&&((decryptLen < ZT_SALSA20_VECTOR_MIN_BYTES)||(!Salsa20::vectorBlocks()))) {
 			uint64_t keyStream[(ZT_PROTO_MAX_PACKET_LENGTH + 64 + 8) / 8];
-			ZT_FAST_SINGLE_PASS_SALSA2012(keyStream,((cs == ZT_PROTO_CIPHER_SUITE__C25519_POLY1305_SALSA2012) ? (payloadLen + 64) : 64),(data + ZT_PACKET_IDX_IV),mangledKey);
+			ZT_FAST_SINGLE_PASS_SALSA2012(keyStream,decryptLen + 64,(data + ZT_PACKET_IDX_IV),mangledKey);
 			uint64_t mac[2];
 			Poly1305::compute(mac,payload,payloadLen,keyStream);
 #ifdef ZT_NO_TYPE_PUNNING
@@ -972,6 +973,118 @@ bool Packet::dearmor(const void *key)
 	}
 }
 
+void Packet::armorBatch(Packet *const *packets,const void *const *keys,const bool encryptPayload,const unsigned int count)
+{
+	for(unsigned int b=0;b<count;b+=ZT_PROTO_ARMOR_BATCH_SIZE) {
+		const unsigned int n = std::min(count - b,(unsigned int)ZT_PROTO_ARMOR_BATCH_SIZE);
+		if ((n < ZT_SALSA20_BATCH_MIN_LANES)||(!Salsa20::vectorBlocks())) {
+			// Too few to interleave, so use the per-packet path (and fast ASM if any)
+			for(unsigned int k=0;k<n;++k)
+				packets[b + k]->armor(keys[b + k],encryptPayload);
+			continue;
+		}
+
+		Salsa20 s20[ZT_PROTO_ARMOR_BATCH_SIZE];
+		Salsa20 *s20p[ZT_PROTO_ARMOR_BATCH_SIZE];
+		uint64_t macKeys[ZT_PROTO_ARMOR_BATCH_SIZE][4];
+		uint64_t macs[ZT_PROTO_ARMOR_BATCH_SIZE][2];
+		const void *zeros[ZT_PROTO_ARMOR_BATCH_SIZE];
+		void *macKeyp[ZT_PROTO_ARMOR_BATCH_SIZE];
+		void *macp[ZT_PROTO_ARMOR_BATCH_SIZE];
+		void *payload[ZT_PROTO_ARMOR_BATCH_SIZE];
+		unsigned int macKeyLen[ZT_PROTO_ARMOR_BATCH_SIZE];
+		unsigned int payloadLen[ZT_PROTO_ARMOR_BATCH_SIZE];
+		for(unsigned int k=0;k<n;++k) {
+			Packet &p = *packets[b + k];
+			uint8_t *const data = reinterpret_cast<uint8_t *>(p.unsafeData());
+			uint8_t mangledKey[32];
+			p.setCipher(encryptPayload ? ZT_PROTO_CIPHER_SUITE__C25519_POLY1305_SALSA2012 : ZT_PROTO_CIPHER_SUITE__C25519_POLY1305_NONE);
+			p._salsa20MangleKey((const unsigned char *)keys[b + k],mangledKey);
+			s20[k].init(mangledKey,data + ZT_PACKET_IDX_IV);
+			s20p[k] = &(s20[k]);
+			zeros[k] = ZERO_KEY;
+			macKeyp[k] = macKeys[k];
+			macKeyLen[k] = sizeof(macKeys[k]);
+			macp[k] = macs[k];
+			payload[k] = data + ZT_PACKET_IDX_VERB;
+			payloadLen[k] = p.size() - ZT_PACKET_IDX_VERB;
+		}
+
+		Salsa20::crypt12Batch(s20p,zeros,macKeyp,macKeyLen,n);
+		if (encryptPayload)
+			Salsa20::crypt12Batch(s20p,payload,payload,payloadLen,n);
+		Poly1305::computeBatch(macp,payload,payloadLen,macKeyp,n);
+
+		for(unsigned int k=0;k<n;++k)
+			ZT_FAST_MEMCPY(reinterpret_cast<uint8_t *>(packets[b + k]->unsafeData()) + ZT_PACKET_IDX_MAC,macs[k],8);
+	}
+}
+
+void Packet::dearmorBatch(Packet *const *packets,const void *const *keys,bool *ok,const unsigned int count)
+{
+	for(unsigned int b=0;b<count;b+=ZT_PROTO_ARMOR_BATCH_SIZE) {
+		const unsigned int n = std::min(count - b,(unsigned int)ZT_PROTO_ARMOR_BATCH_SIZE);
+		if ((n < ZT_SALSA20_BATCH_MIN_LANES)||(!Salsa20::vectorBlocks())) {
+			for(unsigned int k=0;k<n;++k)
+				ok[b + k] = packets[b + k]->dearmor(keys[b + k]);
+			continue;
+		}
+
+		Salsa20 s20[ZT_PROTO_ARMOR_BATCH_SIZE];
+		Salsa20 *s20p[ZT_PROTO_ARMOR_BATCH_SIZE];
+		uint64_t macKeys[ZT_PROTO_ARMOR_BATCH_SIZE][4];
+		uint64_t macs[ZT_PROTO_ARMOR_BATCH_SIZE][2];
+		const void *zeros[ZT_PROTO_ARMOR_BATCH_SIZE];
+		void *macKeyp[ZT_PROTO_ARMOR_BATCH_SIZE];
+		void *macp[ZT_PROTO_ARMOR_BATCH_SIZE];
+		void *payload[ZT_PROTO_ARMOR_BATCH_SIZE];
+		unsigned int macKeyLen[ZT_PROTO_ARMOR_BATCH_SIZE];
+		unsigned int payloadLen[ZT_PROTO_ARMOR_BATCH_SIZE];
+		Packet *pk[ZT_PROTO_ARMOR_BATCH_SIZE];
+		bool *pok[ZT_PROTO_ARMOR_BATCH_SIZE];
+		unsigned int m = 0;
+		for(unsigned int k=0;k<n;++k) {
+			Packet &p = *packets[b + k];
+			const unsigned int cs = p.cipher();
+			if ((cs != ZT_PROTO_CIPHER_SUITE__C25519_POLY1305_NONE)&&(cs != ZT_PROTO_CIPHER_SUITE__C25519_POLY1305_SALSA2012)) {
+				ok[b + k] = false; // unrecognized cipher suite
+				continue;
+			}
+			uint8_t *const data = reinterpret_cast<uint8_t *>(p.unsafeData());
+			uint8_t mangledKey[32];
+			p._salsa20MangleKey((const unsigned char *)keys[b + k],mangledKey);
+			s20[m].init(mangledKey,data + ZT_PACKET_IDX_IV);
+			s20p[m] = &(s20[m]);
+			zeros[m] = ZERO_KEY;
+			macKeyp[m] = macKeys[m];
+			macKeyLen[m] = sizeof(macKeys[m]);
+			macp[m] = macs[m];
+			payload[m] = data + ZT_PACKET_IDX_VERB;
+			payloadLen[m] = p.size() - ZT_PACKET_IDX_VERB;
+			pk[m] = &p;
+			pok[m] = ok + b + k;
+			++m;
+		}
+
+		Salsa20::crypt12Batch(s20p,zeros,macKeyp,macKeyLen,m);
+		Poly1305::computeBatch(macp,payload,payloadLen,macKeyp,m);
+
+		// Decrypt only what passed authentication, compacting the stream list in place
+		unsigned int d = 0;
+		for(unsigned int k=0;k<m;++k) {
+			if ((*pok[k] = Utils::secureEq(macs[k],pk[k]->field(ZT_PACKET_IDX_MAC,8),8))) {
+				if (pk[k]->cipher() == ZT_PROTO_CIPHER_SUITE__C25519_POLY1305_SALSA2012) {
+					s20p[d] = s20p[k];
+					payload[d] = payload[k];
+					payloadLen[d] = payloadLen[k];
+					++d;
+				}
+			}
+		}
+		Salsa20::crypt12Batch(s20p,payload,payload,payloadLen,d);
+	}
+}
+
 void Packet::cryptField(const void *key,unsigned int start,unsigned int len)
 {
 	uint8_t *const data = reinterpret_cast<uint8_t *>(unsafeData());
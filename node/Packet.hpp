@@ -202,6 +202,11 @@
  */
 #define ZT_PROTO_SALSA20_ROUNDS 12
 
+/**
+ * Packets armored or dearmored together by Packet::armorBatch() and dearmorBatch()
+ */
+#define ZT_PROTO_ARMOR_BATCH_SIZE 8
+
 /**
  * PUSH_DIRECT_PATHS flag: forget path
  */
@@ -1247,6 +1252,30 @@ public:
 	 */
 	bool dearmor(const void *key);
 
+	/**
+	 * Armor several packets for transport together
+	 *
+	 * Packets are handled in groups of up to ZT_PROTO_ARMOR_BATCH_SIZE with
+	 * their Salsa20 streams and Poly1305 MACs interleaved. Results are the
+	 * same as calling armor() on each.
+	 *
+	 * @param packets Packets to armor (must be distinct)
+	 * @param keys 32-byte key for each packet
+	 * @param encryptPayload If true, encrypt packet payloads, else just MAC
+	 * @param count Number of packets
+	 */
+	static void armorBatch(Packet *const *packets,const void *const *keys,const bool encryptPayload,const unsigned int count);
+
+	/**
+	 * Verify and (if encrypted) decrypt several packets together
+	 *
+	 * @param packets Packets to dearmor (must be distinct)
+	 * @param keys 32-byte key for each packet
+	 * @param ok Set to what dearmor() would have returned for each packet
+	 * @param count Number of packets
+	 */
+	static void dearmorBatch(Packet *const *packets,const void *const *keys,bool *ok,const unsigned int count);
+
 	/**
 	 * Encrypt/decrypt a separately armored portion of a packet
 	 *
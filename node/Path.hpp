@@ -39,6 +39,7 @@
 #include "SharedPtr.hpp"
 #include "AtomicCounter.hpp"
 #include "Utils.hpp"
+#include "Mutex.hpp"
 
 /**
  * Maximum return value of preferenceRank()
@@ -93,22 +94,42 @@ public:
 		_lastOut(0),
 		_lastIn(0),
 		_lastTrustEstablishedPacketReceived(0),
+		_lastProbe(0),
+		_probePacketId(0),
+		_probeLost(0),
+		_probeCount(0),
+		_probeCountsLoss(false),
+		_loss(0),
+		_lastRtt(0xffff),
+		_jitter16(0),
+		_rttSamples(0),
 		_localSocket(-1),
 		_latency(0xffff),
 		_addr(),
 		_ipScope(InetAddress::IP_SCOPE_NONE)
 	{
+		memset(_rttHistogram,0,sizeof(_rttHistogram));
 	}
 
 	Path(const int64_t localSocket,const InetAddress &addr) :
 		_lastOut(0),
 		_lastIn(0),
 		_lastTrustEstablishedPacketReceived(0),
+		_lastProbe(0),
+		_probePacketId(0),
+		_probeLost(0),
+		_probeCount(0),
+		_probeCountsLoss(false),
+		_loss(0),
+		_lastRtt(0xffff),
+		_jitter16(0),
+		_rttSamples(0),
 		_localSocket(localSocket),
 		_latency(0xffff),
 		_addr(addr),
 		_ipScope(addr.ipScope())
 	{
+		memset(_rttHistogram,0,sizeof(_rttHistogram));
 	}
 
 	/**
@@ -116,7 +137,7 @@ public:
 	 *
 	 * @param t Time of receive
 	 */
-	inline void received(const uint64_t t) { _lastIn = t; }
+	inline void received(const int64_t t) { _lastIn = t; }
 
 	/**
 	 * Set time last trusted packet was received (done in Peer::received())
@@ -155,6 +176,87 @@ public:
 		else _latency = l;
 	}
 
+	/**
+	 * Note that a probe (an ECHO or HELLO expecting a reply) was sent via this path
+	 *
+	 * A previous probe still waiting for its reply is counted as lost unless
+	 * it was sent with countLoss false, e.g. because the peer may have used
+	 * its ECHO reply rate limit on another ECHO. A reply is always counted.
+	 *
+	 * @param now Current time
+	 * @param packetId Packet ID of probe
+	 * @param countLoss If false, a missing reply to this probe is not counted as loss
+	 */
+	inline void probeSent(const int64_t now,const uint64_t packetId,const bool countLoss = true)
+	{
+		Mutex::Lock _l(_stats_m);
+		if ((_probePacketId)&&(_probeCountsLoss))
+			_probeResult(true);
+		_probePacketId = packetId;
+		_probeCountsLoss = countLoss;
+		_lastProbe = now;
+	}
+
+	/**
+	 * Record a round trip time measured from a reply received via this path
+	 *
+	 * @param inRePacketId ID of packet this is a reply to
+	 * @param rtt Round trip time in milliseconds
+	 */
+	inline void replyReceived(const uint64_t inRePacketId,const unsigned int rtt)
+	{
+		updateLatency(rtt);
+		Mutex::Lock _l(_stats_m);
+		if ((_probePacketId)&&(inRePacketId == _probePacketId)) {
+			_probeResult(false);
+			_probePacketId = 0;
+		}
+		if (_lastRtt < 0xffff) {
+			// Interarrival jitter as in RFC 3550 section 6.4.1, kept in 1/16 ms
+			const unsigned int d = (rtt > _lastRtt) ? (rtt - _lastRtt) : (_lastRtt - rtt);
+			_jitter16 = _jitter16 + d - ((_jitter16 + 8) >> 4);
+		}
+		_lastRtt = rtt;
+		static const unsigned int bounds[ZT_PATH_RTT_HISTOGRAM_BUCKETS - 1] = { 5,10,25,50,100,250,500 };
+		unsigned int b = 0;
+		while ((b < (ZT_PATH_RTT_HISTOGRAM_BUCKETS - 1))&&(rtt >= bounds[b]))
+			++b;
+		++_rttHistogram[b];
+		if (++_rttSamples >= ZT_PATH_RTT_HISTOGRAM_WINDOW) {
+			// Halve all counts so the histogram follows recent samples
+			_rttSamples = 0;
+			for(b=0;b<ZT_PATH_RTT_HISTOGRAM_BUCKETS;++b) {
+				_rttHistogram[b] >>= 1;
+				_rttSamples += _rttHistogram[b];
+			}
+		}
+	}
+
+	/**
+	 * @return True if it's time to send another probe via this path
+	 */
+	inline bool needsProbe(const int64_t now) const { return ((now - _lastProbe) >= ZT_PATH_PROBE_INTERVAL); }
+
+	/**
+	 * @return Fraction of recent probes that got no reply in parts per thousand
+	 */
+	inline unsigned int packetLoss() const { return _loss; }
+
+	/**
+	 * @return Mean deviation between successive round trip times in milliseconds
+	 */
+	inline unsigned int jitter() const { return (_jitter16 >> 4); }
+
+	/**
+	 * @param h Buffer to fill with recent round trip time counts per bucket (ZT_PATH_RTT_HISTOGRAM_BUCKETS)
+	 */
+	inline void rttHistogram(unsigned int *h) const
+	{
+		Mutex::Lock _l(_stats_m);
+		for(unsigned int b=0;b<ZT_PATH_RTT_HISTOGRAM_BUCKETS;++b)
+			h[b] = _rttHistogram[b];
+	}
+
 	/**
 	 * @return Local socket as specified by external code
 	 */
@@ -235,7 +337,9 @@ public:
 	 */
 	inline long quality(const int64_t now) const
 	{
-		const int l = (long)_latency;
+		int l = (long)_latency;
+		if (l < 0xffff)
+			l += (int)(_jitter16 >> 3) + (int)((_loss * ZT_PATH_LOSS_PENALTY) / 1000);
 		const int age = (long)std::min((now - _lastIn),(int64_t)(ZT_PATH_HEARTBEAT_PERIOD * 10)); // set an upper sanity limit to avoid overflow
 		return (((age < (ZT_PATH_HEARTBEAT_PERIOD + 5000)) ? l : (l + 0xffff + age)) * (long)((ZT_INETADDRESS_MAX_SCOPE - _ipScope) + 1));
 	}
@@ -266,9 +370,32 @@ public:
 	inline int64_t lastTrustEstablishedPacketReceived() const { return _lastTrustEstablishedPacketReceived; }
 
 private:
+	// Update loss window with the outcome of a probe (_stats_m must be locked)
+	inline void _probeResult(const bool lost)
+	{
+		_probeLost = (_probeLost << 1) | ((lost) ? 1 : 0);
+		if (_probeCount < 32)
+			++_probeCount;
+		unsigned int n = 0;
+		for(uint32_t m=_probeLost;m;m>>=1)
+			n += (unsigned int)(m & 1);
+		_loss = (n * 1000) / _probeCount;
+	}
+
 	volatile int64_t _lastOut;
 	volatile int64_t _lastIn;
 	volatile int64_t _lastTrustEstablishedPacketReceived;
+	int64_t _lastProbe;
+	uint64_t _probePacketId; // outstanding probe or 0 if none
+	uint32_t _probeLost; // bit mask of recent probe results, 1 == lost
+	unsigned int _probeCount;
+	bool _probeCountsLoss; // false if the outstanding probe's reply may have been rate limited away
+	volatile unsigned int _loss;
+	unsigned int _lastRtt;
+	volatile unsigned int _jitter16;
+	unsigned int _rttSamples;
+	unsigned int _rttHistogram[ZT_PATH_RTT_HISTOGRAM_BUCKETS];
+	Mutex _stats_m;
 	int64_t _localSocket;
 	volatile unsigned int _latency;
 	InetAddress _addr;
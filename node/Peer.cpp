@@ -53,6 +53,7 @@ Peer::Peer(const RuntimeEnvironment *renv,const Identity &myIdentity,const Ident
 	_lastCredentialsReceived(0),
 	_lastTrustEstablishedPacketReceived(0),
 	_lastSentFullHello(0),
+	_lastEchoSent(0),
 	_vProto(0),
 	_vMajor(0),
 	_vMinor(0),
@@ -150,6 +151,7 @@ void Peer::received(
 						_paths[replacePath].lr = now;
 						_paths[replacePath].p = path;
 						_paths[replacePath].priority = 1;
+						_paths[replacePath].wrr = 0;
 					} else {
 						attemptToContact = true;
 					}
@@ -255,6 +257,52 @@ SharedPtr<Path> Peer::getBestPath(int64_t now,bool includeExpired) const
 	return SharedPtr<Path>();
 }
 
+SharedPtr<Path> Peer::getMultipath(const int64_t now,const ZT_MultipathMode mode,const uint64_t flowId)
+{
+	Mutex::Lock _l(_paths_m);
+
+	unsigned int live[ZT_MAX_PEER_NETWORK_PATHS];
+	unsigned int n = 0;
+	for(unsigned int i=0;i<ZT_MAX_PEER_NETWORK_PATHS;++i) {
+		if (_paths[i].p) {
+			if (((now - _paths[i].lr) < ZT_PEER_PATH_EXPIRATION)&&(_paths[i].p->alive(now)))
+				live[n++] = i;
+			else _paths[i].wrr = 0;
+		} else break;
+	}
+	if (n < 2)
+		return SharedPtr<Path>();
+
+	if (mode == ZT_MULTIPATH_FLOW_HASH)
+		return _paths[live[(unsigned int)(flowId % (uint64_t)n)]].p;
+
+	// Smooth weighted round robin: each path gains its weight every turn and
+	// the path that is furthest ahead is picked and set back by the total.
+	// Weights are inverse to quality (latency, jitter, and probe loss), which
+	// we measure ourselves, rather than to receive throughput, which follows
+	// whatever paths the other side happens to pick.
+	int64_t w[ZT_MAX_PEER_NETWORK_PATHS];
+	int64_t maxw = 0;
+	for(unsigned int k=0;k<n;++k) {
+		w[k] = (((int64_t)1 << 24) * (int64_t)_paths[live[k]].priority) / std::max((int64_t)1,(int64_t)_paths[live[k]].p->quality(now));
+		if (w[k] > maxw)
+			maxw = w[k];
+	}
+	const int64_t minw = std::max((int64_t)1,maxw / ZT_MULTIPATH_MIN_SHARE);
+	int64_t total = 0;
+	unsigned int pick = live[0];
+	for(unsigned int k=0;k<n;++k) {
+		_PeerPath &pp = _paths[live[k]];
+		const int64_t wk = std::max(w[k],minw);
+		pp.wrr += wk;
+		total += wk;
+		if (pp.wrr > _paths[pick].wrr)
+			pick = live[k];
+	}
+	_paths[pick].wrr -= total;
+	return _paths[pick].p;
+}
+
 void Peer::introduce(void *const tPtr,const int64_t now,const SharedPtr<Peer> &other) const
 {
 	unsigned int myBestV4ByScope[ZT_INETADDRESS_MAX_SCOPE+1];
@@ -376,7 +424,7 @@ void Peer::introduce(void *const tPtr,const int64_t now,const SharedPtr<Peer> &o
 	}
 }
 
-void Peer::sendHELLO(void *tPtr,const int64_t localSocket,const InetAddress &atAddress,int64_t now)
+uint64_t Peer::sendHELLO(void *tPtr,const int64_t localSocket,const InetAddress &atAddress,int64_t now)
 {
 	Packet outp(_id.address(),RR->identity.address(),Packet::VERB_HELLO);
 
@@ -417,17 +465,22 @@ void Peer::sendHELLO(void *tPtr,const int64_t localSocket,const InetAddress &atA
 	} else {
 		RR->sw->send(tPtr,outp,false); // false == don't encrypt full payload, but add MAC
 	}
+
+	return outp.packetId();
 }
 
-void Peer::attemptToContactAt(void *tPtr,const int64_t localSocket,const InetAddress &atAddress,int64_t now,bool sendFullHello)
+uint64_t Peer::attemptToContactAt(void *tPtr,const int64_t localSocket,const InetAddress &atAddress,int64_t now,bool sendFullHello)
 {
 	if ( (!sendFullHello) && (_vProto >= 5) && (!((_vMajor == 1)&&(_vMinor == 1)&&(_vRevision == 0))) ) {
 		Packet outp(_id.address(),RR->identity.address(),Packet::VERB_ECHO);
+		outp.append((uint64_t)now); // echoed back in OK(ECHO) to measure round trip time
 		RR->node->expectReplyTo(outp.packetId());
+		_lastEchoSent = now;
 		outp.armor(_key,true);
 		RR->node->putPacket(tPtr,localSocket,atAddress,outp.data(),outp.size());
+		return outp.packetId();
 	} else {
-		sendHELLO(tPtr,localSocket,atAddress,now);
+		return sendHELLO(tPtr,localSocket,atAddress,now);
 	}
 }
 
@@ -461,14 +514,28 @@ unsigned int Peer::doPingAndKeepalive(void *tPtr,int64_t now)
 		else break;
 	}
 
+	// Only one heartbeat per call is counted as a probe since peers rate limit
+	// ECHO replies. Paths that miss out are probed on a later call. The peer
+	// answers only the first ECHO it gets each ZT_PEER_GENERAL_RATE_LIMIT ms,
+	// so if another ECHO went out just before the probe or alongside it on
+	// another path, a missing reply to the probe is not counted as loss.
+	const bool echoedRecently = ((now - _lastEchoSent) < ZT_PEER_GENERAL_RATE_LIMIT);
+	SharedPtr<Path> probePath;
+	uint64_t probeId = 0;
+	unsigned int contacts = 0;
 	unsigned int j = 0;
 	for(unsigned int i=0;i<ZT_MAX_PEER_NETWORK_PATHS;++i) {
 		if (_paths[i].p) {
 			// Clean expired and reduced priority paths
 			if ( ((now - _paths[i].lr) < ZT_PEER_PATH_EXPIRATION) && (_paths[i].priority == maxPriority) ) {
-				if ((sendFullHello)||(_paths[i].p->needsHeartbeat(now))) {
-					attemptToContactAt(tPtr,_paths[i].p->localSocket(),_paths[i].p->address(),now,sendFullHello);
+				if ((sendFullHello)||(_paths[i].p->needsHeartbeat(now))||((!probePath)&&(_paths[i].p->needsProbe(now)))) {
+					const uint64_t pid = attemptToContactAt(tPtr,_paths[i].p->localSocket(),_paths[i].p->address(),now,sendFullHello);
 					_paths[i].p->sent(now);
+					if (!probePath) {
+						probePath = _paths[i].p;
+						probeId = pid;
+					}
+					++contacts;
 					sent |= (_paths[i].p->address().ss_family == AF_INET) ? 0x1 : 0x2;
 				}
 				if (i != j)
@@ -484,6 +551,10 @@ unsigned int Peer::doPingAndKeepalive(void *tPtr,int64_t now)
 		++j;
 	}
 
+	// Full HELLOs are not subject to the ECHO reply limit
+	if (probePath)
+		probePath->probeSent(now,probeId,(sendFullHello)||((contacts == 1)&&(!echoedRecently)));
+
 	return sent;
 }
 
@@ -160,6 +160,21 @@ public:
 	 */
 	SharedPtr<Path> getBestPath(int64_t now,bool includeExpired) const;
 
+	/**
+	 * Pick one of several live direct paths for a frame in a multipath mode
+	 *
+	 * Paths are in the bundle while they are alive and not expired. With
+	 * ZT_MULTIPATH_FLOW_HASH each flow ID maps to one of them. With
+	 * ZT_MULTIPATH_BALANCE they take turns by smooth weighted round robin,
+	 * weighted inversely to path quality as measured by our own probes.
+	 *
+	 * @param now Current time
+	 * @param mode Multipath mode
+	 * @param flowId Flow ID (nonzero)
+	 * @return Path or NULL if there are fewer than two live paths (use getBestPath())
+	 */
+	SharedPtr<Path> getMultipath(const int64_t now,const ZT_MultipathMode mode,const uint64_t flowId);
+
 	/**
 	 * Send VERB_RENDEZVOUS to this and another peer via the best common IP scope and path
 	 */
@@ -174,21 +189,24 @@ public:
 	 * @param localSocket Local source socket
 	 * @param atAddress Destination address
 	 * @param now Current time
+	 * @return Packet ID of HELLO
 	 */
-	void sendHELLO(void *tPtr,const int64_t localSocket,const InetAddress &atAddress,int64_t now);
+	uint64_t sendHELLO(void *tPtr,const int64_t localSocket,const InetAddress &atAddress,int64_t now);
 
 	/**
 	 * Send ECHO (or HELLO for older peers) to this peer at the given address
 	 *
-	 * No statistics or sent times are updated here.
+	 * No statistics or sent times are updated here. ECHOs carry the send
+	 * time so their replies can be used as path probes.
 	 *
 	 * @param tPtr Thread pointer to be handed through to any callbacks called as a result of this call
 	 * @param localSocket Local source socket
 	 * @param atAddress Destination address
 	 * @param now Current time
 	 * @param sendFullHello If true, always send a full HELLO instead of just an ECHO
+	 * @return Packet ID of ECHO or HELLO
 	 */
-	void attemptToContactAt(void *tPtr,const int64_t localSocket,const InetAddress &atAddress,int64_t now,bool sendFullHello);
+	uint64_t attemptToContactAt(void *tPtr,const int64_t localSocket,const InetAddress &atAddress,int64_t now,bool sendFullHello);
 
 	/**
 	 * Try a memorized or statically defined path if any are known
@@ -492,10 +510,11 @@ public:
 private:
 	struct _PeerPath
 	{
-		_PeerPath() : lr(0),p(),priority(1) {}
+		_PeerPath() : lr(0),p(),priority(1),wrr(0) {}
 		int64_t lr; // time of last valid ZeroTier packet
 		SharedPtr<Path> p;
 		long priority; // >= 1, higher is better
+		int64_t wrr; // current weight for ZT_MULTIPATH_BALANCE
 	};
 
 	uint8_t _key[ZT_PEER_SECRET_KEY_LENGTH];
@@ -515,6 +534,7 @@ private:
 	int64_t _lastCredentialsReceived;
 	int64_t _lastTrustEstablishedPacketReceived;
 	int64_t _lastSentFullHello;
+	int64_t _lastEchoSent;
 
 	uint16_t _vProto;
 	uint16_t _vMajor;
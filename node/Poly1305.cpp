@@ -293,6 +293,69 @@ poly1305_blocks(poly1305_state_internal_t *st, const unsigned char *m, size_t by
   st->h[2] = h2;
 }
 
+/* Two independent messages of the same length, interleaved so their multiply chains overlap */
+static inline void
+poly1305_blocks2(poly1305_state_internal_t *sta, const unsigned char *ma, poly1305_state_internal_t *stb, const unsigned char *mb, size_t bytes) {
+  const unsigned long long hibita = (sta->final) ? 0 : ((unsigned long long)1 << 40); /* 1 << 128 */
+  const unsigned long long hibitb = (stb->final) ? 0 : ((unsigned long long)1 << 40);
+  const unsigned long long ra0 = sta->r[0], ra1 = sta->r[1], ra2 = sta->r[2];
+  const unsigned long long rb0 = stb->r[0], rb1 = stb->r[1], rb2 = stb->r[2];
+  const unsigned long long sa1 = ra1 * (5 << 2), sa2 = ra2 * (5 << 2);
+  const unsigned long long sb1 = rb1 * (5 << 2), sb2 = rb2 * (5 << 2);
+  unsigned long long ha0 = sta->h[0], ha1 = sta->h[1], ha2 = sta->h[2];
+  unsigned long long hb0 = stb->h[0], hb1 = stb->h[1], hb2 = stb->h[2];
+  unsigned long long ca,cb;
+  uint128_t da0,da1,da2,da,db0,db1,db2,db;
+
+  while (bytes >= poly1305_block_size) {
+    unsigned long long ta0,ta1,tb0,tb1;
+
+    /* h += m[i] */
+    ta0 = U8TO64(&ma[0]);
+    ta1 = U8TO64(&ma[8]);
+    tb0 = U8TO64(&mb[0]);
+    tb1 = U8TO64(&mb[8]);
+
+    ha0 += (( ta0                     ) & 0xfffffffffff);
+    hb0 += (( tb0                     ) & 0xfffffffffff);
+    ha1 += (((ta0 >> 44) | (ta1 << 20)) & 0xfffffffffff);
+    hb1 += (((tb0 >> 44) | (tb1 << 20)) & 0xfffffffffff);
+    ha2 += (((ta1 >> 24)              ) & 0x3ffffffffff) | hibita;
+    hb2 += (((tb1 >> 24)              ) & 0x3ffffffffff) | hibitb;
+
+    /* h *= r */
+    MUL(da0, ha0, ra0); MUL(da, ha1, sa2); ADD(da0, da); MUL(da, ha2, sa1); ADD(da0, da);
+    MUL(db0, hb0, rb0); MUL(db, hb1, sb2); ADD(db0, db); MUL(db, hb2, sb1); ADD(db0, db);
+    MUL(da1, ha0, ra1); MUL(da, ha1, ra0); ADD(da1, da); MUL(da, ha2, sa2); ADD(da1, da);
+    MUL(db1, hb0, rb1); MUL(db, hb1, rb0); ADD(db1, db); MUL(db, hb2, sb2); ADD(db1, db);
+    MUL(da2, ha0, ra2); MUL(da, ha1, ra1); ADD(da2, da); MUL(da, ha2, ra0); ADD(da2, da);
+    MUL(db2, hb0, rb2); MUL(db, hb1, rb1); ADD(db2, db); MUL(db, hb2, rb0); ADD(db2, db);
+
+    /* (partial) h %= p */
+                    ca = SHR(da0, 44); ha0 = LO(da0) & 0xfffffffffff;
+                    cb = SHR(db0, 44); hb0 = LO(db0) & 0xfffffffffff;
+    ADDLO(da1, ca); ca = SHR(da1, 44); ha1 = LO(da1) & 0xfffffffffff;
+    ADDLO(db1, cb); cb = SHR(db1, 44); hb1 = LO(db1) & 0xfffffffffff;
+    ADDLO(da2, ca); ca = SHR(da2, 42); ha2 = LO(da2) & 0x3ffffffffff;
+    ADDLO(db2, cb); cb = SHR(db2, 42); hb2 = LO(db2) & 0x3ffffffffff;
+    ha0  += ca * 5; ca = (ha0 >> 44);  ha0 =    ha0  & 0xfffffffffff;
+    hb0  += cb * 5; cb = (hb0 >> 44);  hb0 =    hb0  & 0xfffffffffff;
+    ha1  += ca;
+    hb1  += cb;
+
+    ma += poly1305_block_size;
+    mb += poly1305_block_size;
+    bytes -= poly1305_block_size;
+  }
+
+  sta->h[0] = ha0;
+  sta->h[1] = ha1;
+  sta->h[2] = ha2;
+  stb->h[0] = hb0;
+  stb->h[1] = hb1;
+  stb->h[2] = hb2;
+}
+
 static inline void
 poly1305_finish(poly1305_context *ctx, unsigned char mac[16]) {
   poly1305_state_internal_t *st = (poly1305_state_internal_t *)ctx;
@@ -491,6 +554,12 @@ poly1305_blocks(poly1305_state_internal_t *st, const unsigned char *m, size_t by
   st->h[4] = h4;
 }
 
+static inline void
+poly1305_blocks2(poly1305_state_internal_t *sta, const unsigned char *ma, poly1305_state_internal_t *stb, const unsigned char *mb, size_t bytes) {
+  poly1305_blocks(sta, ma, bytes);
+  poly1305_blocks(stb, mb, bytes);
+}
+
 static inline void
 poly1305_finish(poly1305_context *ctx, unsigned char mac[16]) {
   poly1305_state_internal_t *st = (poly1305_state_internal_t *)ctx;
@@ -629,4 +698,24 @@ void Poly1305::compute(void *auth,const void *data,unsigned int len,const void *
   poly1305_finish(&ctx,reinterpret_cast<unsigned char *>(auth));
 }
 
+void Poly1305::computeBatch(void *const *auth,const void *const *data,const unsigned int *len,const void *const *key,const unsigned int count)
+{
+  unsigned int i = 0;
+  for(;(i + 1)<count;i+=2) {
+    poly1305_context ctx[2];
+    const unsigned char *const ma = reinterpret_cast<const unsigned char *>(data[i]);
+    const unsigned char *const mb = reinterpret_cast<const unsigned char *>(data[i + 1]);
+    poly1305_init(&ctx[0],reinterpret_cast<const unsigned char *>(key[i]));
+    poly1305_init(&ctx[1],reinterpret_cast<const unsigned char *>(key[i + 1]));
+    const size_t common = (size_t)((len[i] < len[i + 1]) ? len[i] : len[i + 1]) & ~((size_t)poly1305_block_size - 1);
+    poly1305_blocks2((poly1305_state_internal_t *)&ctx[0],ma,(poly1305_state_internal_t *)&ctx[1],mb,common);
+    poly1305_update(&ctx[0],ma + common,(size_t)len[i] - common);
+    poly1305_update(&ctx[1],mb + common,(size_t)len[i + 1] - common);
+    poly1305_finish(&ctx[0],reinterpret_cast<unsigned char *>(auth[i]));
+    poly1305_finish(&ctx[1],reinterpret_cast<unsigned char *>(auth[i + 1]));
+  }
+  if (i < count)
+    compute(auth[i],data[i],len[i],key[i]);
+}
+
 } // namespace ZeroTier
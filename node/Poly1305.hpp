@@ -55,6 +55,20 @@ public:
 	 * @param key 32-byte one-time use key to authenticate data (must not be reused)
 	 */
 	static void compute(void *auth,const void *data,unsigned int len,const void *key);
+
+	/**
+	 * Compute several independent authentication codes
+	 *
+	 * Messages are processed in pairs with their block loops interleaved,
+	 * which keeps more multiplies in flight than computing them one by one.
+	 *
+	 * @param auth Buffers to receive codes (16 bytes each)
+	 * @param data Data to authenticate
+	 * @param len Length of each message in bytes
+	 * @param key 32-byte one-time use keys
+	 * @param count Number of messages
+	 */
+	static void computeBatch(void *const *auth,const void *const *data,const unsigned int *len,const void *const *key,const unsigned int count);
 };
 
 } // namespace ZeroTier
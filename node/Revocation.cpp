@@ -35,6 +35,13 @@
 namespace ZeroTier {
 
 int Revocation::verify(const RuntimeEnvironment *RR,void *tPtr) const
+{
+	SignatureBatch sb;
+	const int r = verify(RR,tPtr,sb);
+	return (((r == 0)&&(!sb.verify(RR->sc,RR->node->now()))) ? -1 : r);
+}
+
+int Revocation::verify(const RuntimeEnvironment *RR,void *tPtr,SignatureBatch &sb) const
 {
 	if ((!_signedBy)||(_signedBy != Network::controllerFor(_networkId)))
 		return -1;
@@ -46,7 +53,8 @@ int Revocation::verify(const RuntimeEnvironment *RR,void *tPtr) const
 	try {
 		Buffer<sizeof(Revocation) + 64> tmp;
 		this->serialize(tmp,true);
-		return (id.verify(tmp.data(),tmp.size(),_signature) ? 0 : -1);
+		sb.add(id,tmp.data(),tmp.size(),_signature,0);
+		return 0;
 	} catch ( ... ) {
 		return -1;
 	}
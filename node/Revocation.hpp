@@ -117,6 +117,16 @@ public:
 	 */
 	int verify(const RuntimeEnvironment *RR,void *tPtr) const;
 
+	/**
+	 * Check this revocation and add its signatures to a batch instead of verifying them
+	 *
+	 * @param RR Runtime environment to provide for peer lookup, etc.
+	 * @param tPtr Thread pointer to be handed through to any callbacks called as a result of this call
+	 * @param sb Signature batch
+	 * @return 0 == OK if signature in batch is valid, 1 == waiting for WHOIS, -1 == BAD revocation
+	 */
+	int verify(const RuntimeEnvironment *RR,void *tPtr,SignatureBatch &sb) const;
+
 	template<unsigned int C>
 	inline void serialize(Buffer<C> &b,const bool forSign = false) const
 	{
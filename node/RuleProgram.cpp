@@ -0,0 +1,1064 @@
+/*
+ * ZeroTier One - Network Virtualization Everywhere
+ * Copyright (C) 2011-2018  ZeroTier, Inc.  https://www.zerotier.com/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * --
+ *
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial closed-source software that incorporates or links
+ * directly against ZeroTier software without disclosing the source code
+ * of your own application.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "RuleProgram.hpp"
+#include "RuntimeEnvironment.hpp"
+#include "NetworkConfig.hpp"
+#include "Membership.hpp"
+#include "InetAddress.hpp"
+#include "Node.hpp"
+#include "Tag.hpp"
+
+namespace ZeroTier {
+
+namespace {
+
+// Returns true if packet appears valid; pos and proto will be set
+static bool _ipv6GetPayload(const uint8_t *frameData,unsigned int frameLen,unsigned int &pos,unsigned int &proto)
+{
+	if (frameLen < 40)
+		return false;
+	pos = 40;
+	proto = frameData[6];
+	while (pos <= frameLen) {
+		switch(proto) {
+			case 0: // hop-by-hop options
+			case 43: // routing
+			case 60: // destination options
+			case 135: // mobility options
+				if ((pos + 8) > frameLen)
+					return false; // invalid!
+				proto = frameData[pos];
+				pos += ((unsigned int)frameData[pos + 1] * 8) + 8;
+				break;
+
+			//case 44: // fragment -- we currently can't parse these and they are deprecated in IPv6 anyway
+			//case 50:
+			//case 51: // IPSec ESP and AH -- we have to stop here since this is encrypted stuff
+			default:
+				return true;
+		}
+	}
+	return false; // overflow == invalid
+}
+
+// Computes SENDER_IP_AUTHENTICATED and SENDER_MAC_AUTHENTICATED characteristics bits
+static uint64_t _ownershipVerificationMask(
+	const NetworkConfig &nconf,
+	const Membership *membership,
+	const bool inbound,
+	const MAC &macSource,
+	const uint8_t *const frameData,
+	const unsigned int frameLen,
+	const unsigned int etherType)
+{
+	uint64_t ownershipVerificationMask = 0;
+	InetAddress src;
+	if ((etherType == ZT_ETHERTYPE_IPV4)&&(frameLen >= 20)) {
+		src.set((const void *)(frameData + 12),4,0);
+	} else if ((etherType == ZT_ETHERTYPE_IPV6)&&(frameLen >= 40)) {
+		// IPv6 NDP requires special handling, since the src and dest IPs in the packet are empty or link-local.
+		if ( (frameLen >= (40 + 8 + 16)) && (frameData[6] == 0x3a) && ((frameData[40] == 0x87)||(frameData[40] == 0x88)) ) {
+			if (frameData[40] == 0x87) {
+				// Neighbor solicitations contain no reliable source address, so we implement a small
+				// hack by considering them authenticated. Otherwise you would pretty much have to do
+				// this manually in the rule set for IPv6 to work at all.
+				ownershipVerificationMask |= ZT_RULE_PACKET_CHARACTERISTICS_SENDER_IP_AUTHENTICATED;
+			} else {
+				// Neighbor advertisements on the other hand can absolutely be authenticated.
+				src.set((const void *)(frameData + 40 + 8),16,0);
+			}
+		} else {
+			// Other IPv6 packets can be handled normally
+			src.set((const void *)(frameData + 8),16,0);
+		}
+	} else if ((etherType == ZT_ETHERTYPE_ARP)&&(frameLen >= 28)) {
+		src.set((const void *)(frameData + 14),4,0);
+	}
+	if (inbound) {
+		if (membership) {
+			if ((src)&&(membership->hasCertificateOfOwnershipFor<InetAddress>(nconf,src)))
+				ownershipVerificationMask |= ZT_RULE_PACKET_CHARACTERISTICS_SENDER_IP_AUTHENTICATED;
+			if (membership->hasCertificateOfOwnershipFor<MAC>(nconf,macSource))
+				ownershipVerificationMask |= ZT_RULE_PACKET_CHARACTERISTICS_SENDER_MAC_AUTHENTICATED;
+		}
+	} else {
+		for(unsigned int i=0;i<nconf.certificateOfOwnershipCount;++i) {
+			if ((src)&&(nconf.certificatesOfOwnership[i].owns(src)))
+				ownershipVerificationMask |= ZT_RULE_PACKET_CHARACTERISTICS_SENDER_IP_AUTHENTICATED;
+			if (nconf.certificatesOfOwnership[i].owns(macSource))
+				ownershipVerificationMask |= ZT_RULE_PACKET_CHARACTERISTICS_SENDER_MAC_AUTHENTICATED;
+		}
+	}
+	return ownershipVerificationMask;
+}
+
+// Evaluates TAGS_* and TAG_SENDER/TAG_RECEIVER matches
+static uint8_t _matchTags(
+	const NetworkConfig &nconf,
+	const Membership *membership,
+	const bool inbound,
+	const bool superAccept,
+	const ZT_VirtualNetworkRuleType rt,
+	const ZT_VirtualNetworkRule &rule)
+{
+	if ((rt == ZT_NETWORK_RULE_MATCH_TAG_SENDER)||(rt == ZT_NETWORK_RULE_MATCH_TAG_RECEIVER)) {
+		if (superAccept) {
+			return 1;
+		} else if ( ((rt == ZT_NETWORK_RULE_MATCH_TAG_SENDER)&&(inbound)) || ((rt == ZT_NETWORK_RULE_MATCH_TAG_RECEIVER)&&(!inbound)) ) {
+			const Tag *const remoteTag = ((membership) ? membership->getTag(nconf,rule.v.tag.id) : (const Tag *)0);
+			if (remoteTag) {
+				return (uint8_t)(remoteTag->value() == rule.v.tag.value);
+			} else {
+				// If we are checking the receiver and this is an outbound packet, we
+				// can't be strict since we may not yet know the receiver's tag.
+				return (uint8_t)(rt == ZT_NETWORK_RULE_MATCH_TAG_RECEIVER);
+			}
+		} else { // sender and outbound or receiver and inbound
+			const Tag *const localTag = std::lower_bound(&(nconf.tags[0]),&(nconf.tags[nconf.tagCount]),rule.v.tag.id,Tag::IdComparePredicate());
+			if ((localTag != &(nconf.tags[nconf.tagCount]))&&(localTag->id() == rule.v.tag.id))
+				return (uint8_t)(localTag->value() == rule.v.tag.value);
+			return 0;
+		}
+	}
+
+	const Tag *const localTag = std::lower_bound(&(nconf.tags[0]),&(nconf.tags[nconf.tagCount]),rule.v.tag.id,Tag::IdComparePredicate());
+	if ((localTag != &(nconf.tags[nconf.tagCount]))&&(localTag->id() == rule.v.tag.id)) {
+		const Tag *const remoteTag = ((membership) ? membership->getTag(nconf,rule.v.tag.id) : (const Tag *)0);
+		if (remoteTag) {
+			const uint32_t ltv = localTag->value();
+			const uint32_t rtv = remoteTag->value();
+			switch(rt) {
+				case ZT_NETWORK_RULE_MATCH_TAGS_DIFFERENCE: {
+					const uint32_t diff = (ltv > rtv) ? (ltv - rtv) : (rtv - ltv);
+					return (uint8_t)(diff <= rule.v.tag.value);
+				}
+				case ZT_NETWORK_RULE_MATCH_TAGS_BITWISE_AND:
+					return (uint8_t)((ltv & rtv) == rule.v.tag.value);
+				case ZT_NETWORK_RULE_MATCH_TAGS_BITWISE_OR:
+					return (uint8_t)((ltv | rtv) == rule.v.tag.value);
+				case ZT_NETWORK_RULE_MATCH_TAGS_BITWISE_XOR:
+					return (uint8_t)((ltv ^ rtv) == rule.v.tag.value);
+				case ZT_NETWORK_RULE_MATCH_TAGS_EQUAL:
+					return (uint8_t)((ltv == rule.v.tag.value)&&(rtv == rule.v.tag.value));
+				default: // sanity check, can't really happen
+					return 0;
+			}
+		} else {
+			// Outbound side is not strict since if we have to match both tags and
+			// we are sending a first packet to a recipient, we probably do not know
+			// about their tags yet. They will filter on inbound and we will filter
+			// once we get their tag. If we are a tee/redirect target we are also
+			// not strict since we likely do not have these tags.
+			return (uint8_t)((!inbound)||(superAccept));
+		}
+	}
+	return 0;
+}
+
+static uint8_t _matchIntegerRange(const ZT_VirtualNetworkRule &rule,const uint8_t *const frameData,const unsigned int frameLen)
+{
+	uint64_t integer = 0;
+	const unsigned int bits = (rule.v.intRange.format & 63) + 1;
+	const unsigned int bytes = ((bits + 8 - 1) / 8); // integer ceiling of division by 8
+	if ((rule.v.intRange.format & 0x80) == 0) {
+		// Big-endian
+		unsigned int idx = rule.v.intRange.idx + (8 - bytes);
+		const unsigned int eof = idx + bytes;
+		if (eof <= frameLen) {
+			while (idx < eof) {
+				integer <<= 8;
+				integer |= frameData[idx++];
+			}
+		}
+		integer &= 0xffffffffffffffffULL >> (64 - bits);
+	} else {
+		// Little-endian
+		unsigned int idx = rule.v.intRange.idx;
+		const unsigned int eof = idx + bytes;
+		if (eof <= frameLen) {
+			while (idx < eof) {
+				integer >>= 8;
+				integer |= ((uint64_t)frameData[idx++]) << 56;
+			}
+		}
+		integer >>= (64 - bits);
+	}
+	return (uint8_t)((integer >= rule.v.intRange.start)&&(integer <= (rule.v.intRange.start + (uint64_t)rule.v.intRange.end)));
+}
+
+static inline uint64_t _be32(const uint8_t *p) { return (((uint64_t)p[0] << 24) | ((uint64_t)p[1] << 16) | ((uint64_t)p[2] << 8) | (uint64_t)p[3]); }
+
+static inline bool _isPortProtocol(const unsigned int proto)
+{
+	// All these start with 16-bit source and destination port in that order
+	switch(proto) {
+		case 0x06: // TCP
+		case 0x11: // UDP
+		case 0x84: // SCTP
+		case 0x88: // UDPLite
+			return true;
+	}
+	return false;
+}
+
+} // anonymous namespace
+
+RuleProgram::Flow::Flow(
+	const Address &ztSource,
+	const Address &ztDest,
+	const MAC &macSource,
+	const MAC &macDest,
+	const uint8_t *frameData,
+	const unsigned int frameLen,
+	const unsigned int etherType,
+	const unsigned int vlanId) :
+	_valid((1 << FIELD_ZT_SOURCE)|(1 << FIELD_ZT_DEST)|(1 << FIELD_VLAN_ID)|(1 << FIELD_MAC_SOURCE)|(1 << FIELD_MAC_DEST)|(1 << FIELD_ETHERTYPE)|(1 << FIELD_FRAME_SIZE)),
+	_frameData(frameData),
+	_frameLen(frameLen),
+	_etherType(etherType),
+	_ip6Source((const uint8_t *)0),
+	_ip6Dest((const uint8_t *)0),
+	_tos(-1),
+	_icmpType(-1),
+	_icmpCode(-1),
+	_tcpFlags(0)
+{
+	memset(_field,0,sizeof(_field));
+	_field[FIELD_ZT_SOURCE] = ztSource.toInt();
+	_field[FIELD_ZT_DEST] = ztDest.toInt();
+	_field[FIELD_VLAN_ID] = (uint16_t)vlanId;
+	_field[FIELD_MAC_SOURCE] = macSource.toInt();
+	_field[FIELD_MAC_DEST] = macDest.toInt();
+	_field[FIELD_ETHERTYPE] = (uint16_t)etherType;
+	_field[FIELD_FRAME_SIZE] = frameLen;
+
+	if ((etherType == ZT_ETHERTYPE_IPV4)&&(frameLen >= 20)) {
+		const unsigned int headerLen = 4 * (frameData[0] & 0xf);
+		const unsigned int proto = frameData[9];
+		_field[FIELD_IPV4_SOURCE] = _be32(frameData + 12);
+		_field[FIELD_IPV4_DEST] = _be32(frameData + 16);
+		_field[FIELD_IP_PROTOCOL] = proto;
+		_valid |= (1 << FIELD_IPV4_SOURCE)|(1 << FIELD_IPV4_DEST)|(1 << FIELD_IP_PROTOCOL);
+		_tos = frameData[1];
+		if ((_isPortProtocol(proto))&&(frameLen > (headerLen + 4))) {
+			_field[FIELD_SOURCE_PORT] = ((unsigned int)frameData[headerLen] << 8) | (unsigned int)frameData[headerLen + 1];
+			_field[FIELD_DEST_PORT] = ((unsigned int)frameData[headerLen + 2] << 8) | (unsigned int)frameData[headerLen + 3];
+			_valid |= (1 << FIELD_SOURCE_PORT)|(1 << FIELD_DEST_PORT);
+		}
+		if ((proto == 0x01)&&(frameLen >= (headerLen + 2))) {
+			_icmpType = frameData[headerLen];
+			_icmpCode = frameData[headerLen + 1];
+		}
+		if ((proto == 0x06)&&(frameLen > (headerLen + 13))) {
+			_tcpFlags = (uint64_t)frameData[headerLen + 13];
+			_tcpFlags |= (((uint64_t)(frameData[headerLen + 12] & 0x0f)) << 8);
+		}
+	} else if (etherType == ZT_ETHERTYPE_IPV6) {
+		if (frameLen >= 40) {
+			_ip6Source = frameData + 8;
+			_ip6Dest = frameData + 24;
+			_tos = ((frameData[0] << 4) & 0xf0) | ((frameData[1] >> 4) & 0x0f);
+		}
+		unsigned int pos = 0,proto = 0;
+		if (_ipv6GetPayload(frameData,frameLen,pos,proto)) {
+			_field[FIELD_IP_PROTOCOL] = (uint8_t)proto;
+			_valid |= (1 << FIELD_IP_PROTOCOL);
+			if ((_isPortProtocol(proto))&&(frameLen > (pos + 4))) {
+				// A zero port never matches on IPv6, as in the interpreter
+				_field[FIELD_SOURCE_PORT] = ((unsigned int)frameData[pos] << 8) | (unsigned int)frameData[pos + 1];
+				_field[FIELD_DEST_PORT] = ((unsigned int)frameData[pos + 2] << 8) | (unsigned int)frameData[pos + 3];
+				if (_field[FIELD_SOURCE_PORT])
+					_valid |= (1 << FIELD_SOURCE_PORT);
+				if (_field[FIELD_DEST_PORT])
+					_valid |= (1 << FIELD_DEST_PORT);
+			}
+			if ((proto == 0x3a)&&(frameLen >= (pos + 2))) {
+				_icmpType = frameData[pos];
+				_icmpCode = frameData[pos + 1];
+			}
+			if ((proto == 0x06)&&(frameLen > (pos + 14))) {
+				_tcpFlags = (uint64_t)frameData[pos + 13];
+				_tcpFlags |= (((uint64_t)(frameData[pos + 12] & 0x0f)) << 8);
+			}
+		}
+	}
+}
+
+const RuleProgram::Flow::Key &RuleProgram::Flow::key(Key &fk,const bool inbound) const
+{
+	fk.k[0] = _field[FIELD_ZT_SOURCE] | ((inbound) ? 0x8000000000000000ULL : 0ULL);
+	fk.k[1] = _field[FIELD_ZT_DEST];
+	fk.k[2] = _field[FIELD_MAC_SOURCE];
+	fk.k[3] = _field[FIELD_MAC_DEST];
+	fk.k[4] = (_field[FIELD_ETHERTYPE] << 48) | (_field[FIELD_VLAN_ID] << 32) | ((_ip6Source) ? 0x10000ULL : 0ULL) | (uint64_t)_valid;
+	fk.k[5] = (_field[FIELD_IPV4_SOURCE] << 32) | _field[FIELD_IPV4_DEST];
+	fk.k[6] = (_field[FIELD_IP_PROTOCOL] << 32) | (_field[FIELD_SOURCE_PORT] << 16) | _field[FIELD_DEST_PORT];
+	if (_ip6Source) {
+		memcpy(fk.k + 7,_ip6Source,16);
+		memcpy(fk.k + 9,_ip6Dest,16);
+	} else {
+		fk.k[7] = 0; fk.k[8] = 0; fk.k[9] = 0; fk.k[10] = 0;
+	}
+	fk.k[11] = 0;
+	fk.k[12] = 0;
+	return fk;
+}
+
+bool RuleProgram::cacheable(const ZT_VirtualNetworkRule *rules,const unsigned int ruleCount)
+{
+	for(unsigned int rn=0;rn<ruleCount;++rn) {
+		switch(rules[rn].t & 0x3f) {
+			case ZT_NETWORK_RULE_MATCH_IP_TOS:
+			case ZT_NETWORK_RULE_MATCH_ICMP:
+			case ZT_NETWORK_RULE_MATCH_CHARACTERISTICS:
+			case ZT_NETWORK_RULE_MATCH_FRAME_SIZE_RANGE:
+			case ZT_NETWORK_RULE_MATCH_RANDOM:
+			case ZT_NETWORK_RULE_MATCH_INTEGER_RANGE:
+				return false;
+		}
+	}
+	return true;
+}
+
+void RuleProgram::compile(const ZT_VirtualNetworkRule *rules,const unsigned int ruleCount)
+{
+	_insns.clear();
+	_ranges.clear();
+	_tagIds.clear();
+	_cacheable = cacheable(rules,ruleCount);
+	_destinationIndependent = true;
+
+	// Nothing after an action with no preceding matches can ever be reached, and
+	// trailing matches with no action after them cannot affect the result.
+	unsigned int end = 0;
+	bool unconditional = true;
+	for(unsigned int rn=0;rn<ruleCount;++rn) {
+		const unsigned int rt = (unsigned int)(rules[rn].t & 0x3f);
+		if (rt <= (unsigned int)ZT_NETWORK_RULE_ACTION__MAX_ID) {
+			end = rn + 1;
+			if ((unconditional)&&((rt == ZT_NETWORK_RULE_ACTION_DROP)||(rt == ZT_NETWORK_RULE_ACTION_ACCEPT)||(rt == ZT_NETWORK_RULE_ACTION_BREAK)))
+				break;
+			unconditional = true;
+		} else {
+			unconditional = false;
+		}
+	}
+
+	std::vector<_Range> ranges;
+	for(unsigned int rn=0;rn<end;++rn) {
+		const ZT_VirtualNetworkRule &r = rules[rn];
+		const ZT_VirtualNetworkRuleType rt = (ZT_VirtualNetworkRuleType)(r.t & 0x3f);
+
+		_Insn in;
+		memset(&in,0,sizeof(in));
+		in.flags = (uint8_t)(r.t & 0xc0);
+		in.rule = r;
+
+		switch(rt) {
+			case ZT_NETWORK_RULE_ACTION_TEE:
+			case ZT_NETWORK_RULE_ACTION_WATCH:
+			case ZT_NETWORK_RULE_ACTION_REDIRECT:
+			case ZT_NETWORK_RULE_MATCH_DEST_ZEROTIER_ADDRESS:
+			case ZT_NETWORK_RULE_MATCH_RANDOM:
+				_destinationIndependent = false;
+				break;
+			case ZT_NETWORK_RULE_MATCH_TAGS_DIFFERENCE:
+			case ZT_NETWORK_RULE_MATCH_TAGS_BITWISE_AND:
+			case ZT_NETWORK_RULE_MATCH_TAGS_BITWISE_OR:
+			case ZT_NETWORK_RULE_MATCH_TAGS_BITWISE_XOR:
+			case ZT_NETWORK_RULE_MATCH_TAGS_EQUAL:
+			case ZT_NETWORK_RULE_MATCH_TAG_SENDER:
+			case ZT_NETWORK_RULE_MATCH_TAG_RECEIVER:
+				if (std::find(_tagIds.begin(),_tagIds.end(),r.v.tag.id) == _tagIds.end())
+					_tagIds.push_back(r.v.tag.id);
+				break;
+			default:
+				break;
+		}
+
+		_Range range;
+		range.lo = 1;
+		range.hi = 0; // empty unless set below
+		switch(rt) {
+			case ZT_NETWORK_RULE_ACTION_DROP: in.op = OP_DROP; break;
+			case ZT_NETWORK_RULE_ACTION_ACCEPT: in.op = OP_ACCEPT; break;
+			case ZT_NETWORK_RULE_ACTION_BREAK: in.op = OP_BREAK; break;
+			case ZT_NETWORK_RULE_ACTION_TEE:
+			case ZT_NETWORK_RULE_ACTION_WATCH:
+			case ZT_NETWORK_RULE_ACTION_REDIRECT: in.op = OP_FWD; break;
+
+			case ZT_NETWORK_RULE_MATCH_SOURCE_ZEROTIER_ADDRESS:
+				in.op = OP_RANGE; in.field = Flow::FIELD_ZT_SOURCE;
+				range.lo = range.hi = r.v.zt;
+				break;
+			case ZT_NETWORK_RULE_MATCH_DEST_ZEROTIER_ADDRESS:
+				in.op = OP_RANGE; in.field = Flow::FIELD_ZT_DEST;
+				range.lo = range.hi = r.v.zt;
+				break;
+			case ZT_NETWORK_RULE_MATCH_VLAN_ID:
+				in.op = OP_RANGE; in.field = Flow::FIELD_VLAN_ID;
+				range.lo = range.hi = r.v.vlanId;
+				break;
+			case ZT_NETWORK_RULE_MATCH_VLAN_PCP: // NOT SUPPORTED YET
+				in.op = OP_CONST; in.field = (uint8_t)(r.v.vlanPcp == 0);
+				break;
+			case ZT_NETWORK_RULE_MATCH_VLAN_DEI: // NOT SUPPORTED YET
+				in.op = OP_CONST; in.field = (uint8_t)(r.v.vlanDei == 0);
+				break;
+			case ZT_NETWORK_RULE_MATCH_MAC_SOURCE:
+				in.op = OP_RANGE; in.field = Flow::FIELD_MAC_SOURCE;
+				range.lo = range.hi = MAC(r.v.mac,6).toInt();
+				break;
+			case ZT_NETWORK_RULE_MATCH_MAC_DEST:
+				in.op = OP_RANGE; in.field = Flow::FIELD_MAC_DEST;
+				range.lo = range.hi = MAC(r.v.mac,6).toInt();
+				break;
+			case ZT_NETWORK_RULE_MATCH_IPV4_SOURCE:
+			case ZT_NETWORK_RULE_MATCH_IPV4_DEST: {
+				in.op = OP_RANGE; in.field = (rt == ZT_NETWORK_RULE_MATCH_IPV4_SOURCE) ? Flow::FIELD_IPV4_SOURCE : Flow::FIELD_IPV4_DEST;
+				const uint64_t ip = _be32(reinterpret_cast<const uint8_t *>(&(r.v.ipv4.ip)));
+				const unsigned int bits = r.v.ipv4.mask;
+				if (bits == 0) {
+					range.lo = 0;
+					range.hi = 0xffffffffULL;
+				} else if (bits >= 32) {
+					range.lo = range.hi = ip;
+				} else {
+					const uint64_t hostMask = (1ULL << (32 - bits)) - 1;
+					range.lo = ip & ~hostMask;
+					range.hi = range.lo | hostMask;
+				}
+			}	break;
+			case ZT_NETWORK_RULE_MATCH_IPV6_SOURCE:
+			case ZT_NETWORK_RULE_MATCH_IPV6_DEST: {
+				in.op = (rt == ZT_NETWORK_RULE_MATCH_IPV6_SOURCE) ? OP_IPV6_SOURCE : OP_IPV6_DEST;
+				const InetAddress nm(InetAddress((const void *)r.v.ipv6.ip,16,r.v.ipv6.mask).netmask());
+				memcpy(in.mask,reinterpret_cast<const struct sockaddr_in6 *>(&nm)->sin6_addr.s6_addr,16);
+			}	break;
+			case ZT_NETWORK_RULE_MATCH_IP_TOS: in.op = OP_IP_TOS; break;
+			case ZT_NETWORK_RULE_MATCH_IP_PROTOCOL:
+				in.op = OP_RANGE; in.field = Flow::FIELD_IP_PROTOCOL;
+				range.lo = range.hi = r.v.ipProtocol;
+				break;
+			case ZT_NETWORK_RULE_MATCH_ETHERTYPE:
+				in.op = OP_RANGE; in.field = Flow::FIELD_ETHERTYPE;
+				range.lo = range.hi = r.v.etherType;
+				break;
+			case ZT_NETWORK_RULE_MATCH_ICMP: in.op = OP_ICMP; break;
+			case ZT_NETWORK_RULE_MATCH_IP_SOURCE_PORT_RANGE:
+			case ZT_NETWORK_RULE_MATCH_IP_DEST_PORT_RANGE:
+				in.op = OP_RANGE; in.field = (rt == ZT_NETWORK_RULE_MATCH_IP_SOURCE_PORT_RANGE) ? Flow::FIELD_SOURCE_PORT : Flow::FIELD_DEST_PORT;
+				range.lo = r.v.port[0];
+				range.hi = r.v.port[1];
+				break;
+			case ZT_NETWORK_RULE_MATCH_CHARACTERISTICS: in.op = OP_CHARACTERISTICS; break;
+			case ZT_NETWORK_RULE_MATCH_FRAME_SIZE_RANGE:
+				in.op = OP_RANGE; in.field = Flow::FIELD_FRAME_SIZE;
+				range.lo = r.v.frameSize[0];
+				range.hi = r.v.frameSize[1];
+				break;
+			case ZT_NETWORK_RULE_MATCH_RANDOM: in.op = OP_RANDOM; break;
+			case ZT_NETWORK_RULE_MATCH_TAGS_DIFFERENCE:
+			case ZT_NETWORK_RULE_MATCH_TAGS_BITWISE_AND:
+			case ZT_NETWORK_RULE_MATCH_TAGS_BITWISE_OR:
+			case ZT_NETWORK_RULE_MATCH_TAGS_BITWISE_XOR:
+			case ZT_NETWORK_RULE_MATCH_TAGS_EQUAL:
+			case ZT_NETWORK_RULE_MATCH_TAG_SENDER:
+			case ZT_NETWORK_RULE_MATCH_TAG_RECEIVER: in.op = OP_TAGS; break;
+			case ZT_NETWORK_RULE_MATCH_INTEGER_RANGE: in.op = OP_INTEGER_RANGE; break;
+
+			default:
+				in.op = ((unsigned int)rt <= (unsigned int)ZT_NETWORK_RULE_ACTION__MAX_ID) ? OP_NOP : OP_UNSUPPORTED;
+				break;
+		}
+
+		if (in.op == OP_RANGE) {
+			// Runs of OR (set |= a | b ...) or AND NOT (set &= !(a | b ...)) on
+			// the same field collapse into a single range set lookup.
+			if ( (!_insns.empty()) && (_insns.back().op == OP_RANGE) && (_insns.back().field == in.field) && (_insns.back().flags == in.flags) && ((in.flags == 0x40)||(in.flags == 0x80)) ) {
+				if (range.lo <= range.hi) {
+					ranges.push_back(range);
+					++_insns.back().rangeCount;
+				}
+				continue;
+			}
+			in.rangeStart = (unsigned int)ranges.size();
+			if (range.lo <= range.hi) {
+				ranges.push_back(range);
+				in.rangeCount = 1;
+			}
+		}
+
+		_insns.push_back(in);
+	}
+
+	std::sort(_tagIds.begin(),_tagIds.end());
+
+	// Sort and coalesce each instruction's range set so it can be binary searched
+	for(std::vector<_Insn>::iterator i(_insns.begin());i!=_insns.end();++i) {
+		if (i->op != OP_RANGE)
+			continue;
+		std::vector<_Range>::iterator rb(ranges.begin() + i->rangeStart);
+		std::vector<_Range>::iterator re(rb + i->rangeCount);
+		std::sort(rb,re);
+		i->rangeStart = (unsigned int)_ranges.size();
+		for(;rb!=re;++rb) {
+			if ((_ranges.size() > i->rangeStart)&&((_ranges.back().hi == 0xffffffffffffffffULL)||(rb->lo <= (_ranges.back().hi + 1)))) {
+				if (rb->hi > _ranges.back().hi)
+					_ranges.back().hi = rb->hi;
+			} else {
+				_ranges.push_back(*rb);
+			}
+		}
+		i->rangeCount = (unsigned int)_ranges.size() - i->rangeStart;
+	}
+
+	// Skip targets: once an AND leaves the set false, evaluation resumes at
+	// the next OR or action since everything in between is AND.
+	unsigned int next = (unsigned int)_insns.size();
+	for(unsigned int k=(unsigned int)_insns.size();k>0;--k) {
+		_Insn &in = _insns[k - 1];
+		in.skipTo = next;
+		if ((in.op <= OP_NOP)||(in.flags & 0x40))
+			next = k - 1;
+	}
+}
+
+RuleProgram::Result RuleProgram::run(
+	const RuntimeEnvironment *RR,
+	const NetworkConfig &nconf,
+	const Membership *membership,
+	const bool inbound,
+	const Address &ztSource,
+	Address &ztDest,
+	const MAC &macSource,
+	const MAC &macDest,
+	const Flow &flow,
+	Address &cc,
+	unsigned int &ccLength,
+	bool &ccWatch) const
+{
+	bool superAccept = false;
+	uint8_t thisSetMatches = 1;
+	uint64_t ownershipVerificationMask = 1; // computed lazily, 1 means not yet computed
+
+	const _Insn *const insns = (_insns.empty()) ? (const _Insn *)0 : &(_insns[0]);
+	const _Range *const ranges = (_ranges.empty()) ? (const _Range *)0 : &(_ranges[0]);
+	const unsigned int insnCount = (unsigned int)_insns.size();
+
+	unsigned int pc = 0;
+	while (pc < insnCount) {
+		const _Insn &in = insns[pc];
+		uint8_t thisRuleMatches;
+
+		if (in.op > OP_NOP) {
+			if (thisSetMatches) {
+				if (in.flags & 0x40) { // OR with a set that already matches is a no-op
+					++pc;
+					continue;
+				}
+			} else if (!(in.flags & 0x40)) {
+				pc = in.skipTo;
+				continue;
+			}
+		}
+
+		switch(in.op) {
+			case OP_DROP:
+				if (thisSetMatches)
+					return DROP;
+				thisSetMatches = 1;
+				++pc;
+				continue;
+
+			case OP_ACCEPT:
+				if (thisSetMatches)
+					return (superAccept ? SUPER_ACCEPT : ACCEPT);
+				thisSetMatches = 1;
+				++pc;
+				continue;
+
+			case OP_BREAK:
+				if (thisSetMatches)
+					return NO_MATCH;
+				thisSetMatches = 1;
+				++pc;
+				continue;
+
+			case OP_FWD: {
+				const ZT_VirtualNetworkRuleType rt = (ZT_VirtualNetworkRuleType)(in.rule.t & 0x3f);
+				const Address fwdAddr(in.rule.v.fwd.address);
+				if (thisSetMatches) {
+					if (fwdAddr == ztSource) {
+						// Skip as no-op since source is target
+					} else if (fwdAddr == RR->identity.address()) {
+						if (inbound)
+							return SUPER_ACCEPT;
+					} else if (fwdAddr == ztDest) {
+					} else {
+						if (rt == ZT_NETWORK_RULE_ACTION_REDIRECT) {
+							ztDest = fwdAddr;
+							return REDIRECT;
+						} else {
+							cc = fwdAddr;
+							ccLength = (in.rule.v.fwd.length != 0) ? ((flow._frameLen < (unsigned int)in.rule.v.fwd.length) ? flow._frameLen : (unsigned int)in.rule.v.fwd.length) : flow._frameLen;
+							ccWatch = (rt == ZT_NETWORK_RULE_ACTION_WATCH);
+						}
+					}
+				} else if ((inbound)&&(fwdAddr == RR->identity.address())) {
+					superAccept = true;
+				}
+				thisSetMatches = 1;
+				++pc;
+			}	continue;
+
+			case OP_NOP:
+				thisSetMatches = 1;
+				++pc;
+				continue;
+
+			case OP_RANGE:
+				thisRuleMatches = 0;
+				if ((flow._valid & (1 << in.field))) {
+					const uint64_t v = flow._field[in.field];
+					const _Range *lo = ranges + in.rangeStart;
+					unsigned int n = in.rangeCount;
+					while (n) { // find the last range with range.lo <= v
+						const unsigned int half = n >> 1;
+						if (lo[half].lo <= v) {
+							lo += half + 1;
+							n -= half + 1;
+						} else {
+							n = half;
+						}
+					}
+					if ((lo != (ranges + in.rangeStart))&&(v <= (lo - 1)->hi))
+						thisRuleMatches = 1;
+				}
+				break;
+
+			case OP_IPV6_SOURCE:
+			case OP_IPV6_DEST: {
+				const uint8_t *a = (in.op == OP_IPV6_SOURCE) ? flow._ip6Source : flow._ip6Dest;
+				thisRuleMatches = 0;
+				if (a) {
+					thisRuleMatches = 1;
+					for(unsigned int i=0;i<16;++i) {
+						if ((a[i] & in.mask[i]) != in.rule.v.ipv6.ip[i]) {
+							thisRuleMatches = 0;
+							break;
+						}
+					}
+				}
+			}	break;
+
+			case OP_CONST:
+				thisRuleMatches = in.field;
+				break;
+
+			case OP_UNSUPPORTED:
+				thisRuleMatches = (uint8_t)((nconf.flags & ZT_NETWORKCONFIG_FLAG_RULES_RESULT_OF_UNSUPPORTED_MATCH) != 0);
+				break;
+
+			case OP_IP_TOS:
+				if (flow._tos >= 0) {
+					const uint8_t tosMasked = (uint8_t)flow._tos & in.rule.v.ipTos.mask;
+					thisRuleMatches = (uint8_t)((tosMasked >= in.rule.v.ipTos.value[0])&&(tosMasked <= in.rule.v.ipTos.value[1]));
+				} else {
+					thisRuleMatches = 0;
+				}
+				break;
+
+			case OP_ICMP:
+				if ((flow._icmpType >= 0)&&(in.rule.v.icmp.type == (uint8_t)flow._icmpType)) {
+					thisRuleMatches = ((in.rule.v.icmp.flags & 0x01) != 0) ? (uint8_t)((uint8_t)flow._icmpCode == in.rule.v.icmp.code) : (uint8_t)1;
+				} else {
+					thisRuleMatches = 0;
+				}
+				break;
+
+			case OP_CHARACTERISTICS: {
+				uint64_t cf = (inbound) ? ZT_RULE_PACKET_CHARACTERISTICS_INBOUND : 0ULL;
+				if (macDest.isMulticast()) cf |= ZT_RULE_PACKET_CHARACTERISTICS_MULTICAST;
+				if (macDest.isBroadcast()) cf |= ZT_RULE_PACKET_CHARACTERISTICS_BROADCAST;
+				if (ownershipVerificationMask == 1)
+					ownershipVerificationMask = _ownershipVerificationMask(nconf,membership,inbound,macSource,flow._frameData,flow._frameLen,flow._etherType);
+				cf |= ownershipVerificationMask;
+				cf |= flow._tcpFlags;
+				thisRuleMatches = (uint8_t)((cf & in.rule.v.characteristics) != 0);
+			}	break;
+
+			case OP_RANDOM:
+				thisRuleMatches = (uint8_t)((uint32_t)(RR->node->prng() & 0xffffffffULL) <= in.rule.v.randomProbability);
+				break;
+
+			case OP_TAGS:
+				thisRuleMatches = _matchTags(nconf,membership,inbound,superAccept,(ZT_VirtualNetworkRuleType)(in.rule.t & 0x3f),in.rule);
+				break;
+
+			case OP_INTEGER_RANGE:
+				thisRuleMatches = _matchIntegerRange(in.rule,flow._frameData,flow._frameLen);
+				break;
+
+			default:
+				thisRuleMatches = 0;
+				break;
+		}
+
+		if ((in.flags & 0x40))
+			thisSetMatches |= (thisRuleMatches ^ ((in.flags >> 7) & 1));
+		else thisSetMatches &= (thisRuleMatches ^ ((in.flags >> 7) & 1));
+		++pc;
+	}
+
+	return NO_MATCH;
+}
+
+RuleProgram::Result RuleProgram::interpret(
+	const RuntimeEnvironment *RR,
+	Trace::RuleResultLog &rrl,
+	const NetworkConfig &nconf,
+	const Membership *membership,
+	const bool inbound,
+	const Address &ztSource,
+	Address &ztDest,
+	const MAC &macSource,
+	const MAC &macDest,
+	const uint8_t *const frameData,
+	const unsigned int frameLen,
+	const unsigned int etherType,
+	const unsigned int vlanId,
+	const ZT_VirtualNetworkRule *rules,
+	const unsigned int ruleCount,
+	Address &cc,
+	unsigned int &ccLength,
+	bool &ccWatch)
+{
+	// Set to true if we are a TEE/REDIRECT/WATCH target
+	bool superAccept = false;
+
+	// The default match state for each set of entries starts as 'true' since an
+	// ACTION with no MATCH entries preceding it is always taken.
+	uint8_t thisSetMatches = 1;
+
+	uint64_t ownershipVerificationMask = 1; // computed lazily, 1 means not yet computed
+
+	rrl.clear();
+
+	for(unsigned int rn=0;rn<ruleCount;++rn) {
+		const ZT_VirtualNetworkRuleType rt = (ZT_VirtualNetworkRuleType)(rules[rn].t & 0x3f);
+
+		// First check if this is an ACTION
+		if ((unsigned int)rt <= (unsigned int)ZT_NETWORK_RULE_ACTION__MAX_ID) {
+			if (thisSetMatches) {
+				switch(rt) {
+					case ZT_NETWORK_RULE_ACTION_DROP:
+						return DROP;
+
+					case ZT_NETWORK_RULE_ACTION_ACCEPT:
+						return (superAccept ? SUPER_ACCEPT : ACCEPT); // match, accept packet
+
+					// These are initially handled together since preliminary logic is common
+					case ZT_NETWORK_RULE_ACTION_TEE:
+					case ZT_NETWORK_RULE_ACTION_WATCH:
+					case ZT_NETWORK_RULE_ACTION_REDIRECT:	{
+						const Address fwdAddr(rules[rn].v.fwd.address);
+						if (fwdAddr == ztSource) {
+							// Skip as no-op since source is target
+						} else if (fwdAddr == RR->identity.address()) {
+							if (inbound) {
+								return SUPER_ACCEPT;
+							} else {
+							}
+						} else if (fwdAddr == ztDest) {
+						} else {
+							if (rt == ZT_NETWORK_RULE_ACTION_REDIRECT) {
+								ztDest = fwdAddr;
+								return REDIRECT;
+							} else {
+								cc = fwdAddr;
+								ccLength = (rules[rn].v.fwd.length != 0) ? ((frameLen < (unsigned int)rules[rn].v.fwd.length) ? frameLen : (unsigned int)rules[rn].v.fwd.length) : frameLen;
+								ccWatch = (rt == ZT_NETWORK_RULE_ACTION_WATCH);
+							}
+						}
+					}	continue;
+
+					case ZT_NETWORK_RULE_ACTION_BREAK:
+						return NO_MATCH;
+
+					// Unrecognized ACTIONs are ignored as no-ops
+					default:
+						continue;
+				}
+			} else {
+				// If this is an incoming packet and we are a TEE or REDIRECT target, we should
+				// super-accept if we accept at all. This will cause us to accept redirected or
+				// tee'd packets in spite of MAC and ZT addressing checks.
+				if (inbound) {
+					switch(rt) {
+						case ZT_NETWORK_RULE_ACTION_TEE:
+						case ZT_NETWORK_RULE_ACTION_WATCH:
+						case ZT_NETWORK_RULE_ACTION_REDIRECT:
+							if (RR->identity.address() == rules[rn].v.fwd.address)
+								superAccept = true;
+							break;
+						default:
+							break;
+					}
+				}
+
+				thisSetMatches = 1; // reset to default true for next batch of entries
+				continue;
+			}
+		}
+
+		// Circuit breaker: no need to evaluate an AND if the set's match state
+		// is currently false since anything AND false is false.
+		if ((!thisSetMatches)&&(!(rules[rn].t & 0x40))) {
+			rrl.logSkipped(rn,thisSetMatches);
+			continue;
+		}
+
+		// If this was not an ACTION evaluate next MATCH and update thisSetMatches with (AND [result])
+		uint8_t thisRuleMatches = 0;
+		switch(rt) {
+			case ZT_NETWORK_RULE_MATCH_SOURCE_ZEROTIER_ADDRESS:
+				thisRuleMatches = (uint8_t)(rules[rn].v.zt == ztSource.toInt());
+				break;
+			case ZT_NETWORK_RULE_MATCH_DEST_ZEROTIER_ADDRESS:
+				thisRuleMatches = (uint8_t)(rules[rn].v.zt == ztDest.toInt());
+				break;
+			case ZT_NETWORK_RULE_MATCH_VLAN_ID:
+				thisRuleMatches = (uint8_t)(rules[rn].v.vlanId == (uint16_t)vlanId);
+				break;
+			case ZT_NETWORK_RULE_MATCH_VLAN_PCP:
+				// NOT SUPPORTED YET
+				thisRuleMatches = (uint8_t)(rules[rn].v.vlanPcp == 0);
+				break;
+			case ZT_NETWORK_RULE_MATCH_VLAN_DEI:
+				// NOT SUPPORTED YET
+				thisRuleMatches = (uint8_t)(rules[rn].v.vlanDei == 0);
+				break;
+			case ZT_NETWORK_RULE_MATCH_MAC_SOURCE:
+				thisRuleMatches = (uint8_t)(MAC(rules[rn].v.mac,6) == macSource);
+				break;
+			case ZT_NETWORK_RULE_MATCH_MAC_DEST:
+				thisRuleMatches = (uint8_t)(MAC(rules[rn].v.mac,6) == macDest);
+				break;
+			case ZT_NETWORK_RULE_MATCH_IPV4_SOURCE:
+				if ((etherType == ZT_ETHERTYPE_IPV4)&&(frameLen >= 20)) {
+					thisRuleMatches = (uint8_t)(InetAddress((const void *)&(rules[rn].v.ipv4.ip),4,rules[rn].v.ipv4.mask).containsAddress(InetAddress((const void *)(frameData + 12),4,0)));
+				} else {
+					thisRuleMatches = 0;
+				}
+				break;
+			case ZT_NETWORK_RULE_MATCH_IPV4_DEST:
+				if ((etherType == ZT_ETHERTYPE_IPV4)&&(frameLen >= 20)) {
+					thisRuleMatches = (uint8_t)(InetAddress((const void *)&(rules[rn].v.ipv4.ip),4,rules[rn].v.ipv4.mask).containsAddress(InetAddress((const void *)(frameData + 16),4,0)));
+				} else {
+					thisRuleMatches = 0;
+				}
+				break;
+			case ZT_NETWORK_RULE_MATCH_IPV6_SOURCE:
+				if ((etherType == ZT_ETHERTYPE_IPV6)&&(frameLen >= 40)) {
+					thisRuleMatches = (uint8_t)(InetAddress((const void *)rules[rn].v.ipv6.ip,16,rules[rn].v.ipv6.mask).containsAddress(InetAddress((const void *)(frameData + 8),16,0)));
+				} else {
+					thisRuleMatches = 0;
+				}
+				break;
+			case ZT_NETWORK_RULE_MATCH_IPV6_DEST:
+				if ((etherType == ZT_ETHERTYPE_IPV6)&&(frameLen >= 40)) {
+					thisRuleMatches = (uint8_t)(InetAddress((const void *)rules[rn].v.ipv6.ip,16,rules[rn].v.ipv6.mask).containsAddress(InetAddress((const void *)(frameData + 24),16,0)));
+				} else {
+					thisRuleMatches = 0;
+				}
+				break;
+			case ZT_NETWORK_RULE_MATCH_IP_TOS:
+				if ((etherType == ZT_ETHERTYPE_IPV4)&&(frameLen >= 20)) {
+					const uint8_t tosMasked = frameData[1] & rules[rn].v.ipTos.mask;
+					thisRuleMatches = (uint8_t)((tosMasked >= rules[rn].v.ipTos.value[0])&&(tosMasked <= rules[rn].v.ipTos.value[1]));
+				} else if ((etherType == ZT_ETHERTYPE_IPV6)&&(frameLen >= 40)) {
+					const uint8_t tosMasked = (((frameData[0] << 4) & 0xf0) | ((frameData[1] >> 4) & 0x0f)) & rules[rn].v.ipTos.mask;
+					thisRuleMatches = (uint8_t)((tosMasked >= rules[rn].v.ipTos.value[0])&&(tosMasked <= rules[rn].v.ipTos.value[1]));
+				} else {
+					thisRuleMatches = 0;
+				}
+				break;
+			case ZT_NETWORK_RULE_MATCH_IP_PROTOCOL:
+				if ((etherType == ZT_ETHERTYPE_IPV4)&&(frameLen >= 20)) {
+					thisRuleMatches = (uint8_t)(rules[rn].v.ipProtocol == frameData[9]);
+				} else if (etherType == ZT_ETHERTYPE_IPV6) {
+					unsigned int pos = 0,proto = 0;
+					if (_ipv6GetPayload(frameData,frameLen,pos,proto)) {
+						thisRuleMatches = (uint8_t)(rules[rn].v.ipProtocol == (uint8_t)proto);
+					} else {
+						thisRuleMatches = 0;
+					}
+				} else {
+					thisRuleMatches = 0;
+				}
+				break;
+			case ZT_NETWORK_RULE_MATCH_ETHERTYPE:
+				thisRuleMatches = (uint8_t)(rules[rn].v.etherType == (uint16_t)etherType);
+				break;
+			case ZT_NETWORK_RULE_MATCH_ICMP:
+				if ((etherType == ZT_ETHERTYPE_IPV4)&&(frameLen >= 20)) {
+					if (frameData[9] == 0x01) { // IP protocol == ICMP
+						const unsigned int ihl = (frameData[0] & 0xf) * 4;
+						if (frameLen >= (ihl + 2)) {
+							if (rules[rn].v.icmp.type == frameData[ihl]) {
+								if ((rules[rn].v.icmp.flags & 0x01) != 0) {
+									thisRuleMatches = (uint8_t)(frameData[ihl+1] == rules[rn].v.icmp.code);
+								} else {
+									thisRuleMatches = 1;
+								}
+							} else {
+								thisRuleMatches = 0;
+							}
+						} else {
+							thisRuleMatches = 0;
+						}
+					} else {
+						thisRuleMatches = 0;
+					}
+				} else if (etherType == ZT_ETHERTYPE_IPV6) {
+					unsigned int pos = 0,proto = 0;
+					if (_ipv6GetPayload(frameData,frameLen,pos,proto)) {
+						if ((proto == 0x3a)&&(frameLen >= (pos+2))) {
+							if (rules[rn].v.icmp.type == frameData[pos]) {
+								if ((rules[rn].v.icmp.flags & 0x01) != 0) {
+									thisRuleMatches = (uint8_t)(frameData[pos+1] == rules[rn].v.icmp.code);
+								} else {
+									thisRuleMatches = 1;
+								}
+							} else {
+								thisRuleMatches = 0;
+							}
+						} else {
+							thisRuleMatches = 0;
+						}
+					} else {
+						thisRuleMatches = 0;
+					}
+				} else {
+					thisRuleMatches = 0;
+				}
+				break;
+			case ZT_NETWORK_RULE_MATCH_IP_SOURCE_PORT_RANGE:
+			case ZT_NETWORK_RULE_MATCH_IP_DEST_PORT_RANGE:
+				if ((etherType == ZT_ETHERTYPE_IPV4)&&(frameLen >= 20)) {
+					const unsigned int headerLen = 4 * (frameData[0] & 0xf);
+					int p = -1;
+					if ((_isPortProtocol(frameData[9]))&&(frameLen > (headerLen + 4))) {
+						unsigned int pos = headerLen + ((rt == ZT_NETWORK_RULE_MATCH_IP_DEST_PORT_RANGE) ? 2 : 0);
+						p = (int)frameData[pos++] << 8;
+						p |= (int)frameData[pos];
+					}
+					thisRuleMatches = (p >= 0) ? (uint8_t)((p >= (int)rules[rn].v.port[0])&&(p <= (int)rules[rn].v.port[1])) : (uint8_t)0;
+				} else if (etherType == ZT_ETHERTYPE_IPV6) {
+					unsigned int pos = 0,proto = 0;
+					if (_ipv6GetPayload(frameData,frameLen,pos,proto)) {
+						int p = -1;
+						if ((_isPortProtocol(proto))&&(frameLen > (pos + 4))) {
+							if (rt == ZT_NETWORK_RULE_MATCH_IP_DEST_PORT_RANGE) pos += 2;
+							p = (int)frameData[pos++] << 8;
+							p |= (int)frameData[pos];
+						}
+						thisRuleMatches = (p > 0) ? (uint8_t)((p >= (int)rules[rn].v.port[0])&&(p <= (int)rules[rn].v.port[1])) : (uint8_t)0;
+					} else {
+						thisRuleMatches = 0;
+					}
+				} else {
+					thisRuleMatches = 0;
+				}
+				break;
+			case ZT_NETWORK_RULE_MATCH_CHARACTERISTICS: {
+				uint64_t cf = (inbound) ? ZT_RULE_PACKET_CHARACTERISTICS_INBOUND : 0ULL;
+				if (macDest.isMulticast()) cf |= ZT_RULE_PACKET_CHARACTERISTICS_MULTICAST;
+				if (macDest.isBroadcast()) cf |= ZT_RULE_PACKET_CHARACTERISTICS_BROADCAST;
+				if (ownershipVerificationMask == 1)
+					ownershipVerificationMask = _ownershipVerificationMask(nconf,membership,inbound,macSource,frameData,frameLen,etherType);
+				cf |= ownershipVerificationMask;
+				if ((etherType == ZT_ETHERTYPE_IPV4)&&(frameLen >= 20)&&(frameData[9] == 0x06)) {
+					const unsigned int headerLen = 4 * (frameData[0] & 0xf);
+					if (frameLen > (headerLen + 13)) {
+						cf |= (uint64_t)frameData[headerLen + 13];
+						cf |= (((uint64_t)(frameData[headerLen + 12] & 0x0f)) << 8);
+					}
+				} else if (etherType == ZT_ETHERTYPE_IPV6) {
+					unsigned int pos = 0,proto = 0;
+					if (_ipv6GetPayload(frameData,frameLen,pos,proto)) {
+						if ((proto == 0x06)&&(frameLen > (pos + 14))) {
+							cf |= (uint64_t)frameData[pos + 13];
+							cf |= (((uint64_t)(frameData[pos + 12] & 0x0f)) << 8);
+						}
+					}
+				}
+				thisRuleMatches = (uint8_t)((cf & rules[rn].v.characteristics) != 0);
+			}	break;
+			case ZT_NETWORK_RULE_MATCH_FRAME_SIZE_RANGE:
+				thisRuleMatches = (uint8_t)((frameLen >= (unsigned int)rules[rn].v.frameSize[0])&&(frameLen <= (unsigned int)rules[rn].v.frameSize[1]));
+				break;
+			case ZT_NETWORK_RULE_MATCH_RANDOM:
+				thisRuleMatches = (uint8_t)((uint32_t)(RR->node->prng() & 0xffffffffULL) <= rules[rn].v.randomProbability);
+				break;
+			case ZT_NETWORK_RULE_MATCH_TAGS_DIFFERENCE:
+			case ZT_NETWORK_RULE_MATCH_TAGS_BITWISE_AND:
+			case ZT_NETWORK_RULE_MATCH_TAGS_BITWISE_OR:
+			case ZT_NETWORK_RULE_MATCH_TAGS_BITWISE_XOR:
+			case ZT_NETWORK_RULE_MATCH_TAGS_EQUAL:
+			case ZT_NETWORK_RULE_MATCH_TAG_SENDER:
+			case ZT_NETWORK_RULE_MATCH_TAG_RECEIVER:
+				thisRuleMatches = _matchTags(nconf,membership,inbound,superAccept,rt,rules[rn]);
+				break;
+			case ZT_NETWORK_RULE_MATCH_INTEGER_RANGE:
+				thisRuleMatches = _matchIntegerRange(rules[rn],frameData,frameLen);
+				break;
+
+			// The result of an unsupported MATCH is configurable at the network
+			// level via a flag.
+			default:
+				thisRuleMatches = (uint8_t)((nconf.flags & ZT_NETWORKCONFIG_FLAG_RULES_RESULT_OF_UNSUPPORTED_MATCH) != 0);
+				break;
+		}
+
+		rrl.log(rn,thisRuleMatches,thisSetMatches);
+
+		if ((rules[rn].t & 0x40))
+			thisSetMatches |= (thisRuleMatches ^ ((rules[rn].t >> 7) & 1));
+		else thisSetMatches &= (thisRuleMatches ^ ((rules[rn].t >> 7) & 1));
+	}
+
+	return NO_MATCH;
+}
+
+} // namespace ZeroTier
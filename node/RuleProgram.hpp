@@ -0,0 +1,304 @@
+/*
+ * ZeroTier One - Network Virtualization Everywhere
+ * Copyright (C) 2011-2018  ZeroTier, Inc.  https://www.zerotier.com/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * --
+ *
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial closed-source software that incorporates or links
+ * directly against ZeroTier software without disclosing the source code
+ * of your own application.
+ */
+
+#ifndef ZT_RULEPROGRAM_HPP
+#define ZT_RULEPROGRAM_HPP
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#include "Constants.hpp"
+#include "../include/ZeroTierOne.h"
+#include "Address.hpp"
+#include "MAC.hpp"
+#include "Trace.hpp"
+
+namespace ZeroTier {
+
+class RuntimeEnvironment;
+class NetworkConfig;
+class Membership;
+
+/**
+ * A network rule set compiled for fast repeated evaluation
+ *
+ * Rule sets are compiled once when a network config is applied. Runs of
+ * rules that test the same header field are merged into sorted range sets
+ * searched in O(log n), AND chains jump past the rest of their set once the
+ * set can no longer match, and unreachable rules are dropped. Frame headers
+ * are parsed once into a Flow and shared by the network rules and all
+ * capabilities.
+ *
+ * The original rule interpreter is kept for traced networks (it fills a
+ * Trace::RuleResultLog) and for capabilities presented by remote members.
+ */
+class RuleProgram
+{
+public:
+	enum Result
+	{
+		NO_MATCH,
+		DROP,
+		REDIRECT,
+		ACCEPT,
+		SUPER_ACCEPT
+	};
+
+	/**
+	 * Header fields extracted once per frame
+	 */
+	class Flow
+	{
+		friend class RuleProgram;
+
+	public:
+		enum Field
+		{
+			FIELD_ZT_SOURCE = 0,
+			FIELD_ZT_DEST = 1,
+			FIELD_VLAN_ID = 2,
+			FIELD_MAC_SOURCE = 3,
+			FIELD_MAC_DEST = 4,
+			FIELD_IPV4_SOURCE = 5,
+			FIELD_IPV4_DEST = 6,
+			FIELD_IP_PROTOCOL = 7,
+			FIELD_ETHERTYPE = 8,
+			FIELD_SOURCE_PORT = 9,
+			FIELD_DEST_PORT = 10,
+			FIELD_FRAME_SIZE = 11,
+			FIELD__COUNT = 12
+		};
+
+		/**
+		 * Hash key identifying a flow for the verdict cache
+		 *
+		 * Covers every field a cacheable program can test: ZeroTier and MAC
+		 * addresses, ethertype, VLAN, IP addresses, protocol, and ports.
+		 */
+		struct Key
+		{
+			uint64_t k[13]; // k[11..12] hold recipient tag values when keyed by recipient class
+
+			inline unsigned long hashCode() const
+			{
+				uint64_t h = 0;
+				for(unsigned int i=0;i<13;++i)
+					h = (h + k[i]) * 0x9e3779b97f4a7c15ULL;
+				return (unsigned long)(h ^ (h >> 32));
+			}
+			inline bool operator==(const Key &fk) const { return (memcmp(k,fk.k,sizeof(k)) == 0); }
+			inline bool operator!=(const Key &fk) const { return (memcmp(k,fk.k,sizeof(k)) != 0); }
+		};
+
+		Flow(
+			const Address &ztSource,
+			const Address &ztDest,
+			const MAC &macSource,
+			const MAC &macDest,
+			const uint8_t *frameData,
+			const unsigned int frameLen,
+			const unsigned int etherType,
+			const unsigned int vlanId);
+
+		/**
+		 * @param fk Key to fill
+		 * @param inbound True if frame is inbound
+		 * @return Reference to fk
+		 */
+		const Key &key(Key &fk,const bool inbound) const;
+
+	private:
+		uint64_t _field[FIELD__COUNT];
+		unsigned int _valid; // bit mask of valid fields
+
+		const uint8_t *_frameData;
+		unsigned int _frameLen;
+		unsigned int _etherType;
+		const uint8_t *_ip6Source; // NULL if not IPv6
+		const uint8_t *_ip6Dest;
+		int _tos; // -1 if not IP
+		int _icmpType; // -1 if not ICMP or ICMPv6
+		int _icmpCode;
+		uint64_t _tcpFlags; // TCP flags in ZT_RULE_PACKET_CHARACTERISTICS bit positions
+	};
+
+	RuleProgram() : _cacheable(true),_destinationIndependent(true) {}
+
+	/**
+	 * Compile a rule set, replacing any previously compiled program
+	 *
+	 * @param rules Rules (may be NULL if ruleCount is zero)
+	 * @param ruleCount Number of rules
+	 */
+	void compile(const ZT_VirtualNetworkRule *rules,const unsigned int ruleCount);
+
+	/**
+	 * Evaluate this program against a parsed frame
+	 *
+	 * Arguments and results are the same as interpret() except that no
+	 * rule result log is kept.
+	 */
+	Result run(
+		const RuntimeEnvironment *RR,
+		const NetworkConfig &nconf,
+		const Membership *membership,
+		const bool inbound,
+		const Address &ztSource,
+		Address &ztDest,
+		const MAC &macSource,
+		const MAC &macDest,
+		const Flow &flow,
+		Address &cc,
+		unsigned int &ccLength,
+		bool &ccWatch) const;
+
+	/**
+	 * @return Number of compiled instructions
+	 */
+	inline unsigned int size() const { return (unsigned int)_insns.size(); }
+
+	/**
+	 * @return True if this program's result depends only on fields in Flow::Key and on credentials
+	 */
+	inline bool cacheable() const { return _cacheable; }
+
+	/**
+	 * Check whether a rule set's result depends only on fields in Flow::Key and on credentials
+	 *
+	 * Frame size, TOS, ICMP, characteristics, random, and integer range
+	 * matches make a rule set uncacheable since they can differ between
+	 * frames of the same flow.
+	 *
+	 * @param rules Rules
+	 * @param ruleCount Number of rules
+	 * @return True if results may be cached per flow
+	 */
+	static bool cacheable(const ZT_VirtualNetworkRule *rules,const unsigned int ruleCount);
+
+	/**
+	 * @return True if results depend on the ZeroTier destination only through its tags
+	 */
+	inline bool destinationIndependent() const { return _destinationIndependent; }
+
+	/**
+	 * @return Sorted IDs of tags tested by this program
+	 */
+	inline const std::vector<uint32_t> &tagIds() const { return _tagIds; }
+
+	/**
+	 * Evaluate a rule set directly without compiling it
+	 *
+	 * @param RR Runtime environment
+	 * @param rrl Rule result log, filled with per-rule results for tracing
+	 * @param nconf Network config
+	 * @param membership Membership of remote peer or NULL if none
+	 * @param inbound True if frame is inbound
+	 * @param ztSource ZeroTier source address
+	 * @param ztDest ZeroTier destination (changed on REDIRECT)
+	 * @param macSource Ethernet source
+	 * @param macDest Ethernet destination
+	 * @param frameData Frame payload
+	 * @param frameLen Frame payload length
+	 * @param etherType Ethernet frame type
+	 * @param vlanId VLAN ID or 0 if none
+	 * @param rules Rules (cannot be NULL)
+	 * @param ruleCount Number of rules
+	 * @param cc Set to TEE/WATCH destination if one is taken, otherwise left alone
+	 * @param ccLength Set to length of frame to TEE/WATCH
+	 * @param ccWatch Set to true for WATCH as opposed to TEE
+	 * @return Result of evaluation
+	 */
+	static Result interpret(
+		const RuntimeEnvironment *RR,
+		Trace::RuleResultLog &rrl,
+		const NetworkConfig &nconf,
+		const Membership *membership,
+		const bool inbound,
+		const Address &ztSource,
+		Address &ztDest,
+		const MAC &macSource,
+		const MAC &macDest,
+		const uint8_t *const frameData,
+		const unsigned int frameLen,
+		const unsigned int etherType,
+		const unsigned int vlanId,
+		const ZT_VirtualNetworkRule *rules,
+		const unsigned int ruleCount,
+		Address &cc,
+		unsigned int &ccLength,
+		bool &ccWatch);
+
+private:
+	enum Op
+	{
+		OP_DROP,
+		OP_ACCEPT,
+		OP_BREAK,
+		OP_FWD, // TEE, WATCH, or REDIRECT
+		OP_NOP, // unrecognized action
+		OP_RANGE, // field value within sorted range set
+		OP_IPV6_SOURCE,
+		OP_IPV6_DEST,
+		OP_CONST,
+		OP_UNSUPPORTED,
+		OP_IP_TOS,
+		OP_ICMP,
+		OP_CHARACTERISTICS,
+		OP_RANDOM,
+		OP_TAGS,
+		OP_INTEGER_RANGE
+	};
+
+	struct _Range
+	{
+		uint64_t lo,hi;
+		inline bool operator<(const _Range &r) const { return ((lo < r.lo)||((lo == r.lo)&&(hi < r.hi))); }
+	};
+
+	struct _Insn
+	{
+		uint8_t op;
+		uint8_t flags; // 0x40 for OR, 0x80 for NOT as in ZT_VirtualNetworkRule.t
+		uint8_t field; // Flow::Field for OP_RANGE, result for OP_CONST
+		uint8_t mask[16]; // IPv6 netmask for OP_IPV6_*
+		unsigned int skipTo; // next instruction if this is an AND and the set no longer matches
+		unsigned int rangeStart;
+		unsigned int rangeCount;
+		ZT_VirtualNetworkRule rule;
+	};
+
+	std::vector<_Insn> _insns;
+	std::vector<_Range> _ranges;
+	std::vector<uint32_t> _tagIds;
+	bool _cacheable;
+	bool _destinationIndependent;
+};
+
+} // namespace ZeroTier
+
+#endif
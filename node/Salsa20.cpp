@@ -64,6 +64,272 @@ public:
 static const _s20sseconsts _S20SSECONSTANTS;
 #endif
 
+#ifdef ZT_SALSA20_AVX2
+#include <immintrin.h>
+
+// Salsa20 double round over word-sliced state x[0..15], one block per vector lane
+#define _S20V_DOUBLEROUND(ADD,XOR,ROTL) \
+	x[4] = XOR(x[4],ROTL(ADD(x[0],x[12]),7)); \
+	x[8] = XOR(x[8],ROTL(ADD(x[4],x[0]),9)); \
+	x[12] = XOR(x[12],ROTL(ADD(x[8],x[4]),13)); \
+	x[0] = XOR(x[0],ROTL(ADD(x[12],x[8]),18)); \
+	x[9] = XOR(x[9],ROTL(ADD(x[5],x[1]),7)); \
+	x[13] = XOR(x[13],ROTL(ADD(x[9],x[5]),9)); \
+	x[1] = XOR(x[1],ROTL(ADD(x[13],x[9]),13)); \
+	x[5] = XOR(x[5],ROTL(ADD(x[1],x[13]),18)); \
+	x[14] = XOR(x[14],ROTL(ADD(x[10],x[6]),7)); \
+	x[2] = XOR(x[2],ROTL(ADD(x[14],x[10]),9)); \
+	x[6] = XOR(x[6],ROTL(ADD(x[2],x[14]),13)); \
+	x[10] = XOR(x[10],ROTL(ADD(x[6],x[2]),18)); \
+	x[3] = XOR(x[3],ROTL(ADD(x[15],x[11]),7)); \
+	x[7] = XOR(x[7],ROTL(ADD(x[3],x[15]),9)); \
+	x[11] = XOR(x[11],ROTL(ADD(x[7],x[3]),13)); \
+	x[15] = XOR(x[15],ROTL(ADD(x[11],x[7]),18)); \
+	x[1] = XOR(x[1],ROTL(ADD(x[0],x[3]),7)); \
+	x[2] = XOR(x[2],ROTL(ADD(x[1],x[0]),9)); \
+	x[3] = XOR(x[3],ROTL(ADD(x[2],x[1]),13)); \
+	x[0] = XOR(x[0],ROTL(ADD(x[3],x[2]),18)); \
+	x[6] = XOR(x[6],ROTL(ADD(x[5],x[4]),7)); \
+	x[7] = XOR(x[7],ROTL(ADD(x[6],x[5]),9)); \
+	x[4] = XOR(x[4],ROTL(ADD(x[7],x[6]),13)); \
+	x[5] = XOR(x[5],ROTL(ADD(x[4],x[7]),18)); \
+	x[11] = XOR(x[11],ROTL(ADD(x[10],x[9]),7)); \
+	x[8] = XOR(x[8],ROTL(ADD(x[11],x[10]),9)); \
+	x[9] = XOR(x[9],ROTL(ADD(x[8],x[11]),13)); \
+	x[10] = XOR(x[10],ROTL(ADD(x[9],x[8]),18)); \
+	x[12] = XOR(x[12],ROTL(ADD(x[15],x[14]),7)); \
+	x[13] = XOR(x[13],ROTL(ADD(x[12],x[15]),9)); \
+	x[14] = XOR(x[14],ROTL(ADD(x[13],x[12]),13)); \
+	x[15] = XOR(x[15],ROTL(ADD(x[14],x[13]),18));
+
+// Maps SSE state order (see Salsa20::init()) to standard Salsa20 word order
+static const unsigned char _S20SSEORDER[16] = { 0,5,10,15,4,9,14,3,8,13,2,7,12,1,6,11 };
+
+// Transpose an 8x8 matrix of 32-bit words held in eight vectors (its own inverse)
+__attribute__((target("avx2")))
+static inline void _s20Transpose8x8(__m256i *const a)
+{
+	const __m256i t0 = _mm256_unpacklo_epi32(a[0],a[1]);
+	const __m256i t1 = _mm256_unpackhi_epi32(a[0],a[1]);
+	const __m256i t2 = _mm256_unpacklo_epi32(a[2],a[3]);
+	const __m256i t3 = _mm256_unpackhi_epi32(a[2],a[3]);
+	const __m256i t4 = _mm256_unpacklo_epi32(a[4],a[5]);
+	const __m256i t5 = _mm256_unpackhi_epi32(a[4],a[5]);
+	const __m256i t6 = _mm256_unpacklo_epi32(a[6],a[7]);
+	const __m256i t7 = _mm256_unpackhi_epi32(a[6],a[7]);
+	const __m256i u0 = _mm256_unpacklo_epi64(t0,t2);
+	const __m256i u1 = _mm256_unpackhi_epi64(t0,t2);
+	const __m256i u2 = _mm256_unpacklo_epi64(t1,t3);
+	const __m256i u3 = _mm256_unpackhi_epi64(t1,t3);
+	const __m256i u4 = _mm256_unpacklo_epi64(t4,t6);
+	const __m256i u5 = _mm256_unpackhi_epi64(t4,t6);
+	const __m256i u6 = _mm256_unpacklo_epi64(t5,t7);
+	const __m256i u7 = _mm256_unpackhi_epi64(t5,t7);
+	a[0] = _mm256_permute2x128_si256(u0,u4,0x20);
+	a[1] = _mm256_permute2x128_si256(u1,u5,0x20);
+	a[2] = _mm256_permute2x128_si256(u2,u6,0x20);
+	a[3] = _mm256_permute2x128_si256(u3,u7,0x20);
+	a[4] = _mm256_permute2x128_si256(u0,u4,0x31);
+	a[5] = _mm256_permute2x128_si256(u1,u5,0x31);
+	a[6] = _mm256_permute2x128_si256(u2,u6,0x31);
+	a[7] = _mm256_permute2x128_si256(u3,u7,0x31);
+}
+
+// Encrypt/decrypt 8 blocks per pass; j[] is the state in standard order and its counter is advanced
+__attribute__((target("avx2")))
+static void _salsa2012Avx2(uint32_t *const j,const uint8_t *m,uint8_t *c,unsigned int blocks)
+{
+#define _S20V_ADD(a,b) _mm256_add_epi32((a),(b))
+#define _S20V_XOR(a,b) _mm256_xor_si256((a),(b))
+#define _S20V_ROTL(v,n) _mm256_or_si256(_mm256_slli_epi32((v),(n)),_mm256_srli_epi32((v),32 - (n)))
+	const __m256i sign = _mm256_set1_epi32((int)0x80000000);
+	while (blocks >= 8) {
+		__m256i in[16],x[16];
+		for(unsigned int k=0;k<16;++k)
+			in[k] = _mm256_set1_epi32((int)j[k]);
+
+		// Per-lane 64-bit block counters: low word plus lane index, carrying into high word
+		in[8] = _mm256_add_epi32(in[8],_mm256_set_epi32(7,6,5,4,3,2,1,0));
+		in[9] = _mm256_sub_epi32(in[9],_mm256_cmpgt_epi32(_mm256_xor_si256(_mm256_set1_epi32((int)j[8]),sign),_mm256_xor_si256(in[8],sign)));
+
+		for(unsigned int k=0;k<16;++k)
+			x[k] = in[k];
+		for(unsigned int r=0;r<6;++r) {
+			_S20V_DOUBLEROUND(_S20V_ADD,_S20V_XOR,_S20V_ROTL)
+		}
+		for(unsigned int k=0;k<16;++k)
+			x[k] = _mm256_add_epi32(x[k],in[k]);
+
+		// Transpose words 0-7 and 8-15 of each lane into contiguous blocks
+		_s20Transpose8x8(x);
+		_s20Transpose8x8(x + 8);
+		for(unsigned int b=0;b<8;++b) {
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(c),_mm256_xor_si256(x[b],_mm256_loadu_si256(reinterpret_cast<const __m256i *>(m))));
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(c + 32),_mm256_xor_si256(x[b + 8],_mm256_loadu_si256(reinterpret_cast<const __m256i *>(m + 32))));
+			m += 64;
+			c += 64;
+		}
+
+		if ((j[8] += 8) < 8)
+			++j[9];
+		blocks -= 8;
+	}
+#undef _S20V_ADD
+#undef _S20V_XOR
+#undef _S20V_ROTL
+}
+
+// Encrypt/decrypt up to 8 independent streams, one per lane, until fewer than
+// ZT_SALSA20_BATCH_MIN_LANES have data left; j[k] is stream k's state in
+// standard order and m, c, bytes, and the counters are advanced
+__attribute__((target("avx2")))
+static void _salsa2012Avx2Lanes(uint32_t (*const j)[16],const uint8_t **const m,uint8_t **const c,unsigned int *const bytes,const unsigned int n)
+{
+#define _S20V_ADD(a,b) _mm256_add_epi32((a),(b))
+#define _S20V_XOR(a,b) _mm256_xor_si256((a),(b))
+#define _S20V_ROTL(v,n) _mm256_or_si256(_mm256_slli_epi32((v),(n)),_mm256_srli_epi32((v),32 - (n)))
+	for(;;) {
+		unsigned int active = 0;
+		for(unsigned int k=0;k<n;++k) {
+			if (bytes[k])
+				++active;
+		}
+		if (active < ZT_SALSA20_BATCH_MIN_LANES)
+			break;
+
+		// Load one stream per row, then transpose so each vector holds one word of every stream
+		__m256i in[16],x[16];
+		for(unsigned int k=0;k<8;++k) {
+			const uint32_t *const jk = j[(k < n) ? k : 0];
+			in[k] = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(jk));
+			in[k + 8] = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(jk + 8));
+		}
+		_s20Transpose8x8(in);
+		_s20Transpose8x8(in + 8);
+
+		for(unsigned int k=0;k<16;++k)
+			x[k] = in[k];
+		for(unsigned int r=0;r<6;++r) {
+			_S20V_DOUBLEROUND(_S20V_ADD,_S20V_XOR,_S20V_ROTL)
+		}
+		for(unsigned int k=0;k<16;++k)
+			x[k] = _mm256_add_epi32(x[k],in[k]);
+		_s20Transpose8x8(x);
+		_s20Transpose8x8(x + 8);
+
+		for(unsigned int k=0;k<n;++k) {
+			if (!bytes[k])
+				continue;
+			if (bytes[k] >= 64) {
+				_mm256_storeu_si256(reinterpret_cast<__m256i *>(c[k]),_mm256_xor_si256(x[k],_mm256_loadu_si256(reinterpret_cast<const __m256i *>(m[k]))));
+				_mm256_storeu_si256(reinterpret_cast<__m256i *>(c[k] + 32),_mm256_xor_si256(x[k + 8],_mm256_loadu_si256(reinterpret_cast<const __m256i *>(m[k] + 32))));
+				m[k] += 64;
+				c[k] += 64;
+				bytes[k] -= 64;
+			} else {
+				uint8_t ks[64];
+				_mm256_storeu_si256(reinterpret_cast<__m256i *>(ks),x[k]);
+				_mm256_storeu_si256(reinterpret_cast<__m256i *>(ks + 32),x[k + 8]);
+				for(unsigned int i=0;i<bytes[k];++i)
+					c[k][i] = m[k][i] ^ ks[i];
+				bytes[k] = 0;
+			}
+			if (!(++j[k][8]))
+				++j[k][9];
+		}
+	}
+#undef _S20V_ADD
+#undef _S20V_XOR
+#undef _S20V_ROTL
+}
+
+// Some GCC versions warn spuriously about _mm512_undefined_epi32() inside AVX-512 intrinsics
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+// Encrypt/decrypt 16 blocks per pass; j[] is the state in standard order and its counter is advanced
+__attribute__((target("avx512f")))
+static void _salsa2012Avx512(uint32_t *const j,const uint8_t *m,uint8_t *c,unsigned int blocks)
+{
+#define _S20V_ADD(a,b) _mm512_add_epi32((a),(b))
+#define _S20V_XOR(a,b) _mm512_xor_si512((a),(b))
+#define _S20V_ROTL(v,n) _mm512_rol_epi32((v),(n))
+	while (blocks >= 16) {
+		__m512i in[16],x[16];
+		for(unsigned int k=0;k<16;++k)
+			in[k] = _mm512_set1_epi32((int)j[k]);
+
+		in[8] = _mm512_add_epi32(in[8],_mm512_set_epi32(15,14,13,12,11,10,9,8,7,6,5,4,3,2,1,0));
+		in[9] = _mm512_mask_add_epi32(in[9],_mm512_cmplt_epu32_mask(in[8],_mm512_set1_epi32((int)j[8])),in[9],_mm512_set1_epi32(1));
+
+		for(unsigned int k=0;k<16;++k)
+			x[k] = in[k];
+		for(unsigned int r=0;r<6;++r) {
+			_S20V_DOUBLEROUND(_S20V_ADD,_S20V_XOR,_S20V_ROTL)
+		}
+		for(unsigned int k=0;k<16;++k)
+			x[k] = _mm512_add_epi32(x[k],in[k]);
+
+		// 4x4 transposes within each 128-bit lane: y[g*4+i] lane L holds words g*4..g*4+3 of block L*4+i
+		__m512i y[16];
+		for(unsigned int g=0;g<16;g+=4) {
+			const __m512i t0 = _mm512_unpacklo_epi32(x[g],x[g + 1]);
+			const __m512i t1 = _mm512_unpackhi_epi32(x[g],x[g + 1]);
+			const __m512i t2 = _mm512_unpacklo_epi32(x[g + 2],x[g + 3]);
+			const __m512i t3 = _mm512_unpackhi_epi32(x[g + 2],x[g + 3]);
+			y[g] = _mm512_unpacklo_epi64(t0,t2);
+			y[g + 1] = _mm512_unpackhi_epi64(t0,t2);
+			y[g + 2] = _mm512_unpacklo_epi64(t1,t3);
+			y[g + 3] = _mm512_unpackhi_epi64(t1,t3);
+		}
+
+		// Then a 4x4 transpose of 128-bit lanes yields whole blocks
+		for(unsigned int i=0;i<4;++i) {
+			const __m512i p0 = _mm512_shuffle_i32x4(y[i],y[i + 4],0x44);
+			const __m512i p1 = _mm512_shuffle_i32x4(y[i],y[i + 4],0xee);
+			const __m512i p2 = _mm512_shuffle_i32x4(y[i + 8],y[i + 12],0x44);
+			const __m512i p3 = _mm512_shuffle_i32x4(y[i + 8],y[i + 12],0xee);
+			const unsigned int o = i * 64;
+			_mm512_storeu_si512(reinterpret_cast<void *>(c + o),_mm512_xor_si512(_mm512_shuffle_i32x4(p0,p2,0x88),_mm512_loadu_si512(reinterpret_cast<const void *>(m + o))));
+			_mm512_storeu_si512(reinterpret_cast<void *>(c + o + 256),_mm512_xor_si512(_mm512_shuffle_i32x4(p0,p2,0xdd),_mm512_loadu_si512(reinterpret_cast<const void *>(m + o + 256))));
+			_mm512_storeu_si512(reinterpret_cast<void *>(c + o + 512),_mm512_xor_si512(_mm512_shuffle_i32x4(p1,p3,0x88),_mm512_loadu_si512(reinterpret_cast<const void *>(m + o + 512))));
+			_mm512_storeu_si512(reinterpret_cast<void *>(c + o + 768),_mm512_xor_si512(_mm512_shuffle_i32x4(p1,p3,0xdd),_mm512_loadu_si512(reinterpret_cast<const void *>(m + o + 768))));
+		}
+		m += 1024;
+		c += 1024;
+
+		if ((j[8] += 16) < 16)
+			++j[9];
+		blocks -= 16;
+	}
+#undef _S20V_ADD
+#undef _S20V_XOR
+#undef _S20V_ROTL
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#ifndef ZT_SALSA20_VECTOR_TAIL_BYTES
+#define ZT_SALSA20_VECTOR_TAIL_BYTES 128
+#endif
+
+static unsigned int _s20DetectVectorBlocks()
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		return 16;
+	if (__builtin_cpu_supports("avx2"))
+		return 8;
+	return 0;
+}
+static const unsigned int _S20CPUVECTORBLOCKS = _s20DetectVectorBlocks();
+static unsigned int _s20VectorBlocks = _S20CPUVECTORBLOCKS;
+#endif // ZT_SALSA20_AVX2
+
 namespace ZeroTier {
 
 void Salsa20::init(const void *key,const void *iv)
@@ -124,6 +390,43 @@ void Salsa20::crypt12(const void *in,void *out,unsigned int bytes)
 	if (!bytes)
 		return;
 
+#ifdef ZT_SALSA20_AVX2
+	if ((bytes >= ZT_SALSA20_VECTOR_MIN_BYTES)&&(_s20VectorBlocks)) {
+		uint32_t j[16];
+		for(i=0;i<16;++i)
+			j[_S20SSEORDER[i]] = _state.i[i];
+		unsigned int blocks = bytes / 64;
+		if (_s20VectorBlocks >= 16) {
+			const unsigned int n = blocks & ~15U;
+			_salsa2012Avx512(j,m,c,n);
+			m += n * 64;
+			c += n * 64;
+			blocks -= n;
+		}
+		const unsigned int n = blocks & ~7U;
+		_salsa2012Avx2(j,m,c,n);
+		m += n * 64;
+		c += n * 64;
+		bytes &= 511;
+		if (bytes >= ZT_SALSA20_VECTOR_TAIL_BYTES) {
+			// Finish a long tail with one more padded pass, advancing the counter only by the blocks used
+			uint8_t vtmp[512];
+			const uint64_t ctr = (((uint64_t)j[9]) << 32) | (uint64_t)j[8];
+			memcpy(vtmp,m,bytes);
+			_salsa2012Avx2(j,vtmp,vtmp,8);
+			memcpy(c,vtmp,bytes);
+			const uint64_t nctr = ctr + ((bytes + 63) / 64);
+			j[8] = (uint32_t)nctr;
+			j[9] = (uint32_t)(nctr >> 32);
+			bytes = 0;
+		}
+		_state.i[8] = j[8];
+		_state.i[5] = j[9]; // state reordered for SSE
+		if (!bytes)
+			return;
+	}
+#endif
+
 #ifndef ZT_SALSA20_SSE
 	j0 = _state.i[0];
 	j1 = _state.i[1];
@@ -1338,4 +1641,63 @@ void Salsa20::crypt20(const void *in,void *out,unsigned int bytes)
 	}
 }
 
+void Salsa20::crypt12Batch(Salsa20 *const *s,const void *const *in,void *const *out,const unsigned int *bytes,const unsigned int count)
+{
+#ifdef ZT_SALSA20_AVX2
+	if ((_s20VectorBlocks)&&(count >= ZT_SALSA20_BATCH_MIN_LANES)) {
+		// Long streams already fill the lanes of the multi-block kernels, so only short ones are interleaved
+		uint32_t j[8][16];
+		const uint8_t *m[8];
+		uint8_t *c[8];
+		unsigned int b[8],idx[8];
+		unsigned int n = 0;
+		for(unsigned int i=0;i<=count;++i) {
+			if (i < count) {
+				if (bytes[i] >= ZT_SALSA20_VECTOR_MIN_BYTES) {
+					s[i]->crypt12(in[i],out[i],bytes[i]);
+					continue;
+				}
+				for(unsigned int w=0;w<16;++w)
+					j[n][_S20SSEORDER[w]] = s[i]->_state.i[w];
+				m[n] = reinterpret_cast<const uint8_t *>(in[i]);
+				c[n] = reinterpret_cast<uint8_t *>(out[i]);
+				b[n] = bytes[i];
+				idx[n++] = i;
+			}
+			if ((n == 8)||((i == count)&&(n))) {
+				if (n >= ZT_SALSA20_BATCH_MIN_LANES)
+					_salsa2012Avx2Lanes(j,m,c,b,n);
+				for(unsigned int k=0;k<n;++k) {
+					Salsa20 *const sk = s[idx[k]];
+					sk->_state.i[8] = j[k][8];
+					sk->_state.i[5] = j[k][9]; // state reordered for SSE
+					if (b[k])
+						sk->crypt12(m[k],c[k],b[k]);
+				}
+				n = 0;
+			}
+		}
+		return;
+	}
+#endif
+	for(unsigned int i=0;i<count;++i)
+		s[i]->crypt12(in[i],out[i],bytes[i]);
+}
+
+unsigned int Salsa20::vectorBlocks()
+{
+#ifdef ZT_SALSA20_AVX2
+	return _s20VectorBlocks;
+#else
+	return 0;
+#endif
+}
+
+void Salsa20::limitVectorBlocks(unsigned int maxBlocks)
+{
+#ifdef ZT_SALSA20_AVX2
+	_s20VectorBlocks = (maxBlocks >= 16) ? _S20CPUVECTORBLOCKS : ((maxBlocks >= 8) ? ((_S20CPUVECTORBLOCKS > 8) ? 8 : _S20CPUVECTORBLOCKS) : 0);
+#endif
+}
+
 } // namespace ZeroTier
@@ -23,6 +23,21 @@
 #include <emmintrin.h>
 #endif // ZT_SALSA20_SSE
 
+// Multi-block AVX2/AVX-512 Salsa20/12 kernels, selected at runtime via CPUID
+#if defined(ZT_SALSA20_SSE) && (defined(__x86_64__) || defined(__amd64__)) && defined(__GNUC__) && (!defined(ZT_NO_SALSA20_AVX2))
+#define ZT_SALSA20_AVX2 1
+#endif
+
+/**
+ * Minimum crypt12() length that can use a multi-block vector kernel
+ */
+#define ZT_SALSA20_VECTOR_MIN_BYTES 512
+
+/**
+ * Minimum number of streams with data left for crypt12Batch() to keep them in vector lanes
+ */
+#define ZT_SALSA20_BATCH_MIN_LANES 4
+
 namespace ZeroTier {
 
 /**
@@ -145,6 +160,36 @@ public:
 	 */
 	void crypt20(const void *in,void *out,unsigned int bytes);
 
+	/**
+	 * Encrypt/decrypt several independent streams using Salsa20/12
+	 *
+	 * With AVX2 up to eight streams are run at once, one per vector lane,
+	 * until fewer than ZT_SALSA20_BATCH_MIN_LANES have data left. What is
+	 * left is finished by crypt12(). Results are the same as calling
+	 * crypt12() on each stream.
+	 *
+	 * @param s Cipher instances (must be distinct)
+	 * @param in Input data for each stream
+	 * @param out Output buffer for each stream
+	 * @param bytes Length of each stream's data
+	 * @param count Number of streams
+	 */
+	static void crypt12Batch(Salsa20 *const *s,const void *const *in,void *const *out,const unsigned int *bytes,const unsigned int count);
+
+	/**
+	 * @return Blocks per pass of the vector kernel used by crypt12() (16 for AVX-512, 8 for AVX2) or 0 if none
+	 */
+	static unsigned int vectorBlocks();
+
+	/**
+	 * Limit the vector kernel used by crypt12(), mostly for testing and benchmarking
+	 *
+	 * This cannot enable a kernel the CPU does not support.
+	 *
+	 * @param maxBlocks 16 to allow AVX-512, 8 for at most AVX2, 0 to disable vector kernels
+	 */
+	static void limitVectorBlocks(unsigned int maxBlocks);
+
 private:
 	union {
 #ifdef ZT_SALSA20_SSE
@@ -0,0 +1,191 @@
+/*
+ * ZeroTier One - Network Virtualization Everywhere
+ * Copyright (C) 2011-2018  ZeroTier, Inc.  https://www.zerotier.com/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * --
+ *
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial closed-source software that incorporates or links
+ * directly against ZeroTier software without disclosing the source code
+ * of your own application.
+ */
+
+#ifndef ZT_SIGNATURECACHE_HPP
+#define ZT_SIGNATURECACHE_HPP
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+
+#include "Constants.hpp"
+#include "C25519.hpp"
+#include "SHA512.hpp"
+#include "Hashtable.hpp"
+#include "Mutex.hpp"
+
+/**
+ * Maximum number of verified signatures remembered
+ */
+#define ZT_SIGNATURE_CACHE_MAX_ENTRIES 16384
+
+/**
+ * Time after a credential's timestamp that its verified signature is remembered
+ *
+ * This matches the largest credential time max delta a network config may set.
+ */
+#define ZT_SIGNATURE_CACHE_TTL 7200000
+
+namespace ZeroTier {
+
+/**
+ * Node-wide cache of credential signatures that have already passed verification
+ *
+ * Peers re-send the same credentials on every credential push. Entries are
+ * keyed by a hash of signer, signed data, and signature, so a hit means the
+ * exact same inputs were verified before and C25519::verify() can be skipped.
+ */
+class SignatureCache
+{
+public:
+	struct Key { uint8_t data[32]; };
+
+	SignatureCache() :
+		_entries(1024),
+		_hits(0),
+		_misses(0) {}
+
+	/**
+	 * Compute the key for a signature
+	 *
+	 * @param k Key to fill
+	 * @param signer Signer's public key
+	 * @param data Signed data
+	 * @param len Length of signed data
+	 * @param signature 96-byte signature
+	 */
+	static inline void key(Key &k,const C25519::Public &signer,const void *data,const unsigned int len,const void *signature)
+	{
+		uint8_t tmp[ZT_C25519_PUBLIC_KEY_LEN + ZT_C25519_SIGNATURE_LEN + ZT_SHA512_DIGEST_LEN];
+		memcpy(tmp,signer.data,ZT_C25519_PUBLIC_KEY_LEN);
+		memcpy(tmp + ZT_C25519_PUBLIC_KEY_LEN,signature,ZT_C25519_SIGNATURE_LEN);
+		SHA512::hash(tmp + ZT_C25519_PUBLIC_KEY_LEN + ZT_C25519_SIGNATURE_LEN,data,len);
+		SHA512::hash(tmp,tmp,sizeof(tmp));
+		memcpy(k.data,tmp,32);
+	}
+
+	/**
+	 * @param k Signature key
+	 * @param now Current time
+	 * @return True if signature was verified before and has not expired
+	 */
+	inline bool check(const Key &k,const int64_t now)
+	{
+		{
+			Mutex::Lock _l(_lock);
+			const _Entry *const e = _entries.get(_hk(k));
+			if ((e)&&(e->expires > now)&&(!memcmp(e->k.data,k.data,sizeof(k.data)))) {
+				++_hits;
+				return true;
+			}
+		}
+		++_misses;
+		return false;
+	}
+
+	/**
+	 * Remember a verified signature
+	 *
+	 * @param k Signature key
+	 * @param timestamp Timestamp of credential (nothing is cached if <= 0)
+	 * @param now Current time
+	 */
+	inline void add(const Key &k,const int64_t timestamp,const int64_t now)
+	{
+		if (timestamp <= 0)
+			return;
+		// Expire with the credential, but no later than TTL from now in case of clock skew
+		const int64_t expires = std::min(timestamp,now) + ZT_SIGNATURE_CACHE_TTL;
+		if (expires <= now)
+			return;
+		Mutex::Lock _l(_lock);
+		if (_entries.size() >= ZT_SIGNATURE_CACHE_MAX_ENTRIES) {
+			_clean(now);
+			if (_entries.size() >= ZT_SIGNATURE_CACHE_MAX_ENTRIES)
+				_entries.clear();
+		}
+		_Entry &e = _entries[_hk(k)];
+		e.k = k;
+		e.expires = expires;
+	}
+
+	/**
+	 * Remove expired entries
+	 *
+	 * @param now Current time
+	 */
+	inline void clean(const int64_t now)
+	{
+		Mutex::Lock _l(_lock);
+		_clean(now);
+	}
+
+	/**
+	 * @return Number of lookups that found a verified signature
+	 */
+	inline uint64_t hits() const { return _hits.load(); }
+
+	/**
+	 * @return Number of lookups that did not
+	 */
+	inline uint64_t misses() const { return _misses.load(); }
+
+private:
+	struct _Entry
+	{
+		Key k;
+		int64_t expires;
+	};
+
+	static inline uint64_t _hk(const Key &k)
+	{
+		uint64_t h;
+		memcpy(&h,k.data,8);
+		return h;
+	}
+
+	inline void _clean(const int64_t now)
+	{
+		Hashtable< uint64_t,_Entry >::Iterator i(_entries);
+		uint64_t *hk = (uint64_t *)0;
+		_Entry *e = (_Entry *)0;
+		while (i.next(hk,e)) {
+			if (e->expires <= now)
+				_entries.erase(*hk);
+		}
+	}
+
+	Hashtable< uint64_t,_Entry > _entries;
+	Mutex _lock;
+	std::atomic<uint64_t> _hits;
+	std::atomic<uint64_t> _misses;
+};
+
+} // namespace ZeroTier
+
+#endif
@@ -51,10 +51,23 @@ Switch::Switch(const RuntimeEnvironment *renv) :
 	RR(renv),
 	_lastBeaconResponse(0),
 	_lastCheckedQueues(0),
+	_rxQueue(new RXQueue(ZT_RX_QUEUE_SIZE)),
+	_rxQueueFragmentDrops(0),
+	_rxQueueWaitingDrops(0),
+	_rxQueueEpoch(0),
 	_lastUniteAttempt(8) // only really used on root servers and upstreams, and it'll grow there just fine
 {
 }
 
+Switch::~Switch()
+{
+	delete _rxQueue.load();
+	for(unsigned int e=0;e<2;++e) {
+		for(std::vector< RXQueue * >::iterator q(_rxQueueRetired[e].begin());q!=_rxQueueRetired[e].end();++q)
+			delete *q;
+	}
+}
+
 void Switch::onRemotePacket(void *tPtr,const int64_t localSocket,const InetAddress &fromAddr,const void *data,unsigned int len)
 {
 	try {
@@ -120,17 +133,19 @@ void Switch::onRemotePacket(void *tPtr,const int64_t localSocket,const InetAddre
 						// Total fragments must be more than 1, otherwise why are we
 						// seeing a Packet::Fragment?
 
-						RXQueueEntry *const rq = _findRXQueueEntry(fragmentPacketId);
+						_RXQueueUse qu(*this);
+						RXQueue *const q = qu.q;
+						const unsigned long qi = _findRXQueueEntry(q,now,fragmentPacketId);
+						RXQueueKey &rk = q->keys[qi];
+						RXQueueEntry *const rq = &(q->entries[qi]);
 						Mutex::Lock rql(rq->lock);
-						if (rq->packetId != fragmentPacketId) {
+						if (rk.packetId != fragmentPacketId) {
 							// No packet found, so we received a fragment without its head.
 
-							rq->timestamp = now;
-							rq->packetId = fragmentPacketId;
+							_claimRXQueueEntry(rk,now,fragmentPacketId);
 							rq->frags[fragmentNumber - 1] = fragment;
 							rq->totalFragments = totalFragments; // total fragment count is known
 							rq->haveFragments = 1 << fragmentNumber; // we have only this fragment
-							rq->complete = false;
 						} else if (!(rq->haveFragments & (1 << fragmentNumber))) {
 							// We have other fragments and maybe the head, so add this one and check
 
@@ -144,9 +159,9 @@ void Switch::onRemotePacket(void *tPtr,const int64_t localSocket,const InetAddre
 									rq->frag0.append(rq->frags[f - 1].payload(),rq->frags[f - 1].payloadLength());
 
 								if (rq->frag0.tryDecode(RR,tPtr)) {
-									rq->timestamp = 0; // packet decoded, free entry
+									rk.timestamp = 0; // packet decoded, free entry
 								} else {
-									rq->complete = true; // set complete flag but leave entry since it probably needs WHOIS or something
+									rk.complete = true; // set complete flag but leave entry since it probably needs WHOIS or something
 								}
 							}
 						} // else this is a duplicate fragment, ignore
@@ -203,17 +218,19 @@ void Switch::onRemotePacket(void *tPtr,const int64_t localSocket,const InetAddre
 						((uint64_t)reinterpret_cast<const uint8_t *>(data)[7])
 					);
 
-					RXQueueEntry *const rq = _findRXQueueEntry(packetId);
+					_RXQueueUse qu(*this);
+					RXQueue *const q = qu.q;
+					const unsigned long qi = _findRXQueueEntry(q,now,packetId);
+					RXQueueKey &rk = q->keys[qi];
+					RXQueueEntry *const rq = &(q->entries[qi]);
 					Mutex::Lock rql(rq->lock);
-					if (rq->packetId != packetId) {
+					if (rk.packetId != packetId) {
 						// If we have no other fragments yet, create an entry and save the head
 
-						rq->timestamp = now;
-						rq->packetId = packetId;
+						_claimRXQueueEntry(rk,now,packetId);
 						rq->frag0.init(data,len,path,now);
 						rq->totalFragments = 0;
 						rq->haveFragments = 1;
-						rq->complete = false;
 					} else if (!(rq->haveFragments & 1)) {
 						// If we have other fragments but no head, see if we are complete with the head
 
@@ -225,9 +242,9 @@ void Switch::onRemotePacket(void *tPtr,const int64_t localSocket,const InetAddre
 								rq->frag0.append(rq->frags[f - 1].payload(),rq->frags[f - 1].payloadLength());
 
 							if (rq->frag0.tryDecode(RR,tPtr)) {
-								rq->timestamp = 0; // packet decoded, free entry
+								rk.timestamp = 0; // packet decoded, free entry
 							} else {
-								rq->complete = true; // set complete flag but leave entry since it probably needs WHOIS or something
+								rk.complete = true; // set complete flag but leave entry since it probably needs WHOIS or something
 							}
 						} else {
 							// Still waiting on more fragments, but keep the head
@@ -238,14 +255,18 @@ void Switch::onRemotePacket(void *tPtr,const int64_t localSocket,const InetAddre
 					// Packet is unfragmented, so just process it
 					IncomingPacket packet(data,len,path,now);
 					if (!packet.tryDecode(RR,tPtr)) {
-						RXQueueEntry *const rq = _nextRXQueueEntry();
+						_RXQueueUse qu(*this);
+						RXQueue *const q = qu.q;
+						const uint64_t packetId = packet.packetId();
+						const unsigned long qi = _findRXQueueEntry(q,now,packetId);
+						RXQueueKey &rk = q->keys[qi];
+						RXQueueEntry *const rq = &(q->entries[qi]);
 						Mutex::Lock rql(rq->lock);
-						rq->timestamp = now;
-						rq->packetId = packet.packetId();
+						_claimRXQueueEntry(rk,now,packetId);
 						rq->frag0 = packet;
 						rq->totalFragments = 1;
 						rq->haveFragments = 1;
-						rq->complete = true;
+						rk.complete = true;
 					}
 				}
 
@@ -415,6 +436,7 @@ void Switch::onLocalEthernet(void *tPtr,const SharedPtr<Network> &network,const
 			return;
 		}
 
+		const uint64_t fid = (RR->node->multipathMode() != ZT_MULTIPATH_NONE) ? flowId(from,to,etherType,data,len) : 0;
 		if (fromBridged) {
 			Packet outp(toZT,RR->identity.address(),Packet::VERB_EXT_FRAME);
 			outp.append(network->id());
@@ -425,7 +447,7 @@ void Switch::onLocalEthernet(void *tPtr,const SharedPtr<Network> &network,const
 			outp.append(data,len);
 			if (!network->config().disableCompression())
 				outp.compress();
-			send(tPtr,outp,true);
+			send(tPtr,outp,true,fid);
 		} else {
 			Packet outp(toZT,RR->identity.address(),Packet::VERB_FRAME);
 			outp.append(network->id());
@@ -433,7 +455,7 @@ void Switch::onLocalEthernet(void *tPtr,const SharedPtr<Network> &network,const
 			outp.append(data,len);
 			if (!network->config().disableCompression())
 				outp.compress();
-			send(tPtr,outp,true);
+			send(tPtr,outp,true,fid);
 		}
 
 	} else {
@@ -479,6 +501,7 @@ void Switch::onLocalEthernet(void *tPtr,const SharedPtr<Network> &network,const
 			}
 		}
 
+		const uint64_t fid = (RR->node->multipathMode() != ZT_MULTIPATH_NONE) ? flowId(from,to,etherType,data,len) : 0;
 		for(unsigned int b=0;b<numBridges;++b) {
 			if (network->filterOutgoingPacket(tPtr,true,RR->identity.address(),bridges[b],from,to,(const uint8_t *)data,len,etherType,vlanId)) {
 				Packet outp(bridges[b],RR->identity.address(),Packet::VERB_EXT_FRAME);
@@ -490,7 +513,7 @@ void Switch::onLocalEthernet(void *tPtr,const SharedPtr<Network> &network,const
 				outp.append(data,len);
 				if (!network->config().disableCompression())
 					outp.compress();
-				send(tPtr,outp,true);
+				send(tPtr,outp,true,fid);
 			} else {
 				RR->t->outgoingNetworkFrameDropped(tPtr,network,from,to,etherType,vlanId,len,"filter blocked (bridge replication)");
 			}
@@ -498,24 +521,67 @@ void Switch::onLocalEthernet(void *tPtr,const SharedPtr<Network> &network,const
 	}
 }
 
-void Switch::send(void *tPtr,Packet &packet,bool encrypt)
+void Switch::send(void *tPtr,Packet &packet,bool encrypt,const uint64_t flowId)
 {
 	const Address dest(packet.destination());
 	if (dest == RR->identity.address())
 		return;
-	if (!_trySend(tPtr,packet,encrypt)) {
-		{
-			Mutex::Lock _l(_txQueue_m);
-			if (_txQueue.size() >= ZT_TX_QUEUE_SIZE) {
-				_txQueue.pop_front();
+	if (!_trySend(tPtr,packet,encrypt,flowId))
+		_queueSend(tPtr,packet,encrypt);
+}
+
+void Switch::send(void *tPtr,Packet *const *packets,const unsigned int count,bool encrypt)
+{
+	Packet *batch[ZT_PROTO_ARMOR_BATCH_SIZE];
+	bool sent[ZT_PROTO_ARMOR_BATCH_SIZE];
+	unsigned int n = 0;
+	for(unsigned int i=0;i<=count;++i) {
+		if ((i < count)&&(packets[i]->destination() != RR->identity.address()))
+			batch[n++] = packets[i];
+		if ((n == ZT_PROTO_ARMOR_BATCH_SIZE)||((i == count)&&(n))) {
+			_trySend(tPtr,batch,sent,n,encrypt);
+			for(unsigned int k=0;k<n;++k) {
+				if (!sent[k])
+					_queueSend(tPtr,*batch[k],encrypt);
 			}
-			_txQueue.push_back(TXQueueEntry(dest,RR->node->now(),packet,encrypt));
+			n = 0;
 		}
-		if (!RR->topology->getPeer(tPtr,dest))
-			requestWhois(tPtr,RR->node->now(),dest);
 	}
 }
 
+uint64_t Switch::flowId(const MAC &from,const MAC &to,const unsigned int etherType,const void *data,const unsigned int len)
+{
+	const uint8_t *const d = reinterpret_cast<const uint8_t *>(data);
+	uint64_t h = 0xcbf29ce484222325ULL; // FNV-1a
+	unsigned int proto = 0xffff;
+	unsigned int ports = 0;
+	if ((etherType == ZT_ETHERTYPE_IPV4)&&(len >= 20)&&((d[0] >> 4) == 4)) {
+		for(unsigned int i=12;i<20;++i)
+			h = (h ^ (uint64_t)d[i]) * 0x100000001b3ULL;
+		proto = d[9];
+		if (((d[6] & 0x3f) == 0)&&(d[7] == 0))
+			ports = (d[0] & 0xf) * 4; // not a fragment, so ports follow the header
+	} else if ((etherType == ZT_ETHERTYPE_IPV6)&&(len >= 40)) {
+		for(unsigned int i=8;i<40;++i)
+			h = (h ^ (uint64_t)d[i]) * 0x100000001b3ULL;
+		proto = d[6];
+		ports = 40;
+	} else {
+		h = (h ^ from.toInt()) * 0x100000001b3ULL;
+		h = (h ^ to.toInt()) * 0x100000001b3ULL;
+		h = (h ^ (uint64_t)etherType) * 0x100000001b3ULL;
+	}
+	if (proto != 0xffff) {
+		h = (h ^ (uint64_t)proto) * 0x100000001b3ULL;
+		if (((proto == 6)||(proto == 17)||(proto == 132))&&(ports)&&((ports + 4) <= len)) {
+			for(unsigned int i=ports;i<(ports+4);++i)
+				h = (h ^ (uint64_t)d[i]) * 0x100000001b3ULL;
+		}
+	}
+	h ^= h >> 29; // fold high bits down since paths are picked by modulus
+	return (h) ? h : 1;
+}
+
 void Switch::requestWhois(void *tPtr,const int64_t now,const Address &addr)
 {
 	if (addr == RR->identity.address())
@@ -545,28 +611,80 @@ void Switch::doAnythingWaitingForPeer(void *tPtr,const SharedPtr<Peer> &peer)
 		_lastSentWhoisRequest.erase(peer->address());
 	}
 
+	// Packets from this peer that use its key are taken out of the queue and
+	// authenticated as a batch. Holding several entry locks at once could
+	// deadlock, so they are copied. A packet that still can't be processed is
+	// put back already authenticated, so a retry doesn't dearmor it again.
 	const int64_t now = RR->node->now();
-	for(unsigned int ptr=0;ptr<ZT_RX_QUEUE_SIZE;++ptr) {
-		RXQueueEntry *const rq = &(_rxQueue[ptr]);
-		Mutex::Lock rql(rq->lock);
-		if ((rq->timestamp)&&(rq->complete)) {
-			if ((rq->frag0.tryDecode(RR,tPtr))||((now - rq->timestamp) > ZT_RECEIVE_QUEUE_TIMEOUT))
-				rq->timestamp = 0;
+	_RXQueueUse qu(*this);
+	RXQueue *const q = qu.q;
+	std::vector<IncomingPacket *> fromPeer;
+	for(unsigned long ptr=0;ptr<=q->mask;++ptr) {
+		RXQueueKey &rk = q->keys[ptr];
+		if ((rk.timestamp)&&(rk.complete)) {
+			RXQueueEntry *const rq = &(q->entries[ptr]);
+			Mutex::Lock rql(rq->lock);
+			if ((rk.timestamp)&&(rk.complete)) {
+				if ((rq->frag0.source() == peer->address())&&(rq->frag0.usesPeerKey())) {
+					fromPeer.push_back(new IncomingPacket(rq->frag0.data(),rq->frag0.size(),rq->frag0.path(),(int64_t)rq->frag0.receiveTime()));
+					rk.timestamp = 0;
+				} else if ((rq->frag0.tryDecode(RR,tPtr))||((now - rk.timestamp) > ZT_RECEIVE_QUEUE_TIMEOUT)) {
+					rk.timestamp = 0;
+				}
+			}
+		}
+	}
+	if (!fromPeer.empty()) {
+		IncomingPacket::dearmorBatch(&(fromPeer[0]),(unsigned int)fromPeer.size(),peer);
+		for(std::vector<IncomingPacket *>::iterator p(fromPeer.begin());p!=fromPeer.end();++p) {
+			if (!(*p)->tryDecode(RR,tPtr)) {
+				const uint64_t packetId = (*p)->packetId();
+				const unsigned long qi = _findRXQueueEntry(q,now,packetId);
+				RXQueueKey &rk = q->keys[qi];
+				RXQueueEntry *const rq = &(q->entries[qi]);
+				Mutex::Lock rql(rq->lock);
+				_claimRXQueueEntry(rk,now,packetId);
+				rq->frag0 = **p;
+				rq->totalFragments = 1;
+				rq->haveFragments = 1;
+				if ((*p)->receiveTime() > 0)
+					rk.timestamp = (int64_t)(*p)->receiveTime(); // keep timing out from when it first arrived
+				rk.complete = true;
+			}
+			delete *p;
 		}
 	}
 
 	{
 		Mutex::Lock _l(_txQueue_m);
-		for(std::list< TXQueueEntry >::iterator txi(_txQueue.begin());txi!=_txQueue.end();) {
-			if (txi->dest == peer->address()) {
-				if (_trySend(tPtr,txi->packet,txi->encrypt)) {
-					_txQueue.erase(txi++);
-				} else {
-					++txi;
+		std::list< TXQueueEntry >::iterator waiting[ZT_PROTO_ARMOR_BATCH_SIZE];
+		Packet *batch[ZT_PROTO_ARMOR_BATCH_SIZE];
+		bool sent[ZT_PROTO_ARMOR_BATCH_SIZE];
+		unsigned int n = 0;
+		for(std::list< TXQueueEntry >::iterator txi(_txQueue.begin());;) {
+			const bool end = (txi == _txQueue.end());
+			if (!end) {
+				if (txi->dest == peer->address()) {
+					if (txi->encrypt) {
+						waiting[n] = txi;
+						batch[n++] = &(txi->packet);
+					} else if (_trySend(tPtr,txi->packet,false)) {
+						_txQueue.erase(txi++);
+						continue;
+					}
 				}
-			} else {
 				++txi;
 			}
+			if ((n == ZT_PROTO_ARMOR_BATCH_SIZE)||((end)&&(n))) {
+				_trySend(tPtr,batch,sent,n,true);
+				for(unsigned int k=0;k<n;++k) {
+					if (sent[k])
+						_txQueue.erase(waiting[k]);
+				}
+				n = 0;
+			}
+			if (end)
+				break;
 		}
 	}
 }
@@ -596,19 +714,31 @@ unsigned long Switch::doTimerTasks(void *tPtr,int64_t now)
 	for(std::vector<Address>::const_iterator i(needWhois.begin());i!=needWhois.end();++i)
 		requestWhois(tPtr,now,*i);
 
-	for(unsigned int ptr=0;ptr<ZT_RX_QUEUE_SIZE;++ptr) {
-		RXQueueEntry *const rq = &(_rxQueue[ptr]);
-		Mutex::Lock rql(rq->lock);
-		if ((rq->timestamp)&&(rq->complete)) {
-			if ((rq->frag0.tryDecode(RR,tPtr))||((now - rq->timestamp) > ZT_RECEIVE_QUEUE_TIMEOUT)) {
-				rq->timestamp = 0;
-			} else {
-				const Address src(rq->frag0.source());
-				if (!RR->topology->getPeer(tPtr,src))
-					requestWhois(tPtr,now,src);
+	{
+		_RXQueueUse qu(*this);
+		RXQueue *const q = qu.q;
+		for(unsigned long ptr=0;ptr<=q->mask;++ptr) {
+			RXQueueKey &rk = q->keys[ptr];
+			if (!rk.timestamp)
+				continue;
+			RXQueueEntry *const rq = &(q->entries[ptr]);
+			Mutex::Lock rql(rq->lock);
+			if (rk.timestamp) {
+				if (rk.complete) {
+					if ((rq->frag0.tryDecode(RR,tPtr))||((now - rk.timestamp) > ZT_RECEIVE_QUEUE_TIMEOUT)) {
+						rk.timestamp = 0;
+					} else {
+						const Address src(rq->frag0.source());
+						if (!RR->topology->getPeer(tPtr,src))
+							requestWhois(tPtr,now,src);
+					}
+				} else if ((now - rk.timestamp) > ZT_RECEIVE_QUEUE_TIMEOUT) {
+					rk.timestamp = 0; // evict incomplete fragment sets on timeout
+				}
 			}
 		}
 	}
+	_reclaimRXQueues();
 
 	{
 		Mutex::Lock _l(_lastUniteAttempt_m);
@@ -635,6 +765,33 @@ unsigned long Switch::doTimerTasks(void *tPtr,int64_t now)
 	return ZT_WHOIS_RETRY_DELAY;
 }
 
+void Switch::setRxQueueSize(unsigned long entries)
+{
+	unsigned long size = 1;
+	while ((size < entries)&&(size < ZT_RX_QUEUE_MAX_SIZE))
+		size <<= 1;
+	Mutex::Lock _l(_rxQueueResize_m);
+	RXQueue *const old = _rxQueue.load();
+	if ((old->mask + 1) != size) {
+		_rxQueue.store(new RXQueue(size),std::memory_order_release);
+		_rxQueueRetired[_rxQueueEpoch.load() & 1].push_back(old);
+	}
+}
+
+void Switch::_reclaimRXQueues()
+{
+	Mutex::Lock _l(_rxQueueResize_m);
+	if ((_rxQueueRetired[0].empty())&&(_rxQueueRetired[1].empty()))
+		return;
+	const unsigned int prev = (_rxQueueEpoch.load() - 1) & 1;
+	if (_rxQueueUsers[prev].load() != 0)
+		return; // something may still be using a queue retired then, so try again next time
+	for(std::vector< RXQueue * >::iterator q(_rxQueueRetired[prev].begin());q!=_rxQueueRetired[prev].end();++q)
+		delete *q;
+	_rxQueueRetired[prev].clear();
+	++_rxQueueEpoch;
+}
+
 bool Switch::_shouldUnite(const int64_t now,const Address &source,const Address &destination)
 {
 	Mutex::Lock _l(_lastUniteAttempt_m);
@@ -646,20 +803,20 @@ bool Switch::_shouldUnite(const int64_t now,const Address &source,const Address
 	return false;
 }
 
-bool Switch::_trySend(void *tPtr,Packet &packet,bool encrypt)
+bool Switch::_route(void *tPtr,const int64_t now,Packet &packet,TXRoute &r,const uint64_t flowId)
 {
-	SharedPtr<Path> viaPath;
-	const int64_t now = RR->node->now();
-	const Address destination(packet.destination());
-
-	const SharedPtr<Peer> peer(RR->topology->getPeer(tPtr,destination));
-	if (peer) {
-		viaPath = peer->getBestPath(now,false);
-		if (!viaPath) {
-			peer->tryMemorizedPath(tPtr,now); // periodically attempt memorized or statically defined paths, if any are known
+	r.peer = RR->topology->getPeer(tPtr,packet.destination());
+	if (r.peer) {
+		const ZT_MultipathMode mpm = RR->node->multipathMode();
+		if ((flowId)&&(mpm != ZT_MULTIPATH_NONE))
+			r.viaPath = r.peer->getMultipath(now,mpm,flowId);
+		if (!r.viaPath)
+			r.viaPath = r.peer->getBestPath(now,false);
+		if (!r.viaPath) {
+			r.peer->tryMemorizedPath(tPtr,now); // periodically attempt memorized or statically defined paths, if any are known
 			const SharedPtr<Peer> relay(RR->topology->getUpstreamPeer());
-			if ( (!relay) || (!(viaPath = relay->getBestPath(now,false))) ) {
-				if (!(viaPath = peer->getBestPath(now,true)))
+			if ( (!relay) || (!(r.viaPath = relay->getBestPath(now,false))) ) {
+				if (!(r.viaPath = r.peer->getBestPath(now,true)))
 					return false;
 			}
 		}
@@ -667,20 +824,20 @@ bool Switch::_trySend(void *tPtr,Packet &packet,bool encrypt)
 		return false;
 	}
 
-	unsigned int mtu = ZT_DEFAULT_PHYSMTU;
-	uint64_t trustedPathId = 0;
-	RR->topology->getOutboundPathInfo(viaPath->address(),mtu,trustedPathId);
+	r.mtu = ZT_DEFAULT_PHYSMTU;
+	r.trustedPathId = 0;
+	RR->topology->getOutboundPathInfo(r.viaPath->address(),r.mtu,r.trustedPathId);
 
-	unsigned int chunkSize = std::min(packet.size(),mtu);
-	packet.setFragmented(chunkSize < packet.size());
+	packet.setFragmented(packet.size() > r.mtu);
 
-	if (trustedPathId) {
-		packet.setTrusted(trustedPathId);
-	} else {
-		packet.armor(peer->key(),encrypt);
-	}
+	return true;
+}
 
-	if (viaPath->send(RR,tPtr,packet.data(),chunkSize,now)) {
+void Switch::_sendRouted(void *tPtr,const int64_t now,Packet &packet,const TXRoute &r)
+{
+	const unsigned int mtu = r.mtu;
+	unsigned int chunkSize = std::min(packet.size(),mtu);
+	if (r.viaPath->send(RR,tPtr,packet.data(),chunkSize,now)) {
 		if (chunkSize < packet.size()) {
 			// Too big for one packet, fragment the rest
 			unsigned int fragStart = chunkSize;
@@ -693,14 +850,72 @@ bool Switch::_trySend(void *tPtr,Packet &packet,bool encrypt)
 			for(unsigned int fno=1;fno<totalFragments;++fno) {
 				chunkSize = std::min(remaining,(unsigned int)(mtu - ZT_PROTO_MIN_FRAGMENT_LENGTH));
 				Packet::Fragment frag(packet,fragStart,chunkSize,fno,totalFragments);
-				viaPath->send(RR,tPtr,frag.data(),frag.size(),now);
+				r.viaPath->send(RR,tPtr,frag.data(),frag.size(),now);
 				fragStart += chunkSize;
 				remaining -= chunkSize;
 			}
 		}
 	}
+}
+
+void Switch::_queueSend(void *tPtr,Packet &packet,bool encrypt)
+{
+	const Address dest(packet.destination());
+	{
+		Mutex::Lock _l(_txQueue_m);
+		if (_txQueue.size() >= ZT_TX_QUEUE_SIZE) {
+			_txQueue.pop_front();
+		}
+		_txQueue.push_back(TXQueueEntry(dest,RR->node->now(),packet,encrypt));
+	}
+	if (!RR->topology->getPeer(tPtr,dest))
+		requestWhois(tPtr,RR->node->now(),dest);
+}
+
+bool Switch::_trySend(void *tPtr,Packet &packet,bool encrypt,const uint64_t flowId)
+{
+	const int64_t now = RR->node->now();
+	TXRoute r;
+	if (!_route(tPtr,now,packet,r,flowId))
+		return false;
+
+	if (r.trustedPathId) {
+		packet.setTrusted(r.trustedPathId);
+	} else {
+		packet.armor(r.peer->key(),encrypt);
+	}
+
+	_sendRouted(tPtr,now,packet,r);
 
 	return true;
 }
 
+void Switch::_trySend(void *tPtr,Packet *const *packets,bool *sent,const unsigned int count,bool encrypt)
+{
+	const int64_t now = RR->node->now();
+	for(unsigned int b=0;b<count;b+=ZT_PROTO_ARMOR_BATCH_SIZE) {
+		const unsigned int n = std::min(count - b,(unsigned int)ZT_PROTO_ARMOR_BATCH_SIZE);
+		TXRoute routes[ZT_PROTO_ARMOR_BATCH_SIZE];
+		Packet *armor[ZT_PROTO_ARMOR_BATCH_SIZE];
+		const void *keys[ZT_PROTO_ARMOR_BATCH_SIZE];
+		unsigned int a = 0;
+		for(unsigned int k=0;k<n;++k) {
+			Packet &packet = *packets[b + k];
+			if ((sent[b + k] = _route(tPtr,now,packet,routes[k],0))) {
+				if (routes[k].trustedPathId) {
+					packet.setTrusted(routes[k].trustedPathId);
+				} else {
+					armor[a] = &packet;
+					keys[a++] = routes[k].peer->key();
+				}
+			}
+		}
+		Packet::armorBatch(armor,keys,encrypt,a);
+		for(unsigned int k=0;k<n;++k) {
+			if (sent[b + k])
+				_sendRouted(tPtr,now,*packets[b + k],routes[k]);
+		}
+	}
+}
+
 } // namespace ZeroTier
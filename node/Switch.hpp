@@ -31,6 +31,7 @@
 #include <set>
 #include <vector>
 #include <list>
+#include <atomic>
 
 #include "Constants.hpp"
 #include "Mutex.hpp"
@@ -61,6 +62,7 @@ class Switch
 {
 public:
 	Switch(const RuntimeEnvironment *renv);
+	~Switch();
 
 	/**
 	 * Called when a packet is received from the real network
@@ -102,8 +104,37 @@ public:
 	 * @param tPtr Thread pointer to be handed through to any callbacks called as a result of this call
 	 * @param packet Packet to send (buffer may be modified)
 	 * @param encrypt Encrypt packet payload? (always true except for HELLO)
+	 * @param flowId Flow ID from flowId() for network frames, or 0 to always use the best path
 	 */
-	void send(void *tPtr,Packet &packet,bool encrypt);
+	void send(void *tPtr,Packet &packet,bool encrypt,const uint64_t flowId = 0);
+
+	/**
+	 * Send several packets, armoring those that can go out now as a batch
+	 *
+	 * This is equivalent to calling send() on each packet.
+	 *
+	 * @param tPtr Thread pointer to be handed through to any callbacks called as a result of this call
+	 * @param packets Packets to send (buffers may be modified, must be distinct)
+	 * @param count Number of packets
+	 * @param encrypt Encrypt packet payloads?
+	 */
+	void send(void *tPtr,Packet *const *packets,const unsigned int count,bool encrypt);
+
+	/**
+	 * Compute a flow ID for spreading an Ethernet frame over multiple paths
+	 *
+	 * IPv4 and IPv6 frames are identified by addresses, protocol, and (for
+	 * TCP, UDP, and SCTP) ports. Other frames are identified by MACs and
+	 * ethernet type.
+	 *
+	 * @param from Source MAC
+	 * @param to Destination MAC
+	 * @param etherType Ethernet frame type
+	 * @param data Ethernet payload
+	 * @param len Payload length
+	 * @return Flow ID (never 0)
+	 */
+	static uint64_t flowId(const MAC &from,const MAC &to,const unsigned int etherType,const void *data,const unsigned int len);
 
 	/**
 	 * Request WHOIS on a given address
@@ -136,9 +167,44 @@ public:
 	 */
 	unsigned long doTimerTasks(void *tPtr,int64_t now);
 
+	/**
+	 * Resize the receive queue used for fragment reassembly and WHOIS waits
+	 *
+	 * Size is rounded up to a power of two and clamped to ZT_RX_QUEUE_MAX_SIZE.
+	 * Packets pending in the old queue are dropped. This may be called while
+	 * other threads are processing packets; old queues are freed by a later
+	 * doTimerTasks() once no thread can still be using them.
+	 *
+	 * @param entries Desired number of entries
+	 */
+	void setRxQueueSize(unsigned long entries);
+
+	/**
+	 * @return Number of partially reassembled packets evicted due to receive queue pressure
+	 */
+	inline uint64_t rxQueueFragmentDrops() const { return _rxQueueFragmentDrops.load(); }
+
+	/**
+	 * @return Number of complete packets waiting on WHOIS evicted due to receive queue pressure
+	 */
+	inline uint64_t rxQueueWaitingDrops() const { return _rxQueueWaitingDrops.load(); }
+
 private:
 	bool _shouldUnite(const int64_t now,const Address &source,const Address &destination);
-	bool _trySend(void *tPtr,Packet &packet,bool encrypt); // packet is modified if return is true
+	// Where and how a packet will be sent, found before it is armored
+	struct TXRoute
+	{
+		SharedPtr<Peer> peer;
+		SharedPtr<Path> viaPath;
+		unsigned int mtu;
+		uint64_t trustedPathId;
+	};
+
+	bool _route(void *tPtr,const int64_t now,Packet &packet,TXRoute &r,const uint64_t flowId); // sets fragmented flag if return is true
+	void _sendRouted(void *tPtr,const int64_t now,Packet &packet,const TXRoute &r); // packet must already be armored
+	void _queueSend(void *tPtr,Packet &packet,bool encrypt);
+	bool _trySend(void *tPtr,Packet &packet,bool encrypt,const uint64_t flowId = 0); // packet is modified if return is true
+	void _trySend(void *tPtr,Packet *const *packets,bool *sent,const unsigned int count,bool encrypt); // sent[] set to what _trySend() would return
 
 	const RuntimeEnvironment *const RR;
 	int64_t _lastBeaconResponse;
@@ -149,38 +215,112 @@ private:
 	Mutex _lastSentWhoisRequest_m;
 
 	// Packets waiting for WHOIS replies or other decode info or missing fragments
-	struct RXQueueEntry
+	//
+	// The queue is an open-addressed table indexed by packet ID. Keys are kept
+	// in their own compact array so that probing and periodic scans do not
+	// touch the large packet buffers. Keys are written only while holding the
+	// corresponding entry's lock, but may be read without it as a hint.
+	struct RXQueueKey
 	{
-		RXQueueEntry() : timestamp(0) {}
-		volatile int64_t timestamp; // 0 if entry is not in use
+		RXQueueKey() : packetId(0),timestamp(0),complete(false) {}
 		volatile uint64_t packetId;
+		volatile int64_t timestamp; // 0 if entry is not in use
+		volatile bool complete; // if true, packet is complete
+	};
+	struct RXQueueEntry
+	{
+		RXQueueEntry() : totalFragments(0),haveFragments(0) {}
 		IncomingPacket frag0; // head of packet
 		Packet::Fragment frags[ZT_MAX_PACKET_FRAGMENTS - 1]; // later fragments (if any)
 		unsigned int totalFragments; // 0 if only frag0 received, waiting for frags
 		uint32_t haveFragments; // bit mask, LSB to MSB
-		volatile bool complete; // if true, packet is complete
 		Mutex lock;
 	};
-	RXQueueEntry _rxQueue[ZT_RX_QUEUE_SIZE];
-	AtomicCounter _rxQueuePtr;
+	struct RXQueue
+	{
+		RXQueue(unsigned long size) : mask(size - 1),keys(new RXQueueKey[size]),entries(new RXQueueEntry[size]) {}
+		~RXQueue() { delete [] keys; delete [] entries; }
+		const unsigned long mask; // size - 1, size is a power of two
+		RXQueueKey *const keys;
+		RXQueueEntry *const entries;
+	};
+	std::atomic<RXQueue *> _rxQueue;
+	Mutex _rxQueueResize_m;
+	std::atomic<uint64_t> _rxQueueFragmentDrops;
+	std::atomic<uint64_t> _rxQueueWaitingDrops;
 
-	// Returns matching or next available RX queue entry
-	inline RXQueueEntry *_findRXQueueEntry(uint64_t packetId)
+	// Queues replaced by setRxQueueSize() are retired and freed once no thread
+	// that could have loaded them is still using one. As in ConcurrentHashtable,
+	// users announce themselves on a counter for the current epoch, and
+	// _reclaimRXQueues() frees what was retired before the current epoch once
+	// that epoch's counter has drained.
+	std::atomic<unsigned int> _rxQueueEpoch;
+	AtomicCounter _rxQueueUsers[2]; // by epoch parity
+	std::vector< RXQueue * > _rxQueueRetired[2]; // by epoch parity, guarded by _rxQueueResize_m
+
+	// Holds the current queue for as long as it exists
+	class _RXQueueUse
+	{
+	public:
+		_RXQueueUse(Switch &sw) : _c(sw._enterRXQueue()),q(sw._rxQueue.load(std::memory_order_acquire)) {}
+		~_RXQueueUse() { --(*_c); }
+	private:
+		AtomicCounter *const _c;
+	public:
+		RXQueue *const q;
+	};
+
+	inline AtomicCounter *_enterRXQueue()
+	{
+		for(;;) {
+			const unsigned int e = _rxQueueEpoch.load();
+			AtomicCounter *const c = &(_rxQueueUsers[e & 1]);
+			++(*c); // full barrier
+			if (_rxQueueEpoch.load() == e)
+				return c;
+			--(*c); // _reclaimRXQueues() advanced the epoch in between, so announce under the new one
+		}
+	}
+
+	void _reclaimRXQueues();
+
+	// Returns the index of this packet ID's entry, or of a free, expired, or
+	// (if all are in use) the oldest entry in its probe window
+	inline unsigned long _findRXQueueEntry(const RXQueue *const q,const int64_t now,const uint64_t packetId) const
 	{
-		const unsigned int current = static_cast<unsigned int>(_rxQueuePtr.load());
-		for(unsigned int k=1;k<=ZT_RX_QUEUE_SIZE;++k) {
-			RXQueueEntry *rq = &(_rxQueue[(current - k) % ZT_RX_QUEUE_SIZE]);
-			if ((rq->packetId == packetId)&&(rq->timestamp))
-				return rq;
+		const unsigned long start = (unsigned long)(packetId ^ (packetId >> 32)) & q->mask;
+		const unsigned long probes = (q->mask < ZT_RX_QUEUE_PROBE_LIMIT) ? (q->mask + 1) : ZT_RX_QUEUE_PROBE_LIMIT;
+		unsigned long pick = start;
+		int64_t pickTimestamp = q->keys[start].timestamp;
+		for(unsigned long k=0;k<probes;++k) {
+			const unsigned long i = (start + k) & q->mask;
+			int64_t ts = q->keys[i].timestamp;
+			if (ts) {
+				if (q->keys[i].packetId == packetId)
+					return i;
+				if ((now - ts) > ZT_RECEIVE_QUEUE_TIMEOUT)
+					ts = 0;
+			}
+			if ((pickTimestamp)&&(ts < pickTimestamp)) {
+				pick = i;
+				pickTimestamp = ts;
+			}
 		}
-		++_rxQueuePtr;
-		return &(_rxQueue[static_cast<unsigned int>(current) % ZT_RX_QUEUE_SIZE]);
+		return pick;
 	}
 
-	// Returns current entry in rx queue ring buffer and increments ring pointer
-	inline RXQueueEntry *_nextRXQueueEntry()
+	// Takes over an entry for a new packet ID, counting a drop if a live entry is evicted (entry must be locked)
+	inline void _claimRXQueueEntry(RXQueueKey &rk,const int64_t now,const uint64_t packetId)
 	{
-		return &(_rxQueue[static_cast<unsigned int>((++_rxQueuePtr) - 1) % ZT_RX_QUEUE_SIZE]);
+		const int64_t ts = rk.timestamp;
+		if ((ts)&&((now - ts) <= ZT_RECEIVE_QUEUE_TIMEOUT)) {
+			if (rk.complete)
+				++_rxQueueWaitingDrops;
+			else ++_rxQueueFragmentDrops;
+		}
+		rk.timestamp = now;
+		rk.packetId = packetId;
+		rk.complete = false;
 	}
 
 	// ZeroTier-layer TX queue entry
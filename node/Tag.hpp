@@ -112,6 +112,19 @@ public:
 		return false;
 	}
 
+	/**
+	 * Sign this tag when a signing batch is signed
+	 *
+	 * @param sb Signing batch (this tag must not move until sb.sign())
+	 */
+	inline void sign(SigningBatch &sb)
+	{
+		Buffer<sizeof(Tag) + 64> tmp;
+		_signedBy = sb.signer();
+		this->serialize(tmp,true);
+		sb.add(tmp.data(),tmp.size(),_signature);
+	}
+
 	/**
 	 * Check this tag's signature
 	 *
@@ -121,6 +134,16 @@ public:
 	 */
 	int verify(const RuntimeEnvironment *RR,void *tPtr) const;
 
+	/**
+	 * Check this tag's signature and add its signatures to a batch instead of verifying them
+	 *
+	 * @param RR Runtime environment to allow identity lookup for signedBy
+	 * @param tPtr Thread pointer to be handed through to any callbacks called as a result of this call
+	 * @param sb Signature batch
+	 * @return 0 == OK if signature in batch is valid, 1 == waiting for WHOIS, -1 == BAD tag
+	 */
+	int verify(const RuntimeEnvironment *RR,void *tPtr,SignatureBatch &sb) const;
+
 	template<unsigned int C>
 	inline void serialize(Buffer<C> &b,const bool forSign = false) const
 	{
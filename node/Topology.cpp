@@ -90,24 +90,14 @@ Topology::Topology(const RuntimeEnvironment *renv,void *tPtr) :
 
 Topology::~Topology()
 {
-	Hashtable< Address,SharedPtr<Peer> >::Iterator i(_peers);
-	Address *a = (Address *)0;
-	SharedPtr<Peer> *p = (SharedPtr<Peer> *)0;
-	while (i.next(a,p))
-		_savePeer((void *)0,*p);
+	const std::vector< std::pair< Address,SharedPtr<Peer> > > peers(_peers.entries());
+	for(std::vector< std::pair< Address,SharedPtr<Peer> > >::const_iterator p(peers.begin());p!=peers.end();++p)
+		_savePeer((void *)0,p->second);
 }
 
 SharedPtr<Peer> Topology::addPeer(void *tPtr,const SharedPtr<Peer> &peer)
 {
-	SharedPtr<Peer> np;
-	{
-		Mutex::Lock _l(_peers_m);
-		SharedPtr<Peer> &hp = _peers[peer->address()];
-		if (!hp)
-			hp = peer;
-		np = hp;
-	}
-	return np;
+	return _addPeer(peer->address(),peer);
 }
 
 SharedPtr<Peer> Topology::getPeer(void *tPtr,const Address &zta)
@@ -116,10 +106,9 @@ SharedPtr<Peer> Topology::getPeer(void *tPtr,const Address &zta)
 		return SharedPtr<Peer>();
 
 	{
-		Mutex::Lock _l(_peers_m);
-		const SharedPtr<Peer> *const ap = _peers.get(zta);
+		const SharedPtr<Peer> ap(_peers.get(zta));
 		if (ap)
-			return *ap;
+			return ap;
 	}
 
 	try {
@@ -128,14 +117,12 @@ SharedPtr<Peer> Topology::getPeer(void *tPtr,const Address &zta)
 		int len = RR->node->stateObjectGet(tPtr,ZT_STATE_OBJECT_PEER,idbuf,buf.unsafeData(),ZT_PEER_MAX_SERIALIZED_STATE_SIZE);
 		if (len > 0) {
 			buf.setSize(len);
-			Mutex::Lock _l(_peers_m);
-			SharedPtr<Peer> &ap = _peers[zta];
+			const SharedPtr<Peer> ap(_peers.get(zta));
 			if (ap)
 				return ap;
-			ap = Peer::deserializeFromCache(RR->node->now(),tPtr,buf,RR);
-			if (!ap) {
-				_peers.erase(zta);
-			}
+			const SharedPtr<Peer> np(Peer::deserializeFromCache(RR->node->now(),tPtr,buf,RR));
+			if (np)
+				_addPeer(zta,np);
 			return SharedPtr<Peer>();
 		}
 	} catch ( ... ) {} // ignore invalid identities or other strage failures
@@ -148,10 +135,9 @@ Identity Topology::getIdentity(void *tPtr,const Address &zta)
 	if (zta == RR->identity.address()) {
 		return RR->identity;
 	} else {
-		Mutex::Lock _l(_peers_m);
-		const SharedPtr<Peer> *const ap = _peers.get(zta);
+		const SharedPtr<Peer> ap(_peers.get(zta));
 		if (ap)
-			return (*ap)->identity();
+			return ap->identity();
 	}
 	return Identity();
 }
@@ -160,15 +146,14 @@ SharedPtr<Peer> Topology::getUpstreamPeer()
 {
 	const int64_t now = RR->node->now();
 	unsigned int bestq = ~((unsigned int)0);
-	const SharedPtr<Peer> *best = (const SharedPtr<Peer> *)0;
+	SharedPtr<Peer> best;
 
-	Mutex::Lock _l2(_peers_m);
 	Mutex::Lock _l1(_upstreams_m);
 
 	for(std::vector<Address>::const_iterator a(_upstreamAddresses.begin());a!=_upstreamAddresses.end();++a) {
-		const SharedPtr<Peer> *p = _peers.get(*a);
+		const SharedPtr<Peer> p(_peers.get(*a));
 		if (p) {
-			const unsigned int q = (*p)->relayQuality(now);
+			const unsigned int q = p->relayQuality(now);
 			if (q <= bestq) {
 				bestq = q;
 				best = p;
@@ -176,9 +161,7 @@ SharedPtr<Peer> Topology::getUpstreamPeer()
 		}
 	}
 
-	if (!best)
-		return SharedPtr<Peer>();
-	return *best;
+	return best;
 }
 
 bool Topology::isUpstream(const Identity &id) const
@@ -252,7 +235,6 @@ bool Topology::addWorld(void *tPtr,const World &newWorld,bool alwaysAcceptNew)
 	if ((newWorld.type() != World::TYPE_PLANET)&&(newWorld.type() != World::TYPE_MOON))
 		return false;
 
-	Mutex::Lock _l2(_peers_m);
 	Mutex::Lock _l1(_upstreams_m);
 
 	World *existing = (World *)0;
@@ -341,7 +323,6 @@ void Topology::addMoon(void *tPtr,const uint64_t id,const Address &seed)
 
 void Topology::removeMoon(void *tPtr,const uint64_t id)
 {
-	Mutex::Lock _l2(_peers_m);
 	Mutex::Lock _l1(_upstreams_m);
 
 	std::vector<World> nm;
@@ -368,35 +349,32 @@ void Topology::removeMoon(void *tPtr,const uint64_t id)
 
 void Topology::doPeriodicTasks(void *tPtr,int64_t now)
 {
+	_DeadPeers dead(now);
 	{
-		Mutex::Lock _l1(_peers_m);
-		Mutex::Lock _l2(_upstreams_m);
-		Hashtable< Address,SharedPtr<Peer> >::Iterator i(_peers);
-		Address *a = (Address *)0;
-		SharedPtr<Peer> *p = (SharedPtr<Peer> *)0;
-		while (i.next(a,p)) {
-			if ( (!(*p)->isAlive(now)) && (std::find(_upstreamAddresses.begin(),_upstreamAddresses.end(),*a) == _upstreamAddresses.end()) ) {
-				_savePeer(tPtr,*p);
-				_peers.erase(*a);
-			}
-		}
+		Mutex::Lock _l(_upstreams_m);
+		dead.upstreams = &_upstreamAddresses;
+		_peers.eraseIf(dead);
 	}
-
 	{
-		Mutex::Lock _l(_paths_m);
-		Hashtable< Path::HashKey,SharedPtr<Path> >::Iterator i(_paths);
-		Path::HashKey *k = (Path::HashKey *)0;
-		SharedPtr<Path> *p = (SharedPtr<Path> *)0;
-		while (i.next(k,p)) {
-			if (p->references() <= 1)
-				_paths.erase(*k);
+		Mutex::Lock _l(_peerOrder_m);
+		for(std::vector< SharedPtr<Peer> >::const_iterator p(dead.peers.begin());p!=dead.peers.end();++p) {
+			if (!_peers.get((*p)->address())) // unless it was added back since
+				_peerOrder.erase((*p)->address());
 		}
 	}
+	for(std::vector< SharedPtr<Peer> >::const_iterator p(dead.peers.begin());p!=dead.peers.end();++p)
+		_savePeer(tPtr,*p);
+
+	_UnusedPaths unused(now);
+	_paths.eraseIf(unused);
+
+	_peers.reclaim();
+	_paths.reclaim();
 }
 
 void Topology::_memoizeUpstreams(void *tPtr)
 {
-	// assumes _upstreams_m and _peers_m are locked
+	// assumes _upstreams_m is locked
 	_upstreamAddresses.clear();
 	_amUpstream = false;
 
@@ -405,9 +383,8 @@ void Topology::_memoizeUpstreams(void *tPtr)
 			_amUpstream = true;
 		} else if (std::find(_upstreamAddresses.begin(),_upstreamAddresses.end(),i->identity.address()) == _upstreamAddresses.end()) {
 			_upstreamAddresses.push_back(i->identity.address());
-			SharedPtr<Peer> &hp = _peers[i->identity.address()];
-			if (!hp)
-				hp = new Peer(RR,RR->identity,i->identity);
+			if (!_peers.get(i->identity.address()))
+				_addPeer(i->identity.address(),SharedPtr<Peer>(new Peer(RR,RR->identity,i->identity)));
 		}
 	}
 
@@ -417,9 +394,8 @@ void Topology::_memoizeUpstreams(void *tPtr)
 				_amUpstream = true;
 			} else if (std::find(_upstreamAddresses.begin(),_upstreamAddresses.end(),i->identity.address()) == _upstreamAddresses.end()) {
 				_upstreamAddresses.push_back(i->identity.address());
-				SharedPtr<Peer> &hp = _peers[i->identity.address()];
-				if (!hp)
-					hp = new Peer(RR,RR->identity,i->identity);
+				if (!_peers.get(i->identity.address()))
+					_addPeer(i->identity.address(),SharedPtr<Peer>(new Peer(RR,RR->identity,i->identity)));
 			}
 		}
 	}
@@ -427,6 +403,13 @@ void Topology::_memoizeUpstreams(void *tPtr)
 	std::sort(_upstreamAddresses.begin(),_upstreamAddresses.end());
 }
 
+SharedPtr<Peer> Topology::_addPeer(const Address &a,const SharedPtr<Peer> &p)
+{
+	Mutex::Lock _l(_peerOrder_m);
+	_peerOrder.insert(a);
+	return _peers.add(a,p);
+}
+
 void Topology::_savePeer(void *tPtr,const SharedPtr<Peer> &peer)
 {
 	try {
@@ -31,6 +31,7 @@
 #include <string.h>
 
 #include <vector>
+#include <set>
 #include <stdexcept>
 #include <algorithm>
 #include <utility>
@@ -45,6 +46,7 @@
 #include "Mutex.hpp"
 #include "InetAddress.hpp"
 #include "Hashtable.hpp"
+#include "ConcurrentHashtable.hpp"
 #include "World.hpp"
 
 namespace ZeroTier {
@@ -53,6 +55,9 @@ class RuntimeEnvironment;
 
 /**
  * Database of network topology
+ *
+ * Peers and paths are kept in ConcurrentHashtables, so the per-packet
+ * lookups in getPeer() and getPath() take no locks.
  */
 class Topology
 {
@@ -98,14 +103,7 @@ public:
 	 *
 	 * @param zta ZeroTier address
 	 */
-	inline SharedPtr<Peer> getPeerNoCache(const Address &zta)
-	{
-		Mutex::Lock _l(_peers_m);
-		const SharedPtr<Peer> *const ap = _peers.get(zta);
-		if (ap)
-			return *ap;
-		return SharedPtr<Peer>();
-	}
+	inline SharedPtr<Peer> getPeerNoCache(const Address &zta) { return _peers.get(zta); }
 
 	/**
 	 * Get a Path object for a given local and remote physical address, creating if needed
@@ -116,11 +114,11 @@ public:
 	 */
 	inline SharedPtr<Path> getPath(const int64_t l,const InetAddress &r)
 	{
-		Mutex::Lock _l(_paths_m);
-		SharedPtr<Path> &p = _paths[Path::HashKey(l,r)];
-		if (!p)
-			p.set(new Path(l,r));
-		return p;
+		const Path::HashKey k(l,r);
+		const SharedPtr<Path> p(_paths.get(k));
+		if (p)
+			return p;
+		return _paths.add(k,SharedPtr<Path>(new Path(l,r)));
 	}
 
 	/**
@@ -293,17 +291,9 @@ public:
 	 */
 	inline unsigned long countActive(int64_t now) const
 	{
-		unsigned long cnt = 0;
-		Mutex::Lock _l(_peers_m);
-		Hashtable< Address,SharedPtr<Peer> >::Iterator i(const_cast<Topology *>(this)->_peers);
-		Address *a = (Address *)0;
-		SharedPtr<Peer> *p = (SharedPtr<Peer> *)0;
-		while (i.next(a,p)) {
-			const SharedPtr<Path> pp((*p)->getBestPath(now,false));
-			if (pp)
-				++cnt;
-		}
-		return cnt;
+		_CountActive f(now);
+		_peers.each(f);
+		return f.cnt;
 	}
 
 	/**
@@ -315,24 +305,36 @@ public:
 	template<typename F>
 	inline void eachPeer(F f)
 	{
-		Mutex::Lock _l(_peers_m);
-		Hashtable< Address,SharedPtr<Peer> >::Iterator i(_peers);
-		Address *a = (Address *)0;
-		SharedPtr<Peer> *p = (SharedPtr<Peer> *)0;
-		while (i.next(a,p)) {
-			f(*this,*((const SharedPtr<Peer> *)p));
-		}
+		_EachPeer<F> ef(*this,f);
+		_peers.each(ef);
 	}
 
 	/**
-	 * @return All currently active peers by address (unsorted)
+	 * Get one page of peers in address order
+	 *
+	 * Peers are found through a sorted index of addresses, so a page costs
+	 * about the same however many peers there are.
+	 *
+	 * @param after Get peers with addresses greater than this
+	 * @param max Maximum number of peers to get
+	 * @param page Filled with up to max peers in ascending address order
 	 */
-	inline std::vector< std::pair< Address,SharedPtr<Peer> > > allPeers() const
+	inline void peersAfter(const Address &after,const unsigned int max,std::vector< std::pair< Address,SharedPtr<Peer> > > &page)
 	{
-		Mutex::Lock _l(_peers_m);
-		return _peers.entries();
+		page.clear();
+		Mutex::Lock _l(_peerOrder_m);
+		for(std::set<Address>::const_iterator a(_peerOrder.upper_bound(after));((a!=_peerOrder.end())&&(page.size() < max));++a) {
+			const SharedPtr<Peer> p(_peers.get(*a));
+			if (p) // may be gone but not yet out of the index
+				page.push_back(std::pair< Address,SharedPtr<Peer> >(*a,p));
+		}
 	}
 
+	/**
+	 * @return All currently active peers by address (unsorted)
+	 */
+	inline std::vector< std::pair< Address,SharedPtr<Peer> > > allPeers() const { return _peers.entries(); }
+
 	/**
 	 * @return True if I am a root server in a planet or moon
 	 */
@@ -441,8 +443,57 @@ public:
 	}
 
 private:
+	struct _CountActive
+	{
+		_CountActive(const int64_t n) : now(n),cnt(0) {}
+		inline void operator()(const Address &a,const SharedPtr<Peer> &p)
+		{
+			const SharedPtr<Path> pp(p->getBestPath(now,false));
+			if (pp)
+				++cnt;
+		}
+		const int64_t now;
+		unsigned long cnt;
+	};
+
+	template<typename F>
+	struct _EachPeer
+	{
+		_EachPeer(Topology &t,F &ff) : topology(t),f(ff) {}
+		inline void operator()(const Address &a,const SharedPtr<Peer> &p) { f(topology,p); }
+		Topology &topology;
+		F &f;
+	};
+
+	// Collects and erases peers that are no longer alive, except upstreams (which must be locked)
+	struct _DeadPeers
+	{
+		_DeadPeers(const int64_t n) : now(n),upstreams((const std::vector<Address> *)0) {}
+		inline bool operator()(const Address &a,SharedPtr<Peer> &p)
+		{
+			if ( (!p->isAlive(now)) && (std::find(upstreams->begin(),upstreams->end(),a) == upstreams->end()) ) {
+				peers.push_back(p);
+				return true;
+			}
+			return false;
+		}
+		const int64_t now;
+		const std::vector<Address> *upstreams;
+		std::vector< SharedPtr<Peer> > peers;
+	};
+
+	// Erases paths nothing else refers to. Paths that are still receiving are
+	// kept so a lookup racing with this almost never gets one just dropped.
+	struct _UnusedPaths
+	{
+		_UnusedPaths(const int64_t n) : now(n) {}
+		inline bool operator()(const Path::HashKey &k,SharedPtr<Path> &p) { return ((p.references() <= 1)&&(!p->alive(now))); }
+		const int64_t now;
+	};
+
 	Identity _getIdentity(void *tPtr,const Address &zta);
 	void _memoizeUpstreams(void *tPtr);
+	SharedPtr<Peer> _addPeer(const Address &a,const SharedPtr<Peer> &p);
 	void _savePeer(void *tPtr,const SharedPtr<Peer> &peer);
 
 	const RuntimeEnvironment *const RR;
@@ -450,11 +501,10 @@ private:
 	std::pair<InetAddress,ZT_PhysicalPathConfiguration> _physicalPathConfig[ZT_MAX_CONFIGURABLE_PATHS];
 	volatile unsigned int _numConfiguredPhysicalPaths;
 
-	Hashtable< Address,SharedPtr<Peer> > _peers;
-	Mutex _peers_m;
-
-	Hashtable< Path::HashKey,SharedPtr<Path> > _paths;
-	Mutex _paths_m;
+	ConcurrentHashtable< Address,Peer > _peers;
+	std::set<Address> _peerOrder; // addresses in _peers, for paging in order
+	Mutex _peerOrder_m;
+	ConcurrentHashtable< Path::HashKey,Path > _paths;
 
 	World _planet;
 	std::vector<World> _moons;
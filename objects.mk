@@ -17,6 +17,7 @@ CORE_OBJS=\
 	node/Peer.o \
 	node/Poly1305.o \
 	node/Revocation.o \
+	node/RuleProgram.o \
 	node/Salsa20.o \
 	node/SelfAwareness.o \
 	node/SHA512.o \
@@ -30,10 +31,12 @@ ONE_OBJS=\
 	controller/EmbeddedNetworkController.o \
 	controller/DB.o \
 	controller/FileDB.o \
+	controller/LogDB.o \
 	controller/RethinkDB.o \
 	osdep/ManagedRoute.o \
 	osdep/Http.o \
 	osdep/OSUtils.o \
+	service/PeerStore.o \
 	service/SoftwareUpdater.o \
 	service/OneService.o
 
@@ -84,6 +84,9 @@
 
 #include "service/OneService.hpp"
 
+#include "controller/FileDB.hpp"
+#include "controller/LogDB.hpp"
+
 #include "ext/json/json.hpp"
 
 #define ZT_PID_PATH "zerotier-one.pid"
@@ -959,6 +962,62 @@ static int idtool(int argc,char **argv)
 	return 0;
 }
 
+/****************************************************************************/
+/* zerotier-dbtool personality                                              */
+/****************************************************************************/
+
+static void dbtoolPrintHelp(FILE *out,const char *pn)
+{
+	fprintf(out,
+		"%s version %d.%d.%d" ZT_EOL_S,
+		PROGRAM_NAME,
+		ZEROTIER_ONE_VERSION_MAJOR, ZEROTIER_ONE_VERSION_MINOR, ZEROTIER_ONE_VERSION_REVISION);
+	fprintf(out,
+		COPYRIGHT_NOTICE ZT_EOL_S
+		LICENSE_GRANT ZT_EOL_S);
+	fprintf(out,"Usage: %s <command> [<args>]" ZT_EOL_S"" ZT_EOL_S"Commands:" ZT_EOL_S,pn);
+	fprintf(out,"  import <controller.d> <logdb directory>" ZT_EOL_S);
+	fprintf(out,"  export <logdb directory> <controller.d>" ZT_EOL_S);
+	fprintf(out,"" ZT_EOL_S"Use controllerDbPath \"logdb:<logdb directory>\" in local.conf to run a controller from an imported DB." ZT_EOL_S);
+}
+
+#ifdef __WINDOWS__
+static int dbtool(int argc, _TCHAR* argv[])
+#else
+static int dbtool(int argc,char **argv)
+#endif
+{
+	if (argc < 4) {
+		dbtoolPrintHelp(stdout,argv[0]);
+		return 1;
+	}
+	if (!OSUtils::fileExists(argv[2])) {
+		fprintf(stderr,"%s does not exist" ZT_EOL_S,argv[2]);
+		return 1;
+	}
+
+	if (!strcmp(argv[1],"import")) {
+		FileDB src((EmbeddedNetworkController *)0,Identity(),argv[2]);
+		if (!LogDB::importFrom(src,argv[3])) {
+			fprintf(stderr,"unable to write %s" ZT_EOL_S,argv[3]);
+			return 1;
+		}
+		printf("imported %s into %s" ZT_EOL_S,argv[2],argv[3]);
+	} else if (!strcmp(argv[1],"export")) {
+		LogDB src((EmbeddedNetworkController *)0,Identity(),argv[2]);
+		if (!src.exportTo(argv[3])) {
+			fprintf(stderr,"unable to write %s" ZT_EOL_S,argv[3]);
+			return 1;
+		}
+		printf("exported %s to %s" ZT_EOL_S,argv[2],argv[3]);
+	} else {
+		dbtoolPrintHelp(stdout,argv[0]);
+		return 1;
+	}
+
+	return 0;
+}
+
 /****************************************************************************/
 /* Unix helper functions and signal handlers                                */
 /****************************************************************************/
@@ -1299,6 +1358,7 @@ static void printHelp(const char *cn,FILE *out)
 
 	fprintf(out,"  -i                - Generate and manage identities (zerotier-idtool)" ZT_EOL_S);
 	fprintf(out,"  -q                - Query API (zerotier-cli)" ZT_EOL_S);
+	fprintf(out,"  -b                - Import/export controller databases (zerotier-dbtool)" ZT_EOL_S);
 }
 
 class _OneServiceRunner
@@ -1394,6 +1454,8 @@ int main(int argc,char **argv)
 		return idtool(argc,argv);
 	if ((strstr(argv[0],"zerotier-cli"))||(strstr(argv[0],"ZEROTIER-CLI")))
 		return cli(argc,argv);
+	if ((strstr(argv[0],"zerotier-dbtool"))||(strstr(argv[0],"ZEROTIER-DBTOOL")))
+		return dbtool(argc,argv);
 
 	std::string homeDir;
 	unsigned int port = ZT_DEFAULT_PORT;
@@ -1437,6 +1499,12 @@ int main(int argc,char **argv)
 						return 0;
 					} else return cli(argc,argv);
 
+				case 'b': // Invoke dbtool personality
+					if (argv[i][2]) {
+						printHelp(argv[0],stdout);
+						return 0;
+					} else return dbtool(argc-1,argv+1);
+
 #ifdef __WINDOWS__
 				case 'C': // Run from command line instead of as Windows service
 					winRunFromCommandLine = true;
@@ -98,7 +98,20 @@ private:
 	};
 
 public:
-	Binder() : _bindingCount(0) {}
+	Binder() : _bindingCount(0),_udpReusePort(false),_udpOnly(false) {}
+
+	/**
+	 * Set binding options, must be called before the first refresh()
+	 *
+	 * @param udpReusePort If true bind UDP sockets with SO_REUSEPORT so other binders can share their addresses
+	 * @param udpOnly If true bind only UDP sockets and no TCP listen sockets
+	 */
+	inline void setBindOptions(bool udpReusePort,bool udpOnly)
+	{
+		Mutex::Lock _l(_lock);
+		_udpReusePort = udpReusePort;
+		_udpOnly = udpOnly;
+	}
 
 	/**
 	 * Close all bound ports, should be called on shutdown
@@ -369,9 +382,9 @@ public:
 				++bi;
 			}
 			if (bi == _bindingCount) {
-				udps = phy.udpBind(reinterpret_cast<const struct sockaddr *>(&(ii->first)),(void *)0,ZT_UDP_DESIRED_BUF_SIZE);
-				tcps = phy.tcpListen(reinterpret_cast<const struct sockaddr *>(&(ii->first)),(void *)0);
-				if ((udps)&&(tcps)) {
+				udps = phy.udpBind(reinterpret_cast<const struct sockaddr *>(&(ii->first)),(void *)0,ZT_UDP_DESIRED_BUF_SIZE,_udpReusePort);
+				tcps = (_udpOnly) ? (PhySocket *)0 : phy.tcpListen(reinterpret_cast<const struct sockaddr *>(&(ii->first)),(void *)0);
+				if ((udps)&&((tcps)||(_udpOnly))) {
 #ifdef __LINUX__
 					// Bind Linux sockets to their device so routes tha we manage do not override physical routes (wish all platforms had this!)
 					if (ii->second.length() > 0) {
@@ -380,7 +393,7 @@ public:
 						int fd = (int)Phy<PHY_HANDLER_TYPE>::getDescriptor(udps);
 						if (fd >= 0)
 							setsockopt(fd,SOL_SOCKET,SO_BINDTODEVICE,tmp,strlen(tmp));
-						fd = (int)Phy<PHY_HANDLER_TYPE>::getDescriptor(tcps);
+						fd = (tcps) ? (int)Phy<PHY_HANDLER_TYPE>::getDescriptor(tcps) : -1;
 						if (fd >= 0)
 							setsockopt(fd,SOL_SOCKET,SO_BINDTODEVICE,tmp,strlen(tmp));
 					}
@@ -420,9 +433,13 @@ public:
 		bool r = false;
 		Mutex::Lock _l(_lock);
 		for(unsigned int b=0,c=_bindingCount;b<c;++b) {
-			if (ttl) phy.setIp4UdpTtl(_bindings[b].udpSock,ttl);
-			if (phy.udpSend(_bindings[b].udpSock,(const struct sockaddr *)addr,data,len)) r = true;
-			if (ttl) phy.setIp4UdpTtl(_bindings[b].udpSock,255);
+			if (ttl) {
+				phy.setIp4UdpTtl(_bindings[b].udpSock,ttl);
+				if (phy.udpSend(_bindings[b].udpSock,(const struct sockaddr *)addr,data,len)) r = true;
+				phy.setIp4UdpTtl(_bindings[b].udpSock,255);
+			} else if (phy.udpSendBatched(_bindings[b].udpSock,(const struct sockaddr *)addr,data,len)) {
+				r = true;
+			}
 		}
 		return r;
 	}
@@ -459,6 +476,8 @@ public:
 private:
 	_Binding _bindings[ZT_BINDER_MAX_BINDINGS];
 	std::atomic<unsigned int> _bindingCount;
+	bool _udpReusePort;
+	bool _udpOnly;
 	Mutex _lock;
 };
 
@@ -0,0 +1,207 @@
+/*
+ * ZeroTier One - Network Virtualization Everywhere
+ * Copyright (C) 2011-2018  ZeroTier, Inc.  https://www.zerotier.com/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * --
+ *
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial closed-source software that incorporates or links
+ * directly against ZeroTier software without disclosing the source code
+ * of your own application.
+ */
+
+
+#ifndef ZT_FAIRQUEUE_HPP
+#define ZT_FAIRQUEUE_HPP
+
+#include <stdint.h>
+
+#include <list>
+#include <deque>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+namespace ZeroTier {
+
+/**
+ * Thread-safe queue made of one FIFO per flow, served round-robin
+ *
+ * Items are posted to a flow (e.g. a network) with a key that identifies
+ * duplicates within it (e.g. a member). An item posted while another with
+ * the same key is waiting replaces that item in its place in line. get()
+ * takes one item from each flow that has any in turn, so one busy flow
+ * cannot hold up the others.
+ *
+ * Do not use in node/ since we have not gone C++11 there yet.
+ */
+template <class F,class K,class T>
+class FairQueue
+{
+public:
+	struct Stats
+	{
+		unsigned long depth; // items waiting
+		unsigned long flows; // flows with items waiting
+		uint64_t posted;
+		uint64_t coalesced; // posts that replaced a waiting item
+		uint64_t served;
+		uint64_t totalWait; // ms waited by all items served
+		uint64_t maxWait; // longest ms waited by an item served
+		uint64_t oldestWait; // ms the oldest waiting item has waited so far
+	};
+
+	FairQueue() :
+		_run(true),
+		_depth(0),
+		_posted(0),
+		_coalesced(0),
+		_served(0),
+		_totalWait(0),
+		_maxWait(0) {}
+
+	/**
+	 * @param flow Flow to post to
+	 * @param key Key identifying duplicates within flow
+	 * @param t Item
+	 * @param replaced Set to the replaced item if t replaced one with the same key
+	 * @return True if t replaced an item, which the caller now owns
+	 */
+	inline bool post(const F &flow,const K &key,const T &t,T &replaced)
+	{
+		std::lock_guard<std::mutex> l(_m);
+		++_posted;
+		_Flow &f = _flows[flow];
+		typename std::unordered_map< K,typename std::list<_Item>::iterator >::iterator d(f.index.find(key));
+		if (d != f.index.end()) {
+			replaced = d->second->item;
+			d->second->item = t;
+			++_coalesced;
+			return true;
+		}
+		if (f.items.empty())
+			_ready.push_back(flow);
+		f.items.push_back(_Item(key,t,_now()));
+		f.index[key] = --f.items.end();
+		++_depth;
+		_c.notify_one();
+		return false;
+	}
+
+	/**
+	 * Stop queue, causing get() to return false in all waiting threads
+	 */
+	inline void stop()
+	{
+		std::lock_guard<std::mutex> l(_m);
+		_run = false;
+		_c.notify_all();
+	}
+
+	/**
+	 * Wait for and take the next item
+	 *
+	 * @param t Set to item
+	 * @return False if queue was stopped
+	 */
+	inline bool get(T &t)
+	{
+		std::unique_lock<std::mutex> l(_m);
+		for(;;) {
+			if (!_run)
+				return false;
+			if (!_ready.empty())
+				break;
+			_c.wait(l);
+		}
+
+		const F flow(_ready.front());
+		_ready.pop_front();
+		typename std::unordered_map<F,_Flow>::iterator f(_flows.find(flow));
+		_Item &i = f->second.items.front();
+		t = i.item;
+		const uint64_t waited = _now() - i.queued;
+		f->second.index.erase(i.key);
+		f->second.items.pop_front();
+		if (f->second.items.empty())
+			_flows.erase(f);
+		else _ready.push_back(flow);
+
+		--_depth;
+		++_served;
+		_totalWait += waited;
+		if (waited > _maxWait)
+			_maxWait = waited;
+		return true;
+	}
+
+	/**
+	 * @return Current queue statistics
+	 */
+	inline Stats stats()
+	{
+		std::lock_guard<std::mutex> l(_m);
+		Stats s;
+		s.depth = _depth;
+		s.flows = (unsigned long)_ready.size();
+		s.posted = _posted;
+		s.coalesced = _coalesced;
+		s.served = _served;
+		s.totalWait = _totalWait;
+		s.maxWait = _maxWait;
+		s.oldestWait = 0;
+		const uint64_t now = _now();
+		for(typename std::unordered_map<F,_Flow>::const_iterator f(_flows.begin());f!=_flows.end();++f) {
+			if ((!f->second.items.empty())&&((now - f->second.items.front().queued) > s.oldestWait))
+				s.oldestWait = now - f->second.items.front().queued;
+		}
+		return s;
+	}
+
+private:
+	struct _Item
+	{
+		_Item(const K &k,const T &t,const uint64_t q) : key(k),item(t),queued(q) {}
+		K key;
+		T item;
+		uint64_t queued;
+	};
+	struct _Flow
+	{
+		std::list<_Item> items;
+		std::unordered_map< K,typename std::list<_Item>::iterator > index;
+	};
+
+	static inline uint64_t _now() { return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+
+	bool _run;
+	std::unordered_map<F,_Flow> _flows;
+	std::deque<F> _ready; // flows with items waiting, in the order they will be served
+	unsigned long _depth;
+	uint64_t _posted;
+	uint64_t _coalesced;
+	uint64_t _served;
+	uint64_t _totalWait;
+	uint64_t _maxWait;
+	std::mutex _m;
+	std::condition_variable _c;
+};
+
+} // namespace ZeroTier
+
+#endif
@@ -37,6 +37,7 @@
 #include <sys/ioctl.h>
 #include <sys/wait.h>
 #include <sys/select.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <net/if_arp.h>
 #include <arpa/inet.h>
@@ -85,13 +86,13 @@ LinuxEthernetTap::LinuxEthernetTap(
 	uint64_t nwid,
 	const char *friendlyName,
 	void (*handler)(void *,void *,uint64_t,const MAC &,const MAC &,unsigned int,unsigned int,const void *,unsigned int),
-	void *arg) :
+	void *arg,
+	unsigned int queues) :
 	_handler(handler),
 	_arg(arg),
 	_nwid(nwid),
 	_homePath(homePath),
 	_mtu(mtu),
-	_fd(0),
 	_enabled(true)
 {
 	char procpath[128],nwids[32];
@@ -99,12 +100,17 @@ LinuxEthernetTap::LinuxEthernetTap(
 
 	OSUtils::ztsnprintf(nwids,sizeof(nwids),"%.16llx",nwid);
 
+	if (queues < 1)
+		queues = 1;
+	else if (queues > ZT_LINUX_TAP_MAX_QUEUES)
+		queues = ZT_LINUX_TAP_MAX_QUEUES;
+
 	Mutex::Lock _l(__tapCreateLock); // create only one tap at a time, globally
 
-	_fd = ::open("/dev/net/tun",O_RDWR);
-	if (_fd <= 0) {
-		_fd = ::open("/dev/tun",O_RDWR);
-		if (_fd <= 0)
+	int fd = ::open("/dev/net/tun",O_RDWR);
+	if (fd <= 0) {
+		fd = ::open("/dev/tun",O_RDWR);
+		if (fd <= 0)
 			throw std::runtime_error(std::string("could not open TUN/TAP device: ") + strerror(errno));
 	}
 
@@ -166,20 +172,37 @@ LinuxEthernetTap::LinuxEthernetTap(
 #endif
 	}
 
-	ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
-	if (ioctl(_fd,TUNSETIFF,(void *)&ifr) < 0) {
-		::close(_fd);
-		throw std::runtime_error("unable to configure TUN/TAP device for TAP operation");
+	short tapFlags = IFF_TAP | IFF_NO_PI;
+#ifdef IFF_MULTI_QUEUE
+	if (queues > 1)
+		tapFlags |= IFF_MULTI_QUEUE;
+#else
+	queues = 1;
+#endif
+	ifr.ifr_flags = tapFlags;
+	if (ioctl(fd,TUNSETIFF,(void *)&ifr) < 0) {
+		// Kernels older than 3.8 can't do multi-queue, so try again with just one queue
+		bool singleQueueOk = false;
+		if (queues > 1) {
+			queues = 1;
+			tapFlags = IFF_TAP | IFF_NO_PI;
+			ifr.ifr_flags = tapFlags;
+			singleQueueOk = (ioctl(fd,TUNSETIFF,(void *)&ifr) == 0);
+		}
+		if (!singleQueueOk) {
+			::close(fd);
+			throw std::runtime_error("unable to configure TUN/TAP device for TAP operation");
+		}
 	}
 
 	_dev = ifr.ifr_name;
 
-	::ioctl(_fd,TUNSETPERSIST,0); // valgrind may generate a false alarm here
+	::ioctl(fd,TUNSETPERSIST,0); // valgrind may generate a false alarm here
 
 	// Open an arbitrary socket to talk to netlink
 	int sock = socket(AF_INET,SOCK_DGRAM,0);
 	if (sock <= 0) {
-		::close(_fd);
+		::close(fd);
 		throw std::runtime_error("unable to open netlink socket");
 	}
 
@@ -187,7 +210,7 @@ LinuxEthernetTap::LinuxEthernetTap(
 	ifr.ifr_ifru.ifru_hwaddr.sa_family = ARPHRD_ETHER;
 	mac.copyTo(ifr.ifr_ifru.ifru_hwaddr.sa_data,6);
 	if (ioctl(sock,SIOCSIFHWADDR,(void *)&ifr) < 0) {
-		::close(_fd);
+		::close(fd);
 		::close(sock);
 		throw std::runtime_error("unable to configure TAP hardware (MAC) address");
 		return;
@@ -196,25 +219,25 @@ LinuxEthernetTap::LinuxEthernetTap(
 	// Set MTU
 	ifr.ifr_ifru.ifru_mtu = (int)mtu;
 	if (ioctl(sock,SIOCSIFMTU,(void *)&ifr) < 0) {
-		::close(_fd);
+		::close(fd);
 		::close(sock);
 		throw std::runtime_error("unable to configure TAP MTU");
 	}
 
-	if (fcntl(_fd,F_SETFL,fcntl(_fd,F_GETFL) & ~O_NONBLOCK) == -1) {
-		::close(_fd);
+	if (fcntl(fd,F_SETFL,fcntl(fd,F_GETFL) & ~O_NONBLOCK) == -1) {
+		::close(fd);
 		throw std::runtime_error("unable to set flags on file descriptor for TAP device");
 	}
 
 	/* Bring interface up */
 	if (ioctl(sock,SIOCGIFFLAGS,(void *)&ifr) < 0) {
-		::close(_fd);
+		::close(fd);
 		::close(sock);
 		throw std::runtime_error("unable to get TAP interface flags");
 	}
 	ifr.ifr_flags |= IFF_UP;
 	if (ioctl(sock,SIOCSIFFLAGS,(void *)&ifr) < 0) {
-		::close(_fd);
+		::close(fd);
 		::close(sock);
 		throw std::runtime_error("unable to set TAP interface flags");
 	}
@@ -222,7 +245,28 @@ LinuxEthernetTap::LinuxEthernetTap(
 	::close(sock);
 
 	// Set close-on-exec so that devices cannot persist if we fork/exec for update
-	::fcntl(_fd,F_SETFD,fcntl(_fd,F_GETFD) | FD_CLOEXEC);
+	::fcntl(fd,F_SETFD,fcntl(fd,F_GETFD) | FD_CLOEXEC);
+
+	_queues.push_back(_Queue());
+	_queues.back().fd = fd;
+
+	// Attach any additional queues to the device we just created
+	for(unsigned int q=1;q<queues;++q) {
+		const int qfd = ::open("/dev/net/tun",O_RDWR);
+		if (qfd <= 0)
+			break;
+		struct ifreq qifr;
+		memset(&qifr,0,sizeof(qifr));
+		Utils::scopy(qifr.ifr_name,sizeof(qifr.ifr_name),_dev.c_str());
+		qifr.ifr_flags = tapFlags;
+		if (ioctl(qfd,TUNSETIFF,(void *)&qifr) < 0) {
+			::close(qfd);
+			break;
+		}
+		::fcntl(qfd,F_SETFD,fcntl(qfd,F_GETFD) | FD_CLOEXEC);
+		_queues.push_back(_Queue());
+		_queues.back().fd = qfd;
+	}
 
 	(void)::pipe(_shutdownSignalPipe);
 
@@ -239,14 +283,19 @@ LinuxEthernetTap::LinuxEthernetTap(
 	}
 	*/
 
-	_thread = Thread::start(this);
+	for(std::vector<_Queue>::iterator q(_queues.begin());q!=_queues.end();++q) {
+		q->tap = this;
+		q->thread = Thread::start(&(*q));
+	}
 }
 
 LinuxEthernetTap::~LinuxEthernetTap()
 {
-	(void)::write(_shutdownSignalPipe[1],"\0",1); // causes thread to exit
-	Thread::join(_thread);
-	::close(_fd);
+	(void)::write(_shutdownSignalPipe[1],"\0",1); // causes all queue threads to exit
+	for(std::vector<_Queue>::iterator q(_queues.begin());q!=_queues.end();++q)
+		Thread::join(q->thread);
+	for(std::vector<_Queue>::iterator q(_queues.begin());q!=_queues.end();++q)
+		::close(q->fd);
 	::close(_shutdownSignalPipe[0]);
 	::close(_shutdownSignalPipe[1]);
 }
@@ -420,14 +469,19 @@ std::vector<InetAddress> LinuxEthernetTap::ips() const
 
 void LinuxEthernetTap::put(const MAC &from,const MAC &to,unsigned int etherType,const void *data,unsigned int len)
 {
-	char putBuf[ZT_MAX_MTU + 64];
-	if ((_fd > 0)&&(len <= _mtu)&&(_enabled)) {
-		to.copyTo(putBuf,6);
-		from.copyTo(putBuf + 6,6);
-		*((uint16_t *)(putBuf + 12)) = htons((uint16_t)etherType);
-		memcpy(putBuf + 14,data,len);
-		len += 14;
-		(void)::write(_fd,putBuf,len);
+	char hdr[14];
+	if ((len <= _mtu)&&(_enabled)) {
+		to.copyTo(hdr,6);
+		from.copyTo(hdr + 6,6);
+		*((uint16_t *)(hdr + 12)) = htons((uint16_t)etherType);
+		struct iovec iov[2];
+		iov[0].iov_base = (void *)hdr;
+		iov[0].iov_len = 14;
+		iov[1].iov_base = const_cast<void *>(data);
+		iov[1].iov_len = len;
+		// Pick queue by MAC pair so frames in the same flow are never reordered
+		const int fd = (_queues.size() > 1) ? _queues[(unsigned long)((from.toInt() ^ to.toInt()) % (uint64_t)_queues.size())].fd : _queues[0].fd;
+		(void)::writev(fd,iov,2);
 	}
 }
 
@@ -504,7 +558,7 @@ void LinuxEthernetTap::setMtu(unsigned int mtu)
 	}
 }
 
-void LinuxEthernetTap::threadMain()
+void LinuxEthernetTap::_queueMain(int fd)
 	throw()
 {
 	fd_set readfds,nullfds;
@@ -516,19 +570,19 @@ void LinuxEthernetTap::threadMain()
 
 	FD_ZERO(&readfds);
 	FD_ZERO(&nullfds);
-	nfds = (int)std::max(_shutdownSignalPipe[0],_fd) + 1;
+	nfds = (int)std::max(_shutdownSignalPipe[0],fd) + 1;
 
 	r = 0;
 	for(;;) {
 		FD_SET(_shutdownSignalPipe[0],&readfds);
-		FD_SET(_fd,&readfds);
+		FD_SET(fd,&readfds);
 		select(nfds,&readfds,&nullfds,&nullfds,(struct timeval *)0);
 
 		if (FD_ISSET(_shutdownSignalPipe[0],&readfds)) // writes to shutdown pipe terminate thread
 			break;
 
-		if (FD_ISSET(_fd,&readfds)) {
-			n = (int)::read(_fd,getBuf + r,sizeof(getBuf) - r);
+		if (FD_ISSET(fd,&readfds)) {
+			n = (int)::read(fd,getBuf + r,sizeof(getBuf) - r);
 			if (n < 0) {
 				if ((errno != EINTR)&&(errno != ETIMEDOUT))
 					break;
@@ -37,10 +37,18 @@
 #include "../node/MulticastGroup.hpp"
 #include "Thread.hpp"
 
+// Maximum number of queues (and reader threads) for a multi-queue tap device
+#define ZT_LINUX_TAP_MAX_QUEUES 16
+
 namespace ZeroTier {
 
 /**
  * Linux Ethernet tap using kernel tun/tap driver
+ *
+ * If more than one queue is requested and the kernel supports it, the device
+ * is opened with IFF_MULTI_QUEUE and each queue gets its own file descriptor
+ * and reader thread. Frames written with put() are spread across queues by
+ * source and destination MAC so that each flow stays in order.
  */
 class LinuxEthernetTap
 {
@@ -53,7 +61,8 @@ public:
 		uint64_t nwid,
 		const char *friendlyName,
 		void (*handler)(void *,void *,uint64_t,const MAC &,const MAC &,unsigned int,unsigned int,const void *,unsigned int),
-		void *arg);
+		void *arg,
+		unsigned int queues = 1);
 
 	~LinuxEthernetTap();
 
@@ -71,19 +80,36 @@ public:
 	void scanMulticastGroups(std::vector<MulticastGroup> &added,std::vector<MulticastGroup> &removed);
 	void setMtu(unsigned int mtu);
 
-	void threadMain()
-		throw();
+	/**
+	 * @return Number of queues actually opened (may be fewer than requested)
+	 */
+	inline unsigned int queueCount() const { return (unsigned int)_queues.size(); }
 
 private:
+	struct _Queue
+	{
+		LinuxEthernetTap *tap;
+		int fd;
+		Thread thread;
+
+		inline void threadMain()
+			throw()
+		{
+			tap->_queueMain(fd);
+		}
+	};
+
+	void _queueMain(int fd)
+		throw();
+
 	void (*_handler)(void *,void *,uint64_t,const MAC &,const MAC &,unsigned int,unsigned int,const void *,unsigned int);
 	void *_arg;
 	uint64_t _nwid;
-	Thread _thread;
 	std::string _homePath;
 	std::string _dev;
 	std::vector<MulticastGroup> _multicastGroups;
 	unsigned int _mtu;
-	int _fd;
+	std::vector<_Queue> _queues;
 	int _shutdownSignalPipe[2];
 	volatile bool _enabled;
 };
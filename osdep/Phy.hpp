@@ -32,6 +32,7 @@
 #include <string.h>
 
 #include <list>
+#include <vector>
 #include <stdexcept>
 
 #if defined(_WIN32) || defined(_WIN64)
@@ -67,13 +68,37 @@
 #ifndef IPV6_DONTFRAG
 #define IPV6_DONTFRAG 62
 #endif
+// Use edge-triggered epoll instead of select() on Linux unless told not to
+#ifndef ZT_PHY_NO_EPOLL
+#define ZT_PHY_USE_EPOLL 1
+#include <sys/epoll.h>
+#endif
+// Use recvmmsg() and sendmmsg() to move UDP packets in batches
+#ifndef ZT_PHY_NO_MMSG
+#define ZT_PHY_USE_MMSG 1
+#endif
 #endif
 
 #define ZT_PHY_SOCKFD_TYPE int
 #define ZT_PHY_SOCKFD_NULL (-1)
 #define ZT_PHY_SOCKFD_VALID(s) ((s) > -1)
 #define ZT_PHY_CLOSE_SOCKET(s) ::close(s)
+#ifdef ZT_PHY_USE_EPOLL
+#define ZT_PHY_MAX_SOCKETS 65536
+#define ZT_PHY_EPOLL_MAX_EVENTS 256
+#else
 #define ZT_PHY_MAX_SOCKETS (FD_SETSIZE)
+#endif
+#ifdef ZT_PHY_USE_MMSG
+// Datagrams read per recvmmsg() call and max size of each; slots hold the
+// largest possible UDP payload so nothing is truncated (untouched pages of
+// the slots are never faulted in, so this costs address space, not memory)
+#define ZT_PHY_UDP_RECV_BATCH_SIZE 32
+#define ZT_PHY_UDP_RECV_BATCH_BUF_SIZE 65536
+// Max datagrams and total bytes queued per socket for one sendmmsg() call
+#define ZT_PHY_UDP_SEND_BATCH_SIZE 64
+#define ZT_PHY_UDP_SEND_BATCH_BUF_SIZE 65536
+#endif
 #define ZT_PHY_MAX_INTERCEPTS ZT_PHY_MAX_SOCKETS
 #define ZT_PHY_SOCKADDR_STORAGE_TYPE struct sockaddr_storage
 
@@ -130,6 +155,14 @@ typedef void PhySocket;
  * handler, and in that case close() can be told not to call handlers to
  * prevent recursion.
  *
+ * On Linux an edge-triggered epoll() event engine is used by default, so
+ * the cost of poll() scales with the number of active sockets rather than
+ * with the total number of sockets. Define ZT_PHY_NO_EPOLL at build time to
+ * fall back to select(). UDP sockets are also read with recvmmsg() there,
+ * delivering each batch as consecutive phyOnDatagram() calls, and sends
+ * queued with udpSendBatched() from those handlers go out together via
+ * sendmmsg() at the end of poll(). Define ZT_PHY_NO_MMSG to disable this.
+ *
  * This isn't thread-safe with the exception of whack(), which is safe to
  * call from another thread to abort poll().
  */
@@ -152,21 +185,63 @@ private:
 		ZT_PHY_SOCKET_UNIX_LISTEN = 0x08
 	};
 
+#ifdef ZT_PHY_USE_MMSG
+	struct _UdpRecvBatch
+	{
+		struct mmsghdr msgs[ZT_PHY_UDP_RECV_BATCH_SIZE];
+		struct iovec iov[ZT_PHY_UDP_RECV_BATCH_SIZE];
+		struct sockaddr_storage from[ZT_PHY_UDP_RECV_BATCH_SIZE];
+		char data[ZT_PHY_UDP_RECV_BATCH_SIZE][ZT_PHY_UDP_RECV_BATCH_BUF_SIZE];
+	};
+
+	struct _UdpSendBatch
+	{
+		unsigned int count;
+		unsigned int used;
+		bool queued; // in _sendBatchQueue
+		bool blocked; // unsent tail is waiting for the socket to become writable
+		struct mmsghdr msgs[ZT_PHY_UDP_SEND_BATCH_SIZE];
+		struct iovec iov[ZT_PHY_UDP_SEND_BATCH_SIZE];
+		struct sockaddr_storage to[ZT_PHY_UDP_SEND_BATCH_SIZE];
+		char data[ZT_PHY_UDP_SEND_BATCH_BUF_SIZE];
+	};
+#endif
+
 	struct PhySocketImpl
 	{
 		PhySocketType type;
 		ZT_PHY_SOCKFD_TYPE sock;
 		void *uptr; // user-settable pointer
 		ZT_PHY_SOCKADDR_STORAGE_TYPE saddr; // remote for TCP_OUT and TCP_IN, local for TCP_LISTEN, RAW, and UDP
+#ifdef ZT_PHY_USE_EPOLL
+		bool notifyReadable;
+		bool notifyWritable;
+		bool readPending; // UDP socket left with unread datagrams, in _readPending
+#endif
+#ifdef ZT_PHY_USE_MMSG
+		_UdpSendBatch *sendBatch; // allocated on first udpSendBatched()
+#endif
 	};
 
 	std::list<PhySocketImpl> _socks;
+#ifdef ZT_PHY_USE_MMSG
+	_UdpRecvBatch *_recvBatch;
+	std::vector<PhySocketImpl *> _sendBatchQueue;
+	const void *_outerDispatch; // _dispatching() before this poll() began dispatching
+#endif
+
+#ifdef ZT_PHY_USE_EPOLL
+	int _epfd;
+	std::vector<PhySocketImpl *> _readPending;
+	bool _haveClosed;
+#else
 	fd_set _readfds;
 	fd_set _writefds;
 #if defined(_WIN32) || defined(_WIN64)
 	fd_set _exceptfds;
 #endif
 	long _nfds;
+#endif
 
 	ZT_PHY_SOCKFD_TYPE _whackReceiveSocket;
 	ZT_PHY_SOCKFD_TYPE _whackSendSocket;
@@ -183,8 +258,10 @@ public:
 	Phy(HANDLER_PTR_TYPE handler,bool noDelay,bool noCheck) :
 		_handler(handler)
 	{
+#ifndef ZT_PHY_USE_EPOLL
 		FD_ZERO(&_readfds);
 		FD_ZERO(&_writefds);
+#endif
 
 #if defined(_WIN32) || defined(_WIN64)
 		FD_ZERO(&_exceptfds);
@@ -220,11 +297,39 @@ public:
 			throw std::runtime_error("unable to create pipes for select() abort");
 #endif // Windows or not
 
+#ifdef ZT_PHY_USE_EPOLL
+		_epfd = ::epoll_create1(EPOLL_CLOEXEC);
+		if (_epfd < 0)
+			throw std::runtime_error("unable to create epoll instance");
+		{
+			// The whack pipe is level-triggered and identified by a NULL pointer
+			struct epoll_event ev;
+			memset(&ev,0,sizeof(ev));
+			ev.events = EPOLLIN;
+			ev.data.ptr = (void *)0;
+			if (::epoll_ctl(_epfd,EPOLL_CTL_ADD,pipes[0],&ev) != 0)
+				throw std::runtime_error("unable to add whack pipe to epoll instance");
+		}
+		_haveClosed = false;
+#else
 		_nfds = (pipes[0] > pipes[1]) ? (long)pipes[0] : (long)pipes[1];
+#endif
 		_whackReceiveSocket = pipes[0];
 		_whackSendSocket = pipes[1];
 		_noDelay = noDelay;
 		_noCheck = noCheck;
+
+#ifdef ZT_PHY_USE_MMSG
+		_recvBatch = new _UdpRecvBatch();
+		for(unsigned int i=0;i<ZT_PHY_UDP_RECV_BATCH_SIZE;++i) {
+			_recvBatch->iov[i].iov_base = _recvBatch->data[i];
+			_recvBatch->iov[i].iov_len = ZT_PHY_UDP_RECV_BATCH_BUF_SIZE;
+			_recvBatch->msgs[i].msg_hdr.msg_name = (void *)&(_recvBatch->from[i]);
+			_recvBatch->msgs[i].msg_hdr.msg_iov = &(_recvBatch->iov[i]);
+			_recvBatch->msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+		_outerDispatch = (const void *)0;
+#endif
 	}
 
 	~Phy()
@@ -235,6 +340,12 @@ public:
 		}
 		ZT_PHY_CLOSE_SOCKET(_whackReceiveSocket);
 		ZT_PHY_CLOSE_SOCKET(_whackSendSocket);
+#ifdef ZT_PHY_USE_EPOLL
+		::close(_epfd);
+#endif
+#ifdef ZT_PHY_USE_MMSG
+		delete _recvBatch;
+#endif
 	}
 
 	/**
@@ -305,14 +416,15 @@ public:
 			return (PhySocket *)0;
 		}
 		PhySocketImpl &sws = _socks.back();
-		if ((long)fd > _nfds)
-			_nfds = (long)fd;
-		FD_SET(fd,&_readfds);
 		sws.type = ZT_PHY_SOCKET_UNIX_IN; /* TODO: Type was changed to allow for CBs with new RPC model */
 		sws.sock = fd;
 		sws.uptr = uptr;
 		memset(&(sws.saddr),0,sizeof(struct sockaddr_storage));
 		// no sockaddr for this socket type, leave saddr null
+		if (!_watch(sws)) {
+			_socks.pop_back();
+			return (PhySocket *)0;
+		}
 		return (PhySocket *)&sws;
 	}
 
@@ -322,9 +434,10 @@ public:
 	 * @param localAddress Local endpoint address and port
 	 * @param uptr Initial value of user pointer associated with this socket (default: NULL)
 	 * @param bufferSize Desired socket receive/send buffer size -- will set as close to this as possible (default: 0, leave alone)
+	 * @param reusePort If true set SO_REUSEPORT (where supported) so several sockets can share this address (default: false)
 	 * @return Socket or NULL on failure to bind
 	 */
-	inline PhySocket *udpBind(const struct sockaddr *localAddress,void *uptr = (void *)0,int bufferSize = 0)
+	inline PhySocket *udpBind(const struct sockaddr *localAddress,void *uptr = (void *)0,int bufferSize = 0,bool reusePort = false)
 	{
 		if (_socks.size() >= ZT_PHY_MAX_SOCKETS)
 			return (PhySocket *)0;
@@ -374,6 +487,11 @@ public:
 			}
 			f = 0; setsockopt(s,SOL_SOCKET,SO_REUSEADDR,(void *)&f,sizeof(f));
 			f = 1; setsockopt(s,SOL_SOCKET,SO_BROADCAST,(void *)&f,sizeof(f));
+#ifdef SO_REUSEPORT
+			if (reusePort) {
+				f = 1; setsockopt(s,SOL_SOCKET,SO_REUSEPORT,(void *)&f,sizeof(f));
+			}
+#endif
 #ifdef IP_DONTFRAG
 			f = 0; setsockopt(s,IPPROTO_IP,IP_DONTFRAG,&f,sizeof(f));
 #endif
@@ -410,15 +528,18 @@ public:
 		}
 		PhySocketImpl &sws = _socks.back();
 
-		if ((long)s > _nfds)
-			_nfds = (long)s;
-		FD_SET(s,&_readfds);
 		sws.type = ZT_PHY_SOCKET_UDP;
 		sws.sock = s;
 		sws.uptr = uptr;
 		memset(&(sws.saddr),0,sizeof(struct sockaddr_storage));
 		memcpy(&(sws.saddr),localAddress,(localAddress->sa_family == AF_INET6) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
 
+		if (!_watch(sws)) {
+			_socks.pop_back();
+			ZT_PHY_CLOSE_SOCKET(s);
+			return (PhySocket *)0;
+		}
+
 		return (PhySocket *)&sws;
 	}
 
@@ -459,6 +580,72 @@ public:
 #endif
 	}
 
+	/**
+	 * Send a UDP packet, batching it with others sent from the same poll() if possible
+	 *
+	 * When called by a handler from within poll(), the packet is copied into
+	 * a per-socket queue that is sent with a single sendmmsg() when poll()
+	 * is done dispatching events (or when the queue fills). Called from any
+	 * other thread or context, or on platforms without sendmmsg(), this is
+	 * the same as udpSend(). Don't use this if socket options such as the
+	 * IP TTL are being changed for just this packet.
+	 *
+	 * @param sock UDP socket
+	 * @param remoteAddress Destination address (must be correct type for socket)
+	 * @param data Data to send
+	 * @param len Length of packet
+	 * @return True if packet was queued or appears to have been sent successfully
+	 */
+	inline bool udpSendBatched(PhySocket *sock,const struct sockaddr *remoteAddress,const void *data,unsigned long len)
+	{
+#ifdef ZT_PHY_USE_MMSG
+		// Only handlers running inside poll() may queue; anything else sends right away
+		if ((_dispatching() == (const void *)this)&&(len <= ZT_PHY_UDP_SEND_BATCH_BUF_SIZE)) {
+			PhySocketImpl &sws = *(reinterpret_cast<PhySocketImpl *>(sock));
+			if (sws.type != ZT_PHY_SOCKET_UDP)
+				return false;
+			if (!sws.sendBatch) {
+				try {
+					sws.sendBatch = new _UdpSendBatch();
+				} catch ( ... ) {
+					return udpSend(sock,remoteAddress,data,len);
+				}
+				sws.sendBatch->count = 0;
+				sws.sendBatch->used = 0;
+				sws.sendBatch->queued = false;
+				sws.sendBatch->blocked = false;
+			}
+			_UdpSendBatch &b = *(sws.sendBatch);
+
+			if ((b.count >= ZT_PHY_UDP_SEND_BATCH_SIZE)||((b.used + len) > ZT_PHY_UDP_SEND_BATCH_BUF_SIZE)) {
+				_flushUdpSendBatch(sws);
+				if ((b.count >= ZT_PHY_UDP_SEND_BATCH_SIZE)||((b.used + len) > ZT_PHY_UDP_SEND_BATCH_BUF_SIZE))
+					return false; // still backed up, so drop this one like a failed sendto()
+			}
+			if (!b.queued) {
+				_sendBatchQueue.push_back(&sws);
+				b.queued = true;
+			}
+
+			const unsigned int i = b.count++;
+			memcpy(b.data + b.used,data,len);
+			b.iov[i].iov_base = b.data + b.used;
+			b.iov[i].iov_len = len;
+			b.used += (unsigned int)len;
+			const socklen_t alen = (remoteAddress->sa_family == AF_INET6) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+			memcpy(&(b.to[i]),remoteAddress,alen);
+			memset(&(b.msgs[i]),0,sizeof(struct mmsghdr));
+			b.msgs[i].msg_hdr.msg_name = (void *)&(b.to[i]);
+			b.msgs[i].msg_hdr.msg_namelen = alen;
+			b.msgs[i].msg_hdr.msg_iov = &(b.iov[i]);
+			b.msgs[i].msg_hdr.msg_iovlen = 1;
+
+			return true;
+		}
+#endif
+		return udpSend(sock,remoteAddress,data,len);
+	}
+
 #ifdef __UNIX_LIKE__
 	/**
 	 * Listen for connections on a Unix domain socket
@@ -504,15 +691,18 @@ public:
 		}
 		PhySocketImpl &sws = _socks.back();
 
-		if ((long)s > _nfds)
-			_nfds = (long)s;
-		FD_SET(s,&_readfds);
 		sws.type = ZT_PHY_SOCKET_UNIX_LISTEN;
 		sws.sock = s;
 		sws.uptr = uptr;
 		memset(&(sws.saddr),0,sizeof(struct sockaddr_storage));
 		memcpy(&(sws.saddr),&sun,sizeof(struct sockaddr_un));
 
+		if (!_watch(sws)) {
+			_socks.pop_back();
+			ZT_PHY_CLOSE_SOCKET(s);
+			return (PhySocket *)0;
+		}
+
 		return (PhySocket *)&sws;
 	}
 #endif // __UNIX_LIKE__
@@ -570,15 +760,18 @@ public:
 		}
 		PhySocketImpl &sws = _socks.back();
 
-		if ((long)s > _nfds)
-			_nfds = (long)s;
-		FD_SET(s,&_readfds);
 		sws.type = ZT_PHY_SOCKET_TCP_LISTEN;
 		sws.sock = s;
 		sws.uptr = uptr;
 		memset(&(sws.saddr),0,sizeof(struct sockaddr_storage));
 		memcpy(&(sws.saddr),localAddress,(localAddress->sa_family == AF_INET6) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
 
+		if (!_watch(sws)) {
+			_socks.pop_back();
+			ZT_PHY_CLOSE_SOCKET(s);
+			return (PhySocket *)0;
+		}
+
 		return (PhySocket *)&sws;
 	}
 
@@ -655,23 +848,19 @@ public:
 		}
 		PhySocketImpl &sws = _socks.back();
 
-		if ((long)s > _nfds)
-			_nfds = (long)s;
-		if (connected) {
-			FD_SET(s,&_readfds);
-			sws.type = ZT_PHY_SOCKET_TCP_OUT_CONNECTED;
-		} else {
-			FD_SET(s,&_writefds);
-#if defined(_WIN32) || defined(_WIN64)
-			FD_SET(s,&_exceptfds);
-#endif
-			sws.type = ZT_PHY_SOCKET_TCP_OUT_PENDING;
-		}
+		sws.type = (connected) ? ZT_PHY_SOCKET_TCP_OUT_CONNECTED : ZT_PHY_SOCKET_TCP_OUT_PENDING;
 		sws.sock = s;
 		sws.uptr = uptr;
 		memset(&(sws.saddr),0,sizeof(struct sockaddr_storage));
 		memcpy(&(sws.saddr),remoteAddress,(remoteAddress->sa_family == AF_INET6) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
 
+		if (!_watch(sws)) {
+			_socks.pop_back();
+			ZT_PHY_CLOSE_SOCKET(s);
+			connected = false;
+			return (PhySocket *)0;
+		}
+
 		if ((callConnectHandler)&&(connected)) {
 			try {
 				_handler->phyOnTcpConnect((PhySocket *)&sws,&(sws.uptr),true);
@@ -819,11 +1008,18 @@ public:
 	inline void setNotifyWritable(PhySocket *sock,bool notifyWritable)
 	{
 		PhySocketImpl &sws = *(reinterpret_cast<PhySocketImpl *>(sock));
+#ifdef ZT_PHY_USE_EPOLL
+		// Re-arming also re-reports the socket if it is writable right now,
+		// which edge-triggered notification would otherwise not do.
+		sws.notifyWritable = notifyWritable;
+		_epollUpdate(sws);
+#else
 		if (notifyWritable) {
 			FD_SET(sws.sock,&_writefds);
 		} else {
 			FD_CLR(sws.sock,&_writefds);
 		}
+#endif
 	}
 
 	/**
@@ -839,11 +1035,16 @@ public:
 	inline void setNotifyReadable(PhySocket *sock,bool notifyReadable)
 	{
 		PhySocketImpl &sws = *(reinterpret_cast<PhySocketImpl *>(sock));
+#ifdef ZT_PHY_USE_EPOLL
+		sws.notifyReadable = notifyReadable;
+		_epollUpdate(sws);
+#else
 		if (notifyReadable) {
 			FD_SET(sws.sock,&_readfds);
 		} else {
 			FD_CLR(sws.sock,&_readfds);
 		}
+#endif
 	}
 
 	/**
@@ -855,6 +1056,123 @@ public:
 	 *
 	 * @param timeout Timeout in milliseconds or 0 for none (forever)
 	 */
+#ifdef ZT_PHY_USE_EPOLL
+	inline void poll(unsigned long timeout)
+	{
+		char buf[131072];
+		struct epoll_event events[ZT_PHY_EPOLL_MAX_EVENTS];
+
+		// If UDP sockets were left with unread data last time, don't wait
+		const int n = ::epoll_wait(_epfd,events,ZT_PHY_EPOLL_MAX_EVENTS,(!_readPending.empty()) ? 0 : ((timeout > 0) ? (int)((timeout > 0x7fffffffUL) ? 0x7fffffffUL : timeout) : -1));
+
+#ifdef ZT_PHY_USE_MMSG
+		_beginDispatch();
+#endif
+
+		if (!_readPending.empty()) {
+			std::vector<PhySocketImpl *> rp;
+			rp.swap(_readPending);
+			for(typename std::vector<PhySocketImpl *>::iterator s(rp.begin());s!=rp.end();++s) {
+				(*s)->readPending = false;
+				if ((*s)->type == ZT_PHY_SOCKET_UDP)
+					_epollReadUdp(**s,buf,sizeof(buf));
+			}
+		}
+
+		for(int i=0;i<n;++i) {
+			PhySocketImpl *const s = reinterpret_cast<PhySocketImpl *>(events[i].data.ptr);
+			if (!s) {
+				char tmp[16];
+				(void)::read(_whackReceiveSocket,tmp,16);
+				continue;
+			}
+			const uint32_t ev = events[i].events;
+
+			switch (s->type) {
+
+				case ZT_PHY_SOCKET_TCP_OUT_PENDING:
+					if ((ev & (EPOLLOUT|EPOLLERR|EPOLLHUP)) != 0) {
+						struct sockaddr_storage ss;
+						socklen_t slen = sizeof(ss);
+						if (::getpeername(s->sock,(struct sockaddr *)&ss,&slen) != 0) {
+							this->close((PhySocket *)s,true);
+						} else {
+							s->type = ZT_PHY_SOCKET_TCP_OUT_CONNECTED;
+							s->notifyReadable = true;
+							s->notifyWritable = false;
+							_epollUpdate(*s);
+							try {
+								_handler->phyOnTcpConnect((PhySocket *)s,&(s->uptr),true);
+							} catch ( ... ) {}
+						}
+					}
+					break;
+
+				case ZT_PHY_SOCKET_TCP_OUT_CONNECTED:
+				case ZT_PHY_SOCKET_TCP_IN:
+					if ((ev & (EPOLLIN|EPOLLERR|EPOLLHUP)) != 0)
+						_epollReadStream(*s,buf,sizeof(buf));
+					if (((ev & EPOLLOUT) != 0)&&(s->type != ZT_PHY_SOCKET_CLOSED)&&(s->notifyWritable)) {
+						try {
+							_handler->phyOnTcpWritable((PhySocket *)s,&(s->uptr));
+						} catch ( ... ) {}
+					}
+					break;
+
+				case ZT_PHY_SOCKET_TCP_LISTEN:
+				case ZT_PHY_SOCKET_UNIX_LISTEN:
+					if ((ev & EPOLLIN) != 0)
+						_epollAccept(*s);
+					break;
+
+				case ZT_PHY_SOCKET_UDP:
+#ifdef ZT_PHY_USE_MMSG
+					if ((ev & EPOLLOUT) != 0)
+						_udpWritable(*s);
+#endif
+					if ((ev & EPOLLIN) != 0)
+						_epollReadUdp(*s,buf,sizeof(buf));
+					break;
+
+				case ZT_PHY_SOCKET_UNIX_IN:
+#ifdef __UNIX_LIKE__
+					if (((ev & EPOLLOUT) != 0)&&(s->notifyWritable)) {
+						try {
+							_handler->phyOnUnixWritable((PhySocket *)s,&(s->uptr),false);
+						} catch ( ... ) {}
+					}
+					if (((ev & (EPOLLIN|EPOLLERR|EPOLLHUP)) != 0)&&(s->type != ZT_PHY_SOCKET_CLOSED)&&(s->notifyReadable))
+						_epollReadStream(*s,buf,sizeof(buf));
+#endif // __UNIX_LIKE__
+					break;
+
+				default:
+					break;
+
+			}
+		}
+
+#ifdef ZT_PHY_USE_MMSG
+		_endDispatch();
+#endif
+
+		// Sockets closed above or since the last poll() may still have had events
+		// pending in this batch, so they are only freed here.
+		if (_haveClosed) {
+			_haveClosed = false;
+			for(typename std::vector<PhySocketImpl *>::iterator s(_readPending.begin());s!=_readPending.end();) {
+				if ((*s)->type == ZT_PHY_SOCKET_CLOSED)
+					s = _readPending.erase(s);
+				else ++s;
+			}
+			for(typename std::list<PhySocketImpl>::iterator s(_socks.begin());s!=_socks.end();) {
+				if (s->type == ZT_PHY_SOCKET_CLOSED)
+					_socks.erase(s++);
+				else ++s;
+			}
+		}
+	}
+#else // select()
 	inline void poll(unsigned long timeout)
 	{
 		char buf[131072];
@@ -875,6 +1193,10 @@ public:
 		if (::select((int)_nfds + 1,&rfds,&wfds,&efds,(timeout > 0) ? &tv : (struct timeval *)0) <= 0)
 			return;
 
+#ifdef ZT_PHY_USE_MMSG
+		_beginDispatch();
+#endif
+
 		if (FD_ISSET(_whackReceiveSocket,&rfds)) {
 			char tmp[16];
 #if defined(_WIN32) || defined(_WIN64)
@@ -965,19 +1287,12 @@ public:
 					break;
 
 				case ZT_PHY_SOCKET_UDP:
-					if (FD_ISSET(s->sock,&rfds)) {
-						for(int k=0;k<1024;++k) {
-							memset(&ss,0,sizeof(ss));
-							socklen_t slen = sizeof(ss);
-							long n = (long)::recvfrom(s->sock,buf,sizeof(buf),0,(struct sockaddr *)&ss,&slen);
-							if (n > 0) {
-								try {
-									_handler->phyOnDatagram((PhySocket *)&(*s),&(s->uptr),(const struct sockaddr *)&(s->saddr),(const struct sockaddr *)&ss,(void *)buf,(unsigned long)n);
-								} catch ( ... ) {}
-							} else if (n < 0)
-								break;
-						}
-					}
+#ifdef ZT_PHY_USE_MMSG
+					if (FD_ISSET(s->sock,&wfds))
+						_udpWritable(*s);
+#endif
+					if (FD_ISSET(s->sock,&rfds))
+						_udpReceive(*s,buf,sizeof(buf));
 					break;
 
 				case ZT_PHY_SOCKET_UNIX_IN: {
@@ -1050,7 +1365,12 @@ public:
 				_socks.erase(s++);
 			else ++s;
 		}
+
+#ifdef ZT_PHY_USE_MMSG
+		_endDispatch();
+#endif
 	}
+#endif // ZT_PHY_USE_EPOLL or select()
 
 	/**
 	 * @param sock Socket to close
@@ -1064,10 +1384,18 @@ public:
 		if (sws.type == ZT_PHY_SOCKET_CLOSED)
 			return;
 
+#ifdef ZT_PHY_USE_EPOLL
+		{
+			struct epoll_event ev; // non-NULL for pre-2.6.9 kernels
+			memset(&ev,0,sizeof(ev));
+			::epoll_ctl(_epfd,EPOLL_CTL_DEL,sws.sock,&ev);
+		}
+#else
 		FD_CLR(sws.sock,&_readfds);
 		FD_CLR(sws.sock,&_writefds);
 #if defined(_WIN32) || defined(_WIN64)
 		FD_CLR(sws.sock,&_exceptfds);
+#endif
 #endif
 
 		if (sws.type != ZT_PHY_SOCKET_FD)
@@ -1103,9 +1431,27 @@ public:
 			}
 		}
 
+#ifdef ZT_PHY_USE_MMSG
+		if (sws.sendBatch) {
+			if (sws.sendBatch->queued) {
+				for(typename std::vector<PhySocketImpl *>::iterator q(_sendBatchQueue.begin());q!=_sendBatchQueue.end();++q) {
+					if (*q == &sws) {
+						_sendBatchQueue.erase(q);
+						break;
+					}
+				}
+			}
+			delete sws.sendBatch;
+			sws.sendBatch = (_UdpSendBatch *)0;
+		}
+#endif
+
 		// Causes entry to be deleted from list in poll(), ignored elsewhere
 		sws.type = ZT_PHY_SOCKET_CLOSED;
 
+#ifdef ZT_PHY_USE_EPOLL
+		_haveClosed = true;
+#else
 		if ((long)sws.sock >= (long)_nfds) {
 			long nfds = (long)_whackSendSocket;
 			if ((long)_whackReceiveSocket > nfds)
@@ -1116,7 +1462,312 @@ public:
 			}
 			_nfds = nfds;
 		}
+#endif
+	}
+
+private:
+	// Reads at most about 1024 datagrams so one busy socket can't starve the
+	// rest, returning true if that limit was reached (more may be waiting).
+	inline bool _udpReceive(PhySocketImpl &s,char *buf,unsigned long bufSize)
+	{
+#ifdef ZT_PHY_USE_MMSG
+		_UdpRecvBatch &rb = *_recvBatch;
+		for(int k=0;k<(1024 / ZT_PHY_UDP_RECV_BATCH_SIZE);++k) {
+			memset(rb.from,0,sizeof(rb.from));
+			for(unsigned int i=0;i<ZT_PHY_UDP_RECV_BATCH_SIZE;++i) {
+				rb.msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+				rb.msgs[i].msg_hdr.msg_control = (void *)0;
+				rb.msgs[i].msg_hdr.msg_controllen = 0;
+				rb.msgs[i].msg_hdr.msg_flags = 0;
+				rb.msgs[i].msg_len = 0;
+			}
+			const int n = ::recvmmsg(s.sock,rb.msgs,ZT_PHY_UDP_RECV_BATCH_SIZE,0,(struct timespec *)0);
+			if (n <= 0) {
+				if ((n < 0)&&(errno == EINTR))
+					continue;
+				return false;
+			}
+			for(int i=0;i<n;++i) {
+				if ((rb.msgs[i].msg_len > 0)&&((rb.msgs[i].msg_hdr.msg_flags & MSG_TRUNC) == 0)) {
+					try {
+						_handler->phyOnDatagram((PhySocket *)&s,&(s.uptr),(const struct sockaddr *)&(s.saddr),(const struct sockaddr *)&(rb.from[i]),(void *)rb.data[i],(unsigned long)rb.msgs[i].msg_len);
+					} catch ( ... ) {}
+					if (s.type == ZT_PHY_SOCKET_CLOSED)
+						return false;
+				}
+			}
+			if (n < ZT_PHY_UDP_RECV_BATCH_SIZE)
+				return false;
+		}
+		return true;
+#else
+		struct sockaddr_storage ss;
+		for(int k=0;k<1024;++k) {
+			memset(&ss,0,sizeof(ss));
+			socklen_t slen = sizeof(ss);
+			long n = (long)::recvfrom(s.sock,buf,bufSize,0,(struct sockaddr *)&ss,&slen);
+			if (n > 0) {
+				try {
+					_handler->phyOnDatagram((PhySocket *)&s,&(s.uptr),(const struct sockaddr *)&(s.saddr),(const struct sockaddr *)&ss,(void *)buf,(unsigned long)n);
+				} catch ( ... ) {}
+				if (s.type == ZT_PHY_SOCKET_CLOSED)
+					return false;
+			} else if (n < 0) {
+#ifdef EINTR
+				if (errno == EINTR)
+					continue;
+#endif
+				return false;
+			}
+		}
+		return true;
+#endif
+	}
+
+#ifdef ZT_PHY_USE_MMSG
+	// The Phy (if any) whose poll() is dispatching to handlers on this thread.
+	// Being thread-local, it is never read by any thread but its writer.
+	static inline const void *&_dispatching()
+	{
+		static thread_local const void *d = (const void *)0;
+		return d;
+	}
+
+	inline void _beginDispatch()
+	{
+		_outerDispatch = _dispatching();
+		_dispatching() = (const void *)this;
+	}
+
+	inline void _endDispatch()
+	{
+		_dispatching() = _outerDispatch;
+		for(typename std::vector<PhySocketImpl *>::iterator q(_sendBatchQueue.begin());q!=_sendBatchQueue.end();++q) {
+			(*q)->sendBatch->queued = false;
+			if (!(*q)->sendBatch->blocked) // otherwise sent when the socket is writable
+				_flushUdpSendBatch(**q);
+		}
+		_sendBatchQueue.clear();
+	}
+
+	// Datagrams the kernel refuses outright are dropped like a failed sendto().
+	// If the socket would block, the unsent tail is kept and sent once the
+	// socket becomes writable.
+	inline void _flushUdpSendBatch(PhySocketImpl &sws)
+	{
+		_UdpSendBatch &b = *(sws.sendBatch);
+		unsigned int i = 0;
+		bool wouldBlock = false;
+		while (i < b.count) {
+			const int n = ::sendmmsg(sws.sock,b.msgs + i,b.count - i,0);
+			if (n > 0) {
+				i += (unsigned int)n;
+			} else if ((n < 0)&&(errno == EINTR)) {
+				continue;
+			} else if ((n < 0)&&((errno == EAGAIN)||(errno == EWOULDBLOCK)||(errno == ENOBUFS))) {
+				wouldBlock = true;
+				break;
+			} else if (n < 0) {
+				++i; // skip a datagram the kernel refused outright (e.g. unreachable) and keep going
+			} else {
+				break;
+			}
+		}
+
+		if ((wouldBlock)&&(i < b.count)) {
+			// Move the tail to the front. Its payloads stay where they are in
+			// b.data, so only the headers and addresses are moved.
+			const unsigned int rem = b.count - i;
+			if (i > 0) {
+				memmove(b.iov,b.iov + i,sizeof(struct iovec) * rem);
+				memmove(b.to,b.to + i,sizeof(struct sockaddr_storage) * rem);
+				memmove(b.msgs,b.msgs + i,sizeof(struct mmsghdr) * rem);
+				for(unsigned int k=0;k<rem;++k) {
+					b.msgs[k].msg_hdr.msg_name = (void *)&(b.to[k]);
+					b.msgs[k].msg_hdr.msg_iov = &(b.iov[k]);
+				}
+			}
+			b.count = rem;
+			if (!b.blocked) {
+				b.blocked = true;
+				_watchUdpWritable(sws,true);
+			}
+		} else {
+			b.count = 0;
+			b.used = 0;
+			if (b.blocked) {
+				b.blocked = false;
+				_watchUdpWritable(sws,false);
+			}
+		}
+	}
+
+	// Called when a UDP socket with a blocked send batch becomes writable
+	inline void _udpWritable(PhySocketImpl &sws)
+	{
+		if ((sws.sendBatch)&&(sws.sendBatch->blocked))
+			_flushUdpSendBatch(sws);
+	}
+
+	inline void _watchUdpWritable(PhySocketImpl &sws,bool watch)
+	{
+#ifdef ZT_PHY_USE_EPOLL
+		(void)watch;
+		_epollUpdate(sws);
+#else
+		if (watch)
+			FD_SET(sws.sock,&_writefds);
+		else FD_CLR(sws.sock,&_writefds);
+#endif
+	}
+#endif
+
+	// Add a socket whose type and descriptor are set to the poll set
+	inline bool _watch(PhySocketImpl &sws)
+	{
+#ifdef ZT_PHY_USE_EPOLL
+		sws.notifyReadable = true;
+		sws.notifyWritable = false;
+		sws.readPending = false;
+		struct epoll_event ev;
+		memset(&ev,0,sizeof(ev));
+		ev.events = _epollEvents(sws);
+		ev.data.ptr = (void *)&sws;
+		return (::epoll_ctl(_epfd,EPOLL_CTL_ADD,sws.sock,&ev) == 0);
+#else
+		if ((long)sws.sock > _nfds)
+			_nfds = (long)sws.sock;
+		if (sws.type == ZT_PHY_SOCKET_TCP_OUT_PENDING) {
+			FD_SET(sws.sock,&_writefds);
+#if defined(_WIN32) || defined(_WIN64)
+			FD_SET(sws.sock,&_exceptfds);
+#endif
+		} else {
+			FD_SET(sws.sock,&_readfds);
+		}
+		return true;
+#endif
+	}
+
+#ifdef ZT_PHY_USE_EPOLL
+	static inline uint32_t _epollEvents(const PhySocketImpl &sws)
+	{
+		if (sws.type == ZT_PHY_SOCKET_TCP_OUT_PENDING)
+			return (uint32_t)(EPOLLOUT | EPOLLET);
+		uint32_t e = (uint32_t)EPOLLET;
+		if (sws.notifyReadable)
+			e |= (uint32_t)EPOLLIN;
+		if (sws.notifyWritable)
+			e |= (uint32_t)EPOLLOUT;
+#ifdef ZT_PHY_USE_MMSG
+		if ((sws.sendBatch)&&(sws.sendBatch->blocked))
+			e |= (uint32_t)EPOLLOUT;
+#endif
+		return e;
+	}
+
+	inline void _epollUpdate(PhySocketImpl &sws)
+	{
+		if (sws.type == ZT_PHY_SOCKET_CLOSED)
+			return;
+		struct epoll_event ev;
+		memset(&ev,0,sizeof(ev));
+		ev.events = _epollEvents(sws);
+		ev.data.ptr = (void *)&sws;
+		::epoll_ctl(_epfd,EPOLL_CTL_MOD,sws.sock,&ev);
+	}
+
+	// Edge-triggered: read until the socket would block, reaches EOF, or the
+	// handler closes or pauses it. A short read is not a stopping point, since
+	// data and FIN arriving together produce one edge and the EOF must still
+	// be read to close the socket.
+	inline void _epollReadStream(PhySocketImpl &s,char *buf,unsigned long bufSize)
+	{
+		const ZT_PHY_SOCKFD_TYPE sock = s.sock;
+		for(;;) {
+			const long n = (s.type == ZT_PHY_SOCKET_UNIX_IN) ? (long)::read(sock,buf,bufSize) : (long)::recv(sock,buf,bufSize,0);
+			if (n > 0) {
+				try {
+					if (s.type == ZT_PHY_SOCKET_UNIX_IN) {
+#ifdef __UNIX_LIKE__
+						_handler->phyOnUnixData((PhySocket *)&s,&(s.uptr),(void *)buf,(unsigned long)n);
+#endif
+					} else {
+						_handler->phyOnTcpData((PhySocket *)&s,&(s.uptr),(void *)buf,(unsigned long)n);
+					}
+				} catch ( ... ) {}
+				if ((s.type == ZT_PHY_SOCKET_CLOSED)||(!s.notifyReadable))
+					return;
+			} else if ((n < 0)&&((errno == EAGAIN)||(errno == EWOULDBLOCK))) {
+				return;
+			} else if ((n < 0)&&(errno == EINTR)) {
+				continue;
+			} else {
+				this->close((PhySocket *)&s,true);
+				return;
+			}
+		}
+	}
+
+	// A socket with more datagrams waiting than _udpReceive() will read at once
+	// is picked up again on the next poll().
+	inline void _epollReadUdp(PhySocketImpl &s,char *buf,unsigned long bufSize)
+	{
+		if ((_udpReceive(s,buf,bufSize))&&(!s.readPending)) {
+			s.readPending = true;
+			_readPending.push_back(&s);
+		}
+	}
+
+	inline void _epollAccept(PhySocketImpl &ls)
+	{
+		struct sockaddr_storage ss;
+		for(;;) {
+			memset(&ss,0,sizeof(ss));
+			socklen_t slen = sizeof(ss);
+			ZT_PHY_SOCKFD_TYPE newSock = ::accept(ls.sock,(struct sockaddr *)&ss,&slen);
+			if (!ZT_PHY_SOCKFD_VALID(newSock)) {
+				if (errno == EINTR)
+					continue;
+				return;
+			}
+			if (_socks.size() >= ZT_PHY_MAX_SOCKETS) {
+				ZT_PHY_CLOSE_SOCKET(newSock);
+				continue;
+			}
+
+			if (ls.type == ZT_PHY_SOCKET_TCP_LISTEN) {
+				int f = (_noDelay ? 1 : 0); setsockopt(newSock,IPPROTO_TCP,TCP_NODELAY,(char *)&f,sizeof(f));
+			}
+			fcntl(newSock,F_SETFL,O_NONBLOCK);
+
+			try {
+				_socks.push_back(PhySocketImpl());
+			} catch ( ... ) {
+				ZT_PHY_CLOSE_SOCKET(newSock);
+				continue;
+			}
+			PhySocketImpl &sws = _socks.back();
+			sws.type = (ls.type == ZT_PHY_SOCKET_TCP_LISTEN) ? ZT_PHY_SOCKET_TCP_IN : ZT_PHY_SOCKET_UNIX_IN;
+			sws.sock = newSock;
+			sws.uptr = (void *)0;
+			memcpy(&(sws.saddr),&ss,sizeof(struct sockaddr_storage));
+			if (!_watch(sws)) {
+				_socks.pop_back();
+				ZT_PHY_CLOSE_SOCKET(newSock);
+				continue;
+			}
+
+			if (sws.type == ZT_PHY_SOCKET_TCP_IN) {
+				try {
+					_handler->phyOnTcpAccept((PhySocket *)&ls,(PhySocket *)&sws,&(ls.uptr),&(sws.uptr),(const struct sockaddr *)&(sws.saddr));
+				} catch ( ... ) {}
+			}
+			if (ls.type == ZT_PHY_SOCKET_CLOSED)
+				return;
+		}
 	}
+#endif // ZT_PHY_USE_EPOLL
 };
 
 } // namespace ZeroTier
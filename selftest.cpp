@@ -30,10 +30,13 @@
 #include <time.h>
 
 #include <stdexcept>
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <vector>
 #include <thread>
+#include <map>
+#include <atomic>
 
 #include "node/Constants.hpp"
 #include "node/Hashtable.hpp"
@@ -54,8 +57,22 @@
 #include "node/CertificateOfMembership.hpp"
 #include "node/Node.hpp"
 #include "node/IncomingPacket.hpp"
+#include "node/RuleProgram.hpp"
+#include "node/SignatureCache.hpp"
+#include "node/Switch.hpp"
+#include "node/Path.hpp"
+#include "node/Trace.hpp"
+#include "node/ConcurrentHashtable.hpp"
+#include "node/Mutex.hpp"
+
+#include "controller/EmbeddedNetworkController.hpp"
+#include "controller/IpIndex.hpp"
+
+#include "service/PeerStore.hpp"
+#include "service/OneService.hpp"
 
 #include "osdep/OSUtils.hpp"
+#include "osdep/FairQueue.hpp"
 #include "osdep/Phy.hpp"
 #include "osdep/PortMapper.hpp"
 #include "osdep/Thread.hpp"
@@ -147,6 +164,39 @@ static const C25519TestVector C25519_TEST_VECTORS[ZT_NUM_C25519_TEST_VECTORS] =
 
 //////////////////////////////////////////////////////////////////////////////
 
+// r = a * b mod L for a of alen bytes and b < L, little-endian, used to forge Ed25519 edge cases
+static void _ed25519MulModL(unsigned char r[32],const unsigned char *a,unsigned int alen,const unsigned char b[32])
+{
+	static const unsigned char L[32] = { 0xed,0xd3,0xf5,0x5c,0x1a,0x63,0x12,0x58,0xd6,0x9c,0xf7,0xa2,0xde,0xf9,0xde,0x14,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x10 };
+	unsigned char t[32];
+	memset(r,0,32);
+	for(unsigned int bit=alen*8;bit-->0;) {
+		for(unsigned int add=0;add<2;++add) {
+			if (add) {
+				if (((a[bit / 8] >> (bit % 8)) & 1) == 0)
+					break;
+				memcpy(t,b,32);
+			} else memcpy(t,r,32);
+			unsigned int c = 0;
+			for(unsigned int i=0;i<32;++i) {
+				c += (unsigned int)r[i] + (unsigned int)t[i];
+				r[i] = (unsigned char)c;
+				c >>= 8;
+			}
+			unsigned int i = 32;
+			while ((i--)&&(r[i] == L[i])) {}
+			if ((i > 31)||(r[i] > L[i])) {
+				int borrow = 0;
+				for(i=0;i<32;++i) {
+					const int v = (int)r[i] - (int)L[i] - borrow;
+					borrow = (v < 0) ? 1 : 0;
+					r[i] = (unsigned char)v;
+				}
+			}
+		}
+	}
+}
+
 static int testCrypto()
 {
 	static unsigned char buf1[16384];
@@ -190,6 +240,25 @@ static int testCrypto()
 		std::cout << "FAIL (test vector 1)" << std::endl;
 		return -1;
 	}
+	for(unsigned int i=0;i<64;++i) {
+		// Multi-block vector kernels must match crypting one block at a time
+		const unsigned int skip = (unsigned int)(rand() % 8) * 64;
+		const unsigned int len = (unsigned int)(rand() % 4096);
+		for(unsigned int k=0;k<len;++k)
+			buf1[k] = (unsigned char)rand();
+		Salsa20::limitVectorBlocks((i & 1) ? 8 : 16);
+		Salsa20 s20a(s2012TV0Key,s2012TV0Iv),s20b(s2012TV0Key,s2012TV0Iv);
+		s20a.crypt12(buf3,buf2,skip);
+		s20b.crypt12(buf3,buf2,skip);
+		s20a.crypt12(buf1,buf2,len);
+		for(unsigned int k=0;k<len;k+=64)
+			s20b.crypt12(buf1 + k,buf3 + k,std::min(len - k,64U));
+		if (memcmp(buf2,buf3,len)) {
+			std::cout << "FAIL (vector kernel mismatch at length " << len << ")" << std::endl;
+			return -1;
+		}
+	}
+	Salsa20::limitVectorBlocks(16);
 	std::cout << "PASS" << std::endl;
 
 #ifdef ZT_SALSA20_SSE
@@ -198,8 +267,11 @@ static int testCrypto()
 	std::cout << "[crypto] Salsa20 SSE: DISABLED" << std::endl;
 #endif
 
-	std::cout << "[crypto] Benchmarking Salsa20/12... "; std::cout.flush();
-	{
+	for(unsigned int vb=0;vb<=16;vb+=8) {
+		Salsa20::limitVectorBlocks(vb);
+		if (Salsa20::vectorBlocks() != vb)
+			continue;
+		std::cout << "[crypto] Benchmarking Salsa20/12" << ((vb == 16) ? " (AVX-512)" : ((vb == 8) ? " (AVX2)" : "")) << "... "; std::cout.flush();
 		unsigned char *bb = (unsigned char *)::malloc(1234567);
 		for(unsigned int i=0;i<1234567;++i)
 			bb[i] = (unsigned char)i;
@@ -215,6 +287,7 @@ static int testCrypto()
 		std::cout << ((bytes / 1048576.0) / ((long double)(end - start) / 1024.0)) << " MiB/second (" << Utils::hex(buf1,16,hexbuf) << ')' << std::endl;
 		::free((void *)bb);
 	}
+	Salsa20::limitVectorBlocks(16);
 
 #ifdef ZT_USE_X64_ASM_SALSA2012
 	std::cout << "[crypto] Benchmarking Salsa20/12 fast x64 ASM... "; std::cout.flush();
@@ -428,6 +501,474 @@ static int testCrypto()
 	et = OSUtils::now();
 	std::cout << ((double)(et - st) / 50.0) << "ms per signature." << std::endl;
 
+	std::cout << "[crypto] Testing Ed25519 batch signing... "; std::cout.flush();
+	{
+		C25519::SigningKey sk;
+		C25519::expand(didntSign.priv,didntSign.pub,sk);
+		const unsigned int n = ZT_C25519_SIGN_BATCH_MAX + 5;
+		std::vector<C25519::Signature> sigs(n);
+		std::vector< std::vector<unsigned char> > msgs(n);
+		std::vector<const void *> mp(n);
+		std::vector<unsigned int> lp(n);
+		std::vector<void *> sp(n);
+		for(unsigned int i=0;i<n;++i) {
+			msgs[i].resize(1 + (rand() % 256));
+			for(unsigned int k=0;k<msgs[i].size();++k)
+				msgs[i][k] = (unsigned char)rand();
+			mp[i] = msgs[i].data();
+			lp[i] = (unsigned int)msgs[i].size();
+			sp[i] = sigs[i].data;
+		}
+		// Each test vector's known signature must come out of a batch unchanged wherever it lands in it
+		for(int k=0;k<ZT_NUM_C25519_TEST_VECTORS;++k) {
+			C25519::Pair kp;
+			memcpy(kp.pub.data,C25519_TEST_VECTORS[k].pub1,ZT_C25519_PUBLIC_KEY_LEN);
+			memcpy(kp.priv.data,C25519_TEST_VECTORS[k].priv1,ZT_C25519_PRIVATE_KEY_LEN);
+			C25519::SigningKey ksk;
+			C25519::expand(kp.priv,kp.pub,ksk);
+			const unsigned int at = ((unsigned int)k * 7) % n;
+			mp[at] = C25519_TEST_VECTORS[k].agreement;
+			lp[at] = 64;
+			C25519::signBatch(ksk,mp.data(),lp.data(),sp.data(),n);
+			if (memcmp(sigs[at].data,C25519_TEST_VECTORS[k].agreementSignedBy1,64)) {
+				std::cout << "FAIL (1 " << k << ")" << std::endl;
+				return -1;
+			}
+			for(unsigned int i=0;i<n;++i) {
+				if ((k == 0)||(i == 0)||(i == (n - 1))) {
+					if (!C25519::verify(kp.pub,mp[i],lp[i],sigs[i])) {
+						std::cout << "FAIL (2 " << i << ")" << std::endl;
+						return -1;
+					}
+				}
+			}
+			mp[at] = msgs[at].data();
+			lp[at] = (unsigned int)msgs[at].size();
+		}
+		std::cout << "PASS" << std::endl;
+
+		std::cout << "[crypto] Benchmarking Ed25519 batch signing... "; std::cout.flush();
+		st = OSUtils::now();
+		for(unsigned int k=0;k<10;++k) {
+			for(unsigned int i=0;i<n;++i)
+				C25519::sign(didntSign.priv,didntSign.pub,mp[i],lp[i],sp[i]);
+		}
+		et = OSUtils::now();
+		const double single = (double)(et - st) / (double)(n * 10);
+		st = OSUtils::now();
+		for(unsigned int k=0;k<10;++k)
+			C25519::signBatch(sk,mp.data(),lp.data(),sp.data(),n);
+		et = OSUtils::now();
+		std::cout << single << "ms individually, " << ((double)(et - st) / (double)(n * 10)) << "ms batched per signature" << std::endl;
+	}
+
+	std::cout << "[crypto] Testing Ed25519 batch verification... "; std::cout.flush();
+	{
+		C25519::Pair bk[4];
+		for(unsigned int k=0;k<4;++k)
+			bk[k] = C25519::generate();
+		const unsigned int n = ZT_C25519_VERIFY_BATCH_MAX + 9;
+		std::vector<C25519::Public> pubs(n);
+		std::vector<C25519::Signature> sigs(n);
+		std::vector< std::vector<unsigned char> > msgs(n);
+		std::vector<const C25519::Public *> pp(n);
+		std::vector<const void *> mp(n),sp(n);
+		std::vector<unsigned int> lp(n);
+		bool ok[n];
+		for(unsigned int i=0;i<n;++i) {
+			const C25519::Pair &kp = bk[((i % 5) == 0) ? (i % 4) : 0]; // mostly one signer, like a controller
+			msgs[i].resize(1 + (rand() % 256));
+			for(unsigned int k=0;k<msgs[i].size();++k)
+				msgs[i][k] = (unsigned char)rand();
+			pubs[i] = kp.pub;
+			sigs[i] = C25519::sign(kp,msgs[i].data(),(unsigned int)msgs[i].size());
+			pp[i] = &(pubs[i]);
+			mp[i] = msgs[i].data();
+			lp[i] = (unsigned int)msgs[i].size();
+			sp[i] = sigs[i].data;
+		}
+		if (!C25519::verifyBatch(pp.data(),mp.data(),lp.data(),sp.data(),ok,n)) {
+			std::cout << "FAIL (1)" << std::endl;
+			return -1;
+		}
+		for(unsigned int i=0;i<n;++i) {
+			if (!ok[i]) {
+				std::cout << "FAIL (2)" << std::endl;
+				return -1;
+			}
+		}
+		sigs[3].data[rand() % 32] ^= 0x01; // R
+		sigs[n - 2].data[32 + (rand() % 32)] ^= 0x10; // s
+		++msgs[17][0];
+		pubs[20] = bk[3].pub;
+		if (C25519::verifyBatch(pp.data(),mp.data(),lp.data(),sp.data(),ok,n)) {
+			std::cout << "FAIL (3)" << std::endl;
+			return -1;
+		}
+		for(unsigned int i=0;i<n;++i) {
+			if (ok[i] != C25519::verify(pubs[i],mp[i],lp[i],sigs[i])) {
+				std::cout << "FAIL (4 " << i << ")" << std::endl;
+				return -1;
+			}
+		}
+		if ((ok[3])||(ok[n - 2])||(ok[17])||(ok[20])) {
+			std::cout << "FAIL (5)" << std::endl;
+			return -1;
+		}
+
+		sigs[3] = C25519::sign(bk[0],msgs[3].data(),lp[3]);
+		sigs[n - 2] = C25519::sign(bk[(((n - 2) % 5) == 0) ? ((n - 2) % 4) : 0],msgs[n - 2].data(),lp[n - 2]);
+		--msgs[17][0];
+		pubs[20] = bk[0].pub;
+
+		// R = identity encoded with the sign bit set and s = h*a: the points add up but verify() rejects the encoding
+		const C25519::Signature sig6(sigs[6]),sig7(sigs[7]);
+		C25519::SigningKey fk;
+		C25519::expand(bk[0].priv,bk[0].pub,fk);
+		unsigned char fh[96],hram[64],one[32];
+		memset(sigs[6].data,0,32);
+		sigs[6].data[0] = 0x01;
+		sigs[6].data[31] = 0x80;
+		SHA512::hash(hram,mp[6],lp[6]);
+		memcpy(sigs[6].data + 64,hram,32);
+		memcpy(fh,sigs[6].data,32);
+		memcpy(fh + 32,fk.pub,32);
+		memcpy(fh + 64,sigs[6].data + 64,32);
+		SHA512::hash(hram,fh,96);
+		memset(one,0,32);
+		one[0] = 1;
+		_ed25519MulModL(fh,hram,64,one);
+		_ed25519MulModL(sigs[6].data + 32,fk.az,32,fh);
+		// s + L is accepted by verify() since s is reduced before use
+		static const unsigned char L[32] = { 0xed,0xd3,0xf5,0x5c,0x1a,0x63,0x12,0x58,0xd6,0x9c,0xf7,0xa2,0xde,0xf9,0xde,0x14,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x10 };
+		for(unsigned int i=0,c=0;i<32;++i) {
+			c += (unsigned int)sigs[7].data[32 + i] + (unsigned int)L[i];
+			sigs[7].data[32 + i] = (unsigned char)c;
+			c >>= 8;
+		}
+		C25519::verifyBatch(pp.data(),mp.data(),lp.data(),sp.data(),ok,n);
+		for(unsigned int i=0;i<n;++i) {
+			if (ok[i] != C25519::verify(pubs[i],mp[i],lp[i],sigs[i])) {
+				std::cout << "FAIL (6 " << i << ")" << std::endl;
+				return -1;
+			}
+		}
+		if ((ok[6])||(!ok[7])) {
+			std::cout << "FAIL (7)" << std::endl;
+			return -1;
+		}
+		sigs[6] = sig6;
+		sigs[7] = sig7;
+		std::cout << "PASS" << std::endl;
+
+		std::cout << "[crypto] Benchmarking Ed25519 batch verification... "; std::cout.flush();
+		st = OSUtils::now();
+		for(unsigned int i=0;i<n;++i)
+			C25519::verify(pubs[i],mp[i],lp[i],sigs[i]);
+		et = OSUtils::now();
+		const double single = (double)(et - st) / (double)n;
+		st = OSUtils::now();
+		const bool all = C25519::verifyBatch(pp.data(),mp.data(),lp.data(),sp.data(),ok,n);
+		et = OSUtils::now();
+		std::cout << single << "ms individually, " << ((double)(et - st) / (double)n) << "ms batched per signature" << (all ? "" : " (FAILED)") << std::endl;
+	}
+
+	std::cout << "[crypto] Testing verified signature cache... "; std::cout.flush();
+	{
+		Identity sid;
+		sid.fromString(KNOWN_GOOD_IDENTITY);
+		SignatureCache cache;
+		const int64_t now = OSUtils::now();
+		C25519::Signature csig[4];
+		for(unsigned int i=0;i<4;++i)
+			csig[i] = sid.sign(buf1 + i,64);
+		for(unsigned int pass=0;pass<2;++pass) {
+			Credential::SignatureBatch sb;
+			for(unsigned int i=0;i<4;++i)
+				sb.add(sid,buf1 + i,64,csig[i],(i == 3) ? 0 : now); // timestamp 0 is never cached
+			if (!sb.verify(&cache,now)) {
+				std::cout << "FAIL (1)" << std::endl;
+				return -1;
+			}
+		}
+		if ((cache.hits() != 3)||(cache.misses() != 5)) {
+			std::cout << "FAIL (2 " << cache.hits() << "/" << cache.misses() << ")" << std::endl;
+			return -1;
+		}
+		csig[1].data[70] ^= 0x01;
+		Credential::SignatureBatch sb;
+		sb.add(sid,buf1 + 1,64,csig[1],now);
+		if ((sb.verify(&cache,now))||(cache.hits() != 3)) {
+			std::cout << "FAIL (3)" << std::endl;
+			return -1;
+		}
+		csig[1].data[70] ^= 0x01;
+		SignatureCache::Key ck;
+		SignatureCache::key(ck,sid.publicKey(),buf1 + 1,64,csig[1].data);
+		if ((!cache.check(ck,now))||(cache.check(ck,now + ZT_SIGNATURE_CACHE_TTL))) {
+			std::cout << "FAIL (4)" << std::endl;
+			return -1;
+		}
+	}
+	std::cout << "PASS" << std::endl;
+
+	return 0;
+}
+
+static void _randomRule(ZT_VirtualNetworkRule &r)
+{
+	static const ZT_VirtualNetworkRuleType matches[14] = {
+		ZT_NETWORK_RULE_MATCH_SOURCE_ZEROTIER_ADDRESS,
+		ZT_NETWORK_RULE_MATCH_VLAN_ID,
+		ZT_NETWORK_RULE_MATCH_VLAN_PCP,
+		ZT_NETWORK_RULE_MATCH_MAC_DEST,
+		ZT_NETWORK_RULE_MATCH_IPV4_SOURCE,
+		ZT_NETWORK_RULE_MATCH_IPV4_DEST,
+		ZT_NETWORK_RULE_MATCH_IPV6_DEST,
+		ZT_NETWORK_RULE_MATCH_IP_TOS,
+		ZT_NETWORK_RULE_MATCH_IP_PROTOCOL,
+		ZT_NETWORK_RULE_MATCH_ETHERTYPE,
+		ZT_NETWORK_RULE_MATCH_ICMP,
+		ZT_NETWORK_RULE_MATCH_IP_DEST_PORT_RANGE,
+		ZT_NETWORK_RULE_MATCH_CHARACTERISTICS,
+		ZT_NETWORK_RULE_MATCH_FRAME_SIZE_RANGE
+	};
+	memset(&r,0,sizeof(r));
+	if ((rand() % 5) == 0) {
+		r.t = (uint8_t)((rand() % 3) ? ZT_NETWORK_RULE_ACTION_ACCEPT : ((rand() & 1) ? ZT_NETWORK_RULE_ACTION_DROP : ZT_NETWORK_RULE_ACTION_BREAK));
+		return;
+	}
+	r.t = (uint8_t)matches[rand() % 14] | (uint8_t)((rand() & 3) << 6);
+	switch(r.t & 0x3f) {
+		case ZT_NETWORK_RULE_MATCH_SOURCE_ZEROTIER_ADDRESS: r.v.zt = 0x1000000000ULL + (rand() & 3); break;
+		case ZT_NETWORK_RULE_MATCH_VLAN_ID: r.v.vlanId = (uint16_t)(rand() & 1); break;
+		case ZT_NETWORK_RULE_MATCH_VLAN_PCP: r.v.vlanPcp = (uint8_t)(rand() & 1); break;
+		case ZT_NETWORK_RULE_MATCH_MAC_DEST: r.v.mac[5] = (uint8_t)(rand() & 3); break;
+		case ZT_NETWORK_RULE_MATCH_IPV4_SOURCE:
+		case ZT_NETWORK_RULE_MATCH_IPV4_DEST: {
+			const uint8_t ip[4] = { 10,0,(uint8_t)(rand() & 3),(uint8_t)(rand() & 7) };
+			memcpy(&(r.v.ipv4.ip),ip,4);
+			r.v.ipv4.mask = (uint8_t)((rand() & 1) ? 32 : (rand() % 33));
+		}	break;
+		case ZT_NETWORK_RULE_MATCH_IPV6_DEST:
+			r.v.ipv6.ip[0] = 0xfd;
+			r.v.ipv6.ip[15] = (uint8_t)(rand() & 3);
+			r.v.ipv6.mask = (uint8_t)((rand() & 1) ? 128 : (rand() % 129));
+			break;
+		case ZT_NETWORK_RULE_MATCH_IP_TOS:
+			r.v.ipTos.mask = (uint8_t)rand();
+			r.v.ipTos.value[0] = (uint8_t)(rand() & 0x3f);
+			r.v.ipTos.value[1] = (uint8_t)(r.v.ipTos.value[0] + (rand() & 0x3f));
+			break;
+		case ZT_NETWORK_RULE_MATCH_IP_PROTOCOL: r.v.ipProtocol = (uint8_t)((rand() & 1) ? 0x06 : 0x11); break;
+		case ZT_NETWORK_RULE_MATCH_ETHERTYPE: r.v.etherType = (uint16_t)((rand() & 1) ? ZT_ETHERTYPE_IPV4 : ZT_ETHERTYPE_IPV6); break;
+		case ZT_NETWORK_RULE_MATCH_ICMP: r.v.icmp.type = (uint8_t)(rand() & 1); r.v.icmp.code = (uint8_t)(rand() & 1); r.v.icmp.flags = (uint8_t)(rand() & 1); break;
+		case ZT_NETWORK_RULE_MATCH_IP_DEST_PORT_RANGE:
+			r.v.port[0] = (uint16_t)(rand() % 16);
+			r.v.port[1] = (uint16_t)(r.v.port[0] + (rand() % 4));
+			break;
+		case ZT_NETWORK_RULE_MATCH_CHARACTERISTICS: r.v.characteristics = ((uint64_t)rand() & 0xfff) | ((rand() & 1) ? ZT_RULE_PACKET_CHARACTERISTICS_MULTICAST : 0ULL); break;
+		case ZT_NETWORK_RULE_MATCH_FRAME_SIZE_RANGE:
+			r.v.frameSize[0] = (uint16_t)(rand() % 128);
+			r.v.frameSize[1] = (uint16_t)(r.v.frameSize[0] + (rand() % 64));
+			break;
+	}
+}
+
+static unsigned int _randomFrame(uint8_t *f,unsigned int &etherType)
+{
+	const unsigned int len = 20 + (rand() % 100);
+	for(unsigned int i=0;i<len;++i)
+		f[i] = (uint8_t)rand();
+	switch(rand() % 3) {
+		case 0:
+			etherType = ZT_ETHERTYPE_IPV4;
+			f[0] = 0x45;
+			f[9] = (uint8_t)((rand() & 1) ? ((rand() & 1) ? 0x06 : 0x11) : 0x01);
+			f[12] = 10; f[13] = 0; f[14] = (uint8_t)(rand() & 3); f[15] = (uint8_t)(rand() & 7);
+			f[16] = 10; f[17] = 0; f[18] = (uint8_t)(rand() & 3); f[19] = (uint8_t)(rand() & 7);
+			if (len > 24) { f[20] = 0; f[22] = 0; f[23] = (uint8_t)(rand() % 20); }
+			break;
+		case 1:
+			etherType = ZT_ETHERTYPE_IPV6;
+			f[6] = (uint8_t)((rand() & 1) ? 0x06 : 0x3a);
+			memset(f + 24,0,16);
+			f[24] = 0xfd;
+			f[39] = (uint8_t)(rand() & 3);
+			if (len > 44) { f[40] = 0; f[42] = 0; f[43] = (uint8_t)(rand() % 20); }
+			break;
+		default:
+			etherType = ZT_ETHERTYPE_ARP;
+			break;
+	}
+	return len;
+}
+
+static int testRules()
+{
+	RuntimeEnvironment RR((Node *)0);
+	NetworkConfig *const nconf = new NetworkConfig();
+	ZT_VirtualNetworkRule *const rules = new ZT_VirtualNetworkRule[ZT_MAX_NETWORK_RULES];
+	uint8_t frame[128];
+	Trace::RuleResultLog rrl;
+
+	std::cout << "[rules] Testing compiled rule programs against interpreter... "; std::cout.flush();
+	for(unsigned int k=0;k<2000;++k) {
+		const unsigned int ruleCount = 1 + (rand() % 48);
+		for(unsigned int i=0;i<ruleCount;++i)
+			_randomRule(rules[i]);
+		nconf->flags = (rand() & 1) ? ZT_NETWORKCONFIG_FLAG_RULES_RESULT_OF_UNSUPPORTED_MATCH : 0;
+
+		RuleProgram prog;
+		prog.compile(rules,ruleCount);
+
+		for(unsigned int j=0;j<64;++j) {
+			unsigned int etherType = 0;
+			const unsigned int frameLen = _randomFrame(frame,etherType);
+			const Address ztSource(0x1000000000ULL + (rand() & 3));
+			const MAC macSource(0x020000000000ULL);
+			const MAC macDest((rand() & 1) ? 0xffffffffffffULL : (uint64_t)(rand() & 3));
+			const unsigned int vlanId = (unsigned int)(rand() & 1);
+			const bool inbound = ((rand() & 1) != 0);
+
+			Address ztDest1(0x2000000000ULL),ztDest2(0x2000000000ULL),cc1,cc2;
+			unsigned int ccLength1 = 0,ccLength2 = 0;
+			bool ccWatch1 = false,ccWatch2 = false;
+			const RuleProgram::Result r1 = RuleProgram::interpret(&RR,rrl,*nconf,(const Membership *)0,inbound,ztSource,ztDest1,macSource,macDest,frame,frameLen,etherType,vlanId,rules,ruleCount,cc1,ccLength1,ccWatch1);
+			const RuleProgram::Result r2 = prog.run(&RR,*nconf,(const Membership *)0,inbound,ztSource,ztDest2,macSource,macDest,RuleProgram::Flow(ztSource,ztDest2,macSource,macDest,frame,frameLen,etherType,vlanId),cc2,ccLength2,ccWatch2);
+			if (r1 != r2) {
+				std::cout << "FAIL (rule set " << k << ", frame " << j << ": interpreted " << (int)r1 << ", compiled " << (int)r2 << ")" << std::endl;
+				delete [] rules;
+				delete nconf;
+				return -1;
+			}
+		}
+	}
+	std::cout << "PASS" << std::endl;
+
+	std::cout << "[rules] Testing flow cache keys... "; std::cout.flush();
+	{
+		uint8_t f1[64],f2[64];
+		Utils::getSecureRandom(f1,sizeof(f1));
+		f1[0] = 0x45; f1[9] = 0x06;
+		memcpy(f2,f1,40);
+		Utils::getSecureRandom(f2 + 40,sizeof(f2) - 40); // same flow, different payload
+		const Address zs(0x1000000000ULL),zd(0x2000000000ULL);
+		const MAC ms(0x020000000000ULL),md(0x020000000001ULL);
+		RuleProgram::Flow::Key k1,k2,k3;
+		RuleProgram::Flow(zs,zd,ms,md,f1,sizeof(f1),ZT_ETHERTYPE_IPV4,0).key(k1,false);
+		RuleProgram::Flow(zs,zd,ms,md,f2,sizeof(f2),ZT_ETHERTYPE_IPV4,0).key(k2,false);
+		f2[23] ^= 0x01; // different destination port
+		RuleProgram::Flow(zs,zd,ms,md,f2,sizeof(f2),ZT_ETHERTYPE_IPV4,0).key(k3,false);
+		if ((k1 != k2)||(k1.hashCode() != k2.hashCode())||(k1 == k3)) {
+			std::cout << "FAIL (keys)" << std::endl;
+			delete [] rules;
+			delete nconf;
+			return -1;
+		}
+		memset(rules,0,sizeof(ZT_VirtualNetworkRule) * 2);
+		rules[0].t = (uint8_t)ZT_NETWORK_RULE_MATCH_IP_DEST_PORT_RANGE;
+		rules[1].t = (uint8_t)ZT_NETWORK_RULE_ACTION_ACCEPT;
+		const bool c1 = RuleProgram::cacheable(rules,2);
+		rules[0].t = (uint8_t)ZT_NETWORK_RULE_MATCH_FRAME_SIZE_RANGE;
+		if ((!c1)||(RuleProgram::cacheable(rules,2))) {
+			std::cout << "FAIL (cacheable)" << std::endl;
+			delete [] rules;
+			delete nconf;
+			return -1;
+		}
+
+		// Verdicts can be shared by multicast recipients with equal tags unless rules test the destination itself
+		rules[0].t = (uint8_t)ZT_NETWORK_RULE_MATCH_TAG_RECEIVER;
+		rules[0].v.tag.id = 7;
+		RuleProgram byTag;
+		byTag.compile(rules,2);
+		rules[0].t = (uint8_t)ZT_NETWORK_RULE_MATCH_DEST_ZEROTIER_ADDRESS;
+		RuleProgram byDest;
+		byDest.compile(rules,2);
+		if ((!byTag.destinationIndependent())||(byTag.tagIds().size() != 1)||(byTag.tagIds()[0] != 7)||(byDest.destinationIndependent())) {
+			std::cout << "FAIL (recipient classes)" << std::endl;
+			delete [] rules;
+			delete nconf;
+			return -1;
+		}
+	}
+	std::cout << "PASS" << std::endl;
+
+	// Large rule set typical of big allow lists: many destination hosts and ports
+	unsigned int ruleCount = 0;
+	for(unsigned int i=0;i<200;++i) {
+		ZT_VirtualNetworkRule &r = rules[ruleCount++];
+		memset(&r,0,sizeof(r));
+		r.t = (uint8_t)ZT_NETWORK_RULE_MATCH_IPV4_DEST | ((i > 0) ? 0x40 : 0x00);
+		const uint8_t ip[4] = { 10,(uint8_t)(i >> 8),(uint8_t)i,1 };
+		memcpy(&(r.v.ipv4.ip),ip,4);
+		r.v.ipv4.mask = 32;
+	}
+	for(unsigned int i=0;i<6;++i) {
+		for(unsigned int j=0;j<(ZT_MAX_NETWORK_RULES - 210) / 6;++j) {
+			ZT_VirtualNetworkRule &r = rules[ruleCount++];
+			memset(&r,0,sizeof(r));
+			r.t = (uint8_t)ZT_NETWORK_RULE_MATCH_IP_DEST_PORT_RANGE | ((j > 0) ? 0x40 : 0x00);
+			r.v.port[0] = r.v.port[1] = (uint16_t)(1000 + (i * 1000) + (j * 3));
+		}
+		memset(&(rules[ruleCount]),0,sizeof(ZT_VirtualNetworkRule));
+		rules[ruleCount++].t = (uint8_t)ZT_NETWORK_RULE_ACTION_ACCEPT;
+		memcpy(&(rules[ruleCount]),&(rules[0]),sizeof(ZT_VirtualNetworkRule)); // re-check destination for next port group
+		++ruleCount;
+	}
+	memset(&(rules[ruleCount]),0,sizeof(ZT_VirtualNetworkRule));
+	rules[ruleCount++].t = (uint8_t)ZT_NETWORK_RULE_ACTION_DROP;
+
+	RuleProgram prog;
+	prog.compile(rules,ruleCount);
+
+	std::vector< std::vector<uint8_t> > frames;
+	for(unsigned int i=0;i<256;++i) {
+		std::vector<uint8_t> f(64,0);
+		f[0] = 0x45; f[9] = 0x06;
+		f[16] = 10; f[17] = 0; f[18] = (uint8_t)(rand() % 256); f[19] = 1;
+		const unsigned int port = 1000 + (rand() % 7000);
+		f[22] = (uint8_t)(port >> 8); f[23] = (uint8_t)port;
+		frames.push_back(f);
+	}
+
+	const Address ztSource(0x1000000000ULL);
+	const MAC macSource(0x020000000000ULL),macDest(0x020000000001ULL);
+	const unsigned int iterations = 20000;
+	unsigned long interpretedAccepts = 0,compiledAccepts = 0;
+
+	std::cout << "[rules] Benchmarking " << ruleCount << " rules (" << prog.size() << " compiled instructions)... "; std::cout.flush();
+	uint64_t start = OSUtils::now();
+	for(unsigned int i=0;i<iterations;++i) {
+		const std::vector<uint8_t> &f = frames[i & 0xff];
+		Address ztDest(0x2000000000ULL),cc;
+		unsigned int ccLength = 0;
+		bool ccWatch = false;
+		if (RuleProgram::interpret(&RR,rrl,*nconf,(const Membership *)0,false,ztSource,ztDest,macSource,macDest,f.data(),(unsigned int)f.size(),ZT_ETHERTYPE_IPV4,0,rules,ruleCount,cc,ccLength,ccWatch) == RuleProgram::ACCEPT)
+			++interpretedAccepts;
+	}
+	uint64_t end = OSUtils::now();
+	std::cout << "interpreted: " << ((double)(end - start) * 1000.0) / (double)iterations << "us/frame, ";
+	start = OSUtils::now();
+	for(unsigned int i=0;i<iterations;++i) {
+		const std::vector<uint8_t> &f = frames[i & 0xff];
+		Address ztDest(0x2000000000ULL),cc;
+		unsigned int ccLength = 0;
+		bool ccWatch = false;
+		if (prog.run(&RR,*nconf,(const Membership *)0,false,ztSource,ztDest,macSource,macDest,RuleProgram::Flow(ztSource,ztDest,macSource,macDest,f.data(),(unsigned int)f.size(),ZT_ETHERTYPE_IPV4,0),cc,ccLength,ccWatch) == RuleProgram::ACCEPT)
+			++compiledAccepts;
+	}
+	end = OSUtils::now();
+	std::cout << "compiled: " << ((double)(end - start) * 1000.0) / (double)iterations << "us/frame" << std::endl;
+
+	delete [] rules;
+	delete nconf;
+
+	if (interpretedAccepts != compiledAccepts) {
+		std::cout << "[rules] FAIL (benchmark results differ: " << interpretedAccepts << " != " << compiledAccepts << ")" << std::endl;
+		return -1;
+	}
 	return 0;
 }
 
@@ -597,6 +1138,480 @@ static int testCertificate()
 	return 0;
 }
 
+// Stands in for Node as the controller's sender, checking the first config it gets
+class ControllerBenchSender : public NetworkController::Sender
+{
+public:
+	ControllerBenchSender(const Identity &signer) : signer(signer),configs(0),errors(0),checked(false),ok(false) {}
+
+	virtual void ncSendConfig(uint64_t nwid,uint64_t requestPacketId,const Address &destination,const NetworkConfig &nc,bool sendLegacyFormatConfig)
+	{
+		Dictionary<ZT_NETWORKCONFIG_DICT_CAPACITY> *d = new Dictionary<ZT_NETWORKCONFIG_DICT_CAPACITY>();
+		const bool serialized = nc.toDictionary(*d,sendLegacyFormatConfig);
+		delete d;
+		if (!checked.exchange(true)) {
+			// Batch signed credentials must match the same credentials signed one at a time
+			ok = ((serialized)&&(nc.com.signedBy() == signer.address())&&(nc.capabilityCount > 0)&&(nc.tagCount > 0)&&(nc.certificateOfOwnershipCount > 0));
+			Buffer<8192> a,b;
+			CertificateOfMembership com(nc.com);
+			com.sign(signer);
+			nc.com.serialize(a); com.serialize(b);
+			ok = ((ok)&&(a == b));
+			for(unsigned int i=0;i<nc.tagCount;++i) {
+				Tag t(nc.tags[i]);
+				t.sign(signer);
+				a.clear(); b.clear();
+				nc.tags[i].serialize(a); t.serialize(b);
+				ok = ((ok)&&(a == b));
+			}
+			CertificateOfOwnership coo(nc.certificatesOfOwnership[0]);
+			coo.sign(signer);
+			a.clear(); b.clear();
+			nc.certificatesOfOwnership[0].serialize(a); coo.serialize(b);
+			ok = ((ok)&&(a == b));
+		}
+		{
+			Mutex::Lock _l(lastNameLock);
+			lastName = nc.name;
+		}
+		if (serialized)
+			++configs;
+		else ++errors;
+	}
+	virtual void ncSendRevocation(const Address &destination,const Revocation &rev) {}
+	virtual void ncSendError(uint64_t nwid,uint64_t requestPacketId,const Address &destination,NetworkController::ErrorCode errorCode) { ++errors; }
+
+	const Identity signer;
+	std::atomic<unsigned int> configs;
+	std::atomic<unsigned int> errors;
+	std::atomic<bool> checked;
+	std::atomic<bool> ok;
+	Mutex lastNameLock;
+	std::string lastName;
+};
+
+static int testController()
+{
+	char tmp[256];
+
+	const char *const dbPath = "zerotier-selftest-controller.d";
+	OSUtils::rmDashRf(dbPath);
+
+	Identity signer;
+	signer.fromString(KNOWN_GOOD_IDENTITY);
+	const uint64_t nwid = (signer.address().toInt() << 24) | 0x000001ULL;
+
+	{
+		// Fill a /16 pool except for one address at the end, then check that the free address is found in one lookup from anywhere
+		std::cout << "[controller] Testing IP index on a nearly full /16 pool... "; std::cout.flush();
+		const uint32_t poolStart = 0x0a930001,poolEnd = 0x0a93fffe; // 10.147.0.1 - 10.147.255.254
+		IpIndex idx;
+		for(uint32_t ip=poolStart;ip<poolEnd;++ip)
+			idx.add(InetAddress(Utils::hton(ip),0));
+		uint32_t freeIp = 0;
+		bool ok = ((idx.nextFreeIpv4(poolStart,poolEnd,freeIp))&&(freeIp == poolEnd)&&(!idx.nextFreeIpv4(poolStart,poolEnd - 1,freeIp)));
+		idx.remove(InetAddress(Utils::hton((uint32_t)0x0a938000),0));
+		ok = ((ok)&&(!idx.contains(InetAddress(Utils::hton((uint32_t)0x0a938000),0)))&&(idx.contains(InetAddress(Utils::hton((uint32_t)0x0a938001),0))));
+		ok = ((ok)&&(idx.nextFreeIpv4(poolStart + 1,poolEnd,freeIp))&&(freeIp == 0x0a938000));
+		idx.add(InetAddress(Utils::hton((uint32_t)0x0a938000),0));
+		ok = ((ok)&&(idx.nextFreeIpv4(poolStart + 1,poolEnd,freeIp))&&(freeIp == poolEnd));
+		const unsigned int n = 1000000;
+		unsigned int found = 0;
+		const int64_t st = OSUtils::now();
+		for(unsigned int i=0;((ok)&&(i<n));++i) {
+			if ((idx.nextFreeIpv4(poolStart + (i % (poolEnd - poolStart)),poolEnd,freeIp))&&(freeIp == poolEnd))
+				++found;
+		}
+		const int64_t et = OSUtils::now();
+		if ((ok)&&(found == n)) {
+			std::cout << "PASS (" << ((double)n / ((double)std::max((int64_t)1,et - st) / 1000.0)) << " lookups/second)" << std::endl;
+		} else {
+			std::cout << "FAIL" << std::endl;
+			return -1;
+		}
+	}
+
+	std::cout << "[controller] Generating member identities... "; std::cout.flush();
+	std::vector<Identity> members(8);
+	for(unsigned int i=0;i<(unsigned int)members.size();++i)
+		members[i].generate();
+	std::cout << "done" << std::endl;
+
+	int r = 0;
+	{
+		ControllerBenchSender sender(signer);
+		EmbeddedNetworkController controller((Node *)0,dbPath);
+		controller.init(signer,&sender);
+
+		std::vector<std::string> path;
+		path.push_back("network");
+		OSUtils::ztsnprintf(tmp,sizeof(tmp),"%.16llx",(unsigned long long)nwid);
+		path.push_back(tmp);
+		std::map<std::string,std::string> urlArgs,headers;
+		std::string responseBody,responseContentType;
+		controller.handleControlPlaneHttpPOST(path,urlArgs,headers,
+			"{\"private\":false,"
+			"\"v4AssignMode\":{\"zt\":true},"
+			"\"ipAssignmentPools\":[{\"ipRangeStart\":\"10.147.0.1\",\"ipRangeEnd\":\"10.147.255.254\"}],"
+			"\"routes\":[{\"target\":\"10.147.0.0/16\"}],"
+			"\"rules\":[{\"type\":\"ACTION_ACCEPT\"}],"
+			"\"capabilities\":[{\"id\":1,\"default\":true,\"rules\":[{\"type\":\"ACTION_ACCEPT\"}]}],"
+			"\"tags\":[{\"id\":1,\"default\":1},{\"id\":2,\"default\":0}]}",
+			responseBody,responseContentType);
+
+		// Requests without a packet ID bypass rate limiting, as with config pushes
+		Dictionary<ZT_NETWORKCONFIG_METADATA_DICT_CAPACITY> metaData;
+		metaData.add(ZT_NETWORKCONFIG_REQUEST_METADATA_KEY_VERSION,(uint64_t)ZT_NETWORKCONFIG_VERSION);
+		metaData.add(ZT_NETWORKCONFIG_REQUEST_METADATA_KEY_RULES_ENGINE_REV,(uint64_t)ZT_RULES_ENGINE_REVISION);
+		std::cout << "[controller] Testing batch signed network config... "; std::cout.flush();
+		controller.request(nwid,InetAddress(),0,members[0],metaData);
+		for(unsigned int k=0;((k<1000)&&(sender.configs.load() + sender.errors.load()) < 1);++k)
+			Thread::sleep(10);
+		if ((sender.configs.load() == 1)&&(sender.ok)) {
+			std::cout << "PASS" << std::endl;
+		} else {
+			std::cout << "FAIL" << std::endl;
+			r = -1;
+		}
+
+		if (!r) {
+			// One request per member per round, each round answered before the next, so none are coalesced
+			std::cout << "[controller] Benchmarking network config requests... "; std::cout.flush();
+			std::vector<std::string> statusPath;
+			controller.handleControlPlaneHttpGET(statusPath,urlArgs,headers,std::string(),responseBody,responseContentType);
+			const unsigned int coalescedBefore = (unsigned int)OSUtils::jsonInt(OSUtils::jsonParse(responseBody)["requestQueue"]["coalesced"],0ULL);
+			const unsigned int rounds = 250;
+			const unsigned int n = rounds * (unsigned int)members.size();
+			const unsigned int before = sender.configs.load() + sender.errors.load();
+			const int64_t st = OSUtils::now();
+			for(unsigned int k=0;k<rounds;++k) {
+				for(unsigned int i=0;i<members.size();++i)
+					controller.request(nwid,InetAddress(),0,members[i],metaData);
+				while ((sender.configs.load() + sender.errors.load()) < (before + ((k + 1) * (unsigned int)members.size()))) {
+					std::this_thread::yield();
+					if ((OSUtils::now() - st) > 60000)
+						break;
+				}
+			}
+			const int64_t et = OSUtils::now();
+			controller.handleControlPlaneHttpGET(statusPath,urlArgs,headers,std::string(),responseBody,responseContentType);
+			unsigned int coalesced = (unsigned int)OSUtils::jsonInt(OSUtils::jsonParse(responseBody)["requestQueue"]["coalesced"],0ULL) - coalescedBefore;
+			if ((sender.configs.load() != (before + n))||(sender.errors.load() != 0)||(coalesced != 0)) {
+				std::cout << "FAIL (" << sender.configs.load() << " configs, " << sender.errors.load() << " errors, " << coalesced << " coalesced)" << std::endl;
+				r = -1;
+			} else {
+				std::cout << ((double)n / ((double)std::max((int64_t)1,et - st) / 1000.0)) << " config responses/second (" << members.size() << " requests at a time)" << std::endl;
+			}
+
+			if (!r) {
+				// Requests from a member that already has one waiting are coalesced into it
+				std::cout << "[controller] Testing config request coalescing... "; std::cout.flush();
+				const unsigned int burst = 200;
+				const unsigned int answeredBefore = sender.configs.load() + sender.errors.load();
+				for(unsigned int i=0;i<burst;++i)
+					controller.request(nwid,InetAddress(),0,members[0],metaData);
+				controller.handleControlPlaneHttpGET(statusPath,urlArgs,headers,std::string(),responseBody,responseContentType);
+				coalesced = (unsigned int)OSUtils::jsonInt(OSUtils::jsonParse(responseBody)["requestQueue"]["coalesced"],0ULL) - coalescedBefore;
+				const unsigned int expected = answeredBefore + burst - coalesced;
+				for(unsigned int k=0;((k<1000)&&(sender.configs.load() + sender.errors.load()) < expected);++k)
+					Thread::sleep(10);
+				Thread::sleep(50); // anything answered beyond expected would show up here
+				if ((coalesced > 0)&&(sender.configs.load() == expected)&&(sender.errors.load() == 0)) {
+					std::cout << "PASS (" << coalesced << " of " << burst << " coalesced)" << std::endl;
+				} else {
+					std::cout << "FAIL (" << sender.configs.load() << " configs, " << sender.errors.load() << " errors, " << coalesced << " coalesced)" << std::endl;
+					r = -1;
+				}
+			}
+		}
+
+		if (!r) {
+			// Configs are built from a cached template that must follow network changes
+			std::cout << "[controller] Testing network config after network update... "; std::cout.flush();
+			controller.handleControlPlaneHttpPOST(path,urlArgs,headers,"{\"name\":\"selftest-renamed\"}",responseBody,responseContentType);
+			const unsigned int before = sender.configs.load() + sender.errors.load();
+			controller.request(nwid,InetAddress(),0,members[1],metaData);
+			for(unsigned int k=0;((k<1000)&&(sender.configs.load() + sender.errors.load()) <= before);++k)
+				Thread::sleep(10);
+			if ((sender.configs.load() + sender.errors.load()) > before) {
+				std::string lastName;
+				{
+					Mutex::Lock _l(sender.lastNameLock);
+					lastName = sender.lastName;
+				}
+				if (lastName == "selftest-renamed") {
+					std::cout << "PASS" << std::endl;
+				} else {
+					std::cout << "FAIL (" << lastName << ")" << std::endl;
+					r = -1;
+				}
+			} else {
+				std::cout << "FAIL (no response)" << std::endl;
+				r = -1;
+			}
+		}
+	}
+
+	if (!r) {
+		// Member changes must be visible at once but only written to disk when flushed, here at shutdown
+		std::cout << "[controller] Testing write-behind member saves... "; std::cout.flush();
+		OSUtils::ztsnprintf(tmp,sizeof(tmp),"%s" ZT_PATH_SEPARATOR_S "network" ZT_PATH_SEPARATOR_S "%.16llx" ZT_PATH_SEPARATOR_S "member" ZT_PATH_SEPARATOR_S "%.10llx.json",dbPath,(unsigned long long)nwid,(unsigned long long)members[1].address().toInt());
+		const std::string memberPath(tmp);
+		std::string buf;
+		bool ok = true;
+		{
+			ControllerBenchSender sender(signer);
+			EmbeddedNetworkController controller((Node *)0,dbPath);
+			controller.setFileDbWriteOptions(60000,false);
+			controller.init(signer,&sender);
+			std::vector<std::string> path;
+			path.push_back("network");
+			OSUtils::ztsnprintf(tmp,sizeof(tmp),"%.16llx",(unsigned long long)nwid);
+			path.push_back(tmp);
+			path.push_back("member");
+			OSUtils::ztsnprintf(tmp,sizeof(tmp),"%.10llx",(unsigned long long)members[1].address().toInt());
+			path.push_back(tmp);
+			std::map<std::string,std::string> urlArgs,headers;
+			std::string responseBody,responseContentType;
+			for(unsigned int i=0;i<=100;++i)
+				ok &= (controller.handleControlPlaneHttpPOST(path,urlArgs,headers,((i & 1) == 0) ? "{\"noAutoAssignIps\":true}" : "{\"noAutoAssignIps\":false}",responseBody,responseContentType) == 200);
+			ok = ((ok)&&(controller.handleControlPlaneHttpGET(path,urlArgs,headers,std::string(),responseBody,responseContentType) == 200)&&(OSUtils::jsonBool(OSUtils::jsonParse(responseBody)["noAutoAssignIps"],false)));
+			ok = ((ok)&&(OSUtils::readFile(memberPath.c_str(),buf))&&(!OSUtils::jsonBool(OSUtils::jsonParse(buf)["noAutoAssignIps"],false)));
+		}
+		buf.clear();
+		ok = ((ok)&&(OSUtils::readFile(memberPath.c_str(),buf))&&(OSUtils::jsonBool(OSUtils::jsonParse(buf)["noAutoAssignIps"],false)));
+		if (ok) {
+			std::cout << "PASS" << std::endl;
+		} else {
+			std::cout << "FAIL" << std::endl;
+			r = -1;
+		}
+	}
+
+	if (!r) {
+		// Unknown fields must survive conversion to and from the typed in-memory record
+		std::cout << "[controller] Testing typed member record round trip... "; std::cout.flush();
+		char idtmp[ZT_IDENTITY_STRING_BUFFER_LENGTH];
+		nlohmann::json mj(OSUtils::jsonParse("{\"id\":\"0123456789\",\"nwid\":\"0123456789000001\",\"objtype\":\"member\",\"name\":\"selftest\",\"authorized\":true,\"ipAssignments\":[\"10.147.0.5\"],\"tags\":[[1,2]],\"remoteTraceTarget\":null}"));
+		mj["identity"] = members[0].toString(false,idtmp);
+		DB::Member m,m2;
+		m.fromJson(mj);
+		nlohmann::json mj2(m.toJson());
+		m2.fromJson(mj2);
+		bool ok = ((m == m2)&&(m.id == 0x0123456789ULL)&&(m.identity == members[0])&&(m.authorized)&&(m.ipAssignments.size() == 1)&&(m.tags.size() == 1)&&(OSUtils::jsonString(mj2["name"],"") == "selftest"));
+		// Values that do not parse are kept as they are, not dropped
+		mj["ipAssignments"] = { "10.147.0.6","not-an-ip" };
+		mj["remoteTraceTarget"] = "not-an-address";
+		DB::Member m3;
+		m3.fromJson(mj);
+		mj2 = m3.toJson();
+		ok = ((ok)&&(m3.ipAssignments.size() == 1)&&(!m3.remoteTraceTarget)&&(mj2["ipAssignments"] == mj["ipAssignments"])&&(mj2["remoteTraceTarget"] == mj["remoteTraceTarget"]));
+		if (ok) {
+			std::cout << "PASS" << std::endl;
+		} else {
+			std::cout << "FAIL" << std::endl;
+			r = -1;
+		}
+	}
+
+	if (!r) {
+		// Import the FileDB tree written above, change it through a controller, then reload after a torn write and a damaged record and export it back
+		std::cout << "[controller] Testing LogDB import, reload after torn write and damaged record, and export... "; std::cout.flush();
+		const char *const logDbPath = "zerotier-selftest-controller.logdb";
+		const char *const exportPath = "zerotier-selftest-controller.export";
+		OSUtils::rmDashRf(logDbPath);
+		OSUtils::rmDashRf(exportPath);
+		const uint64_t memberId = members[0].address().toInt();
+		nlohmann::json network,member;
+		std::vector<nlohmann::json> fileMembers;
+		bool ok;
+		{
+			FileDB fdb((EmbeddedNetworkController *)0,signer,dbPath);
+			ok = ((fdb.get(nwid,network,fileMembers))&&(fileMembers.size() == members.size())&&(LogDB::importFrom(fdb,logDbPath)));
+		}
+		if (ok) {
+			ControllerBenchSender sender(signer);
+			EmbeddedNetworkController controller((Node *)0,(std::string("logdb:") + logDbPath).c_str());
+			controller.init(signer,&sender);
+			std::vector<std::string> path;
+			path.push_back("network");
+			OSUtils::ztsnprintf(tmp,sizeof(tmp),"%.16llx",(unsigned long long)nwid);
+			path.push_back(tmp);
+			path.push_back("member");
+			OSUtils::ztsnprintf(tmp,sizeof(tmp),"%.10llx",(unsigned long long)memberId);
+			path.push_back(tmp);
+			std::map<std::string,std::string> urlArgs,headers;
+			std::string responseBody,responseContentType;
+			ok = (controller.handleControlPlaneHttpPOST(path,urlArgs,headers,"{\"activeBridge\":true}",responseBody,responseContentType) == 200);
+		}
+		const std::string logPath(std::string(logDbPath) + ZT_PATH_SEPARATOR_S + "controller.log");
+		const int64_t logSize = OSUtils::getFileSize(logPath.c_str());
+		if (ok) {
+			FILE *f = fopen(logPath.c_str(),"ab");
+			ok = ((f)&&(fwrite("\x00\x00\x01\x00\x02torn",1,9,f) == 9));
+			if (f)
+				fclose(f);
+		}
+		const uint64_t memberId2 = members[1].address().toInt();
+		if (ok) {
+			// The torn log is set aside and replaced, not truncated, and later changes are appended to the new log
+			LogDB ldb((EmbeddedNetworkController *)0,signer,logDbPath);
+			nlohmann::json n2,m2;
+			std::vector<nlohmann::json> logMembers;
+			ok = ((ldb.get(nwid,n2,logMembers))&&(n2 == network)&&(logMembers.size() == members.size()));
+			ok = ((ok)&&(ldb.get(nwid,n2,memberId,m2))&&(OSUtils::jsonBool(m2["activeBridge"],false)));
+			ok = ((ok)&&(OSUtils::getFileSize((logPath + ".damaged").c_str()) == (logSize + 9))&&(OSUtils::getFileSize(logPath.c_str()) < logSize));
+		}
+		if (ok) {
+			ControllerBenchSender sender(signer);
+			EmbeddedNetworkController controller((Node *)0,(std::string("logdb:") + logDbPath).c_str());
+			controller.init(signer,&sender);
+			std::map<std::string,std::string> urlArgs,headers;
+			std::string responseBody,responseContentType;
+			for(unsigned int k=0;k<2;++k) {
+				std::vector<std::string> path;
+				path.push_back("network");
+				OSUtils::ztsnprintf(tmp,sizeof(tmp),"%.16llx",(unsigned long long)nwid);
+				path.push_back(tmp);
+				path.push_back("member");
+				OSUtils::ztsnprintf(tmp,sizeof(tmp),"%.10llx",(unsigned long long)((k) ? memberId2 : memberId));
+				path.push_back(tmp);
+				ok &= (controller.handleControlPlaneHttpPOST(path,urlArgs,headers,(k) ? "{\"activeBridge\":true}" : "{\"activeBridge\":false}",responseBody,responseContentType) == 200);
+			}
+		}
+		if (ok) {
+			// Damage the first of those two records (header is 16 bytes, record header 21); the one after it must still load
+			FILE *f = fopen(logPath.c_str(),"r+b");
+			ok = ((f)&&(fseek(f,16 + 21,SEEK_SET) == 0)&&(fputc(0xff,f) != EOF));
+			if (f)
+				fclose(f);
+		}
+		if (ok) {
+			LogDB ldb((EmbeddedNetworkController *)0,signer,logDbPath);
+			nlohmann::json n2,m2,m2b;
+			ok = ((ldb.get(nwid,n2,memberId,m2))&&(OSUtils::jsonBool(m2["activeBridge"],false)));
+			ok = ((ok)&&(ldb.get(nwid,n2,memberId2,m2b))&&(OSUtils::jsonBool(m2b["activeBridge"],false)));
+			ok = ((ok)&&(ldb.exportTo(exportPath)));
+			member = m2;
+		}
+		if (ok) {
+			FileDB fdb((EmbeddedNetworkController *)0,signer,exportPath);
+			nlohmann::json n3,m3;
+			ok = ((fdb.get(nwid,n3,memberId,m3))&&(n3 == network)&&(m3 == member));
+		}
+		if (ok) {
+			std::cout << "PASS" << std::endl;
+		} else {
+			std::cout << "FAIL" << std::endl;
+			r = -1;
+		}
+		OSUtils::rmDashRf(logDbPath);
+		OSUtils::rmDashRf(exportPath);
+	}
+
+	OSUtils::rmDashRf(dbPath);
+	return r;
+}
+
+// Members in the synthetic tree used to time controller startup, kept small so a default run stays
+// quick (build with e.g. -DZT_SELFTEST_CONTROLLER_STARTUP_MEMBERS=500000 for a full size run)
+#ifndef ZT_SELFTEST_CONTROLLER_STARTUP_MEMBERS
+#define ZT_SELFTEST_CONTROLLER_STARTUP_MEMBERS 2000
+#endif
+
+static int testControllerStartup()
+{
+	char tmp[1024];
+
+	const char *const dbPath = "zerotier-selftest-controller-startup.d";
+	OSUtils::rmDashRf(dbPath);
+
+	Identity signer;
+	signer.fromString(KNOWN_GOOD_IDENTITY);
+	Identity member;
+	member.generate();
+	member.toString(false,tmp);
+	const std::string memberIdentity(tmp);
+
+	// One large network and one small one, both with our member authorized
+	const unsigned int n = ZT_SELFTEST_CONTROLLER_STARTUP_MEMBERS;
+	const uint64_t bigNwid = (signer.address().toInt() << 24) | 0x000001ULL;
+	const uint64_t smallNwid = (signer.address().toInt() << 24) | 0x000002ULL;
+	std::cout << "[controller] Writing FileDB tree with " << n << " members... "; std::cout.flush();
+	const std::string networksPath(std::string(dbPath) + ZT_PATH_SEPARATOR_S + "network");
+	OSUtils::mkdir(dbPath);
+	OSUtils::mkdir(networksPath);
+	for(unsigned int k=0;k<2;++k) {
+		const uint64_t nwid = (k == 0) ? bigNwid : smallNwid;
+		nlohmann::json network;
+		OSUtils::ztsnprintf(tmp,sizeof(tmp),"%.16llx",(unsigned long long)nwid);
+		network["id"] = tmp;
+		network["nwid"] = tmp;
+		DB::initNetwork(network);
+		OSUtils::ztsnprintf(tmp,sizeof(tmp),"%s" ZT_PATH_SEPARATOR_S "%.16llx.json",networksPath.c_str(),(unsigned long long)nwid);
+		OSUtils::writeFile(tmp,OSUtils::jsonDump(network,-1));
+		OSUtils::ztsnprintf(tmp,sizeof(tmp),"%s" ZT_PATH_SEPARATOR_S "%.16llx",networksPath.c_str(),(unsigned long long)nwid);
+		OSUtils::mkdir(tmp);
+		const std::string membersPath(std::string(tmp) + ZT_PATH_SEPARATOR_S "member");
+		OSUtils::mkdir(membersPath);
+		const unsigned int count = (k == 0) ? n : 8;
+		for(unsigned int i=0;i<=count;++i) {
+			const uint64_t id = (i == count) ? member.address().toInt() : (0x1000000000ULL + i);
+			nlohmann::json m;
+			OSUtils::ztsnprintf(tmp,sizeof(tmp),"%.10llx",(unsigned long long)id);
+			m["id"] = tmp;
+			m["address"] = tmp;
+			OSUtils::ztsnprintf(tmp,sizeof(tmp),"%.16llx",(unsigned long long)nwid);
+			m["nwid"] = tmp;
+			DB::initMember(m);
+			m["authorized"] = true;
+			if (i == count)
+				m["identity"] = memberIdentity;
+			OSUtils::ztsnprintf(tmp,sizeof(tmp),"10.%u.%u.%u",(i >> 16) & 0xff,(i >> 8) & 0xff,i & 0xff);
+			m["ipAssignments"] = { tmp };
+			OSUtils::ztsnprintf(tmp,sizeof(tmp),"%s" ZT_PATH_SEPARATOR_S "%.10llx.json",membersPath.c_str(),(unsigned long long)id);
+			OSUtils::writeFile(tmp,OSUtils::jsonDump(m,-1));
+		}
+	}
+	std::cout << "done" << std::endl;
+
+	int r = 0;
+	std::cout << "[controller] Benchmarking startup (time to first config)... "; std::cout.flush();
+	{
+		Dictionary<ZT_NETWORKCONFIG_METADATA_DICT_CAPACITY> metaData;
+		metaData.add(ZT_NETWORKCONFIG_REQUEST_METADATA_KEY_VERSION,(uint64_t)ZT_NETWORKCONFIG_VERSION);
+		metaData.add(ZT_NETWORKCONFIG_REQUEST_METADATA_KEY_RULES_ENGINE_REV,(uint64_t)ZT_RULES_ENGINE_REVISION);
+
+		ControllerBenchSender sender(signer);
+		const int64_t st = OSUtils::now();
+		EmbeddedNetworkController controller((Node *)0,dbPath);
+		controller.init(signer,&sender);
+		controller.request(smallNwid,InetAddress(),0,member,metaData);
+		while ((sender.configs.load() + sender.errors.load()) < 1) {
+			Thread::sleep(1);
+			if ((OSUtils::now() - st) > 600000)
+				break;
+		}
+		const int64_t first = OSUtils::now();
+		controller.request(bigNwid,InetAddress(),0,member,metaData);
+		while ((sender.configs.load() + sender.errors.load()) < 2) {
+			Thread::sleep(1);
+			if ((OSUtils::now() - st) > 600000)
+				break;
+		}
+		const int64_t big = OSUtils::now();
+		if ((sender.configs.load() != 2)||(sender.errors.load() != 0)) {
+			std::cout << "FAIL (" << sender.configs.load() << " configs, " << sender.errors.load() << " errors)" << std::endl;
+			r = -1;
+		} else {
+			std::cout << (first - st) << "ms small network, " << (big - st) << "ms " << n << "-member network" << std::endl;
+		}
+	}
+
+	OSUtils::rmDashRf(dbPath);
+	return r;
+}
+
 static int testPacket()
 {
 	unsigned char salsaKey[32];
@@ -636,10 +1651,197 @@ static int testPacket()
 		return -1;
 	}
 
+	b = a;
+	Salsa20::limitVectorBlocks(0);
+	a.armor(salsaKey,true);
+	Salsa20::limitVectorBlocks(16);
+	if ((!a.dearmor(salsaKey))||(a != b)) {
+		std::cout << "FAIL (encrypt-decrypt/verify across Salsa20 kernels)" << std::endl;
+		return -1;
+	}
+
+	std::cout << "PASS" << std::endl;
+
+	std::cout << "[packet] Testing batch armor/dearmor... "; std::cout.flush();
+	{
+		// 11 packets covers a full interleaved group plus a short one done per packet
+		std::vector<Packet> batched(11),single(11),plain(11);
+		std::vector<Packet *> bp(11),sp(11);
+		unsigned char keys[11][32];
+		const void *kp[11];
+		bool ok[11];
+		for(unsigned int enc=0;enc<2;++enc) {
+			for(unsigned int i=0;i<11;++i) {
+				plain[i].reset(Address((uint64_t)rand()),Address((uint64_t)rand()),Packet::VERB_FRAME);
+				plain[i].appendRandom((unsigned int)(rand() % 1400));
+				Utils::getSecureRandom(keys[i],32);
+				kp[i] = keys[i];
+				batched[i] = plain[i];
+				single[i] = plain[i];
+				bp[i] = &(batched[i]);
+				sp[i] = &(single[i]);
+				single[i].armor(keys[i],enc != 0);
+			}
+			Packet::armorBatch(&(bp[0]),kp,enc != 0,11);
+			for(unsigned int i=0;i<11;++i) {
+				if (batched[i] != single[i]) {
+					std::cout << "FAIL (armorBatch differs from armor)" << std::endl;
+					return -1;
+				}
+			}
+			batched[4][ZT_PACKET_IDX_MAC] ^= 1;
+			Packet::dearmorBatch(&(bp[0]),kp,ok,11);
+			for(unsigned int i=0;i<11;++i) {
+				if ((ok[i] != (i != 4))||((i != 4)&&(!single[i].dearmor(keys[i])))||((i != 4)&&(batched[i] != single[i]))) {
+					std::cout << "FAIL (dearmorBatch differs from dearmor)" << std::endl;
+					return -1;
+				}
+			}
+		}
+	}
 	std::cout << "PASS" << std::endl;
+
+	for(unsigned int len=128;len<=1408;len+=1280) {
+		std::cout << "[packet] Benchmarking armor of 8 x " << len << " byte packets... "; std::cout.flush();
+		std::vector<Packet> pk(8);
+		std::vector<Packet *> pp(8);
+		const void *kp[8];
+		for(unsigned int i=0;i<8;++i) {
+			pk[i].reset(Address((uint64_t)i + 1),Address(),Packet::VERB_FRAME);
+			pk[i].setSize(len);
+			pp[i] = &(pk[i]);
+			kp[i] = salsaKey;
+		}
+		uint64_t start = OSUtils::now();
+		for(unsigned int r=0;r<20000;++r) {
+			for(unsigned int i=0;i<8;++i)
+				pk[i].armor(salsaKey,true);
+		}
+		uint64_t end = OSUtils::now();
+		std::cout << ((double)(end - start) * 1000000.0 / 160000.0) << "ns/packet one at a time, "; std::cout.flush();
+		start = OSUtils::now();
+		for(unsigned int r=0;r<20000;++r)
+			Packet::armorBatch(&(pp[0]),kp,true,8);
+		end = OSUtils::now();
+		std::cout << ((double)(end - start) * 1000000.0 / 160000.0) << "ns/packet batched" << std::endl;
+	}
+
 	return 0;
 }
 
+// Minimal callbacks for driving a Node in tests; its identity is KNOWN_GOOD_IDENTITY,
+// testNodePeerState holds cached peers it loads on first contact, and testNodeSent
+// collects the packets it sends
+static std::map< uint64_t,std::string > testNodePeerState;
+static std::vector< std::pair< InetAddress,std::string > > testNodeSent;
+static void testNodeStatePut(ZT_Node *node,void *uptr,void *tptr,enum ZT_StateObjectType type,const uint64_t id[2],const void *data,int len) {}
+static int testNodeStateGet(ZT_Node *node,void *uptr,void *tptr,enum ZT_StateObjectType type,const uint64_t id[2],void *data,unsigned int maxlen)
+{
+	if (type == ZT_STATE_OBJECT_PEER) {
+		std::map< uint64_t,std::string >::const_iterator ps(testNodePeerState.find(id[0]));
+		if ((ps == testNodePeerState.end())||(maxlen < ps->second.length()))
+			return -1;
+		memcpy(data,ps->second.data(),ps->second.length());
+		return (int)ps->second.length();
+	}
+	if ((type != ZT_STATE_OBJECT_IDENTITY_SECRET)||(maxlen <= strlen(KNOWN_GOOD_IDENTITY)))
+		return -1;
+	memcpy(data,KNOWN_GOOD_IDENTITY,strlen(KNOWN_GOOD_IDENTITY));
+	return (int)strlen(KNOWN_GOOD_IDENTITY);
+}
+static int testNodeWirePacketSend(ZT_Node *node,void *uptr,void *tptr,int64_t localSocket,const struct sockaddr_storage *addr,const void *data,unsigned int len,unsigned int ttl)
+{
+	testNodeSent.push_back(std::pair< InetAddress,std::string >(*reinterpret_cast<const InetAddress *>(addr),std::string((const char *)data,len)));
+	return 0;
+}
+static void testNodeVirtualNetworkFrame(ZT_Node *node,void *uptr,void *tptr,uint64_t nwid,void **nuptr,uint64_t sourceMac,uint64_t destMac,unsigned int etherType,unsigned int vlanId,const void *data,unsigned int len) {}
+static int testNodeVirtualNetworkConfig(ZT_Node *node,void *uptr,void *tptr,uint64_t nwid,void **nuptr,enum ZT_VirtualNetworkConfigOperation op,const ZT_VirtualNetworkConfig *nwconf) { return 0; }
+static void testNodeEvent(ZT_Node *node,void *uptr,void *tptr,enum ZT_Event event,const void *metaData) {}
+static Node *testNodeNew(int64_t now)
+{
+	ZT_Node_Callbacks cb;
+	memset(&cb,0,sizeof(cb));
+	cb.version = 0;
+	cb.statePutFunction = testNodeStatePut;
+	cb.stateGetFunction = testNodeStateGet;
+	cb.wirePacketSendFunction = testNodeWirePacketSend;
+	cb.virtualNetworkFrameFunction = testNodeVirtualNetworkFrame;
+	cb.virtualNetworkConfigFunction = testNodeVirtualNetworkConfig;
+	cb.eventCallback = testNodeEvent;
+	return new Node((void *)0,(void *)0,&cb,now);
+}
+
+// Sends the head (if head) and/or last fragment (if tail) of a two-fragment
+// NOP from an unknown peer, so once complete it waits in the receive queue
+static void testRxQueueSend(Node *n,const int64_t now,const Address &src,const uint64_t packetId,const bool head,const bool tail)
+{
+	Packet p(n->identity().address(),src,Packet::VERB_NOP);
+	p.setAt<uint64_t>(ZT_PACKET_IDX_IV,packetId);
+	for(unsigned int i=0;i<400;++i)
+		p.append((uint8_t)i);
+	p.setFragmented(true);
+	const InetAddress from("10.1.2.3/9993");
+	volatile int64_t dl = 0;
+	if (head)
+		n->processWirePacket((void *)0,now,0,reinterpret_cast<const struct sockaddr_storage *>(&from),p.data(),200,&dl);
+	if (tail) {
+		Packet::Fragment f(p,200,p.size() - 200,1,2);
+		n->processWirePacket((void *)0,now,0,reinterpret_cast<const struct sockaddr_storage *>(&from),f.data(),f.size(),&dl);
+	}
+}
+
+// Makes a test node load a peer at address a from its state cache. The peer has the
+// test identity's key, so packets to and from it are armored with testNodePeerKey().
+static void testNodeLoadPeer(Node *n,const int64_t now,const Address &a)
+{
+	Identity pid;
+	pid.fromString(KNOWN_GOOD_IDENTITY);
+	Buffer<ZT_PEER_MAX_SERIALIZED_STATE_SIZE> b;
+	b.append((uint8_t)1);
+	pid.serialize(b,false);
+	a.copyTo(b.field(1,ZT_ADDRESS_LENGTH),ZT_ADDRESS_LENGTH);
+	b.append((uint16_t)10);
+	b.append((uint16_t)1);
+	b.append((uint16_t)2);
+	b.append((uint16_t)3);
+	b.append((uint16_t)0);
+	testNodePeerState[a.toInt()] = std::string((const char *)b.data(),b.size());
+
+	// Any packet from an unknown address makes the node look it up
+	Packet p(n->identity().address(),a,Packet::VERB_NOP);
+	const InetAddress from("10.1.2.3/9993");
+	volatile int64_t dl = 0;
+	n->processWirePacket((void *)0,now,0,reinterpret_cast<const struct sockaddr_storage *>(&from),p.data(),p.size(),&dl);
+	testNodePeerState.erase(a.toInt());
+}
+static void testNodePeerKey(uint8_t key[ZT_PEER_SECRET_KEY_LENGTH])
+{
+	Identity id;
+	id.fromString(KNOWN_GOOD_IDENTITY);
+	id.agree(id,key,ZT_PEER_SECRET_KEY_LENGTH);
+}
+
+// Gives a peer loaded by testNodeLoadPeer() a live direct path: peers only learn paths
+// from an OK, here to a HELLO the node is told it sent
+static void testNodeLearnPath(Node *n,const int64_t now,const Address &a,const int64_t localSocket,const InetAddress &at)
+{
+	uint8_t key[ZT_PEER_SECRET_KEY_LENGTH];
+	testNodePeerKey(key);
+	const uint64_t helloId = 0x7e57000000000000ULL | ((uint64_t)localSocket << 32);
+	n->expectReplyTo(helloId);
+	Packet ok(n->identity().address(),a,Packet::VERB_OK);
+	ok.append((uint8_t)Packet::VERB_HELLO);
+	ok.append(helloId);
+	ok.append((uint64_t)now);
+	ok.append((uint8_t)ZT_PROTO_VERSION);
+	ok.append((uint8_t)1);
+	ok.append((uint8_t)2);
+	ok.append((uint16_t)3);
+	ok.armor(key,true);
+	volatile int64_t dl = 0;
+	n->processWirePacket((void *)0,now,localSocket,reinterpret_cast<const struct sockaddr_storage *>(&at),ok.data(),ok.size(),&dl);
+}
+
 static int testOther()
 {
 	char buf[1024];
@@ -662,6 +1864,371 @@ static int testOther()
 		return -1;
 	}
 
+	{
+		// A flow with a long backlog must not delay another flow's single item, and duplicates must coalesce
+		std::cout << "[other] Testing FairQueue round-robin and coalescing... "; std::cout.flush();
+		FairQueue<uint64_t,uint64_t,int> fq;
+		int replaced = -1,t = -1;
+		bool ok = true;
+		for(int i=0;i<1000;++i)
+			ok &= (!fq.post(1,(uint64_t)i,i,replaced));
+		ok &= (!fq.post(2,0,5000,replaced));
+		ok &= ((fq.post(1,1,1001,replaced))&&(replaced == 1));
+		ok &= ((fq.get(t))&&(t == 0)&&(fq.get(t))&&(t == 5000)&&(fq.get(t))&&(t == 1001));
+		const FairQueue<uint64_t,uint64_t,int>::Stats st(fq.stats());
+		ok &= ((st.depth == 998)&&(st.flows == 1)&&(st.posted == 1002)&&(st.coalesced == 1)&&(st.served == 3));
+		if (ok) {
+			std::cout << "PASS" << std::endl;
+		} else {
+			std::cout << "FAIL" << std::endl;
+			return -1;
+		}
+	}
+
+	{
+		// Frames of one TCP flow must share a flow ID whatever their payload, and IP fragments without ports must stay together
+		std::cout << "[other] Testing multipath flow IDs... "; std::cout.flush();
+		uint8_t ip[64];
+		memset(ip,0,sizeof(ip));
+		ip[0] = 0x45; ip[9] = 6;
+		ip[12] = 10; ip[15] = 1; ip[16] = 10; ip[19] = 2;
+		ip[20] = 0xc0; ip[21] = 0x01; ip[22] = 0x00; ip[23] = 0x50;
+		const MAC m1(0x0200000001ULL),m2(0x0200000002ULL);
+		const uint64_t f1 = Switch::flowId(m1,m2,ZT_ETHERTYPE_IPV4,ip,sizeof(ip));
+		ip[40] = 0xff;
+		const uint64_t f2 = Switch::flowId(m1,m2,ZT_ETHERTYPE_IPV4,ip,sizeof(ip));
+		ip[21] = 0x02;
+		const uint64_t f3 = Switch::flowId(m1,m2,ZT_ETHERTYPE_IPV4,ip,sizeof(ip));
+		ip[7] = 0xb9; // fragment offset, no ports
+		const uint64_t f4 = Switch::flowId(m1,m2,ZT_ETHERTYPE_IPV4,ip,sizeof(ip));
+		ip[21] = 0x03;
+		const uint64_t f5 = Switch::flowId(m1,m2,ZT_ETHERTYPE_IPV4,ip,sizeof(ip));
+		bool ok = ((f1)&&(f1 == f2)&&(f1 != f3)&&(f4 == f5)&&(f4 != f3));
+		if (ok) {
+			std::cout << "PASS" << std::endl;
+		} else {
+			std::cout << "FAIL" << std::endl;
+			return -1;
+		}
+	}
+
+	{
+		// Paths with 10ms and 40ms latency and one not yet measured: balance mode
+		// weights them 4:1 and lifts the unmeasured one to 1/8 of the busiest.
+		std::cout << "[other] Testing multipath path selection... "; std::cout.flush();
+		Node *const n = testNodeNew(1000);
+		RuntimeEnvironment rr(n);
+		rr.identity.fromString(KNOWN_GOOD_IDENTITY);
+		Trace t(&rr);
+		rr.t = &t;
+		SharedPtr<Peer> peer(new Peer(&rr,rr.identity,rr.identity));
+		SharedPtr<Path> paths[3];
+		const unsigned int rtt[3] = { 10,40,0 };
+		for(unsigned int i=0;i<3;++i) {
+			char tmp[64];
+			OSUtils::ztsnprintf(tmp,sizeof(tmp),"10.0.0.%u/9993",i + 1);
+			paths[i] = SharedPtr<Path>(new Path((int64_t)i + 1,InetAddress(tmp)));
+			paths[i]->received(1000);
+			for(unsigned int k=0;(rtt[i])&&(k<8);++k)
+				paths[i]->replyReceived(0,rtt[i]);
+			peer->received((void *)0,paths[i],0,(uint64_t)i + 1,Packet::VERB_OK,0,Packet::VERB_NOP,false,0);
+		}
+		unsigned int picks[3] = { 0,0,0 };
+		for(unsigned int k=0;k<1100;++k) {
+			const SharedPtr<Path> p(peer->getMultipath(1000,ZT_MULTIPATH_BALANCE,0));
+			for(unsigned int i=0;i<3;++i) {
+				if (p == paths[i])
+					++picks[i];
+			}
+		}
+		bool ok = ((picks[0] >= 790)&&(picks[0] <= 810)&&(picks[1] >= 190)&&(picks[1] <= 210)&&(picks[2] >= 95)&&(picks[2] <= 105)&&((picks[0] + picks[1] + picks[2]) == 1100));
+
+		// Flow hash mode sends each flow over one path and spreads flows over all of them
+		unsigned int flows[3] = { 0,0,0 };
+		for(uint64_t f=1;f<=300;++f) {
+			const SharedPtr<Path> p(peer->getMultipath(1000,ZT_MULTIPATH_FLOW_HASH,f * 0x9e3779b97f4a7c15ULL));
+			for(unsigned int k=0;k<4;++k)
+				ok &= (peer->getMultipath(1000,ZT_MULTIPATH_FLOW_HASH,f * 0x9e3779b97f4a7c15ULL) == p);
+			for(unsigned int i=0;i<3;++i) {
+				if (p == paths[i])
+					++flows[i];
+			}
+		}
+		ok &= ((flows[0] > 50)&&(flows[1] > 50)&&(flows[2] > 50)&&((flows[0] + flows[1] + flows[2]) == 300));
+
+		// With fewer than two live paths there is nothing to spread over
+		SharedPtr<Peer> single(new Peer(&rr,rr.identity,rr.identity));
+		single->received((void *)0,paths[0],0,4,Packet::VERB_OK,0,Packet::VERB_NOP,false,0);
+		ok &= ((!single->getMultipath(1000,ZT_MULTIPATH_BALANCE,0))&&(!single->getMultipath(1000,ZT_MULTIPATH_FLOW_HASH,1)));
+		paths[0]->received(1000 + ZT_PATH_HEARTBEAT_PERIOD + 5000);
+		ok &= (!peer->getMultipath(1000 + ZT_PATH_HEARTBEAT_PERIOD + 5000,ZT_MULTIPATH_BALANCE,0)); // only path 0 is still alive
+
+		single.zero();
+		peer.zero();
+		for(unsigned int i=0;i<3;++i)
+			paths[i].zero();
+		delete n;
+
+		if (ok) {
+			std::cout << "PASS" << std::endl;
+		} else {
+			std::cout << "FAIL (balance " << picks[0] << "/" << picks[1] << "/" << picks[2] << ", flows " << flows[0] << "/" << flows[1] << "/" << flows[2] << ")" << std::endl;
+			return -1;
+		}
+	}
+
+	{
+		// With 16 entries every insert probes the whole table, so the drop
+		// counters show exactly which entries were found, kept, or evicted.
+		std::cout << "[other] Testing receive queue lookup, eviction, and resize... "; std::cout.flush();
+		Node *const n = testNodeNew(1000);
+		n->setReceiveQueueSize(16);
+		const Address src(0x0102030405ULL);
+		ZT_NodeStatus st;
+		bool ok = true;
+
+		// Heads, then their tails: each tail must find its head's entry
+		for(uint64_t i=0;i<16;++i)
+			testRxQueueSend(n,1000,src,0x1000 + i,true,false);
+		for(uint64_t i=0;i<16;++i)
+			testRxQueueSend(n,1500,src,0x1000 + i,false,true);
+		n->status(&st);
+		ok &= ((st.rxQueueFragmentDrops == 0)&&(st.rxQueueWaitingDrops == 0));
+
+		// New heads evict the older, complete packets waiting on WHOIS
+		for(uint64_t i=0;i<16;++i)
+			testRxQueueSend(n,2000,src,0x2000 + i,true,false);
+		n->status(&st);
+		ok &= ((st.rxQueueFragmentDrops == 0)&&(st.rxQueueWaitingDrops == 16));
+
+		// After growing, the full old table no longer causes evictions
+		n->setReceiveQueueSize(64);
+		for(uint64_t i=0;i<16;++i)
+			testRxQueueSend(n,3000,src,0x3000 + i,true,false);
+		n->status(&st);
+		ok &= ((st.rxQueueFragmentDrops == 0)&&(st.rxQueueWaitingDrops == 16));
+
+		// Housekeeping frees the retired table, and fragments keep working after
+		volatile int64_t dl = 0;
+		n->processBackgroundTasks((void *)0,10000,&dl);
+		n->processBackgroundTasks((void *)0,20000,&dl);
+		testRxQueueSend(n,20000,src,0x4000,true,false);
+		testRxQueueSend(n,20000,src,0x4000,false,true);
+		n->status(&st);
+		ok &= ((st.rxQueueFragmentDrops == 0)&&(st.rxQueueWaitingDrops == 16));
+		delete n;
+
+		if (ok) {
+			std::cout << "PASS" << std::endl;
+		} else {
+			std::cout << "FAIL (" << st.rxQueueFragmentDrops << " fragment drops, " << st.rxQueueWaitingDrops << " waiting drops)" << std::endl;
+			return -1;
+		}
+	}
+
+	{
+		// Peers are spread over the address space with gaps and loaded in
+		// scrambled order, then walked in pages of every size that matters.
+		std::cout << "[other] Testing peer lookup and paging... "; std::cout.flush();
+		Node *const n = testNodeNew(1000);
+		std::vector<uint64_t> addrs;
+		for(uint64_t i=0;i<300;++i) {
+			const uint64_t a = 0x2000000000ULL + (((i * 7) % 300) * 0x9e3779b1ULL);
+			testNodeLoadPeer(n,1000,Address(a));
+			addrs.push_back(a);
+		}
+		std::sort(addrs.begin(),addrs.end());
+
+		// The full list is the reference: sorted and containing every loaded peer (plus roots)
+		std::vector<uint64_t> all;
+		ZT_PeerList *pl = n->peers();
+		for(unsigned long i=0;i<pl->peerCount;++i)
+			all.push_back(pl->peers[i].address);
+		n->freeQueryResult((void *)pl);
+		bool ok = (std::is_sorted(all.begin(),all.end()))&&(std::includes(all.begin(),all.end(),addrs.begin(),addrs.end()));
+
+		// Pages of 1, 7, exactly all, and more than all, each continuing after the last address
+		const unsigned int pageSizes[4] = { 1,7,(unsigned int)all.size(),(unsigned int)all.size() + 1 };
+		for(unsigned int ps=0;ps<4;++ps) {
+			std::vector<uint64_t> walked;
+			uint64_t after = 0;
+			for(;;) {
+				pl = n->peersAfter(after,pageSizes[ps],ZT_PEER_FIELD_ALL);
+				const unsigned long cnt = pl->peerCount;
+				for(unsigned long i=0;i<cnt;++i)
+					walked.push_back(pl->peers[i].address);
+				if (cnt)
+					after = pl->peers[cnt - 1].address;
+				n->freeQueryResult((void *)pl);
+				ok &= (cnt <= pageSizes[ps]);
+				if (cnt < pageSizes[ps])
+					break;
+			}
+			ok &= (walked == all);
+		}
+
+		// after is exclusive, and an address in a gap continues at the next peer
+		pl = n->peersAfter(addrs[41],2,0);
+		ok &= ((pl->peerCount == 2)&&(pl->peers[0].address == addrs[42])&&(pl->peers[1].address == addrs[43]));
+		n->freeQueryResult((void *)pl);
+		pl = n->peersAfter(addrs[41] + 1,1,0);
+		ok &= ((pl->peerCount == 1)&&(pl->peers[0].address == addrs[42]));
+		n->freeQueryResult((void *)pl);
+		pl = n->peersAfter(all.back(),16,0);
+		ok &= (pl->peerCount == 0);
+		n->freeQueryResult((void *)pl);
+		pl = n->peersAfter(0,0,0);
+		ok &= (pl->peerCount == 0);
+		n->freeQueryResult((void *)pl);
+
+		// Single lookups fill in only the fields asked for and miss gaps
+		ZT_Peer *zp = ZT_Node_peer(reinterpret_cast<ZT_Node *>(n),addrs[100],ZT_PEER_FIELD_VERSION);
+		ok &= ((zp)&&(zp->address == addrs[100])&&(zp->versionMajor == 1)&&(zp->versionMinor == 2)&&(zp->versionRev == 3));
+		n->freeQueryResult((void *)zp);
+		zp = ZT_Node_peer(reinterpret_cast<ZT_Node *>(n),addrs[100],0);
+		ok &= ((zp)&&(zp->address == addrs[100])&&(zp->versionMajor == 0));
+		n->freeQueryResult((void *)zp);
+		ok &= (ZT_Node_peer(reinterpret_cast<ZT_Node *>(n),addrs[100] + 1,ZT_PEER_FIELD_ALL) == (ZT_Peer *)0);
+
+		// GET /peer pages: from the start or after an address, with or without a limit, in pages of 1, 16 and all
+		for(unsigned int q=0;q<9;++q) {
+			std::vector<uint64_t> expect(all);
+			uint64_t after = 0;
+			unsigned long remaining = 0xffffffffUL;
+			unsigned long count = 0;
+			if ((q % 3) >= 1) {
+				after = addrs[9];
+				expect.erase(expect.begin(),std::upper_bound(expect.begin(),expect.end(),addrs[9]));
+			}
+			if ((q % 3) == 2) {
+				remaining = 25;
+				expect.resize(25);
+			}
+			const unsigned int pageSize = (q < 3) ? 1 : ((q < 6) ? 16 : 0xffffffffU);
+			std::string json("[");
+			unsigned int calls = 0;
+			while ((remaining)&&(++calls < 1000))
+				ok &= OneService::peersToJson(n,after,remaining,count,pageSize,json);
+			json.push_back(']');
+			const nlohmann::json pj(OSUtils::jsonParse(json));
+			ok &= ((pj.is_array())&&(pj.size() == expect.size())&&(count == expect.size()));
+			for(unsigned long i=0;(ok)&&(i<expect.size());++i)
+				ok &= (Utils::hexStrToU64(OSUtils::jsonString(pj[i]["address"],"").c_str()) == expect[i]);
+		}
+
+		// Peers that expire leave the listing; the rest still page in order
+		volatile int64_t dl = 0;
+		n->processBackgroundTasks((void *)0,1000 + ZT_PEER_ACTIVITY_TIMEOUT + 1000,&dl);
+		pl = n->peersAfter(0,0xffffffffU,0);
+		std::vector<uint64_t> left;
+		for(unsigned long i=0;i<pl->peerCount;++i)
+			left.push_back(pl->peers[i].address);
+		n->freeQueryResult((void *)pl);
+		ok &= ((std::is_sorted(left.begin(),left.end()))&&(left.size() < all.size()));
+		for(std::vector<uint64_t>::const_iterator a(addrs.begin());a!=addrs.end();++a)
+			ok &= (!std::binary_search(left.begin(),left.end(),*a));
+		testNodeLoadPeer(n,1000 + ZT_PEER_ACTIVITY_TIMEOUT + 1000,Address(addrs[5]));
+		pl = n->peersAfter(addrs[5] - 1,1,0);
+		ok &= ((pl->peerCount == 1)&&(pl->peers[0].address == addrs[5]));
+		n->freeQueryResult((void *)pl);
+		delete n;
+
+		if (ok) {
+			std::cout << "PASS" << std::endl;
+		} else {
+			std::cout << "FAIL" << std::endl;
+			return -1;
+		}
+	}
+
+	{
+		// The first frame of a flow fills the flow cache and the second is served from it
+		std::cout << "[other] Testing redirected flows with the flow cache... "; std::cout.flush();
+		Node *const n = testNodeNew(1000);
+		const uint64_t nwid = 0x8056c2e21c000001ULL;
+		const Address target(0x3000000001ULL),dest(0x3000000002ULL);
+		const InetAddress targetAt("10.9.0.1/9993");
+		testNodeLoadPeer(n,1000,target);
+		testNodeLearnPath(n,1000,target,1,targetAt);
+		n->join(nwid,(void *)0,(void *)0);
+		NetworkConfig *const nc = new NetworkConfig();
+		nc->networkId = nwid;
+		nc->timestamp = 1000;
+		nc->revision = 1;
+		nc->issuedTo = n->identity().address();
+		nc->ruleCount = 1;
+		memset(&(nc->rules[0]),0,sizeof(ZT_VirtualNetworkRule));
+		nc->rules[0].t = (uint8_t)ZT_NETWORK_RULE_ACTION_REDIRECT;
+		nc->rules[0].v.fwd.address = target.toInt();
+		SharedPtr<Network> nw(n->network(nwid));
+		bool ok = ((nw)&&(nw->setConfiguration((void *)0,*nc,false) != 0));
+		delete nc;
+
+		uint8_t f[64];
+		memset(f,0,sizeof(f));
+		f[0] = 0x45; f[9] = 0x06;
+		f[12] = 10; f[15] = 1; f[16] = 10; f[19] = 2;
+		f[23] = 80;
+		testNodeSent.clear();
+		for(unsigned int i=0;(ok)&&(i<2);++i)
+			ok = !nw->filterOutgoingPacket((void *)0,false,n->identity().address(),dest,MAC(0x020000000001ULL),MAC(0x020000000002ULL),f,sizeof(f),ZT_ETHERTYPE_IPV4,0); // false since redirected
+
+		// Both frames go to the redirect target
+		uint8_t key[ZT_PEER_SECRET_KEY_LENGTH];
+		testNodePeerKey(key);
+		unsigned int frames = 0;
+		for(std::vector< std::pair< InetAddress,std::string > >::const_iterator s(testNodeSent.begin());s!=testNodeSent.end();++s) {
+			if ((s->first == targetAt)&&(s->second.length() >= ZT_PROTO_MIN_PACKET_LENGTH)) {
+				Packet p(s->second.data(),(unsigned int)s->second.length());
+				if ((p.destination() == target)&&(p.dearmor(key))&&(p.uncompress())&&(p.verb() == Packet::VERB_EXT_FRAME)&&(p.at<uint64_t>(ZT_PACKET_IDX_PAYLOAD) == nwid))
+					++frames;
+			}
+		}
+		ok &= (frames == 2);
+		nw.zero(); // before the node it belongs to
+		delete n;
+
+		if (ok) {
+			std::cout << "PASS" << std::endl;
+		} else {
+			std::cout << "FAIL (" << frames << " frames reached the redirect target)" << std::endl;
+			return -1;
+		}
+	}
+
+	{
+		// Unanswered probes count as lost once the next one goes out, and loss and jitter make a path worse
+		std::cout << "[other] Testing path probe statistics... "; std::cout.flush();
+		Path clean(0,InetAddress("10.0.0.1/9993")),lossy(0,InetAddress("10.0.0.2/9993"));
+		for(uint64_t i=1;i<=40;++i) {
+			clean.probeSent((int64_t)i * 10000,i);
+			clean.replyReceived(i,25);
+			lossy.probeSent((int64_t)i * 10000,i);
+			if ((i % 4) != 0)
+				lossy.replyReceived(i,(i & 1) ? 20 : 30);
+		}
+		unsigned int h[ZT_PATH_RTT_HISTOGRAM_BUCKETS];
+		lossy.rttHistogram(h);
+		bool ok = ((clean.packetLoss() == 0)&&(clean.jitter() == 0)&&(lossy.packetLoss() == 250)&&(lossy.jitter() >= 5)&&(lossy.jitter() <= 10));
+		ok &= ((h[2] == 20)&&(h[3] == 10)&&(h[0] == 0)&&(h[7] == 0));
+		ok &= (lossy.quality(400000) > clean.quality(400000));
+		// Probes whose reply may have been rate limited away by another ECHO are only counted if answered
+		Path shared(0,InetAddress("10.0.0.3/9993"));
+		for(uint64_t i=1;i<=40;++i) {
+			shared.probeSent((int64_t)i * 10000,i,false);
+			if ((i % 4) == 0)
+				shared.replyReceived(i,25);
+		}
+		shared.probeSent(410000,41);
+		ok &= (shared.packetLoss() == 0);
+		if (ok) {
+			std::cout << "PASS" << std::endl;
+		} else {
+			std::cout << "FAIL" << std::endl;
+			return -1;
+		}
+	}
+
 	std::cout << "[other] Testing InetAddress encode/decode..."; std::cout.flush();
 	std::cout << " " << InetAddress("127.0.0.1/9993").toString(buf);
 	std::cout << " " << InetAddress("feed:dead:babe:dead:beef:f00d:1234:5678/12345").toString(buf);
@@ -881,6 +2448,97 @@ static int testOther()
 	std::cout << "PASS" << std::endl;
 #endif
 
+	std::cout << "[other] Testing ConcurrentHashtable with concurrent readers, writers, and reclaim... "; std::cout.flush();
+	{
+		ConcurrentHashtable< Path::HashKey,Path > ct;
+		std::vector<InetAddress> addrs;
+		for(uint32_t i=0;i<4096;++i)
+			addrs.push_back(InetAddress(0x0a000000 + i,9993));
+		bool ok = true;
+		for(unsigned int i=0;i<addrs.size();++i) {
+			const SharedPtr<Path> p(new Path(1,addrs[i]));
+			ok &= (ct.add(Path::HashKey(1,addrs[i]),p) == p);
+			ok &= (ct.add(Path::HashKey(1,addrs[i]),SharedPtr<Path>(new Path(1,addrs[i]))) == p); // existing value wins
+		}
+		ok &= (ct.size() == addrs.size());
+
+		// Readers check every hit against its key while the writer erases, re-adds, and reclaims
+		std::atomic<bool> run(true);
+		std::atomic<unsigned long> bad(0);
+		std::vector<std::thread> readers;
+		for(unsigned int t=0;t<4;++t) {
+			readers.push_back(std::thread([&ct,&addrs,&run,&bad,t]() {
+				unsigned int i = t * 997;
+				while (run) {
+					const InetAddress &a = addrs[++i % addrs.size()];
+					const SharedPtr<Path> p(ct.get(Path::HashKey(1,a)));
+					if ((p)&&(p->address() != a))
+						++bad;
+				}
+			}));
+		}
+		for(unsigned int round=0;round<20;++round) {
+			for(unsigned int i=round % 2;i<addrs.size();i+=2)
+				ct.erase(Path::HashKey(1,addrs[i]));
+			ct.reclaim();
+			for(unsigned int i=round % 2;i<addrs.size();i+=2)
+				ct.add(Path::HashKey(1,addrs[i]),SharedPtr<Path>(new Path(1,addrs[i])));
+			ct.reclaim();
+		}
+		run = false;
+		for(std::vector<std::thread>::iterator t(readers.begin());t!=readers.end();++t)
+			t->join();
+		ok &= ((bad == 0)&&(ct.size() == addrs.size()));
+		for(unsigned int i=0;i<addrs.size();++i) {
+			const SharedPtr<Path> p(ct.get(Path::HashKey(1,addrs[i])));
+			ok &= ((p)&&(p->address() == addrs[i])&&(!ct.get(Path::HashKey(2,addrs[i]))));
+		}
+		if (!ok) {
+			std::cout << "FAILED" << std::endl;
+			return -1;
+		}
+		std::cout << "PASS" << std::endl;
+
+		// Same lookup pattern as Topology::getPath() for each packet, against the previous single mutex and Hashtable
+		const unsigned int threads = std::max(2U,std::min(8U,std::thread::hardware_concurrency()));
+		Hashtable< Path::HashKey,SharedPtr<Path> > ht;
+		Mutex ht_m;
+		for(unsigned int i=0;i<addrs.size();++i)
+			ht.set(Path::HashKey(1,addrs[i]),ct.get(Path::HashKey(1,addrs[i])));
+		for(int locked=1;locked>=0;--locked) {
+			std::cout << "[other] Benchmarking path lookups with " << threads << " threads (" << ((locked) ? "Hashtable and mutex" : "ConcurrentHashtable") << ")... "; std::cout.flush();
+			std::atomic<unsigned long> lookups(0);
+			std::vector<std::thread> workers;
+			const int64_t start = OSUtils::now();
+			for(unsigned int t=0;t<threads;++t) {
+				workers.push_back(std::thread([&,t]() {
+					unsigned long n = 0;
+					unsigned int i = t * 997;
+					while ((OSUtils::now() - start) < 1000) {
+						for(unsigned int k=0;k<1024;++k) {
+							const Path::HashKey key(1,addrs[++i % addrs.size()]);
+							SharedPtr<Path> p;
+							if (locked) {
+								Mutex::Lock _l(ht_m);
+								const SharedPtr<Path> *const hp = ht.get(key);
+								if (hp)
+									p = *hp;
+							} else {
+								p = ct.get(key);
+							}
+							n += (unsigned long)(bool)p;
+						}
+					}
+					lookups += n;
+				}));
+			}
+			for(std::vector<std::thread>::iterator t(workers.begin());t!=workers.end();++t)
+				t->join();
+			const int64_t end = OSUtils::now();
+			std::cout << ((double)lookups / ((double)(end - start) / 1000.0)) << " lookups/second" << std::endl;
+		}
+	}
+
 	std::cout << "[other] Testing/fuzzing Dictionary... "; std::cout.flush();
 	for(int k=0;k<1000;++k) {
 		Dictionary<8194> *test = new Dictionary<8194>();
@@ -933,20 +2591,131 @@ static int testOther()
 	}
 	std::cout << "PASS (junk value to prevent optimization-out of test: " << foo << ")" << std::endl;
 
+	std::cout << "[other] Testing PeerStore put/get, compaction, reload after torn write or damage, expiry, and failed writes... "; std::cout.flush();
+	{
+		const char *const psPath = "zerotier-selftest-peers.db";
+		OSUtils::rm(psPath);
+		char pd[256];
+		bool ok = true;
+		{
+			// Another thread reads while records are appended and the file is compacted
+			PeerStore ps(psPath);
+			std::atomic<bool> reading(true),readOk(true);
+			std::thread reader([&ps,&reading,&readOk]() {
+				char rd[256];
+				for(unsigned int i=0;reading;i=(i + 1) % 2000) {
+					char prefix[16];
+					OSUtils::ztsnprintf(prefix,sizeof(prefix),"%u:",i);
+					const int l = ps.get(0x1000000000ULL + i,rd,sizeof(rd));
+					if ((l >= 0)&&((l != (int)sizeof(rd))||(strncmp(rd,prefix,strlen(prefix)) != 0)||((unsigned char)rd[sizeof(rd) - 1] != (i & 0xff))))
+						readOk = false;
+				}
+			});
+			for(int round=0;round<6;++round) {
+				for(unsigned int i=0;i<2000;++i) {
+					memset(pd,(int)(i & 0xff),sizeof(pd));
+					OSUtils::ztsnprintf(pd,sizeof(pd),"%u:%d",i,round);
+					ps.put(0x1000000000ULL + i,pd,sizeof(pd),(int64_t)(round * 10000) + i);
+				}
+				ok &= ps.flush();
+			}
+			reading = false;
+			reader.join();
+			ok = ((ok)&&(readOk));
+			memset(pd,0,sizeof(pd));
+			OSUtils::ztsnprintf(pd,sizeof(pd),"0:5");
+			ps.put(0x1000000000ULL,pd,sizeof(pd),0); // unchanged, so its timestamp stays 50000 and it survives expire() below
+			ps.erase(0x1000000001ULL);
+			ok = ((ok)&&(ps.size() == 1999)&&(ps.get(0x1000000001ULL,pd,sizeof(pd)) < 0)&&(ps.get(0x2000000000ULL,pd,sizeof(pd)) < 0));
+		}
+		ok = ((ok)&&(OSUtils::getFileSize(psPath) < (2000 * 3 * (int64_t)sizeof(pd)))); // compacted at least once
+		FILE *f = fopen(psPath,"ab");
+		ok = ((ok)&&(f)&&(fwrite("\x00\x00\x01\x00torn",1,8,f) == 8));
+		if (f)
+			fclose(f);
+		if (ok) {
+			PeerStore ps(psPath);
+			ok = (ps.size() == 1999);
+			for(unsigned int i=0;(ok)&&(i<2000);++i) {
+				char expected[32];
+				OSUtils::ztsnprintf(expected,sizeof(expected),"%u:5",i);
+				const int l = ps.get(0x1000000000ULL + i,pd,sizeof(pd));
+				ok = (i == 1) ? (l < 0) : ((l == (int)sizeof(pd))&&(strcmp(pd,expected) == 0)&&((unsigned char)pd[sizeof(pd) - 1] == (i & 0xff)));
+			}
+			ok = ((ok)&&(ps.expire(50500) == 499)&&(ps.size() == 1500));
+		}
+		if (ok) {
+			PeerStore ps(psPath);
+			ok = ((ps.size() == 1500)&&(ps.get(0x1000000000ULL + 499,pd,sizeof(pd)) < 0)&&(ps.get(0x1000000000ULL + 500,pd,sizeof(pd)) == (int)sizeof(pd)));
+		}
+		OSUtils::rm(psPath);
+
+		// Damage the contents of one record and the length of another in a file of
+		// 100: only those two are lost, including everything written after them
+		if (ok) {
+			PeerStore ps(psPath);
+			for(unsigned int i=0;i<100;++i) {
+				memset(pd,(int)i,sizeof(pd));
+				ps.put(0x1000000000ULL + i,pd,sizeof(pd),1);
+			}
+		}
+		std::string db;
+		ok = ((ok)&&(OSUtils::readFile(psPath,db))&&(db.length() == (8 + (100 * (28 + sizeof(pd))))));
+		if (ok) {
+			db[8 + (30 * (28 + sizeof(pd))) + 20 + 5] ^= 1;
+			db[8 + (70 * (28 + sizeof(pd)))] = 0x7f;
+			ok = OSUtils::writeFile(psPath,db);
+		}
+		for(int reload=0;(ok)&&(reload<2);++reload) { // the second load reads the rewritten file
+			PeerStore ps(psPath);
+			unsigned long found = 0;
+			for(unsigned int i=0;(ok)&&(i<100);++i) {
+				const int l = ps.get(0x1000000000ULL + i,pd,sizeof(pd));
+				if (l >= 0) {
+					ok = ((l == (int)sizeof(pd))&&((unsigned char)pd[0] == i)&&((unsigned char)pd[sizeof(pd) - 1] == i));
+					++found;
+				}
+			}
+			ok = ((ok)&&(found == 98)&&(ps.size() == 98)&&(OSUtils::getFileSize(psPath) == (int64_t)(8 + (98 * (28 + sizeof(pd))))));
+		}
+		OSUtils::rm(psPath);
+
+		// A file that can't be written: flush() reports it and the change stays pending and readable
+		if (ok) {
+			ok = OSUtils::mkdir(psPath);
+			PeerStore ps(psPath);
+			memset(pd,7,sizeof(pd));
+			ps.put(0x1000000007ULL,pd,sizeof(pd),1);
+			memset(pd,0,sizeof(pd));
+			ok = ((ok)&&(!ps.flush())&&(!ps.flush())&&(ps.size() == 1)&&(ps.get(0x1000000007ULL,pd,sizeof(pd)) == (int)sizeof(pd))&&((unsigned char)pd[sizeof(pd) - 1] == 7));
+		}
+		OSUtils::rmDashRf(psPath);
+		if (!ok) {
+			std::cout << "FAILED" << std::endl;
+			return -1;
+		}
+		std::cout << "PASS" << std::endl;
+	}
+
 	return 0;
 }
 
 #define ZT_TEST_PHY_NUM_UDP_PACKETS 10000
 #define ZT_TEST_PHY_UDP_PACKET_SIZE 1000
+#define ZT_TEST_PHY_UDP_LARGE_PACKET_SIZE 60000
 #define ZT_TEST_PHY_NUM_VALID_TCP_CONNECTS 10
 #define ZT_TEST_PHY_NUM_INVALID_TCP_CONNECTS 2
 #define ZT_TEST_PHY_TCP_MESSAGE_SIZE 1000000
 #define ZT_TEST_PHY_TIMEOUT_MS 20000
+#define ZT_TEST_PHY_NUM_UDP_ECHOES 10000
 static unsigned long phyTestUdpPacketCount = 0;
+static unsigned long phyTestUdpEchoesRemaining = 0;
+static unsigned long phyTestUdpLargestDatagram = 0;
 static unsigned long phyTestTcpByteCount = 0;
 static unsigned long phyTestTcpConnectSuccessCount = 0;
 static unsigned long phyTestTcpConnectFailCount = 0;
 static unsigned long phyTestTcpAcceptCount = 0;
+static unsigned long phyTestTcpClientCloseCount = 0;
 struct TestPhyHandlers;
 static Phy<TestPhyHandlers *> *testPhyInstance = (Phy<TestPhyHandlers *> *)0;
 struct TestPhyHandlers
@@ -954,6 +2723,12 @@ struct TestPhyHandlers
 	inline void phyOnDatagram(PhySocket *sock,void **uptr,const struct sockaddr *localAddr,const struct sockaddr *from,void *data,unsigned long len)
 	{
 		++phyTestUdpPacketCount;
+		if (len > phyTestUdpLargestDatagram)
+			phyTestUdpLargestDatagram = len;
+		if (phyTestUdpEchoesRemaining > 0) {
+			--phyTestUdpEchoesRemaining;
+			testPhyInstance->udpSendBatched(sock,from,data,len);
+		}
 	}
 
 	inline void phyOnTcpConnect(PhySocket *sock,void **uptr,bool success)
@@ -974,6 +2749,8 @@ struct TestPhyHandlers
 
 	inline void phyOnTcpClose(PhySocket *sock,void **uptr)
 	{
+		if (!*uptr)
+			++phyTestTcpClientCloseCount; // only outgoing connections have no testMessage
 		delete (std::string *)*uptr; // delete testMessage if any
 	}
 
@@ -1004,6 +2781,58 @@ struct TestPhyHandlers
 
 	inline void phyOnFileDescriptorActivity(PhySocket *sock,void **uptr,bool readable,bool writable) {}
 };
+#ifdef SO_REUSEPORT
+// Stands in for a OneService I/O worker: its own Phy and thread on a shared port
+#define ZT_TEST_PHY_REUSEPORT_WORKERS 4
+#define ZT_TEST_PHY_REUSEPORT_SENDERS 64
+#define ZT_TEST_PHY_REUSEPORT_PACKETS_PER_SENDER 16
+struct TestPhyReusePortWorker
+{
+	TestPhyReusePortWorker() : phy(this,false,true),sock((PhySocket *)0),run(true),received(0),corrupt(0) {}
+
+	inline void phyOnDatagram(PhySocket *sock,void **uptr,const struct sockaddr *localAddr,const struct sockaddr *from,void *data,unsigned long len)
+	{
+		// Payload is a 32-bit sequence number followed by bytes derived from it
+		const unsigned char *const d = (const unsigned char *)data;
+		bool ok = (len == 64);
+		if (ok) {
+			const uint32_t seq = ((uint32_t)d[0] << 24) | ((uint32_t)d[1] << 16) | ((uint32_t)d[2] << 8) | (uint32_t)d[3];
+			for(unsigned int i=4;i<len;++i) {
+				if (d[i] != (unsigned char)(seq + i))
+					ok = false;
+			}
+		}
+		if (ok)
+			++received;
+		else ++corrupt;
+	}
+	inline void phyOnTcpConnect(PhySocket *sock,void **uptr,bool success) {}
+	inline void phyOnTcpAccept(PhySocket *sockL,PhySocket *sockN,void **uptrL,void **uptrN,const struct sockaddr *from) {}
+	inline void phyOnTcpClose(PhySocket *sock,void **uptr) {}
+	inline void phyOnTcpData(PhySocket *sock,void **uptr,void *data,unsigned long len) {}
+	inline void phyOnTcpWritable(PhySocket *sock,void **uptr) {}
+#ifdef __UNIX_LIKE__
+	inline void phyOnUnixAccept(PhySocket *sockL,PhySocket *sockN,void **uptrL,void **uptrN) {}
+	inline void phyOnUnixClose(PhySocket *sock,void **uptr) {}
+	inline void phyOnUnixData(PhySocket *sock,void **uptr,void *data,unsigned long len) {}
+	inline void phyOnUnixWritable(PhySocket *sock,void **uptr,bool b) {}
+#endif // __UNIX_LIKE__
+	inline void phyOnFileDescriptorActivity(PhySocket *sock,void **uptr,bool readable,bool writable) {}
+
+	inline void threadMain()
+	{
+		while (run)
+			phy.poll(100);
+	}
+
+	Phy<TestPhyReusePortWorker *> phy;
+	PhySocket *sock;
+	std::atomic<bool> run;
+	std::atomic<unsigned long> received;
+	std::atomic<unsigned long> corrupt;
+};
+#endif
+
 static int testPhy()
 {
 	char udpTestPayload[ZT_TEST_PHY_UDP_PACKET_SIZE];
@@ -1057,6 +2886,37 @@ static int testPhy()
 	}
 	std::cout << "got " << phyTestUdpPacketCount << " packets, OK" << std::endl;
 
+	std::cout << "[phy] Testing batched UDP send from handler... "; std::cout.flush();
+	const unsigned long phyTestUdpEchoTarget = phyTestUdpPacketCount + ZT_TEST_PHY_NUM_UDP_ECHOES;
+	phyTestUdpEchoesRemaining = ZT_TEST_PHY_NUM_UDP_ECHOES;
+	for(int i=0;i<16;++i)
+		testPhyInstance->udpSend(udpListenSock,(const struct sockaddr *)&bindaddr,udpTestPayload,sizeof(udpTestPayload));
+	timeoutAt = OSUtils::now() + ZT_TEST_PHY_TIMEOUT_MS;
+	while ((OSUtils::now() < timeoutAt)&&(phyTestUdpPacketCount < phyTestUdpEchoTarget))
+		testPhyInstance->poll(100);
+	if (phyTestUdpPacketCount < phyTestUdpEchoTarget) {
+		std::cout << "got " << (phyTestUdpPacketCount - (phyTestUdpEchoTarget - ZT_TEST_PHY_NUM_UDP_ECHOES)) << " packets, FAILED." << std::endl;
+		return -1;
+	}
+	std::cout << "got " << (phyTestUdpPacketCount - (phyTestUdpEchoTarget - ZT_TEST_PHY_NUM_UDP_ECHOES)) << " packets, OK" << std::endl;
+
+	std::cout << "[phy] Testing large UDP datagram... "; std::cout.flush();
+	{
+		std::vector<char> big(ZT_TEST_PHY_UDP_LARGE_PACKET_SIZE,(char)0xff);
+		if (!testPhyInstance->udpSend(udpListenSock,(const struct sockaddr *)&bindaddr,big.data(),(unsigned long)big.size())) {
+			std::cout << "send FAILED." << std::endl;
+			return -1;
+		}
+		timeoutAt = OSUtils::now() + ZT_TEST_PHY_TIMEOUT_MS;
+		while ((OSUtils::now() < timeoutAt)&&(phyTestUdpLargestDatagram < ZT_TEST_PHY_UDP_LARGE_PACKET_SIZE))
+			testPhyInstance->poll(100);
+		if (phyTestUdpLargestDatagram != ZT_TEST_PHY_UDP_LARGE_PACKET_SIZE) {
+			std::cout << "largest was " << phyTestUdpLargestDatagram << " bytes, FAILED." << std::endl;
+			return -1;
+		}
+	}
+	std::cout << "got " << phyTestUdpLargestDatagram << " bytes, OK" << std::endl;
+
 	std::cout << "[phy] Testing TCP... "; std::cout.flush();
 	timeoutAt = OSUtils::now() + ZT_TEST_PHY_TIMEOUT_MS;
 	while ((OSUtils::now() < timeoutAt)&&(phyTestTcpByteCount < (ZT_TEST_PHY_NUM_VALID_TCP_CONNECTS * ZT_TEST_PHY_TCP_MESSAGE_SIZE))) {
@@ -1081,6 +2941,110 @@ static int testPhy()
 		std::cout << "got " << phyTestTcpConnectSuccessCount << " connect successes, " << phyTestTcpConnectFailCount << " failures, and " << phyTestTcpByteCount << " bytes, OK" << std::endl;
 	}
 
+	// Each server closes right after its last write, so the tail of the data
+	// and the FIN often arrive together. Every client must still see the EOF.
+	std::cout << "[phy] Testing TCP close after final data... "; std::cout.flush();
+	timeoutAt = OSUtils::now() + ZT_TEST_PHY_TIMEOUT_MS;
+	while ((OSUtils::now() < timeoutAt)&&(phyTestTcpClientCloseCount < phyTestTcpConnectSuccessCount))
+		testPhyInstance->poll(100);
+	if (phyTestTcpClientCloseCount < phyTestTcpConnectSuccessCount) {
+		std::cout << "got " << phyTestTcpClientCloseCount << " of " << phyTestTcpConnectSuccessCount << " closes, FAILED." << std::endl;
+		return -1;
+	}
+	std::cout << "got " << phyTestTcpClientCloseCount << " closes, OK" << std::endl;
+
+#ifdef SO_REUSEPORT
+	std::cout << "[phy] Binding two SO_REUSEPORT UDP sockets to 127.0.0.1/60005... ";
+	bindaddr.sin_port = Utils::hton((uint16_t)60005);
+	PhySocket *reuseSock1 = testPhyInstance->udpBind((const struct sockaddr *)&bindaddr,(void *)0,0,true);
+	PhySocket *reuseSock2 = testPhyInstance->udpBind((const struct sockaddr *)&bindaddr,(void *)0,0,true);
+	if ((!reuseSock1)||(!reuseSock2)) {
+		std::cout << "FAILED." << std::endl;
+		return -1;
+	}
+	testPhyInstance->close(reuseSock1,false);
+	testPhyInstance->close(reuseSock2,false);
+	std::cout << "OK" << std::endl;
+
+	// The kernel hashes each sender's address to one socket, so with enough
+	// senders every worker should get some traffic and all of it intact.
+	std::cout << "[phy] Testing SO_REUSEPORT spread across " << ZT_TEST_PHY_REUSEPORT_WORKERS << " worker threads... "; std::cout.flush();
+	{
+		bindaddr.sin_port = Utils::hton((uint16_t)60006);
+		TestPhyReusePortWorker *workers[ZT_TEST_PHY_REUSEPORT_WORKERS];
+		std::thread workerThreads[ZT_TEST_PHY_REUSEPORT_WORKERS];
+		bool ok = true;
+		for(unsigned int w=0;w<ZT_TEST_PHY_REUSEPORT_WORKERS;++w) {
+			workers[w] = new TestPhyReusePortWorker();
+			workers[w]->sock = workers[w]->phy.udpBind((const struct sockaddr *)&bindaddr,(void *)0,0,true);
+			if (!workers[w]->sock)
+				ok = false;
+		}
+		if (ok) {
+			for(unsigned int w=0;w<ZT_TEST_PHY_REUSEPORT_WORKERS;++w)
+				workerThreads[w] = std::thread(&TestPhyReusePortWorker::threadMain,workers[w]);
+
+			struct sockaddr_in senderAddr;
+			memset(&senderAddr,0,sizeof(senderAddr));
+			senderAddr.sin_family = AF_INET;
+			senderAddr.sin_addr.s_addr = Utils::hton((uint32_t)0x7f000001);
+			uint32_t seq = 0;
+			unsigned long sent = 0;
+			for(unsigned int k=0;k<ZT_TEST_PHY_REUSEPORT_SENDERS;++k) {
+				senderAddr.sin_port = Utils::hton((uint16_t)(60100 + k));
+				PhySocket *const ss = testPhyInstance->udpBind((const struct sockaddr *)&senderAddr);
+				if (!ss)
+					continue;
+				for(unsigned int i=0;i<ZT_TEST_PHY_REUSEPORT_PACKETS_PER_SENDER;++i) {
+					unsigned char pkt[64];
+					pkt[0] = (unsigned char)(seq >> 24); pkt[1] = (unsigned char)(seq >> 16); pkt[2] = (unsigned char)(seq >> 8); pkt[3] = (unsigned char)seq;
+					for(unsigned int j=4;j<sizeof(pkt);++j)
+						pkt[j] = (unsigned char)(seq + j);
+					++seq;
+					if (testPhyInstance->udpSend(ss,(const struct sockaddr *)&bindaddr,pkt,sizeof(pkt)))
+						++sent;
+				}
+				testPhyInstance->close(ss,false);
+			}
+
+			timeoutAt = OSUtils::now() + ZT_TEST_PHY_TIMEOUT_MS;
+			unsigned long total = 0;
+			while (OSUtils::now() < timeoutAt) {
+				total = 0;
+				for(unsigned int w=0;w<ZT_TEST_PHY_REUSEPORT_WORKERS;++w)
+					total += workers[w]->received + workers[w]->corrupt;
+				if (total >= sent)
+					break;
+				Thread::sleep(10);
+			}
+
+			for(unsigned int w=0;w<ZT_TEST_PHY_REUSEPORT_WORKERS;++w) {
+				workers[w]->run = false;
+				workers[w]->phy.whack();
+				workerThreads[w].join();
+			}
+
+			unsigned long received = 0,corrupt = 0,idle = 0;
+			for(unsigned int w=0;w<ZT_TEST_PHY_REUSEPORT_WORKERS;++w) {
+				std::cout << ((w) ? "/" : "") << workers[w]->received;
+				received += workers[w]->received;
+				corrupt += workers[w]->corrupt;
+				if (!workers[w]->received)
+					++idle;
+			}
+			std::cout << " of " << sent << " datagrams";
+			ok = ((sent > 0)&&(received == sent)&&(corrupt == 0)&&(idle == 0));
+		}
+		for(unsigned int w=0;w<ZT_TEST_PHY_REUSEPORT_WORKERS;++w)
+			delete workers[w];
+		if (!ok) {
+			std::cout << ", FAILED." << std::endl;
+			return -1;
+		}
+		std::cout << ", OK" << std::endl;
+	}
+#endif
+
 	return 0;
 }
 
@@ -1145,8 +3109,11 @@ int main(int argc,char **argv)
 	r |= testOther();
 	r |= testCrypto();
 	r |= testPacket();
+	r |= testRules();
 	r |= testIdentity();
 	r |= testCertificate();
+	r |= testController();
+	r |= testControllerStartup();
 	r |= testPhy();
 	//*/
 
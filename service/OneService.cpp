@@ -34,6 +34,8 @@
 #include <vector>
 #include <algorithm>
 #include <list>
+#include <thread>
+#include <atomic>
 
 #include "../version.h"
 #include "../include/ZeroTierOne.h"
@@ -60,6 +62,7 @@
 
 #include "OneService.hpp"
 #include "SoftwareUpdater.hpp"
+#include "PeerStore.hpp"
 
 #ifdef __WINDOWS__
 #include <WinSock2.h>
@@ -162,6 +165,12 @@ namespace ZeroTier { typedef BSDEthernetTap EthernetTap; }
 // TCP activity timeout
 #define ZT_TCP_ACTIVITY_TIMEOUT 60000
 
+// Maximum number of UDP I/O threads (including the main thread)
+#define ZT_MAX_IO_THREADS 64
+
+// Peers serialized per write when sending GET /peer
+#define ZT_PEER_LISTING_PAGE_SIZE 256
+
 namespace ZeroTier {
 
 namespace {
@@ -278,6 +287,13 @@ static void _peerToJson(nlohmann::json &pj,const ZT_Peer *peer)
 		j["active"] = (bool)(peer->paths[i].expired == 0);
 		j["expired"] = (bool)(peer->paths[i].expired != 0);
 		j["preferred"] = (bool)(peer->paths[i].preferred != 0);
+		j["latency"] = peer->paths[i].latency;
+		j["jitter"] = peer->paths[i].jitter;
+		j["packetLoss"] = peer->paths[i].packetLoss;
+		nlohmann::json h = nlohmann::json::array();
+		for(unsigned int b=0;b<ZT_PATH_RTT_HISTOGRAM_BUCKETS;++b)
+			h.push_back(peer->paths[i].rttHistogram[b]);
+		j["rttHistogram"] = h;
 		pa.push_back(j);
 	}
 	pj["paths"] = pa;
@@ -353,6 +369,16 @@ static const struct http_parser_settings HTTP_PARSER_SETTINGS = {
 };
 #endif
 
+/**
+ * Progress of a GET /peer response that is sent a page at a time
+ */
+struct PeerListing
+{
+	uint64_t after; // address of the last peer sent
+	unsigned long remaining; // most peers still to send, 0 once the list is closed
+	unsigned long count; // peers sent so far
+};
+
 /**
  * A TCP connection and related state and buffers
  */
@@ -381,9 +407,71 @@ struct TcpConnection
 
 	std::string readq;
 	std::string writeq;
+	PeerListing peerListing; // refills writeq as it drains, guarded by writeq_m
 	Mutex writeq_m;
 };
 
+/**
+ * An additional UDP I/O thread with its own set of SO_REUSEPORT sockets
+ *
+ * Each worker binds the same addresses and ports as the main thread. The
+ * kernel spreads incoming datagrams across sockets sharing an address by
+ * hashing the remote endpoint, so each peer's traffic stays on one thread
+ * while different peers are processed in parallel.
+ */
+class OneServiceIoWorker
+{
+public:
+	OneServiceIoWorker(OneServiceImpl *p) :
+		parent(p),
+		phy(this,false,true),
+		portCount(0),
+		run(true),
+		refreshNeeded(false)
+	{
+		binder.setBindOptions(true,true);
+	}
+
+	// Called from the main thread after it refreshes its own bindings
+	inline void refresh(const unsigned int *p,unsigned int pc,const std::vector<InetAddress> &eb)
+	{
+		{
+			Mutex::Lock _l(refresh_m);
+			for(unsigned int i=0;i<pc;++i)
+				ports[i] = p[i];
+			portCount = pc;
+			explicitBind = eb;
+			refreshNeeded = true;
+		}
+		phy.whack();
+	}
+
+	void threadMain() throw();
+
+	inline void phyOnDatagram(PhySocket *sock,void **uptr,const struct sockaddr *localAddr,const struct sockaddr *from,void *data,unsigned long len);
+	inline void phyOnTcpConnect(PhySocket *sock,void **uptr,bool success) {}
+	inline void phyOnTcpAccept(PhySocket *sockL,PhySocket *sockN,void **uptrL,void **uptrN,const struct sockaddr *from) {}
+	inline void phyOnTcpClose(PhySocket *sock,void **uptr) {}
+	inline void phyOnTcpData(PhySocket *sock,void **uptr,void *data,unsigned long len) {}
+	inline void phyOnTcpWritable(PhySocket *sock,void **uptr) {}
+	inline void phyOnFileDescriptorActivity(PhySocket *sock,void **uptr,bool readable,bool writable) {}
+	inline void phyOnUnixAccept(PhySocket *sockL,PhySocket *sockN,void **uptrL,void **uptrN) {}
+	inline void phyOnUnixClose(PhySocket *sock,void **uptr) {}
+	inline void phyOnUnixData(PhySocket *sock,void **uptr,void *data,unsigned long len) {}
+	inline void phyOnUnixWritable(PhySocket *sock,void **uptr,bool lwip_invoked) {}
+
+	OneServiceImpl *const parent;
+	Phy<OneServiceIoWorker *> phy;
+	Binder binder;
+	Thread thread;
+	unsigned int ports[3];
+	unsigned int portCount;
+	std::vector<InetAddress> explicitBind;
+	Mutex refresh_m;
+	std::atomic<bool> run;
+	std::atomic<bool> refreshNeeded;
+};
+
 class OneServiceImpl : public OneService
 {
 public:
@@ -392,6 +480,8 @@ public:
 	const std::string _homePath;
 	std::string _authToken;
 	std::string _controllerDbPath;
+	unsigned int _controllerDbWriteDelay;
+	bool _controllerDbSync;
 	const std::string _networksPath;
 	const std::string _moonsPath;
 
@@ -399,12 +489,15 @@ public:
 	Phy<OneServiceImpl *> _phy;
 	Node *_node;
 	SoftwareUpdater *_updater;
+	PeerStore *_peerStore;
 	PhySocket *_localControlSocket4;
 	PhySocket *_localControlSocket6;
 	bool _updateAutoApply;
 	bool _allowTcpFallbackRelay;
 	unsigned int _primaryPort;
 	volatile unsigned int _udpPortPickerCounter;
+	unsigned int _tapQueues; // local.conf settings
+	unsigned int _ioThreads; // local.conf settings
 
 	// Local configuration and memo-ized information from it
 	json _localConfig;
@@ -432,17 +525,21 @@ public:
 	unsigned int _ports[3];
 	Binder _binder;
 
-	// Time we last received a packet from a global address
-	uint64_t _lastDirectReceiveFromGlobal;
+	// Additional UDP I/O threads (if ioThreads > 1), only changed at startup and shutdown
+	std::vector< OneServiceIoWorker * > _ioWorkers;
+
+	// Time we last received a packet from a global address (written by I/O threads)
+	std::atomic<int64_t> _lastDirectReceiveFromGlobal;
 #ifdef ZT_TCP_FALLBACK_RELAY
-	uint64_t _lastSendToGlobalV4;
+	std::atomic<int64_t> _lastSendToGlobalV4;
 #endif
 
 	// Last potential sleep/wake event
-	uint64_t _lastRestart;
+	std::atomic<int64_t> _lastRestart;
 
-	// Deadline for the next background task service function
-	volatile int64_t _nextBackgroundTaskDeadline;
+	// Deadline for the next background task service function. The core only
+	// updates this through a pointer to a local copy (see _lowerBackgroundTaskDeadline()).
+	std::atomic<int64_t> _nextBackgroundTaskDeadline;
 
 	// Configured networks
 	struct NetworkState
@@ -490,17 +587,22 @@ public:
 	OneServiceImpl(const char *hp,unsigned int port) :
 		_homePath((hp) ? hp : ".")
 		,_controllerDbPath(_homePath + ZT_PATH_SEPARATOR_S "controller.d")
+		,_controllerDbWriteDelay(ZT_CONTROLLER_FILEDB_DEFAULT_WRITE_DELAY)
+		,_controllerDbSync(false)
 		,_networksPath(_homePath + ZT_PATH_SEPARATOR_S "networks.d")
 		,_moonsPath(_homePath + ZT_PATH_SEPARATOR_S "moons.d")
 		,_controller((EmbeddedNetworkController *)0)
 		,_phy(this,false,true)
 		,_node((Node *)0)
 		,_updater((SoftwareUpdater *)0)
+		,_peerStore((PeerStore *)0)
 		,_localControlSocket4((PhySocket *)0)
 		,_localControlSocket6((PhySocket *)0)
 		,_updateAutoApply(false)
 		,_primaryPort(port)
 		,_udpPortPickerCounter(0)
+		,_tapQueues(1)
+		,_ioThreads(1)
 		,_lastDirectReceiveFromGlobal(0)
 #ifdef ZT_TCP_FALLBACK_RELAY
 		,_lastSendToGlobalV4(0)
@@ -554,6 +656,26 @@ public:
 				_authToken = _trimString(_authToken);
 			}
 
+			// Peer cache, imported once from the one-file-per-peer peers.d directory used by older versions
+			_peerStore = new PeerStore((_homePath + ZT_PATH_SEPARATOR_S "peers.db").c_str());
+			{
+				const std::string peersDir(_homePath + ZT_PATH_SEPARATOR_S "peers.d");
+				if (OSUtils::fileExists(peersDir.c_str(),false)) {
+					std::vector<std::string> peerFiles(OSUtils::listDirectory(peersDir.c_str()));
+					for(std::vector<std::string>::const_iterator pf(peerFiles.begin());pf!=peerFiles.end();++pf) {
+						if ((pf->length() == 15)&&(pf->substr(10) == ".peer")) {
+							const std::string pp(peersDir + ZT_PATH_SEPARATOR_S + *pf);
+							std::string buf;
+							if ((OSUtils::readFile(pp.c_str(),buf))&&(buf.length() > 0))
+								_peerStore->put(Utils::hexStrToU64(pf->substr(0,10).c_str()),buf.data(),(unsigned int)buf.length(),(int64_t)OSUtils::getLastModified(pp.c_str()));
+						}
+					}
+					// If the import can't be written, keep peers.d and import it again next start
+					if (_peerStore->flush())
+						OSUtils::rmDashRf(peersDir.c_str());
+				}
+			}
+
 			{
 				struct ZT_Node_Callbacks cb;
 				cb.version = 0;
@@ -637,6 +759,8 @@ public:
 					const std::string cdbp(OSUtils::jsonString(settings["controllerDbPath"],""));
 					if (cdbp.length() > 0)
 						_controllerDbPath = cdbp;
+					_controllerDbWriteDelay = (unsigned int)OSUtils::jsonInt(settings["controllerDbWriteDelay"],(uint64_t)_controllerDbWriteDelay);
+					_controllerDbSync = OSUtils::jsonBool(settings["controllerDbSync"],_controllerDbSync);
 
 					// Bind to wildcard instead of to specific interfaces (disables full tunnel capability)
 					json &bind = settings["bind"];
@@ -751,6 +875,7 @@ public:
 
 			// Network controller is now enabled by default for desktop and server
 			_controller = new EmbeddedNetworkController(_node,_controllerDbPath.c_str());
+			_controller->setFileDbWriteOptions(_controllerDbWriteDelay,_controllerDbSync);
 			_node->setNetconfMaster((void *)_controller);
 
 			// Join existing networks in networks.d
@@ -773,6 +898,18 @@ public:
 				}
 			}
 
+#ifdef SO_REUSEPORT
+			// Start additional UDP I/O threads, which share our ports via SO_REUSEPORT
+			if (_ioThreads > 1) {
+				_binder.setBindOptions(true,false);
+				for(unsigned int i=1;i<_ioThreads;++i) {
+					OneServiceIoWorker *const w = new OneServiceIoWorker(this);
+					_ioWorkers.push_back(w);
+					w->thread = Thread::start(w);
+				}
+			}
+#endif
+
 			// Main I/O loop
 			_nextBackgroundTaskDeadline = 0;
 			int64_t clockShouldBe = OSUtils::now();
@@ -820,6 +957,8 @@ public:
 							p[pc++] = _ports[i];
 					}
 					_binder.refresh(_phy,p,pc,explicitBind,*this);
+					for(std::vector< OneServiceIoWorker * >::const_iterator w(_ioWorkers.begin());w!=_ioWorkers.end();++w)
+						(*w)->refresh(p,pc,explicitBind);
 					{
 						Mutex::Lock _l(_nets_m);
 						for(std::map<uint64_t,NetworkState>::iterator n(_nets.begin());n!=_nets.end();++n) {
@@ -832,8 +971,10 @@ public:
 				// Run background task processor in core if it's time to do so
 				int64_t dl = _nextBackgroundTaskDeadline;
 				if (dl <= now) {
-					_node->processBackgroundTasks((void *)0,now,&_nextBackgroundTaskDeadline);
-					dl = _nextBackgroundTaskDeadline;
+					volatile int64_t ndl = dl;
+					_node->processBackgroundTasks((void *)0,now,&ndl);
+					dl = ndl;
+					_nextBackgroundTaskDeadline = dl;
 				}
 
 				// Close TCP fallback tunnel if we have direct UDP
@@ -881,10 +1022,10 @@ public:
 						_node->addLocalInterfaceAddress(reinterpret_cast<const struct sockaddr_storage *>(&(*i)));
 				}
 
-				// Clean peers.d periodically
+				// Expire old peers from the peer cache periodically
 				if ((now - lastCleanedPeersDb) >= 3600000) {
 					lastCleanedPeersDb = now;
-					OSUtils::cleanDirectory((_homePath + ZT_PATH_SEPARATOR_S "peers.d").c_str(),now - 2592000000LL); // delete older than 30 days
+					_peerStore->expire(now - 2592000000LL); // delete older than 30 days
 				}
 
 				const unsigned long delay = (dl > now) ? (unsigned long)(dl - now) : 100;
@@ -901,6 +1042,12 @@ public:
 			_fatalErrorMessage = "unexpected exception in main thread: unknown exception";
 		}
 
+		for(std::vector< OneServiceIoWorker * >::const_iterator w(_ioWorkers.begin());w!=_ioWorkers.end();++w) {
+			(*w)->run = false;
+			(*w)->phy.whack();
+			Thread::join((*w)->thread);
+		}
+
 		try {
 			Mutex::Lock _l(_tcpConnections_m);
 			while (!_tcpConnections.empty())
@@ -918,6 +1065,12 @@ public:
 		_updater = (SoftwareUpdater *)0;
 		delete _node;
 		_node = (Node *)0;
+		delete _peerStore; // after node, which saves all peers on delete
+		_peerStore = (PeerStore *)0;
+
+		for(std::vector< OneServiceIoWorker * >::const_iterator w(_ioWorkers.begin());w!=_ioWorkers.end();++w)
+			delete *w;
+		_ioWorkers.clear();
 
 		return _termReason;
 	}
@@ -1038,7 +1191,8 @@ public:
 		const std::map<std::string,std::string> &headers,
 		const std::string &body,
 		std::string &responseBody,
-		std::string &responseContentType)
+		std::string &responseContentType,
+		PeerListing &peerListing)
 	{
 		char tmp[256];
 		unsigned int scode = 404;
@@ -1137,6 +1291,10 @@ public:
 					res["address"] = tmp;
 					res["publicIdentity"] = status.publicIdentity;
 					res["online"] = (bool)(status.online != 0);
+					res["rxQueueFragmentDrops"] = status.rxQueueFragmentDrops;
+					res["rxQueueWaitingDrops"] = status.rxQueueWaitingDrops;
+					res["signatureCacheHits"] = status.signatureCacheHits;
+					res["signatureCacheMisses"] = status.signatureCacheMisses;
 					res["tcpFallbackActive"] = (_tcpFallbackTunnel != (TcpConnection *)0);
 					res["versionMajor"] = ZEROTIER_ONE_VERSION_MAJOR;
 					res["versionMinor"] = ZEROTIER_ONE_VERSION_MINOR;
@@ -1227,34 +1385,41 @@ public:
 						_node->freeQueryResult((void *)nws);
 					} else scode = 500;
 				} else if (ps[0] == "peer") {
-					ZT_PeerList *pl = _node->peers();
-					if (pl) {
-						if (ps.size() == 1) {
-							// Return [array] of all peers
-
-							res = nlohmann::json::array();
-							for(unsigned long i=0;i<pl->peerCount;++i) {
-								nlohmann::json pj;
-								_peerToJson(pj,&(pl->peers[i]));
-								res.push_back(pj);
-							}
-
+					if (ps.size() == 1) {
+						// Return [array] of peers in address order. after=<address> skips peers up to
+						// and including that one and limit=<count> returns at most that many. Only the
+						// first page is serialized here, the rest as the connection drains.
+						peerListing.after = 0;
+						peerListing.remaining = 0xffffffffUL;
+						peerListing.count = 0;
+						std::map<std::string,std::string>::const_iterator ua(urlArgs.find("after"));
+						if (ua != urlArgs.end())
+							peerListing.after = Utils::hexStrToU64(ua->second.c_str());
+						ua = urlArgs.find("limit");
+						if (ua != urlArgs.end())
+							peerListing.remaining = Utils::strToULong(ua->second.c_str());
+
+						responseBody.push_back('[');
+						if (peersToJson(_node,peerListing.after,peerListing.remaining,peerListing.count,ZT_PEER_LISTING_PAGE_SIZE,responseBody)) {
+							if (!peerListing.remaining)
+								responseBody.push_back(']');
+							responseContentType = "application/json";
 							scode = 200;
-						} else if (ps.size() == 2) {
-							// Return a single peer by ID or 404 if not found
-
-							uint64_t wantp = Utils::hexStrToU64(ps[1].c_str());
-							for(unsigned long i=0;i<pl->peerCount;++i) {
-								if (pl->peers[i].address == wantp) {
-									_peerToJson(res,&(pl->peers[i]));
-									scode = 200;
-									break;
-								}
-							}
+						} else {
+							peerListing.remaining = 0;
+							responseBody.clear();
+							scode = 500;
+						}
+					} else if (ps.size() == 2) {
+						// Return a single peer by ID or 404 if not found
 
+						ZT_Peer *const p = _node->peer(Utils::hexStrToU64(ps[1].c_str()),ZT_PEER_FIELD_ALL);
+						if (p) {
+							_peerToJson(res,p);
+							_node->freeQueryResult((void *)p);
+							scode = 200;
 						} else scode = 404;
-						_node->freeQueryResult((void *)pl);
-					} else scode = 500;
+					} else scode = 404;
 				} else {
 					if (_controller) {
 						scode = _controller->handleControlPlaneHttpGET(std::vector<std::string>(ps.begin()+1,ps.end()),urlArgs,headers,body,responseBody,responseContentType);
@@ -1482,6 +1647,22 @@ public:
 		_primaryPort = (unsigned int)OSUtils::jsonInt(settings["primaryPort"],(uint64_t)_primaryPort) & 0xffff;
 		_allowTcpFallbackRelay = OSUtils::jsonBool(settings["allowTcpFallbackRelay"],true);
 		_portMappingEnabled = OSUtils::jsonBool(settings["portMappingEnabled"],true);
+		_tapQueues = (unsigned int)OSUtils::jsonInt(settings["tapQueues"],1ULL);
+		if (!_tapQueues)
+			_tapQueues = std::max(1U,std::thread::hardware_concurrency());
+		_ioThreads = (unsigned int)OSUtils::jsonInt(settings["ioThreads"],1ULL);
+		if (!_ioThreads)
+			_ioThreads = std::max(1U,std::thread::hardware_concurrency());
+		_ioThreads = std::min(_ioThreads,(unsigned int)ZT_MAX_IO_THREADS);
+		const unsigned int rxQueueSize = (unsigned int)OSUtils::jsonInt(settings["rxQueueSize"],0ULL);
+		if (rxQueueSize)
+			_node->setReceiveQueueSize(rxQueueSize);
+		const std::string mpm(OSUtils::jsonString(settings["multipathMode"],"none"));
+		if (mpm == "flow")
+			_node->setMultipathMode(ZT_MULTIPATH_FLOW_HASH);
+		else if (mpm == "balance")
+			_node->setMultipathMode(ZT_MULTIPATH_BALANCE);
+		else _node->setMultipathMode(ZT_MULTIPATH_NONE);
 
 #ifndef ZT_SDK
 		const std::string up(OSUtils::jsonString(settings["softwareUpdate"],ZT_SOFTWARE_UPDATE_DEFAULT));
@@ -1674,6 +1855,7 @@ public:
 	{
 		if ((len >= 16)&&(reinterpret_cast<const InetAddress *>(from)->ipScope() == InetAddress::IP_SCOPE_GLOBAL))
 			_lastDirectReceiveFromGlobal = OSUtils::now();
+		volatile int64_t dl = _nextBackgroundTaskDeadline;
 		const ZT_ResultCode rc = _node->processWirePacket(
 			(void *)0,
 			OSUtils::now(),
@@ -1681,7 +1863,8 @@ public:
 			reinterpret_cast<const struct sockaddr_storage *>(from), // Phy<> uses sockaddr_storage, so it'll always be that big
 			data,
 			len,
-			&_nextBackgroundTaskDeadline);
+			&dl);
+		_lowerBackgroundTaskDeadline(dl);
 		if (ZT_ResultCode_isFatal(rc)) {
 			char tmp[256];
 			OSUtils::ztsnprintf(tmp,sizeof(tmp),"fatal error code from processWirePacket: %d",(int)rc);
@@ -1856,6 +2039,7 @@ public:
 
 								if (from) {
 									InetAddress fakeTcpLocalInterfaceAddress((uint32_t)0xffffffff,0xffff);
+									volatile int64_t dl = _nextBackgroundTaskDeadline;
 									const ZT_ResultCode rc = _node->processWirePacket(
 										(void *)0,
 										OSUtils::now(),
@@ -1863,7 +2047,8 @@ public:
 										reinterpret_cast<struct sockaddr_storage *>(&from),
 										data,
 										plen,
-										&_nextBackgroundTaskDeadline);
+										&dl);
+									_lowerBackgroundTaskDeadline(dl);
 									if (ZT_ResultCode_isFatal(rc)) {
 										char tmp[256];
 										OSUtils::ztsnprintf(tmp,sizeof(tmp),"fatal error code from processWirePacket: %d",(int)rc);
@@ -1901,10 +2086,19 @@ public:
 				if (sent > 0) {
 					if ((unsigned long)sent >= (unsigned long)tc->writeq.length()) {
 						tc->writeq.clear();
-						_phy.setNotifyWritable(sock,false);
-
-						if (tc->type == TcpConnection::TCP_HTTP_INCOMING)
-							closeit = true; // HTTP keep alive not supported
+						if ((tc->type == TcpConnection::TCP_HTTP_INCOMING)&&(tc->peerListing.remaining)) {
+							// Next page of GET /peer; if the node can't provide it the list ends early
+							if (!peersToJson(_node,tc->peerListing.after,tc->peerListing.remaining,tc->peerListing.count,ZT_PEER_LISTING_PAGE_SIZE,tc->writeq))
+								tc->peerListing.remaining = 0;
+							if (!tc->peerListing.remaining)
+								tc->writeq.push_back(']');
+							_phy.setNotifyWritable(sock,true); // re-arm, since the socket is still writable
+						} else {
+							_phy.setNotifyWritable(sock,false);
+
+							if (tc->type == TcpConnection::TCP_HTTP_INCOMING)
+								closeit = true; // HTTP keep alive not supported
+						}
 					} else {
 						tc->writeq.erase(tc->writeq.begin(),tc->writeq.begin() + sent);
 					}
@@ -1944,7 +2138,11 @@ public:
 							nwid,
 							friendlyName,
 							StapFrameHandler,
-							(void *)this);
+							(void *)this
+#if defined(__LINUX__) && !defined(ZT_USE_TEST_TAP) && !defined(ZT_SDK)
+							,_tapQueues
+#endif
+							);
 						*nuptr = (void *)&n;
 
 						char nlcpath[256];
@@ -2110,9 +2308,12 @@ public:
 				secure = true;
 				break;
 			case ZT_STATE_OBJECT_PEER:
-				OSUtils::ztsnprintf(dirname,sizeof(dirname),"%s" ZT_PATH_SEPARATOR_S "peers.d",_homePath.c_str());
-				OSUtils::ztsnprintf(p,sizeof(p),"%s" ZT_PATH_SEPARATOR_S "%.10llx.peer",dirname,(unsigned long long)id[0]);
-				break;
+				if (_peerStore) {
+					if (len > 0)
+						_peerStore->put(id[0],data,(unsigned int)len,OSUtils::now());
+					else _peerStore->erase(id[0]);
+				}
+				return;
 			default:
 				return;
 		}
@@ -2169,8 +2370,7 @@ public:
 				OSUtils::ztsnprintf(p,sizeof(p),"%s" ZT_PATH_SEPARATOR_S "networks.d" ZT_PATH_SEPARATOR_S "%.16llx.conf",_homePath.c_str(),(unsigned long long)id[0]);
 				break;
 			case ZT_STATE_OBJECT_PEER:
-				OSUtils::ztsnprintf(p,sizeof(p),"%s" ZT_PATH_SEPARATOR_S "peers.d" ZT_PATH_SEPARATOR_S "%.10llx.peer",_homePath.c_str(),(unsigned long long)id[0]);
-				break;
+				return (_peerStore) ? _peerStore->get(id[0],data,maxlen) : -1;
 			default:
 				return -1;
 		}
@@ -2248,14 +2448,28 @@ public:
 		// working we can instantly "fail forward" to it and stop using TCP
 		// proxy fallback, which is slow.
 
-		if ((localSocket != -1)&&(localSocket != 0)&&(_binder.isUdpSocketValid((PhySocket *)((uintptr_t)localSocket)))) {
-			if ((ttl)&&(addr->ss_family == AF_INET)) _phy.setIp4UdpTtl((PhySocket *)((uintptr_t)localSocket),ttl);
-			const bool r = _phy.udpSend((PhySocket *)((uintptr_t)localSocket),(const struct sockaddr *)addr,data,len);
-			if ((ttl)&&(addr->ss_family == AF_INET)) _phy.setIp4UdpTtl((PhySocket *)((uintptr_t)localSocket),255);
+		if ((localSocket != -1)&&(localSocket != 0)) {
+			PhySocket *const sock = (PhySocket *)((uintptr_t)localSocket);
+			if (_binder.isUdpSocketValid(sock))
+				return _udpSendFrom(_phy,sock,addr,data,len,ttl);
+			for(std::vector< OneServiceIoWorker * >::const_iterator w(_ioWorkers.begin());w!=_ioWorkers.end();++w) {
+				if ((*w)->binder.isUdpSocketValid(sock))
+					return _udpSendFrom((*w)->phy,sock,addr,data,len,ttl);
+			}
+		}
+		return ((_binder.udpSendAll(_phy,addr,data,len,ttl)) ? 0 : -1);
+	}
+
+	template<typename PHY_HANDLER_TYPE>
+	inline int _udpSendFrom(Phy<PHY_HANDLER_TYPE> &phy,PhySocket *sock,const struct sockaddr_storage *addr,const void *data,unsigned int len,unsigned int ttl)
+	{
+		if ((ttl)&&(addr->ss_family == AF_INET)) {
+			phy.setIp4UdpTtl(sock,ttl);
+			const bool r = phy.udpSend(sock,(const struct sockaddr *)addr,data,len);
+			phy.setIp4UdpTtl(sock,255);
 			return ((r) ? 0 : -1);
-		} else {
-			return ((_binder.udpSendAll(_phy,addr,data,len,ttl)) ? 0 : -1);
 		}
+		return ((phy.udpSendBatched(sock,(const struct sockaddr *)addr,data,len)) ? 0 : -1);
 	}
 
 	inline void nodeVirtualNetworkFrameFunction(uint64_t nwid,void **nuptr,uint64_t sourceMac,uint64_t destMac,unsigned int etherType,unsigned int vlanId,const void *data,unsigned int len)
@@ -2337,7 +2551,17 @@ public:
 
 	inline void tapFrameHandler(uint64_t nwid,const MAC &from,const MAC &to,unsigned int etherType,unsigned int vlanId,const void *data,unsigned int len)
 	{
-		_node->processVirtualNetworkFrame((void *)0,OSUtils::now(),nwid,from.toInt(),to.toInt(),etherType,vlanId,data,len,&_nextBackgroundTaskDeadline);
+		volatile int64_t dl = _nextBackgroundTaskDeadline;
+		_node->processVirtualNetworkFrame((void *)0,OSUtils::now(),nwid,from.toInt(),to.toInt(),etherType,vlanId,data,len,&dl);
+		_lowerBackgroundTaskDeadline(dl);
+	}
+
+	// Packet and frame handlers run on several threads, so each gives the core
+	// its own copy of the deadline and only an earlier result is kept.
+	inline void _lowerBackgroundTaskDeadline(const int64_t dl)
+	{
+		int64_t cur = _nextBackgroundTaskDeadline;
+		while ((dl < cur)&&(!_nextBackgroundTaskDeadline.compare_exchange_weak(cur,dl))) {}
 	}
 
 	inline void onHttpRequestToServer(TcpConnection *tc)
@@ -2350,8 +2574,9 @@ public:
 		// Note that we check allowed IP ranges when HTTP connections are first detected in
 		// phyOnTcpData(). If we made it here the source IP is okay.
 
+		tc->peerListing.remaining = 0;
 		try {
-			scode = handleControlPlaneHttpRequest(tc->remoteAddr,tc->parser.method,tc->url,tc->headers,tc->readq,data,contentType);
+			scode = handleControlPlaneHttpRequest(tc->remoteAddr,tc->parser.method,tc->url,tc->headers,tc->readq,data,contentType,tc->peerListing);
 		} catch (std::exception &exc) {
 			fprintf(stderr,"WARNING: unexpected exception processing control HTTP request: %s" ZT_EOL_S,exc.what());
 			scode = 500;
@@ -2373,11 +2598,22 @@ public:
 			default: scodestr = "Error"; break;
 		}
 
-		OSUtils::ztsnprintf(tmpn,sizeof(tmpn),"HTTP/1.1 %.3u %s\r\nCache-Control: no-cache\r\nPragma: no-cache\r\nContent-Type: %s\r\nContent-Length: %lu\r\nConnection: close\r\n\r\n",
-			scode,
-			scodestr,
-			contentType.c_str(),
-			(unsigned long)data.length());
+		if ((scode != 200)||(tc->parser.method == HTTP_HEAD))
+			tc->peerListing.remaining = 0;
+
+		// A peer list still being serialized has no length yet, so its end is marked by closing the connection
+		if (tc->peerListing.remaining) {
+			OSUtils::ztsnprintf(tmpn,sizeof(tmpn),"HTTP/1.1 %.3u %s\r\nCache-Control: no-cache\r\nPragma: no-cache\r\nContent-Type: %s\r\nConnection: close\r\n\r\n",
+				scode,
+				scodestr,
+				contentType.c_str());
+		} else {
+			OSUtils::ztsnprintf(tmpn,sizeof(tmpn),"HTTP/1.1 %.3u %s\r\nCache-Control: no-cache\r\nPragma: no-cache\r\nContent-Type: %s\r\nContent-Length: %lu\r\nConnection: close\r\n\r\n",
+				scode,
+				scodestr,
+				contentType.c_str(),
+				(unsigned long)data.length());
+		}
 		{
 			Mutex::Lock _l(tc->writeq_m);
 			tc->writeq = tmpn;
@@ -2485,6 +2721,34 @@ public:
 	}
 };
 
+inline void OneServiceIoWorker::phyOnDatagram(PhySocket *sock,void **uptr,const struct sockaddr *localAddr,const struct sockaddr *from,void *data,unsigned long len)
+{ parent->phyOnDatagram(sock,uptr,localAddr,from,data,len); }
+
+void OneServiceIoWorker::threadMain()
+	throw()
+{
+	unsigned int p[3];
+	unsigned int pc;
+	std::vector<InetAddress> eb;
+	try {
+		while (run) {
+			if (refreshNeeded) {
+				{
+					Mutex::Lock _l(refresh_m);
+					for(unsigned int i=0;i<portCount;++i)
+						p[i] = ports[i];
+					pc = portCount;
+					eb = explicitBind;
+					refreshNeeded = false;
+				}
+				binder.refresh(phy,p,pc,eb,*parent);
+			}
+			phy.poll(ZT_BINDER_REFRESH_PERIOD);
+		}
+	} catch ( ... ) {}
+	binder.closeAll(phy);
+}
+
 static int SnodeVirtualNetworkConfigFunction(ZT_Node *node,void *uptr,void *tptr,uint64_t nwid,void **nuptr,enum ZT_VirtualNetworkConfigOperation op,const ZT_VirtualNetworkConfig *nwconf)
 { return reinterpret_cast<OneServiceImpl *>(uptr)->nodeVirtualNetworkConfigFunction(nwid,nuptr,op,nwconf); }
 static void SnodeEventCallback(ZT_Node *node,void *uptr,void *tptr,enum ZT_Event event,const void *metaData)
@@ -2589,6 +2853,29 @@ std::string OneService::platformDefaultHomePath()
 	return OSUtils::platformDefaultHomePath();
 }
 
+bool OneService::peersToJson(Node *node,uint64_t &after,unsigned long &remaining,unsigned long &count,const unsigned int pageSize,std::string &json)
+{
+	if (!remaining)
+		return true;
+	const unsigned int want = (unsigned int)std::min(remaining,(unsigned long)pageSize);
+	ZT_PeerList *const pl = node->peersAfter(after,want,ZT_PEER_FIELD_ALL);
+	if (!pl)
+		return false;
+
+	for(unsigned long i=0;i<pl->peerCount;++i) {
+		nlohmann::json pj;
+		_peerToJson(pj,&(pl->peers[i]));
+		if (count++)
+			json.push_back(',');
+		json.append(OSUtils::jsonDump(pj));
+		after = pl->peers[i].address;
+	}
+	remaining = (pl->peerCount < want) ? 0 : (remaining - pl->peerCount);
+	node->freeQueryResult((void *)pl);
+
+	return true;
+}
+
 OneService *OneService::newInstance(const char *hp,unsigned int port) { return new OneServiceImpl(hp,port); }
 OneService::~OneService() {}
 
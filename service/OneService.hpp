@@ -41,6 +41,8 @@ namespace ZeroTier { typedef VirtualTap EthernetTap; }
 
 namespace ZeroTier {
 
+class Node;
+
 /**
  * Local service for ZeroTier One as system VPN/NFV provider
  */
@@ -105,6 +107,22 @@ public:
 	 */
 	static std::string platformDefaultHomePath();
 
+	/**
+	 * Serialize the next page of a node's peers for GET /peer
+	 *
+	 * Peers are appended in address order as comma-separated JSON objects.
+	 * Call until remaining is 0 and wrap the result in [ ] to get the list.
+	 *
+	 * @param node Node to query
+	 * @param after Peers up to and including this address are skipped; set to the last peer appended
+	 * @param remaining Most peers still to append; reduced by those appended, or set to 0 at the end of the list
+	 * @param count Peers appended so far (start at 0)
+	 * @param pageSize Most peers to append in this call
+	 * @param json Peers are appended here
+	 * @return False if the node could not allocate the page
+	 */
+	static bool peersToJson(Node *node,uint64_t &after,unsigned long &remaining,unsigned long &count,const unsigned int pageSize,std::string &json);
+
 	/**
 	 * Create a new instance of the service
 	 *
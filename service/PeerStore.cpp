@@ -0,0 +1,515 @@
+/*
+ * ZeroTier One - Network Virtualization Everywhere
+ * Copyright (C) 2011-2018  ZeroTier, Inc.  https://www.zerotier.com/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * --
+ *
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial closed-source software that incorporates or links
+ * directly against ZeroTier software without disclosing the source code
+ * of your own application.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <vector>
+#include <algorithm>
+#include <chrono>
+
+#include "../node/Constants.hpp"
+#include "../node/SHA512.hpp"
+
+#include "../osdep/OSUtils.hpp"
+
+#include "PeerStore.hpp"
+
+// Files start with this
+#define ZT_PEERSTORE_MAGIC "ZTPEERS1"
+#define ZT_PEERSTORE_HEADER_LEN 8
+
+// Record: data length[4], timestamp[8], address[8], data, checksum[8] (zero length erases)
+#define ZT_PEERSTORE_RECORD_OVERHEAD 28
+
+namespace ZeroTier {
+
+static inline uint64_t _getU64(const uint8_t *p)
+{
+	uint64_t i = 0;
+	for(unsigned int k=0;k<8;++k)
+		i = (i << 8) | (uint64_t)p[k];
+	return i;
+}
+
+static inline void _appendU64(std::string &buf,const uint64_t i)
+{
+	for(int k=56;k>=0;k-=8)
+		buf.push_back((char)((i >> k) & 0xff));
+}
+
+// The checksum covers the address and data but not the timestamp, so it also tells put() if a peer changed
+static uint64_t _checksum(const uint64_t address,const void *data,const unsigned int len)
+{
+	std::string tmp;
+	tmp.reserve(8 + len);
+	_appendU64(tmp,address);
+	tmp.append((const char *)data,len);
+	uint8_t h[ZT_SHA512_DIGEST_LEN];
+	SHA512::hash(h,tmp.data(),(unsigned int)tmp.length());
+	return _getU64(h);
+}
+
+static void _appendRecord(std::string &buf,const uint64_t address,const int64_t timestamp,const void *data,const unsigned int len,const uint64_t check)
+{
+	buf.push_back((char)((len >> 24) & 0xff));
+	buf.push_back((char)((len >> 16) & 0xff));
+	buf.push_back((char)((len >> 8) & 0xff));
+	buf.push_back((char)(len & 0xff));
+	_appendU64(buf,(uint64_t)timestamp);
+	_appendU64(buf,address);
+	buf.append((const char *)data,len);
+	_appendU64(buf,check);
+}
+
+// True if a whole record with a good checksum starts at p; dlen and check are set from it
+static inline bool _recordAt(const uint8_t *const data,const uint64_t len,const uint64_t p,unsigned int &dlen,uint64_t &check)
+{
+	if ((p + ZT_PEERSTORE_RECORD_OVERHEAD) > len)
+		return false;
+	dlen = ((unsigned int)data[p] << 24) | ((unsigned int)data[p + 1] << 16) | ((unsigned int)data[p + 2] << 8) | (unsigned int)data[p + 3];
+	if ((p + ZT_PEERSTORE_RECORD_OVERHEAD + (uint64_t)dlen) > len)
+		return false;
+	uint8_t h[ZT_SHA512_DIGEST_LEN];
+	SHA512::hash(h,data + p + 12,8 + dlen);
+	check = _getU64(h);
+	return (check == _getU64(data + p + 20 + dlen));
+}
+
+static inline bool _writeAll(FILE *f,const std::string &buf)
+{
+	return ((buf.length() == 0)||(fwrite(buf.data(),1,buf.length(),f) == buf.length()));
+}
+
+PeerStore::PeerStore(const char *path) :
+	_path(path),
+	_rf((FILE *)0),
+	_wf((FILE *)0),
+	_fileBytes(0),
+	_liveBytes(0),
+	_oldestPending(0),
+	_writeFailed(false),
+	_run(true)
+{
+	{
+		std::lock_guard<std::mutex> wl(_writeLock);
+		_load();
+	}
+	_writer = std::thread([this]() { _writerMain(); });
+}
+
+PeerStore::~PeerStore()
+{
+	{
+		std::lock_guard<std::mutex> l(_l);
+		_run = false;
+	}
+	_wake.notify_all();
+	if (_writer.joinable())
+		_writer.join();
+	std::lock_guard<std::mutex> wl(_writeLock);
+	_flush();
+	_close();
+}
+
+void PeerStore::put(const uint64_t address,const void *data,const unsigned int len,const int64_t timestamp)
+{
+	if (!len)
+		return;
+	const uint64_t check = _checksum(address,data,len);
+	std::lock_guard<std::mutex> l(_l);
+
+	// A pending entry may be being written right now, so it is replaced rather than dropped
+	auto p = _pending.find(address);
+	if (p != _pending.end()) {
+		if ((p->second.check == check)&&(p->second.data.length() == len))
+			return;
+	} else {
+		auto e = _index.find(address);
+		if ((e != _index.end())&&(e->second.check == check)&&(e->second.len == len))
+			return;
+	}
+
+	if (_pending.empty())
+		_oldestPending = OSUtils::now();
+	_Pending &np = _pending[address];
+	np.data.assign((const char *)data,len);
+	np.check = check;
+	np.timestamp = timestamp;
+	if (_pending.size() >= ZT_PEERSTORE_WRITE_BATCH_MAX)
+		_wake.notify_one();
+}
+
+void PeerStore::erase(const uint64_t address)
+{
+	std::lock_guard<std::mutex> l(_l);
+	if ((_index.find(address) == _index.end())&&(_pending.find(address) == _pending.end()))
+		return;
+	if (_pending.empty())
+		_oldestPending = OSUtils::now();
+	_Pending &np = _pending[address];
+	np.data.clear();
+	np.check = 0;
+	np.timestamp = OSUtils::now();
+}
+
+int PeerStore::get(const uint64_t address,void *data,const unsigned int maxlen)
+{
+	std::lock_guard<std::mutex> l(_l);
+	auto p = _pending.find(address);
+	if (p != _pending.end()) {
+		if ((p->second.data.empty())||(p->second.data.length() > maxlen))
+			return -1;
+		memcpy(data,p->second.data.data(),p->second.data.length());
+		return (int)p->second.data.length();
+	}
+	auto e = _index.find(address);
+	if ((e == _index.end())||(e->second.len > maxlen)||(!_rf))
+		return -1;
+	if ((fseek(_rf,(long)e->second.offset,SEEK_SET) != 0)||(fread(data,1,e->second.len,_rf) != e->second.len))
+		return -1;
+	return (int)e->second.len;
+}
+
+unsigned long PeerStore::expire(const int64_t olderThan)
+{
+	std::lock_guard<std::mutex> l(_l);
+	const int64_t now = OSUtils::now();
+	unsigned long n = 0;
+	for(auto e=_index.begin();e!=_index.end();++e) {
+		if (e->second.timestamp < olderThan) {
+			auto p = _pending.find(e->first);
+			if (p != _pending.end()) // already being replaced or erased
+				continue;
+			if (_pending.empty())
+				_oldestPending = now;
+			_Pending &np = _pending[e->first];
+			np.check = 0;
+			np.timestamp = now;
+			++n;
+		}
+	}
+	return n;
+}
+
+bool PeerStore::flush()
+{
+	std::lock_guard<std::mutex> wl(_writeLock);
+	return _flush();
+}
+
+unsigned long PeerStore::size()
+{
+	std::lock_guard<std::mutex> l(_l);
+	unsigned long n = (unsigned long)_index.size();
+	for(auto p=_pending.begin();p!=_pending.end();++p) {
+		const bool stored = (_index.find(p->first) != _index.end());
+		if ((p->second.data.empty())&&(stored))
+			--n;
+		else if ((!p->second.data.empty())&&(!stored))
+			++n;
+	}
+	return n;
+}
+
+// Caller must hold _writeLock; _l is not needed since no other thread is running yet
+void PeerStore::_load()
+{
+	std::string buf;
+	uint64_t end = 0; // end of the last good record
+	uint64_t damaged = 0;
+	if ((OSUtils::readFile(_path.c_str(),buf))&&(buf.length() >= ZT_PEERSTORE_HEADER_LEN)&&(memcmp(buf.data(),ZT_PEERSTORE_MAGIC,ZT_PEERSTORE_HEADER_LEN) == 0)) {
+		const uint8_t *const data = (const uint8_t *)buf.data();
+		const uint64_t len = (uint64_t)buf.length();
+		uint64_t p = ZT_PEERSTORE_HEADER_LEN;
+		end = p;
+		while (p < len) {
+			unsigned int dlen = 0;
+			uint64_t check = 0;
+			if (!_recordAt(data,len,p,dlen,check)) {
+				// Resume at the next intact record: right after this one if only its
+				// contents are bad, otherwise wherever one is found
+				uint64_t next = p + ZT_PEERSTORE_RECORD_OVERHEAD + (uint64_t)dlen;
+				unsigned int ndlen = 0;
+				uint64_t ncheck;
+				if ((next >= len)||(!_recordAt(data,len,next,ndlen,ncheck))) {
+					next = p + 1;
+					while ((next < len)&&(!_recordAt(data,len,next,ndlen,ncheck)))
+						++next;
+				}
+				damaged += next - p;
+				p = next;
+				continue;
+			}
+
+			const uint64_t address = _getU64(data + p + 12);
+			if (dlen) {
+				_Entry &e = _index[address];
+				e.offset = p + 20;
+				e.check = check;
+				e.timestamp = (int64_t)_getU64(data + p + 4);
+				e.len = dlen;
+			} else {
+				_index.erase(address);
+			}
+
+			p += ZT_PEERSTORE_RECORD_OVERHEAD + dlen;
+			end = p;
+		}
+	}
+
+	if (end) {
+		_fileBytes = end;
+		_liveBytes = ZT_PEERSTORE_HEADER_LEN;
+		for(auto e=_index.begin();e!=_index.end();++e)
+			_liveBytes += ZT_PEERSTORE_RECORD_OVERHEAD + e->second.len;
+		if (_open()) {
+			// Rewrite the file without damaged records or a torn tail. If that fails,
+			// appends still go after the last good record and a later load skips
+			// whatever damage is left before it.
+			if (damaged) {
+				fprintf(stderr,"WARNING: peer cache %s has %llu bytes of damaged or incomplete records, skipped" ZT_EOL_S,_path.c_str(),(unsigned long long)damaged);
+				_compact();
+			}
+		}
+	} else {
+		_index.clear();
+		FILE *nf = fopen(_path.c_str(),"wb");
+		if (nf) {
+			const bool ok = ((fwrite(ZT_PEERSTORE_MAGIC,1,ZT_PEERSTORE_HEADER_LEN,nf) == ZT_PEERSTORE_HEADER_LEN)&&(fflush(nf) == 0));
+			fclose(nf);
+			if (ok)
+				_open();
+		}
+		_fileBytes = ZT_PEERSTORE_HEADER_LEN;
+		_liveBytes = ZT_PEERSTORE_HEADER_LEN;
+	}
+	if (!_wf)
+		fprintf(stderr,"WARNING: unable to write to file: %s (unable to open)" ZT_EOL_S,_path.c_str());
+}
+
+// Caller must hold _writeLock and _l, or be the only thread
+bool PeerStore::_open()
+{
+	_rf = fopen(_path.c_str(),"rb");
+	_wf = fopen(_path.c_str(),"r+b");
+	if ((!_rf)||(!_wf)) {
+		_close();
+		return false;
+	}
+	// Unbuffered, so get() never sees stale bytes of a region since appended to through _wf
+	setvbuf(_rf,(char *)0,_IONBF,0);
+	return true;
+}
+
+// Caller must hold _writeLock and _l, or be the only thread
+void PeerStore::_close()
+{
+	if (_rf)
+		fclose(_rf);
+	if (_wf)
+		fclose(_wf);
+	_rf = (FILE *)0;
+	_wf = (FILE *)0;
+}
+
+// Caller must hold _writeLock but not _l
+bool PeerStore::_flush()
+{
+	// Pending entries stay visible to get() until they are in the index
+	std::string buf;
+	std::vector<_Written> batch;
+	{
+		std::lock_guard<std::mutex> l(_l);
+		if (_pending.empty())
+			return true;
+		batch.reserve(_pending.size());
+		for(auto p=_pending.begin();p!=_pending.end();++p) {
+			_Written w;
+			w.address = p->first;
+			w.check = p->second.check;
+			w.timestamp = p->second.timestamp;
+			w.len = (unsigned int)p->second.data.length();
+			batch.push_back(w);
+			if (p->second.data.empty()) {
+				const uint64_t check = _checksum(p->first,(const void *)0,0);
+				_appendRecord(buf,p->first,p->second.timestamp,(const void *)0,0,check);
+			} else {
+				_appendRecord(buf,p->first,p->second.timestamp,p->second.data.data(),w.len,w.check);
+			}
+		}
+	}
+
+	// Writes go at the end of the last good record, so a failed batch is overwritten by the
+	// next. Nothing there is in the index, so get() can keep reading while this runs.
+	const bool ok = ((_wf)&&(fseek(_wf,(long)_fileBytes,SEEK_SET) == 0)&&(_writeAll(_wf,buf))&&(fflush(_wf) == 0));
+	if ((!ok)&&(!_writeFailed))
+		fprintf(stderr,"WARNING: unable to write to file: %s (I/O error), will retry" ZT_EOL_S,_path.c_str());
+
+	{
+		std::lock_guard<std::mutex> l(_l);
+		_writeFailed = !ok;
+		if (!ok) {
+			// Everything stays pending, and get() keeps serving it, until a write succeeds
+			_oldestPending = OSUtils::now();
+			return false;
+		}
+		uint64_t offset = _fileBytes;
+		for(auto w=batch.begin();w!=batch.end();++w) {
+			auto e = _index.find(w->address);
+			if (e != _index.end())
+				_liveBytes -= ZT_PEERSTORE_RECORD_OVERHEAD + e->second.len;
+			if (w->len) {
+				_Entry &ne = _index[w->address];
+				ne.offset = offset + 20;
+				ne.check = w->check;
+				ne.timestamp = w->timestamp;
+				ne.len = w->len;
+				_liveBytes += ZT_PEERSTORE_RECORD_OVERHEAD + w->len;
+			} else if (e != _index.end()) {
+				_index.erase(e);
+			}
+			offset += ZT_PEERSTORE_RECORD_OVERHEAD + w->len;
+
+			// Entries changed while the batch was written stay pending for the next one
+			auto p = _pending.find(w->address);
+			if ((p != _pending.end())&&(p->second.check == w->check)&&(p->second.data.length() == w->len))
+				_pending.erase(p);
+		}
+		_fileBytes = offset;
+		if (!_pending.empty())
+			_oldestPending = OSUtils::now();
+	}
+
+	if ((_fileBytes >= ZT_PEERSTORE_COMPACT_MIN_BYTES)&&(_fileBytes > (_liveBytes * 2)))
+		_compact();
+	return true;
+}
+
+// Caller must hold _writeLock but not _l
+bool PeerStore::_compact()
+{
+	// Only holders of _writeLock change the index, so this copy stays current until the swap below
+	std::vector<_Written> order;
+	{
+		std::lock_guard<std::mutex> l(_l);
+		order.reserve(_index.size());
+		for(auto e=_index.begin();e!=_index.end();++e) {
+			_Written w;
+			w.address = e->first;
+			w.check = e->second.check;
+			w.timestamp = e->second.timestamp;
+			w.len = e->second.len;
+			w.offset = e->second.offset;
+			order.push_back(w);
+		}
+	}
+	// Copy records in file order so the old file is read sequentially
+	std::sort(order.begin(),order.end(),[](const _Written &a,const _Written &b) { return (a.offset < b.offset); });
+
+	const std::string tmpPath(_path + ".new");
+	FILE *of = fopen(_path.c_str(),"rb");
+	if (!of)
+		return false;
+	FILE *nf = fopen(tmpPath.c_str(),"wb");
+	if (!nf) {
+		fclose(of);
+		return false;
+	}
+
+	bool ok = true;
+	std::string buf(ZT_PEERSTORE_MAGIC,ZT_PEERSTORE_HEADER_LEN);
+	std::vector<char> data;
+	std::vector<uint64_t> offsets;
+	offsets.reserve(order.size());
+	uint64_t bytes = 0;
+	for(auto o=order.begin();o!=order.end();++o) {
+		data.resize(o->len);
+		if ((fseek(of,(long)o->offset,SEEK_SET) != 0)||(fread(data.data(),1,o->len,of) != o->len)) {
+			ok = false;
+			break;
+		}
+		offsets.push_back(bytes + (uint64_t)buf.length() + 20);
+		_appendRecord(buf,o->address,o->timestamp,data.data(),o->len,o->check);
+		if (buf.length() >= 1048576) {
+			ok &= _writeAll(nf,buf);
+			bytes += buf.length();
+			buf.clear();
+		}
+	}
+	ok &= _writeAll(nf,buf);
+	bytes += buf.length();
+	ok &= (fflush(nf) == 0);
+	fclose(nf);
+	fclose(of);
+
+	if (!ok) {
+		OSUtils::rm(tmpPath.c_str());
+		return false;
+	}
+
+	std::lock_guard<std::mutex> l(_l);
+	// Some platforms will not replace a file that is open
+	_close();
+	if (!OSUtils::rename(tmpPath.c_str(),_path.c_str())) {
+		OSUtils::rm(tmpPath.c_str());
+		_open();
+		return false;
+	}
+	for(std::size_t i=0;i<order.size();++i)
+		_index[order[i].address].offset = offsets[i];
+	_fileBytes = bytes;
+	_liveBytes = bytes;
+	return _open();
+}
+
+void PeerStore::_writerMain()
+{
+	for(;;) {
+		{
+			std::unique_lock<std::mutex> l(_l);
+			if (!_run)
+				return;
+			if (_pending.empty()) {
+				_wake.wait(l);
+				continue;
+			}
+			const int64_t wait = (_oldestPending + (int64_t)ZT_PEERSTORE_WRITE_DELAY) - OSUtils::now();
+			// After a failed write, wait out the delay even if the batch is full
+			if ((wait > 0)&&((_pending.size() < ZT_PEERSTORE_WRITE_BATCH_MAX)||(_writeFailed))) {
+				_wake.wait_for(l,std::chrono::milliseconds(wait));
+				continue;
+			}
+		}
+		std::lock_guard<std::mutex> wl(_writeLock);
+		_flush();
+	}
+}
+
+} // namespace ZeroTier
@@ -0,0 +1,180 @@
+/*
+ * ZeroTier One - Network Virtualization Everywhere
+ * Copyright (C) 2011-2018  ZeroTier, Inc.  https://www.zerotier.com/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * --
+ *
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial closed-source software that incorporates or links
+ * directly against ZeroTier software without disclosing the source code
+ * of your own application.
+ */
+
+
+#ifndef ZT_PEERSTORE_HPP
+#define ZT_PEERSTORE_HPP
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+/**
+ * Maximum time in ms a changed peer is held in memory before it is appended to the file
+ */
+#define ZT_PEERSTORE_WRITE_DELAY 5000
+
+/**
+ * Append pending peers early once this many are waiting
+ */
+#define ZT_PEERSTORE_WRITE_BATCH_MAX 1024
+
+/**
+ * Compact the file once it is at least this big and more than twice the size of its live records
+ */
+#define ZT_PEERSTORE_COMPACT_MIN_BYTES 1048576
+
+namespace ZeroTier {
+
+/**
+ * Peer cache kept in a single append-only file with an in-memory index
+ *
+ * Each put() appends one checksummed record for a peer and the index keeps
+ * the offset of its newest record, so a get() is one seek and read and a
+ * miss touches no file at all. Puts are held in memory and appended in
+ * batches by a background thread. A put of data identical to what is
+ * already stored is dropped without reading anything back. Startup reads
+ * the whole file once to build the index, skipping damaged records and a
+ * torn record at its end. Once superseded records make up most of the file
+ * it is rewritten with only the newest record for each peer.
+ *
+ * Appends and rewrites do their file I/O without holding the lock get()
+ * takes, so lookups are not held up behind them.
+ */
+class PeerStore
+{
+public:
+	/**
+	 * @param path Path to peer cache file (created if missing)
+	 */
+	PeerStore(const char *path);
+	~PeerStore();
+
+	/**
+	 * Store a peer's cached state
+	 *
+	 * @param address Peer address
+	 * @param data Serialized peer state
+	 * @param len Length of data (must be nonzero)
+	 * @param timestamp Time of save, used by expire()
+	 */
+	void put(const uint64_t address,const void *data,const unsigned int len,const int64_t timestamp);
+
+	/**
+	 * Delete a peer's cached state
+	 *
+	 * @param address Peer address
+	 */
+	void erase(const uint64_t address);
+
+	/**
+	 * Get a peer's cached state
+	 *
+	 * @param address Peer address
+	 * @param data Buffer to fill
+	 * @param maxlen Size of buffer
+	 * @return Length of state or -1 if not found or larger than maxlen
+	 */
+	int get(const uint64_t address,void *data,const unsigned int maxlen);
+
+	/**
+	 * Delete all peers last saved before a given time
+	 *
+	 * @param olderThan Cutoff time
+	 * @return Number of peers deleted
+	 */
+	unsigned long expire(const int64_t olderThan);
+
+	/**
+	 * Append all pending changes now
+	 *
+	 * @return True if they are all in the file; on failure they stay pending and are retried later
+	 */
+	bool flush();
+
+	/**
+	 * @return Number of peers stored
+	 */
+	unsigned long size();
+
+private:
+	struct _Entry
+	{
+		uint64_t offset; // offset of data in file
+		uint64_t check; // record checksum, also used to detect unchanged puts
+		int64_t timestamp;
+		unsigned int len;
+	};
+
+	struct _Pending
+	{
+		std::string data; // empty to erase
+		uint64_t check;
+		int64_t timestamp;
+	};
+
+	struct _Written
+	{
+		uint64_t address;
+		uint64_t check;
+		int64_t timestamp;
+		uint64_t offset; // used by _compact() only
+		unsigned int len;
+	};
+
+	void _load();
+	bool _open();
+	void _close();
+	bool _flush();
+	bool _compact();
+	void _writerMain();
+
+	const std::string _path;
+	FILE *_rf; // read by get() under _l
+	FILE *_wf; // appended to under _writeLock
+	uint64_t _fileBytes; // _fileBytes, _liveBytes, and _index change only under both locks
+	uint64_t _liveBytes;
+
+	std::unordered_map< uint64_t,_Entry > _index;
+	std::unordered_map< uint64_t,_Pending > _pending;
+	int64_t _oldestPending;
+	bool _writeFailed; // last append failed, so it was warned about and is retried after ZT_PEERSTORE_WRITE_DELAY
+
+	bool _run;
+	std::mutex _writeLock; // held while writing the file, taken before _l
+	std::mutex _l;
+	std::condition_variable _wake;
+	std::thread _writer;
+};
+
+} // namespace ZeroTier
+
+#endif